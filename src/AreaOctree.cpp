@@ -0,0 +1,308 @@
+#include "AreaOctree.h"
+
+#include <iostream>
+#include <fstream>
+#include <cfloat>
+#include <cstring>
+
+#include <tribox3.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#define AREA_OCTREE_MAGIC 0x4f415753	// "SWAO"
+#define AREA_OCTREE_VERSION 2
+
+AreaOctree::AreaOctree()
+{
+}
+
+AreaOctree::~AreaOctree()
+{
+}
+
+std::string AreaOctree::getCachePath(std::string objFile)
+{
+	return objFile + ".octree";
+}
+
+void AreaOctree::build(const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds)
+{
+	m_vNodes.clear();
+	m_vuiTriIndices.clear();
+	m_vfTriAreas.clear();
+
+	size_t nTris = inds.size() / 3;
+	if (nTris == 0)
+		return;
+
+	std::vector<glm::vec3> centroids(nTris);
+	glm::vec3 bbMin(FLT_MAX), bbMax(-FLT_MAX);
+	for (size_t t = 0; t < nTris; ++t)
+	{
+		centroids[t] = (verts[inds[3 * t + 0]] + verts[inds[3 * t + 1]] + verts[inds[3 * t + 2]]) / 3.f;
+		bbMin = glm::min(bbMin, centroids[t]);
+		bbMax = glm::max(bbMax, centroids[t]);
+	}
+
+	m_vuiTriIndices.resize(nTris);
+	for (size_t t = 0; t < nTris; ++t)
+		m_vuiTriIndices[t] = static_cast<unsigned int>(t);
+
+	Node root;
+	root.firstChild = 0;
+	root.childCount = 0;
+	root.firstTri = 0;
+	root.triCount = static_cast<unsigned int>(nTris);
+	m_vNodes.push_back(root);
+
+	glm::vec3 extent(bbMax - bbMin);
+	buildNode(0, bbMin, std::max(extent.x, std::max(extent.y, extent.z)), 0, centroids, verts, inds);
+
+	m_vfTriAreas.resize(nTris);
+	for (size_t i = 0; i < nTris; ++i)
+	{
+		unsigned int t = m_vuiTriIndices[i];
+		glm::vec3 a(verts[inds[3 * t + 0]]), b(verts[inds[3 * t + 1]]), c(verts[inds[3 * t + 2]]);
+		m_vfTriAreas[i] = glm::length(glm::cross(b - a, c - a)) * 0.5f;
+	}
+}
+
+// Tight bounds and summed area over the node's triangle range
+void AreaOctree::updateNode(Node &node, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds)
+{
+	node.bbMin = glm::vec3(FLT_MAX);
+	node.bbMax = glm::vec3(-FLT_MAX);
+	node.area = 0.0;
+
+	for (unsigned int i = node.firstTri; i < node.firstTri + node.triCount; ++i)
+	{
+		unsigned int t = m_vuiTriIndices[i];
+		glm::vec3 a(verts[inds[3 * t + 0]]), b(verts[inds[3 * t + 1]]), c(verts[inds[3 * t + 2]]);
+
+		node.bbMin = glm::min(node.bbMin, glm::min(a, glm::min(b, c)));
+		node.bbMax = glm::max(node.bbMax, glm::max(a, glm::max(b, c)));
+		node.area += glm::length(glm::cross(b - a, c - a)) * 0.5;
+	}
+}
+
+// Triangles go to the octant holding their centroid; only non-empty octants get a child
+void AreaOctree::buildNode(unsigned int nodeIndex, glm::vec3 cubeMin, float cubeSize, int depth, const std::vector<glm::vec3> &centroids, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds)
+{
+	updateNode(m_vNodes[nodeIndex], verts, inds);
+
+	unsigned int firstTri = m_vNodes[nodeIndex].firstTri;
+	unsigned int triCount = m_vNodes[nodeIndex].triCount;
+
+	if (triCount <= AREA_OCTREE_LEAF_TRIANGLES || depth >= AREA_OCTREE_MAX_DEPTH)
+		return;
+
+	float half = cubeSize * 0.5f;
+	glm::vec3 center(cubeMin + half);
+
+	unsigned int counts[8] = { 0 };
+	std::vector<unsigned char> octants(triCount);
+	for (unsigned int i = 0; i < triCount; ++i)
+	{
+		glm::vec3 c(centroids[m_vuiTriIndices[firstTri + i]]);
+		octants[i] = (c.x >= center.x ? 1 : 0) | (c.y >= center.y ? 2 : 0) | (c.z >= center.z ? 4 : 0);
+		counts[octants[i]]++;
+	}
+
+	unsigned int offsets[8];
+	unsigned int sum = 0;
+	for (int o = 0; o < 8; ++o)
+	{
+		offsets[o] = sum;
+		sum += counts[o];
+	}
+
+	std::vector<unsigned int> sorted(triCount);
+	for (unsigned int i = 0; i < triCount; ++i)
+		sorted[offsets[octants[i]]++] = m_vuiTriIndices[firstTri + i];
+	std::copy(sorted.begin(), sorted.end(), m_vuiTriIndices.begin() + firstTri);
+
+	unsigned int firstChild = static_cast<unsigned int>(m_vNodes.size());
+	unsigned int childCount = 0;
+	unsigned int childFirstTri = firstTri;
+	unsigned int childOctants[8];
+
+	for (int o = 0; o < 8; ++o)
+	{
+		if (counts[o] == 0)
+			continue;
+
+		Node child;
+		child.firstChild = 0;
+		child.childCount = 0;
+		child.firstTri = childFirstTri;
+		child.triCount = counts[o];
+		m_vNodes.push_back(child);
+
+		childOctants[childCount++] = o;
+		childFirstTri += counts[o];
+	}
+
+	m_vNodes[nodeIndex].firstChild = firstChild;
+	m_vNodes[nodeIndex].childCount = childCount;
+
+	for (unsigned int c = 0; c < childCount; ++c)
+	{
+		unsigned int o = childOctants[c];
+		glm::vec3 childMin(cubeMin + glm::vec3(o & 1 ? half : 0.f, o & 2 ? half : 0.f, o & 4 ? half : 0.f));
+		buildNode(firstChild + c, childMin, half, depth + 1, centroids, verts, inds);
+	}
+}
+
+AreaOctree::Result AreaOctree::query(glm::vec3 bbMin, glm::vec3 bbMax, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, float minNodeSize) const
+{
+	Result result;
+	result.area = 0.0;
+	result.errorBound = 0.0;
+	result.nodesVisited = 0;
+	result.trianglesTested = 0;
+
+	if (m_vNodes.empty())
+		return result;
+
+	glm::vec3 boxCenter((bbMin + bbMax) * 0.5f);
+	glm::vec3 boxHalfExtents((bbMax - bbMin) * 0.5f);
+
+	unsigned int stack[8 * AREA_OCTREE_MAX_DEPTH + 8];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node &node = m_vNodes[stack[--stackSize]];
+		result.nodesVisited++;
+
+		if (glm::any(glm::lessThan(node.bbMax, bbMin)) || glm::any(glm::greaterThan(node.bbMin, bbMax)))
+			continue;
+
+		// Every triangle below a node that fits in the box overlaps it
+		if (glm::all(glm::greaterThanEqual(node.bbMin, bbMin)) && glm::all(glm::lessThanEqual(node.bbMax, bbMax)))
+		{
+			result.area += node.area;
+			continue;
+		}
+
+		if (node.childCount == 0)
+		{
+			for (unsigned int i = node.firstTri; i < node.firstTri + node.triCount; ++i)
+			{
+				unsigned int t = m_vuiTriIndices[i];
+				float triVerts[3][3];
+				for (int v = 0; v < 3; ++v)
+					for (int axis = 0; axis < 3; ++axis)
+						triVerts[v][axis] = verts[inds[3 * t + v]][axis];
+
+				if (triBoxOverlap(glm::value_ptr(boxCenter), glm::value_ptr(boxHalfExtents), triVerts))
+					result.area += m_vfTriAreas[i];
+				result.trianglesTested++;
+			}
+			continue;
+		}
+
+		// Approximate mode: estimate small boundary nodes by the fraction of their bounds in the box
+		glm::vec3 nodeExtent(node.bbMax - node.bbMin);
+		if (minNodeSize > 0.f && std::max(nodeExtent.x, std::max(nodeExtent.y, nodeExtent.z)) <= minNodeSize)
+		{
+			glm::vec3 overlap(glm::min(node.bbMax, bbMax) - glm::max(node.bbMin, bbMin));
+			double fraction = 1.0;
+			for (int axis = 0; axis < 3; ++axis)
+				if (nodeExtent[axis] > 0.f)
+					fraction *= glm::clamp(overlap[axis] / nodeExtent[axis], 0.f, 1.f);
+
+			double estimate = node.area * fraction;
+			result.area += estimate;
+			result.errorBound += std::max(estimate, node.area - estimate);
+			continue;
+		}
+
+		for (unsigned int c = 0; c < node.childCount; ++c)
+			stack[stackSize++] = node.firstChild + c;
+	}
+
+	return result;
+}
+
+// FNV-1a over the vertex positions and the index buffer, to tell whether a cache still matches its mesh
+uint64_t AreaOctree::hashMesh(const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (auto const &v : verts)
+	{
+		uint32_t bits[3];
+		memcpy(bits, &v[0], sizeof(bits));
+		for (auto const &b : bits)
+		{
+			hash ^= b;
+			hash *= 1099511628211ull;
+		}
+	}
+
+	for (auto const &i : inds)
+	{
+		hash ^= i;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+bool AreaOctree::save(std::string path, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds) const
+{
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "Could not write octree cache " << path << std::endl;
+		return false;
+	}
+
+	uint32_t header[2] = { AREA_OCTREE_MAGIC, AREA_OCTREE_VERSION };
+	uint64_t sizes[4] = { inds.size(), hashMesh(verts, inds), m_vNodes.size(), m_vuiTriIndices.size() };
+
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+	out.write(reinterpret_cast<const char*>(m_vNodes.data()), m_vNodes.size() * sizeof(Node));
+	out.write(reinterpret_cast<const char*>(m_vuiTriIndices.data()), m_vuiTriIndices.size() * sizeof(unsigned int));
+	out.write(reinterpret_cast<const char*>(m_vfTriAreas.data()), m_vfTriAreas.size() * sizeof(float));
+
+	return out.good();
+}
+
+bool AreaOctree::load(std::string path, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds)
+{
+	std::ifstream in(path, std::ios::binary);
+	if (!in)
+		return false;
+
+	uint32_t header[2];
+	uint64_t sizes[4];
+
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	in.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+
+	if (!in || header[0] != AREA_OCTREE_MAGIC || header[1] != AREA_OCTREE_VERSION)
+		return false;
+
+	// Stale cache: the vertices, the mesh or its triangle order changed since it was written
+	if (sizes[0] != inds.size() || sizes[1] != hashMesh(verts, inds) || sizes[3] != inds.size() / 3)
+		return false;
+
+	std::vector<Node> nodes(static_cast<size_t>(sizes[2]));
+	std::vector<unsigned int> triIndices(static_cast<size_t>(sizes[3]));
+	std::vector<float> triAreas(static_cast<size_t>(sizes[3]));
+
+	in.read(reinterpret_cast<char*>(nodes.data()), nodes.size() * sizeof(Node));
+	in.read(reinterpret_cast<char*>(triIndices.data()), triIndices.size() * sizeof(unsigned int));
+	in.read(reinterpret_cast<char*>(triAreas.data()), triAreas.size() * sizeof(float));
+
+	if (!in)
+		return false;
+
+	m_vNodes.swap(nodes);
+	m_vuiTriIndices.swap(triIndices);
+	m_vfTriAreas.swap(triAreas);
+
+	return true;
+}
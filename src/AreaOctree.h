@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#define AREA_OCTREE_LEAF_TRIANGLES 32
+#define AREA_OCTREE_MAX_DEPTH 20
+
+// Sparse octree over a model's triangles that stores the summed surface area of every node.
+// A box query adds up nodes that lie wholly inside the box and only tests triangles in leaves that
+// straddle its boundary. The octree can be saved beside the mesh so later sessions skip the build.
+// Like the BVH it keeps only a triangle permutation; queries take the model's vertex/index arrays.
+class AreaOctree
+{
+public:
+	struct Node {
+		glm::vec3 bbMin, bbMax;		// tight bounds of the node's triangles
+		double area;				// one-sided area of every triangle below the node
+		unsigned int firstChild;	// children are stored contiguously
+		unsigned int childCount;	// 0 for leaves
+		unsigned int firstTri;
+		unsigned int triCount;
+	};
+
+	struct Result {
+		double area;			// one-sided area of the triangles overlapping the box
+		double errorBound;		// |true area - area| is at most this; 0 for exact queries
+		size_t nodesVisited;
+		size_t trianglesTested;
+	};
+
+public:
+	AreaOctree();
+	~AreaOctree();
+
+	void build(const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds);
+
+	// Boundary nodes no larger than minNodeSize are estimated from their overlap with the box
+	// instead of being opened; 0 gives the exact answer
+	Result query(glm::vec3 bbMin, glm::vec3 bbMax, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, float minNodeSize = 0.f) const;
+
+	// The cache is only accepted for the same vertex and index buffers it was built from
+	bool save(std::string path, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds) const;
+	bool load(std::string path, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds);
+
+	bool empty() const { return m_vNodes.empty(); }
+	size_t getNodeCount() const { return m_vNodes.size(); }
+
+	static std::string getCachePath(std::string objFile);
+
+private:
+	void buildNode(unsigned int nodeIndex, glm::vec3 cubeMin, float cubeSize, int depth, const std::vector<glm::vec3> &centroids, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds);
+	void updateNode(Node &node, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds);
+
+	static uint64_t hashMesh(const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds);
+
+	std::vector<Node> m_vNodes;
+	std::vector<unsigned int> m_vuiTriIndices;	// triangle ids in leaf order
+	std::vector<float> m_vfTriAreas;			// per triangle, in leaf order
+};
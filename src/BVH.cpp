@@ -0,0 +1,438 @@
+#include "BVH.h"
+
+#include <algorithm>
+#include <emmintrin.h>
+
+BVH::BVH()
+{
+}
+
+BVH::~BVH()
+{
+	clear();
+}
+
+void BVH::clear()
+{
+	m_vNodes.clear();
+	m_vuiTriIndices.clear();
+}
+
+void BVH::updateBounds(Node &node, const std::vector<glm::vec3> &triMin, const std::vector<glm::vec3> &triMax)
+{
+	node.bbMin = glm::vec3(FLT_MAX);
+	node.bbMax = glm::vec3(-FLT_MAX);
+
+	for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+	{
+		node.bbMin = glm::min(node.bbMin, triMin[m_vuiTriIndices[i]]);
+		node.bbMax = glm::max(node.bbMax, triMax[m_vuiTriIndices[i]]);
+	}
+}
+
+static float surfaceArea(glm::vec3 bbMin, glm::vec3 bbMax)
+{
+	glm::vec3 e(glm::max(bbMax - bbMin, glm::vec3(0.f)));
+	return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+// Top-down build with binned SAH splits
+void BVH::build(const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds)
+{
+	clear();
+
+	unsigned int nTris = static_cast<unsigned int>(inds.size() / 3);
+	if (nTris == 0)
+		return;
+
+	std::vector<glm::vec3> triMin(nTris), triMax(nTris), centroids(nTris);
+	m_vuiTriIndices.resize(nTris);
+
+	for (unsigned int t = 0; t < nTris; ++t)
+	{
+		glm::vec3 a(verts[inds[3 * t + 0]]), b(verts[inds[3 * t + 1]]), c(verts[inds[3 * t + 2]]);
+		triMin[t] = glm::min(a, glm::min(b, c));
+		triMax[t] = glm::max(a, glm::max(b, c));
+		centroids[t] = (triMin[t] + triMax[t]) * 0.5f;
+		m_vuiTriIndices[t] = t;
+	}
+
+	m_vNodes.reserve(2 * nTris / BVH_LEAF_SIZE + 1);
+
+	Node root;
+	root.leftOrFirst = 0;
+	root.count = nTris;
+	updateBounds(root, triMin, triMax);
+	m_vNodes.push_back(root);
+
+	// Node and its depth
+	std::vector<std::pair<unsigned int, unsigned int>> stack(1, std::make_pair(0u, 0u));
+
+	while (!stack.empty())
+	{
+		unsigned int nodeIdx = stack.back().first;
+		unsigned int depth = stack.back().second;
+		stack.pop_back();
+
+		// Degenerate input, such as many nearly coincident centroids, can split one triangle off at a time
+		Node node = m_vNodes[nodeIdx];
+		if (node.count <= BVH_LEAF_SIZE || depth >= BVH_MAX_DEPTH)
+			continue;
+
+		glm::vec3 cMin(FLT_MAX), cMax(-FLT_MAX);
+		for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			cMin = glm::min(cMin, centroids[m_vuiTriIndices[i]]);
+			cMax = glm::max(cMax, centroids[m_vuiTriIndices[i]]);
+		}
+
+		glm::vec3 extent(cMax - cMin);
+		int axis = 0;
+		if (extent.y > extent[axis]) axis = 1;
+		if (extent.z > extent[axis]) axis = 2;
+
+		// All centroids coincide; no split can separate them
+		if (extent[axis] <= 0.f)
+			continue;
+
+		// Bin the centroids along the widest axis
+		unsigned int binCount[BVH_BINS] = { 0 };
+		glm::vec3 binMin[BVH_BINS], binMax[BVH_BINS];
+		for (int b = 0; b < BVH_BINS; ++b)
+		{
+			binMin[b] = glm::vec3(FLT_MAX);
+			binMax[b] = glm::vec3(-FLT_MAX);
+		}
+
+		float scale = BVH_BINS / extent[axis];
+		for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			unsigned int t = m_vuiTriIndices[i];
+			int b = std::min(BVH_BINS - 1, static_cast<int>((centroids[t][axis] - cMin[axis]) * scale));
+			binCount[b]++;
+			binMin[b] = glm::min(binMin[b], triMin[t]);
+			binMax[b] = glm::max(binMax[b], triMax[t]);
+		}
+
+		// Sweep from both ends to cost every split plane between bins
+		float leftArea[BVH_BINS - 1], rightArea[BVH_BINS - 1];
+		unsigned int leftCount[BVH_BINS - 1], rightCount[BVH_BINS - 1];
+		glm::vec3 lMin(FLT_MAX), lMax(-FLT_MAX), rMin(FLT_MAX), rMax(-FLT_MAX);
+		unsigned int lSum = 0, rSum = 0;
+		for (int i = 0; i < BVH_BINS - 1; ++i)
+		{
+			lSum += binCount[i];
+			leftCount[i] = lSum;
+			lMin = glm::min(lMin, binMin[i]);
+			lMax = glm::max(lMax, binMax[i]);
+			leftArea[i] = surfaceArea(lMin, lMax);
+
+			rSum += binCount[BVH_BINS - 1 - i];
+			rightCount[BVH_BINS - 2 - i] = rSum;
+			rMin = glm::min(rMin, binMin[BVH_BINS - 1 - i]);
+			rMax = glm::max(rMax, binMax[BVH_BINS - 1 - i]);
+			rightArea[BVH_BINS - 2 - i] = surfaceArea(rMin, rMax);
+		}
+
+		int bestSplit = -1;
+		float bestCost = node.count * surfaceArea(node.bbMin, node.bbMax);
+		for (int i = 0; i < BVH_BINS - 1; ++i)
+		{
+			if (leftCount[i] == 0 || rightCount[i] == 0)
+				continue;
+
+			float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestSplit = i;
+			}
+		}
+
+		if (bestSplit < 0)
+			continue;
+
+		// Partition the node's triangles around the chosen plane
+		unsigned int *first = &m_vuiTriIndices[node.leftOrFirst];
+		unsigned int *mid = std::partition(first, first + node.count, [&](unsigned int t) {
+			return std::min(BVH_BINS - 1, static_cast<int>((centroids[t][axis] - cMin[axis]) * scale)) <= bestSplit;
+		});
+		unsigned int leftN = static_cast<unsigned int>(mid - first);
+
+		Node left, right;
+		left.leftOrFirst = node.leftOrFirst;
+		left.count = leftN;
+		right.leftOrFirst = node.leftOrFirst + leftN;
+		right.count = node.count - leftN;
+		updateBounds(left, triMin, triMax);
+		updateBounds(right, triMin, triMax);
+
+		unsigned int leftIdx = static_cast<unsigned int>(m_vNodes.size());
+		m_vNodes.push_back(left);
+		m_vNodes.push_back(right);
+
+		m_vNodes[nodeIdx].leftOrFirst = leftIdx;
+		m_vNodes[nodeIdx].count = 0;
+
+		stack.push_back(std::make_pair(leftIdx, depth + 1));
+		stack.push_back(std::make_pair(leftIdx + 1, depth + 1));
+	}
+}
+
+// Moller-Trumbore, two-sided since fronds are rendered from both sides
+bool BVH::intersectTriangle(const Ray &ray, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float &t, float &u, float &v)
+{
+	glm::vec3 e1(v1 - v0), e2(v2 - v0);
+	glm::vec3 p(glm::cross(ray.direction, e2));
+	float det = glm::dot(e1, p);
+
+	if (fabs(det) < 1e-12f)
+		return false;
+
+	float invDet = 1.f / det;
+	glm::vec3 s(ray.origin - v0);
+	u = glm::dot(s, p) * invDet;
+	if (u < 0.f || u > 1.f)
+		return false;
+
+	glm::vec3 q(glm::cross(s, e1));
+	v = glm::dot(ray.direction, q) * invDet;
+	if (v < 0.f || u + v > 1.f)
+		return false;
+
+	t = glm::dot(e2, q) * invDet;
+	return t > 0.f;
+}
+
+static bool intersectBox(glm::vec3 origin, glm::vec3 invDir, glm::vec3 bbMin, glm::vec3 bbMax, float tMax, float &tEntry)
+{
+	glm::vec3 t0((bbMin - origin) * invDir);
+	glm::vec3 t1((bbMax - origin) * invDir);
+	glm::vec3 tNear(glm::min(t0, t1)), tFar(glm::max(t0, t1));
+
+	tEntry = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, 0.f));
+	float tExit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, tMax));
+
+	return tEntry <= tExit;
+}
+
+bool BVH::intersect(const Ray &ray, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, Hit &hit) const
+{
+	hit = Hit();
+	if (m_vNodes.empty())
+		return false;
+
+	glm::vec3 invDir(1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z);
+	float tBest = ray.tMax;
+
+	float tEntry;
+	if (!intersectBox(ray.origin, invDir, m_vNodes[0].bbMin, m_vNodes[0].bbMax, tBest, tEntry))
+		return false;
+
+	unsigned int stack[BVH_STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+
+	while (sp > 0)
+	{
+		const Node &node = m_vNodes[stack[--sp]];
+
+		if (node.count > 0)
+		{
+			for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+			{
+				unsigned int tri = m_vuiTriIndices[i];
+				float t, u, v;
+				if (intersectTriangle(ray, verts[inds[3 * tri + 0]], verts[inds[3 * tri + 1]], verts[inds[3 * tri + 2]], t, u, v) && t < tBest)
+				{
+					tBest = t;
+					hit.triangle = tri;
+					hit.t = t;
+					hit.u = u;
+					hit.v = v;
+				}
+			}
+			continue;
+		}
+
+		// Visit the nearer child first so the far one is usually rejected by tBest
+		unsigned int c0 = node.leftOrFirst, c1 = node.leftOrFirst + 1;
+		float t0, t1;
+		bool h0 = intersectBox(ray.origin, invDir, m_vNodes[c0].bbMin, m_vNodes[c0].bbMax, tBest, t0);
+		bool h1 = intersectBox(ray.origin, invDir, m_vNodes[c1].bbMin, m_vNodes[c1].bbMax, tBest, t1);
+
+		if (h0 && h1)
+		{
+			if (t0 > t1)
+				std::swap(c0, c1);
+			stack[sp++] = c1;
+			stack[sp++] = c0;
+		}
+		else if (h0)
+			stack[sp++] = c0;
+		else if (h1)
+			stack[sp++] = c1;
+	}
+
+	return hit.valid();
+}
+
+static bool overlapsBox(glm::vec3 aMin, glm::vec3 aMax, glm::vec3 bMin, glm::vec3 bMax)
+{
+	return aMin.x <= bMax.x && aMax.x >= bMin.x
+		&& aMin.y <= bMax.y && aMax.y >= bMin.y
+		&& aMin.z <= bMax.z && aMax.z >= bMin.z;
+}
+
+void BVH::queryAABB(glm::vec3 bbMin, glm::vec3 bbMax, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, std::vector<unsigned int> &tris) const
+{
+	if (m_vNodes.empty())
+		return;
+
+	unsigned int stack[BVH_STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+
+	while (sp > 0)
+	{
+		const Node &node = m_vNodes[stack[--sp]];
+
+		if (!overlapsBox(node.bbMin, node.bbMax, bbMin, bbMax))
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[sp++] = node.leftOrFirst + 1;
+			stack[sp++] = node.leftOrFirst;
+			continue;
+		}
+
+		for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			unsigned int tri = m_vuiTriIndices[i];
+			glm::vec3 a(verts[inds[3 * tri + 0]]), b(verts[inds[3 * tri + 1]]), c(verts[inds[3 * tri + 2]]);
+
+			if (overlapsBox(glm::min(a, glm::min(b, c)), glm::max(a, glm::max(b, c)), bbMin, bbMax))
+				tris.push_back(tri);
+		}
+	}
+}
+
+// Packet traversal: a node is visited if any active ray's slab interval overlaps it
+void BVH::intersect4(const Ray rays[4], const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, Hit hits[4]) const
+{
+	for (int r = 0; r < 4; ++r)
+		hits[r] = Hit();
+
+	if (m_vNodes.empty())
+		return;
+
+	__m128 ox = _mm_setr_ps(rays[0].origin.x, rays[1].origin.x, rays[2].origin.x, rays[3].origin.x);
+	__m128 oy = _mm_setr_ps(rays[0].origin.y, rays[1].origin.y, rays[2].origin.y, rays[3].origin.y);
+	__m128 oz = _mm_setr_ps(rays[0].origin.z, rays[1].origin.z, rays[2].origin.z, rays[3].origin.z);
+	__m128 dx = _mm_setr_ps(rays[0].direction.x, rays[1].direction.x, rays[2].direction.x, rays[3].direction.x);
+	__m128 dy = _mm_setr_ps(rays[0].direction.y, rays[1].direction.y, rays[2].direction.y, rays[3].direction.y);
+	__m128 dz = _mm_setr_ps(rays[0].direction.z, rays[1].direction.z, rays[2].direction.z, rays[3].direction.z);
+	__m128 one = _mm_set1_ps(1.f);
+	__m128 zero = _mm_setzero_ps();
+	__m128 idx = _mm_div_ps(one, dx);
+	__m128 idy = _mm_div_ps(one, dy);
+	__m128 idz = _mm_div_ps(one, dz);
+	__m128 tBest = _mm_setr_ps(rays[0].tMax, rays[1].tMax, rays[2].tMax, rays[3].tMax);
+	__m128 hitTri = _mm_castsi128_ps(_mm_set1_epi32(-1));
+	__m128 hitU = zero, hitV = zero;
+
+	unsigned int stack[BVH_STACK_SIZE];
+	int sp = 0;
+	stack[sp++] = 0;
+
+	while (sp > 0)
+	{
+		const Node &node = m_vNodes[stack[--sp]];
+
+		// Slab test against all four rays at once
+		__m128 tx0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbMin.x), ox), idx);
+		__m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbMax.x), ox), idx);
+		__m128 ty0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbMin.y), oy), idy);
+		__m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbMax.y), oy), idy);
+		__m128 tz0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbMin.z), oz), idz);
+		__m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(node.bbMax.z), oz), idz);
+		__m128 tNear = _mm_max_ps(_mm_max_ps(_mm_min_ps(tx0, tx1), _mm_min_ps(ty0, ty1)), _mm_max_ps(_mm_min_ps(tz0, tz1), zero));
+		__m128 tFar = _mm_min_ps(_mm_min_ps(_mm_max_ps(tx0, tx1), _mm_max_ps(ty0, ty1)), _mm_min_ps(_mm_max_ps(tz0, tz1), tBest));
+
+		if (_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)) == 0)
+			continue;
+
+		if (node.count == 0)
+		{
+			stack[sp++] = node.leftOrFirst + 1;
+			stack[sp++] = node.leftOrFirst;
+			continue;
+		}
+
+		for (unsigned int i = node.leftOrFirst; i < node.leftOrFirst + node.count; ++i)
+		{
+			unsigned int tri = m_vuiTriIndices[i];
+			glm::vec3 v0(verts[inds[3 * tri + 0]]);
+			glm::vec3 e1(verts[inds[3 * tri + 1]] - v0), e2(verts[inds[3 * tri + 2]] - v0);
+
+			__m128 e1x = _mm_set1_ps(e1.x), e1y = _mm_set1_ps(e1.y), e1z = _mm_set1_ps(e1.z);
+			__m128 e2x = _mm_set1_ps(e2.x), e2y = _mm_set1_ps(e2.y), e2z = _mm_set1_ps(e2.z);
+
+			// p = d x e2
+			__m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+			__m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+			__m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+			__m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+			__m128 invDet = _mm_div_ps(one, det);
+
+			// s = o - v0
+			__m128 sx = _mm_sub_ps(ox, _mm_set1_ps(v0.x));
+			__m128 sy = _mm_sub_ps(oy, _mm_set1_ps(v0.y));
+			__m128 sz = _mm_sub_ps(oz, _mm_set1_ps(v0.z));
+			__m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(sx, px), _mm_mul_ps(sy, py)), _mm_mul_ps(sz, pz)), invDet);
+
+			// q = s x e1
+			__m128 qx = _mm_sub_ps(_mm_mul_ps(sy, e1z), _mm_mul_ps(sz, e1y));
+			__m128 qy = _mm_sub_ps(_mm_mul_ps(sz, e1x), _mm_mul_ps(sx, e1z));
+			__m128 qz = _mm_sub_ps(_mm_mul_ps(sx, e1y), _mm_mul_ps(sy, e1x));
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)), _mm_mul_ps(dz, qz)), invDet);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+
+			__m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.f), det);
+			__m128 mask = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+			mask = _mm_and_ps(mask, _mm_cmpge_ps(v, zero));
+			mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, v), one));
+			mask = _mm_and_ps(mask, _mm_cmpgt_ps(t, zero));
+			mask = _mm_and_ps(mask, _mm_cmplt_ps(t, tBest));
+
+			if (_mm_movemask_ps(mask) == 0)
+				continue;
+
+			// Blend the new hits into the running closest hits
+			tBest = _mm_or_ps(_mm_and_ps(mask, t), _mm_andnot_ps(mask, tBest));
+			hitU = _mm_or_ps(_mm_and_ps(mask, u), _mm_andnot_ps(mask, hitU));
+			hitV = _mm_or_ps(_mm_and_ps(mask, v), _mm_andnot_ps(mask, hitV));
+			hitTri = _mm_or_ps(_mm_and_ps(mask, _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(tri)))), _mm_andnot_ps(mask, hitTri));
+		}
+	}
+
+	float t[4], u[4], v[4];
+	unsigned int tris[4];
+	_mm_storeu_ps(t, tBest);
+	_mm_storeu_ps(u, hitU);
+	_mm_storeu_ps(v, hitV);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(tris), _mm_castps_si128(hitTri));
+
+	for (int r = 0; r < 4; ++r)
+	{
+		if (tris[r] == ~0u)
+			continue;
+
+		hits[r].triangle = tris[r];
+		hits[r].t = t[r];
+		hits[r].u = u[r];
+		hits[r].v = v[r];
+	}
+}
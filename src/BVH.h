@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+#include <cfloat>
+
+#include <glm/glm.hpp>
+
+#define BVH_LEAF_SIZE 4
+#define BVH_BINS 16
+#define BVH_MAX_DEPTH 64		// deeper nodes stay leaves, so traversal stacks can't overflow
+#define BVH_STACK_SIZE (BVH_MAX_DEPTH + 2)
+
+// Bounding volume hierarchy over an indexed triangle list. The BVH keeps only a
+// triangle permutation and node bounds; queries take the same vertex/index arrays it was built from.
+class BVH
+{
+public:
+	struct Node {
+		glm::vec3 bbMin;
+		unsigned int leftOrFirst;	// first child for interior nodes (second child follows), first triangle for leaves
+		glm::vec3 bbMax;
+		unsigned int count;			// triangles in a leaf, 0 for interior nodes
+	};
+
+	struct Ray {
+		glm::vec3 origin;
+		glm::vec3 direction;
+		float tMax;
+
+		Ray() : tMax(FLT_MAX) {}
+		Ray(glm::vec3 o, glm::vec3 d, float t = FLT_MAX) : origin(o), direction(d), tMax(t) {}
+	};
+
+	struct Hit {
+		unsigned int triangle;	// triangle index into the index list (indices 3t..3t+2)
+		float t;
+		float u, v;				// barycentrics of the hit on the triangle
+
+		Hit() : triangle(~0u), t(FLT_MAX), u(0.f), v(0.f) {}
+		bool valid() const { return triangle != ~0u; }
+	};
+
+public:
+	BVH();
+	~BVH();
+
+	void build(const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds);
+	void clear();
+
+	// Closest hit along a single ray
+	bool intersect(const Ray &ray, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, Hit &hit) const;
+
+	// Closest hits for four coherent rays traversed together with SSE
+	void intersect4(const Ray rays[4], const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, Hit hits[4]) const;
+
+	// Triangles whose bounding boxes overlap the query box
+	void queryAABB(glm::vec3 bbMin, glm::vec3 bbMax, const std::vector<glm::vec3> &verts, const std::vector<unsigned int> &inds, std::vector<unsigned int> &tris) const;
+
+	bool empty() const { return m_vNodes.empty(); }
+	size_t getNodeCount() const { return m_vNodes.size(); }
+
+private:
+	void updateBounds(Node &node, const std::vector<glm::vec3> &triMin, const std::vector<glm::vec3> &triMax);
+
+	static bool intersectTriangle(const Ray &ray, glm::vec3 v0, glm::vec3 v1, glm::vec3 v2, float &t, float &u, float &v);
+
+	std::vector<Node> m_vNodes;
+	std::vector<unsigned int> m_vuiTriIndices;	// triangle ids in leaf order
+};
@@ -2,8 +2,11 @@
 
 #include <vector>
 #include <algorithm>
+#include <initializer_list>
 
-class Object;
+#include "EventQueue.h"
+
+#define BROADCAST_QUEUE_SIZE 1024	// events held between dispatches; must be a power of two
 
 namespace BroadcastSystem
 {
@@ -14,36 +17,120 @@ namespace BroadcastSystem
 		MOUSE_SCROLL,
 		KEY_PRESS,
 		KEY_UNPRESS,
-		KEY_REPEAT
+		KEY_REPEAT,
+		WINDOW_REFRESH,
+		WINDOW_RESIZE,
+		EVENT_COUNT
+	};
+
+	// Fixed-size record; the member that applies depends on the type
+	struct Event {
+		EVENT type;
+		union {
+			int key;		// KEY_PRESS, KEY_UNPRESS, KEY_REPEAT
+			struct {
+				int button;
+				float x, y;			// cursor when the button went down or up, window coordinates
+			} click;		// MOUSE_CLICK, MOUSE_UNCLICK
+			struct {
+				float dx, dy;		// cursor offset, y up
+				bool buttonDown;	// a mouse button was held while moving
+			} move;			// MOUSE_MOVE
+			float scroll;	// MOUSE_SCROLL
+			struct {
+				int width, height;	// framebuffer pixels
+			} size;			// WINDOW_RESIZE
+		};
 	};
 
 	class Listener
 	{
 	public:
 		virtual ~Listener() {}
-		virtual void receiveEvent(Object* obj, const int event, void* data) = 0;	
+		virtual void receiveEvent(const Event &event) = 0;
 	};
 
+	// Events are queued when posted and handed out on the main thread once per frame by dispatch(),
+	// so a slow handler delays the next frame instead of the window system's callbacks. Listeners
+	// subscribe per event type and only hear about those types.
 	class Broadcaster
 	{
 	public:
-		void attach(Listener *obs)
+		Broadcaster()
+			: m_nDispatched(0)
+			, m_nCoalesced(0)
 		{
-			m_vpListeners.push_back(obs);
+		}
+
+		virtual ~Broadcaster() {}
+
+		void attach(Listener *obs, std::initializer_list<EVENT> events)
+		{
+			for (auto const &e : events)
+				if (std::find(m_vpListeners[e].begin(), m_vpListeners[e].end(), obs) == m_vpListeners[e].end())
+					m_vpListeners[e].push_back(obs);
 		}
 
 		void detach(Listener *obs)
 		{
-			m_vpListeners.erase(std::remove(m_vpListeners.begin(), m_vpListeners.end(), obs), m_vpListeners.end());
+			for (auto &listeners : m_vpListeners)
+				listeners.erase(std::remove(listeners.begin(), listeners.end(), obs), listeners.end());
+		}
+
+		// Safe from any thread; false if the queue is full and the event was dropped
+		bool post(const Event &event)
+		{
+			return m_Queue.push(event);
 		}
 
-	protected:
-		virtual void notify(Object* obj, const int event, void* data = NULL)
+		// Delivers everything queued so far. Runs of mouse moves with the same button state are
+		// merged into one move carrying the summed offset.
+		void dispatch()
 		{
-			for (auto obs : m_vpListeners) obs->receiveEvent(obj, event, data);
+			Event event, pending;
+			bool hasPending = false;
+
+			while (m_Queue.pop(event))
+			{
+				if (hasPending && event.type == MOUSE_MOVE && event.move.buttonDown == pending.move.buttonDown)
+				{
+					pending.move.dx += event.move.dx;
+					pending.move.dy += event.move.dy;
+					m_nCoalesced++;
+					continue;
+				}
+
+				if (hasPending)
+					deliver(pending);
+				hasPending = false;
+
+				if (event.type == MOUSE_MOVE)
+				{
+					pending = event;
+					hasPending = true;
+				}
+				else
+					deliver(event);
+			}
+
+			if (hasPending)
+				deliver(pending);
 		}
 
+		unsigned int getDispatchedCount() const { return m_nDispatched; }
+		unsigned int getCoalescedCount() const { return m_nCoalesced; }
+		unsigned int getDroppedCount() const { return m_Queue.getDroppedCount(); }
+
 	private:
-		std::vector<Listener *> m_vpListeners;
+		void deliver(const Event &event)
+		{
+			m_nDispatched++;
+			for (auto obs : m_vpListeners[event.type])
+				obs->receiveEvent(event);
+		}
+
+		std::vector<Listener *> m_vpListeners[EVENT_COUNT];
+		EventQueue<Event, BROADCAST_QUEUE_SIZE> m_Queue;
+		unsigned int m_nDispatched, m_nCoalesced;
 	};
- }
\ No newline at end of file
+}
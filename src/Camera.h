@@ -8,6 +8,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "Object.h"
+#include "Frustum.h"
 #include "GLFWInputBroadcaster.h"
 
 // Defines several possible options for camera movement. Used as abstraction to stay away from window-system specific input methods
@@ -28,8 +29,13 @@ const float m_fDefaultSensitivity     =   0.065f;
 const float m_fDefaultZoom            =  45.f;
 const float m_fDefaultZoomMin         =  45.f;
 const float m_fDefaultZoomMax         =   1.f;
+const float m_fDefaultAspect          =   1.f;
+const float m_fDefaultNearPlane       =   0.1f;
+const float m_fDefaultFarPlane        = 1000.f;
 
-// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+// An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL.
+// The matrices and frustum are cached and only rebuilt by update() after a move, look or zoom; each rebuild
+// bumps the version so consumers can skip their own work while the camera is still.
 class Camera : public Object, public BroadcastSystem::Listener
 {
 public:
@@ -45,82 +51,107 @@ public:
 		, m_fZoom(m_fDefaultZoom)
 		, m_fZoomMin(m_fDefaultZoomMin)
 		, m_fZoomMax(m_fDefaultZoomMax)
+		, m_fAspect(m_fDefaultAspect)
+		, m_fNearPlane(m_fDefaultNearPlane)
+		, m_fFarPlane(m_fDefaultFarPlane)
+		, m_bOrientationDirty(true)
+		, m_bViewDirty(true)
+		, m_bProjectionDirty(true)
+		, m_nVersion(0)
+		, m_nNodeVersion(0)
     {
-        m_vec3Position = position;
+        setPosition(position);
 		m_vec3WorldUp = up;
         m_fYaw = yaw;
         m_fPitch = pitch;
-        updateCameraVectors();
 		memset(m_brMovementState, 0, sizeof(m_brMovementState));
+		updateMatrices();
     }
 
     // Returns the view matrix calculated using Eular Angles and the LookAt Matrix
     glm::mat4 getViewMatrix()
     {
-        return glm::lookAt(m_vec3Position, m_vec3Position + m_mat3Rotation[2], m_mat3Rotation[1]);
+        return m_mat4View;
     }
 
+	glm::mat4 getProjectionMatrix() { return m_mat4Projection; }
+	glm::mat4 getViewProjectionMatrix() { return m_mat4ViewProjection; }
+
+	// In the space the camera moves in
+	const Frustum& getFrustum() { return m_frustum; }
+
+	// Changes whenever any of the matrices do
+	unsigned int getVersion() { return m_nVersion; }
+
+	// A movement key is held, so the view changes every frame
+	bool isMoving() { return m_brMovementState[FORWARD] || m_brMovementState[BACKWARD] || m_brMovementState[LEFT] || m_brMovementState[RIGHT]; }
+
 	float getZoom() 
 	{ 
 		return m_fZoom; 
 	}
 
-	void receiveEvent(Object * obj, const int event, void * data)
+	void setAspect(float aspect)
 	{
-		if (event == BroadcastSystem::EVENT::KEY_PRESS)
-		{
-			int key;
-			memcpy(&key, data, sizeof(key));
+		if (aspect == m_fAspect)
+			return;
 
+		m_fAspect = aspect;
+		m_bProjectionDirty = true;
+	}
+
+	void setClipPlanes(float nearPlane, float farPlane)
+	{
+		m_fNearPlane = nearPlane;
+		m_fFarPlane = farPlane;
+		m_bProjectionDirty = true;
+	}
+
+	void receiveEvent(const BroadcastSystem::Event &event)
+	{
+		if (event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
 			// Camera controls
-			if (key == GLFW_KEY_W)
+			if (event.key == GLFW_KEY_W)
 				m_brMovementState[FORWARD] = true;
-			if (key == GLFW_KEY_S)
+			if (event.key == GLFW_KEY_S)
 				m_brMovementState[BACKWARD] = true;
-			if (key == GLFW_KEY_A)
+			if (event.key == GLFW_KEY_A)
 				m_brMovementState[LEFT] = true;
-			if (key == GLFW_KEY_D)
+			if (event.key == GLFW_KEY_D)
 				m_brMovementState[RIGHT] = true;
 
-			if (key == GLFW_KEY_LEFT_SHIFT)
+			if (event.key == GLFW_KEY_LEFT_SHIFT)
 				m_fMovementSpeed *= 5.f;
 		}
 
-		if (event == BroadcastSystem::EVENT::KEY_UNPRESS)
+		if (event.type == BroadcastSystem::EVENT::KEY_UNPRESS)
 		{
-			int key;
-			memcpy(&key, data, sizeof(key));
-
 			// Camera controls
-			if (key == GLFW_KEY_W)
+			if (event.key == GLFW_KEY_W)
 				m_brMovementState[FORWARD] = false;
-			if (key == GLFW_KEY_S)
+			if (event.key == GLFW_KEY_S)
 				m_brMovementState[BACKWARD] = false;
-			if (key == GLFW_KEY_A)
+			if (event.key == GLFW_KEY_A)
 				m_brMovementState[LEFT] = false;
-			if (key == GLFW_KEY_D)
+			if (event.key == GLFW_KEY_D)
 				m_brMovementState[RIGHT] = false;
 
-			if (key == GLFW_KEY_LEFT_SHIFT)
+			if (event.key == GLFW_KEY_LEFT_SHIFT)
 				m_fMovementSpeed *= 0.2f;
 		}
 
-		if (event == BroadcastSystem::EVENT::MOUSE_MOVE)
+		if (event.type == BroadcastSystem::EVENT::MOUSE_MOVE)
 		{
-			if (GLFWInputBroadcaster::getInstance().mousePressed())
-			{
-				float offset[2];
-				memcpy(offset, data, sizeof(offset)); // recover array
-				look(-offset[0], -offset[1]);
-			}
+			// Ctrl-drag is rubber-band selection and Alt-drag moves the measurement box, not mouse look
+			if (event.move.buttonDown &&
+				!GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_CONTROL) &&
+				!GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_ALT))
+				look(-event.move.dx, -event.move.dy);
 		}
 
-		if (event == BroadcastSystem::EVENT::MOUSE_SCROLL)
-		{
-			float yoffset;
-			memcpy(&yoffset, data, sizeof(yoffset));
-			zoom( yoffset );
-		}
+		if (event.type == BroadcastSystem::EVENT::MOUSE_SCROLL)
+			zoom(event.scroll);
 	}
 
 	void update(float deltaTime)
@@ -128,8 +159,7 @@ public:
 		// Move the camera based on its current movement state
 		move(deltaTime);
 
-        // Update Front, Right and Up Vectors using the updated Eular angles
-        this->updateCameraVectors();
+		updateMatrices();
 	}
 
 private:
@@ -144,22 +174,37 @@ private:
 	float m_fMovementSpeed;
 	float m_fSensitivity;
 	float m_fZoom, m_fZoomMin, m_fZoomMax;
+	float m_fAspect, m_fNearPlane, m_fFarPlane;
 
 	bool m_brMovementState[4]; // FORWARD, BACKWARD, LEFT, RIGHT
-	
+
+	// Cached matrices and what has to be rebuilt; the view also follows the scene node's world version
+	glm::mat4 m_mat4View, m_mat4Projection, m_mat4ViewProjection;
+	Frustum m_frustum;
+	bool m_bOrientationDirty, m_bViewDirty, m_bProjectionDirty;
+	unsigned int m_nVersion, m_nNodeVersion;
+
 
 	// Processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
 	void move(float deltaTime)
 	{
+		if (!isMoving())
+			return;
+
+		glm::vec3 position(getPosition());
+		glm::mat3 rotation(getOrientation());
+
 		float velocity = m_fMovementSpeed * deltaTime;
 		if (m_brMovementState[FORWARD])
-			m_vec3Position += m_mat3Rotation[2] * velocity;
+			position += rotation[2] * velocity;
 		if (m_brMovementState[BACKWARD])
-			m_vec3Position -= m_mat3Rotation[2] * velocity;
+			position -= rotation[2] * velocity;
 		if (m_brMovementState[LEFT])
-			m_vec3Position -= m_mat3Rotation[0] * velocity;
+			position -= rotation[0] * velocity;
 		if (m_brMovementState[RIGHT])
-			m_vec3Position += m_mat3Rotation[0] * velocity;
+			position += rotation[0] * velocity;
+
+		setPosition(position);
 	}
 
 	// Processes input received from a mouse input system. Expects the offset value in both the x and y direction.
@@ -170,6 +215,7 @@ private:
 
 		m_fYaw += dx;
 		m_fPitch += dy;
+		m_bOrientationDirty = true;
 
 		// Make sure that when pitch is out of bounds, screen doesn't get flipped
 		if (constrainPitch)
@@ -184,6 +230,8 @@ private:
 	// Processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
 	void zoom(float dz)
 	{
+		m_bProjectionDirty = true;
+
 		if (m_fZoom >= m_fZoomMax && m_fZoom <= m_fZoomMin)
 			m_fZoom -= dz;
 		if (m_fZoom <= m_fZoomMax)
@@ -200,10 +248,45 @@ private:
         front.x = cos(glm::radians(m_fYaw)) * cos(glm::radians(m_fPitch));
         front.y = sin(glm::radians(m_fPitch));
         front.z = sin(glm::radians(m_fYaw)) * cos(glm::radians(m_fPitch));
-		m_mat3Rotation[2] = glm::normalize(front);
+		glm::mat3 rotation;
+		rotation[2] = glm::normalize(front);
 
         // Also re-calculate the Right and Up vector
-		m_mat3Rotation[0] = glm::normalize(glm::cross(m_mat3Rotation[2], m_vec3WorldUp));  // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
-		m_mat3Rotation[1] = glm::normalize(glm::cross(m_mat3Rotation[0], m_mat3Rotation[2]));
+		rotation[0] = glm::normalize(glm::cross(rotation[2], m_vec3WorldUp));  // Normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
+		rotation[1] = glm::normalize(glm::cross(rotation[0], rotation[2]));
+		setOrientation(rotation);
     }
+
+	// Rebuild only what the last move, look or zoom invalidated
+	void updateMatrices()
+	{
+		if (m_bOrientationDirty)
+			updateCameraVectors();
+
+		// Moves, looks and anything the camera hangs off all show up as a new world version
+		unsigned int nodeVersion = getWorldVersion();
+		if (nodeVersion != m_nNodeVersion)
+		{
+			m_nNodeVersion = nodeVersion;
+			m_bViewDirty = true;
+		}
+
+		if (!m_bViewDirty && !m_bProjectionDirty)
+			return;
+
+		if (m_bViewDirty)
+		{
+			glm::mat4 world(getWorldMatrix());
+			glm::vec3 eye(world[3]);
+			m_mat4View = glm::lookAt(eye, eye + glm::normalize(glm::vec3(world[2])), glm::normalize(glm::vec3(world[1])));
+		}
+		if (m_bProjectionDirty)
+			m_mat4Projection = glm::perspective(glm::radians(m_fZoom), m_fAspect, m_fNearPlane, m_fFarPlane);
+
+		m_mat4ViewProjection = m_mat4Projection * m_mat4View;
+		m_frustum.extract(m_mat4ViewProjection);
+
+		m_bOrientationDirty = m_bViewDirty = m_bProjectionDirty = false;
+		m_nVersion++;
+	}
 };
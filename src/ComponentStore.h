@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+typedef unsigned int Entity;
+
+#define ENTITY_NONE 0xFFFFFFFFu
+
+// Hands out entity ids; released ids are reused so the sparse tables below stay small
+class EntityRegistry
+{
+public:
+	Entity create()
+	{
+		if (!m_vFree.empty())
+		{
+			Entity e = m_vFree.back();
+			m_vFree.pop_back();
+			return e;
+		}
+
+		return m_nNext++;
+	}
+
+	void release(Entity e)
+	{
+		m_vFree.push_back(e);
+	}
+
+private:
+	Entity m_nNext = 0;
+	std::vector<Entity> m_vFree;
+};
+
+// Dense array of one component type. Components are packed without holes, so a system walks
+// contiguous memory touching only the components it needs. A sparse table maps entities to
+// their slot, and removal moves the last component into the freed slot, so slot order is only
+// stable while nothing is removed.
+template <typename T>
+class ComponentArray
+{
+public:
+	T& add(Entity e, const T &component = T())
+	{
+		if (e >= m_vSlot.size())
+			m_vSlot.resize(e + 1, ENTITY_NONE);
+
+		if (m_vSlot[e] != ENTITY_NONE)
+			return m_vData[m_vSlot[e]] = component;
+
+		m_vSlot[e] = static_cast<unsigned int>(m_vData.size());
+		m_vData.push_back(component);
+		m_vEntities.push_back(e);
+
+		return m_vData.back();
+	}
+
+	bool remove(Entity e)
+	{
+		if (!has(e))
+			return false;
+
+		unsigned int slot = m_vSlot[e];
+		Entity last = m_vEntities.back();
+
+		m_vData[slot] = m_vData.back();
+		m_vEntities[slot] = last;
+		m_vSlot[last] = slot;
+
+		m_vData.pop_back();
+		m_vEntities.pop_back();
+		m_vSlot[e] = ENTITY_NONE;
+
+		return true;
+	}
+
+	bool has(Entity e) const { return e < m_vSlot.size() && m_vSlot[e] != ENTITY_NONE; }
+
+	// NULL if the entity has no such component
+	T* get(Entity e) { return has(e) ? &m_vData[m_vSlot[e]] : NULL; }
+
+	// Dense access, for systems iterating over every component
+	size_t size() const { return m_vData.size(); }
+	bool empty() const { return m_vData.empty(); }
+	T* data() { return m_vData.data(); }
+	T& operator[](size_t slot) { return m_vData[slot]; }
+	Entity getEntity(size_t slot) const { return m_vEntities[slot]; }
+
+	typename std::vector<T>::iterator begin() { return m_vData.begin(); }
+	typename std::vector<T>::iterator end() { return m_vData.end(); }
+
+	void clear()
+	{
+		m_vData.clear();
+		m_vEntities.clear();
+		m_vSlot.clear();
+	}
+
+private:
+	std::vector<T> m_vData;
+	std::vector<Entity> m_vEntities;	// owner of each slot
+	std::vector<unsigned int> m_vSlot;	// per entity, ENTITY_NONE if absent
+};
@@ -0,0 +1,366 @@
+#include "ConvexHull.h"
+
+#include <map>
+#include <cfloat>
+
+#include "Parallel.h"
+
+#define CONVEX_HULL_MIN_CHUNK 4096	// points per thread before chunked hulls pay off
+
+ConvexHull::ConvexHull()
+{
+}
+
+ConvexHull::~ConvexHull()
+{
+}
+
+bool ConvexHull::build(const std::vector<glm::dvec3> &points)
+{
+	m_vdvec3Vertices.clear();
+	m_vuiTriangles.clear();
+
+	if (points.size() < 4)
+		return false;
+
+	std::vector<glm::dvec3> candidates;
+
+	unsigned int nChunks = static_cast<unsigned int>(std::min<size_t>(Parallel::getThreadCount(), points.size() / CONVEX_HULL_MIN_CHUNK));
+	if (nChunks > 1)
+	{
+		// Points inside a chunk's hull can't be on the final hull, so keep only chunk hull vertices
+		std::vector<std::vector<glm::dvec3>> chunkVerts(nChunks);
+
+		Parallel::parallelFor(points.size(), [&](size_t begin, size_t end, unsigned int chunk) {
+			std::vector<glm::dvec3> subset(points.begin() + begin, points.begin() + end);
+			std::vector<unsigned int> tris;
+
+			if (!quickhull(subset, tris))
+			{
+				chunkVerts[chunk].swap(subset);
+				return;
+			}
+
+			std::vector<bool> used(subset.size(), false);
+			for (auto const &i : tris)
+				used[i] = true;
+			for (size_t i = 0; i < subset.size(); ++i)
+				if (used[i])
+					chunkVerts[chunk].push_back(subset[i]);
+		}, nChunks);
+
+		for (auto const &verts : chunkVerts)
+			candidates.insert(candidates.end(), verts.begin(), verts.end());
+	}
+	else
+		candidates = points;
+
+	std::vector<unsigned int> tris;
+	if (!quickhull(candidates, tris))
+		return false;
+
+	// Compact to the vertices the hull actually uses
+	std::vector<unsigned int> remap(candidates.size(), ~0u);
+	for (auto const &i : tris)
+	{
+		if (remap[i] == ~0u)
+		{
+			remap[i] = static_cast<unsigned int>(m_vdvec3Vertices.size());
+			m_vdvec3Vertices.push_back(candidates[i]);
+		}
+		m_vuiTriangles.push_back(remap[i]);
+	}
+
+	return true;
+}
+
+ConvexHull::Face ConvexHull::makeFace(const std::vector<glm::dvec3> &points, unsigned int a, unsigned int b, unsigned int c)
+{
+	Face f;
+	f.v[0] = a;
+	f.v[1] = b;
+	f.v[2] = c;
+	f.normal = glm::cross(points[b] - points[a], points[c] - points[a]);
+
+	double len = glm::length(f.normal);
+	if (len > 0.0)
+		f.normal /= len;
+
+	f.offset = glm::dot(f.normal, points[a]);
+	f.alive = true;
+
+	return f;
+}
+
+// Point face f's edge a -> b at face n
+void ConvexHull::setNeighbor(std::vector<Face> &faces, size_t f, unsigned int a, unsigned int b, size_t n)
+{
+	for (int e = 0; e < 3; ++e)
+		if (faces[f].v[e] == a && faces[f].v[(e + 1) % 3] == b)
+			faces[f].neighbor[e] = n;
+}
+
+// Give each candidate point to the first new face it lies in front of; points behind all of them are interior
+void ConvexHull::assignOutside(const std::vector<glm::dvec3> &points, const std::vector<unsigned int> &candidates, std::vector<Face> &faces, size_t firstFace, double eps)
+{
+	for (auto const &p : candidates)
+	{
+		for (size_t f = firstFace; f < faces.size(); ++f)
+		{
+			if (glm::dot(faces[f].normal, points[p]) - faces[f].offset > eps)
+			{
+				faces[f].outside.push_back(p);
+				break;
+			}
+		}
+	}
+}
+
+bool ConvexHull::quickhull(const std::vector<glm::dvec3> &points, std::vector<unsigned int> &tris)
+{
+	tris.clear();
+
+	if (points.size() < 4)
+		return false;
+
+	// Extreme points along each axis
+	unsigned int extremes[6] = { 0, 0, 0, 0, 0, 0 };
+	for (unsigned int i = 1; i < points.size(); ++i)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (points[i][axis] < points[extremes[2 * axis]][axis])
+				extremes[2 * axis] = i;
+			if (points[i][axis] > points[extremes[2 * axis + 1]][axis])
+				extremes[2 * axis + 1] = i;
+		}
+	}
+
+	double maxExtent = 0.0;
+	unsigned int a = 0, b = 0;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		double extent = points[extremes[2 * axis + 1]][axis] - points[extremes[2 * axis]][axis];
+		if (extent > maxExtent)
+		{
+			maxExtent = extent;
+			a = extremes[2 * axis];
+			b = extremes[2 * axis + 1];
+		}
+	}
+
+	double eps = 1e-10 * (maxExtent + glm::length(points[a]) + glm::length(points[b]));
+	if (maxExtent <= eps)
+		return false;
+
+	// Farthest point from line ab, then farthest from plane abc
+	glm::dvec3 ab(glm::normalize(points[b] - points[a]));
+	unsigned int c = 0;
+	double maxDist = 0.0;
+	for (unsigned int i = 0; i < points.size(); ++i)
+	{
+		double dist = glm::length(glm::cross(points[i] - points[a], ab));
+		if (dist > maxDist)
+		{
+			maxDist = dist;
+			c = i;
+		}
+	}
+
+	if (maxDist <= eps)
+		return false;
+
+	Face base(makeFace(points, a, b, c));
+	unsigned int d = 0;
+	maxDist = 0.0;
+	for (unsigned int i = 0; i < points.size(); ++i)
+	{
+		double dist = fabs(glm::dot(base.normal, points[i]) - base.offset);
+		if (dist > maxDist)
+		{
+			maxDist = dist;
+			d = i;
+		}
+	}
+
+	if (maxDist <= eps)
+		return false;
+
+	// Initial tetrahedron, wound so normals point away from its centroid
+	if (glm::dot(base.normal, points[d]) - base.offset > 0.0)
+		std::swap(b, c);
+
+	std::vector<Face> faces;
+	faces.push_back(makeFace(points, a, b, c));
+	faces.push_back(makeFace(points, a, d, b));
+	faces.push_back(makeFace(points, b, d, c));
+	faces.push_back(makeFace(points, c, d, a));
+
+	// Every edge of the tetrahedron appears reversed in exactly one other face
+	for (size_t f = 0; f < 4; ++f)
+		for (size_t g = 0; g < 4; ++g)
+			if (f != g)
+				for (int e = 0; e < 3; ++e)
+					setNeighbor(faces, g, faces[f].v[(e + 1) % 3], faces[f].v[e], f);
+
+	std::vector<unsigned int> candidates;
+	candidates.reserve(points.size());
+	for (unsigned int i = 0; i < points.size(); ++i)
+		if (i != a && i != b && i != c && i != d)
+			candidates.push_back(i);
+
+	assignOutside(points, candidates, faces, 0, eps);
+
+	std::vector<size_t> visible, stack;
+	std::vector<std::pair<size_t, int>> horizon;	// (visible face, edge) pairs bordering the rest of the hull
+	std::vector<bool> isVisible(faces.size(), false);
+	std::map<unsigned int, size_t> newFaceFrom, newFaceTo;
+
+	for (size_t i = 0; i < faces.size(); ++i)
+	{
+		if (!faces[i].alive || faces[i].outside.empty())
+			continue;
+
+		// Farthest outside point becomes a hull vertex
+		unsigned int eye = faces[i].outside[0];
+		double eyeDist = -DBL_MAX;
+		for (auto const &p : faces[i].outside)
+		{
+			double dist = glm::dot(faces[i].normal, points[p]) - faces[i].offset;
+			if (dist > eyeDist)
+			{
+				eyeDist = dist;
+				eye = p;
+			}
+		}
+
+		// Flood the faces the eye can see, starting from this one
+		isVisible.resize(faces.size(), false);
+		visible.clear();
+		horizon.clear();
+		stack.clear();
+
+		isVisible[i] = true;
+		stack.push_back(i);
+		while (!stack.empty())
+		{
+			size_t f = stack.back();
+			stack.pop_back();
+			visible.push_back(f);
+
+			for (int e = 0; e < 3; ++e)
+			{
+				size_t n = faces[f].neighbor[e];
+				if (isVisible[n])
+					continue;
+
+				if (glm::dot(faces[n].normal, points[eye]) - faces[n].offset > eps)
+				{
+					isVisible[n] = true;
+					stack.push_back(n);
+				}
+				else
+					horizon.push_back(std::make_pair(f, e));
+			}
+		}
+
+		candidates.clear();
+		for (auto const &f : visible)
+		{
+			faces[f].alive = false;
+			for (auto const &p : faces[f].outside)
+				if (p != eye)
+					candidates.push_back(p);
+			std::vector<unsigned int>().swap(faces[f].outside);
+		}
+
+		// Connect each horizon edge to the eye, stitching the new faces to the old hull and each other
+		size_t firstNew = faces.size();
+		newFaceFrom.clear();
+		newFaceTo.clear();
+
+		for (auto const &h : horizon)
+		{
+			unsigned int ha = faces[h.first].v[h.second], hb = faces[h.first].v[(h.second + 1) % 3];
+			size_t outer = faces[h.first].neighbor[h.second];
+			size_t nf = faces.size();
+
+			faces.push_back(makeFace(points, ha, hb, eye));
+			faces[nf].neighbor[0] = outer;
+			setNeighbor(faces, outer, hb, ha, nf);
+
+			newFaceFrom[ha] = nf;
+			newFaceTo[hb] = nf;
+		}
+
+		for (size_t nf = firstNew; nf < faces.size(); ++nf)
+		{
+			faces[nf].neighbor[1] = newFaceFrom[faces[nf].v[1]];	// across hb -> eye
+			faces[nf].neighbor[2] = newFaceTo[faces[nf].v[0]];		// across eye -> ha
+		}
+
+		for (auto const &f : visible)
+			isVisible[f] = false;
+
+		assignOutside(points, candidates, faces, firstNew, eps);
+	}
+
+	for (auto const &f : faces)
+	{
+		if (!f.alive)
+			continue;
+
+		tris.push_back(f.v[0]);
+		tris.push_back(f.v[1]);
+		tris.push_back(f.v[2]);
+	}
+
+	return true;
+}
+
+double ConvexHull::getVolume()
+{
+	if (m_vuiTriangles.empty())
+		return 0.0;
+
+	// Sum of signed tetrahedra against an interior reference point
+	glm::dvec3 ref(0.0);
+	for (auto const &v : m_vdvec3Vertices)
+		ref += v;
+	ref /= static_cast<double>(m_vdvec3Vertices.size());
+
+	double volume = 0.0;
+	for (size_t t = 0; t < m_vuiTriangles.size(); t += 3)
+	{
+		glm::dvec3 a(m_vdvec3Vertices[m_vuiTriangles[t + 0]] - ref);
+		glm::dvec3 b(m_vdvec3Vertices[m_vuiTriangles[t + 1]] - ref);
+		glm::dvec3 c(m_vdvec3Vertices[m_vuiTriangles[t + 2]] - ref);
+		volume += glm::dot(a, glm::cross(b, c));
+	}
+
+	return volume / 6.0;
+}
+
+double ConvexHull::getSurfaceArea()
+{
+	double area = 0.0;
+	for (size_t t = 0; t < m_vuiTriangles.size(); t += 3)
+	{
+		glm::dvec3 a(m_vdvec3Vertices[m_vuiTriangles[t + 0]]);
+		glm::dvec3 b(m_vdvec3Vertices[m_vuiTriangles[t + 1]]);
+		glm::dvec3 c(m_vdvec3Vertices[m_vuiTriangles[t + 2]]);
+		area += glm::length(glm::cross(b - a, c - a)) * 0.5;
+	}
+
+	return area;
+}
+
+const std::vector<glm::dvec3>& ConvexHull::getVertices()
+{
+	return m_vdvec3Vertices;
+}
+
+const std::vector<unsigned int>& ConvexHull::getTriangles()
+{
+	return m_vuiTriangles;
+}
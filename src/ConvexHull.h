@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// 3D convex hull by Quickhull. Large inputs are split into one chunk per thread, each chunk is
+// hulled independently, and the hull of the surviving chunk vertices is the final hull.
+class ConvexHull
+{
+public:
+	ConvexHull();
+	~ConvexHull();
+
+	// Returns false when the points are degenerate (fewer than four, or all coplanar)
+	bool build(const std::vector<glm::dvec3> &points);
+
+	double getVolume();
+	double getSurfaceArea();
+
+	const std::vector<glm::dvec3>& getVertices();
+	const std::vector<unsigned int>& getTriangles();	// indices into getVertices(), outward CCW
+
+private:
+	struct Face {
+		unsigned int v[3];
+		size_t neighbor[3];		// face across edge v[e] -> v[e + 1]
+		glm::dvec3 normal;
+		double offset;
+		std::vector<unsigned int> outside;	// points in front of the face, not yet on the hull
+		bool alive;
+	};
+
+	static bool quickhull(const std::vector<glm::dvec3> &points, std::vector<unsigned int> &tris);
+	static Face makeFace(const std::vector<glm::dvec3> &points, unsigned int a, unsigned int b, unsigned int c);
+	static void setNeighbor(std::vector<Face> &faces, size_t f, unsigned int a, unsigned int b, size_t n);
+	static void assignOutside(const std::vector<glm::dvec3> &points, const std::vector<unsigned int> &candidates, std::vector<Face> &faces, size_t firstFace, double eps);
+
+	std::vector<glm::dvec3> m_vdvec3Vertices;
+	std::vector<unsigned int> m_vuiTriangles;
+};
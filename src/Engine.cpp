@@ -4,11 +4,17 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <sstream>
+#include <fstream>
+
 glm::vec3 g_vec3Ambient(0.1f, 0.1f, 0.1f);
 glm::vec3 g_vec3Diffuse(0.f, 0.7f, 0.f);
 glm::vec3 g_vec3Specular(0.f, 0.f, 0.f);
 glm::vec3 g_vec3Emissive(0.f, 0.f, 0.f);
 float g_fShininess(32.f);
+unsigned int g_uiMaterialVersion = 1;	// bumped on every material edit
+
+const float g_fAreaQuerySizes[] = { 10.f, 25.f, 50.f, 100.f };	// cm
 
 float *g_pfCurrentEditValue = NULL;
 float g_fEditValueDelta = 0.1f;
@@ -22,64 +28,291 @@ Engine::Engine(int argc, char* argv[])
 	, m_pCamera(NULL)
 	, m_pShaderLighting(NULL)
 	, m_pShaderNormals(NULL)
+	, m_pShaderDepth(NULL)
+	, m_pShaderBox(NULL)
 	, m_pSphere(NULL)
+	, m_pArena(NULL)
+	, m_pMeasurementBox(NULL)
+	, m_pSurvey(NULL)
+	, m_bBackfaceCulling(false)
+	, m_bMultiDraw(true)
+	, m_glFrameUBO(0)
+	, m_glFragmentQueryTarget(GL_SAMPLES_PASSED)
+	, m_nFrameCount(0)
+	, m_iMeasurementPercent(-1)
+	, m_bMeasurementWaiting(false)
+	, m_nMeasurementScanCount(0)
+	, m_nMeasurementTriangles(0)
+	, m_dMeasurementSeconds(0.0)
+	, m_nCameraVersion(0)
+	, m_nViewVersion(0)
+	, m_bWorldRotationDirty(true)
+	, m_bCullValid(false)
+	, m_nCullViewVersion(0)
+	, m_nCullDrawVersion(0)
+	, m_bCullBackface(false)
+	, m_nCullPasses(0)
+	, m_bIdleMode(true)
+	, m_nSceneVersion(0)
+	, m_nDrawnSceneVersion(~0u)
+	, m_nFramesDrawn(0)
+	, m_nIdleWakeups(0)
+	, m_dIdleWaitSeconds(0.0)
+	, m_dLoopStatsStart(0.0)
+	, m_pRenderTarget(NULL)
+	, m_iFramebufferWidth(0)
+	, m_iFramebufferHeight(0)
+	, m_iMSAASamples(DEFAULT_MSAA_SAMPLES)
+	, m_bDynamicResolution(true)
+	, m_fRenderScale(1.f)
+	, m_bFullResolutionFrame(false)
+	, m_bLastFrameScaled(false)
+	, m_fClickX(0.f)
+	, m_fClickY(0.f)
 {
 	for (int i = 0; i < argc; ++i)
 		m_vstrArgs.push_back(std::string(argv[i]));
+
+	memset(&m_frameStats, 0, sizeof(m_frameStats));
+	memset(m_glFragmentQueries, 0, sizeof(m_glFragmentQueries));
+	memset(m_glTimerQueries, 0, sizeof(m_glTimerQueries));
+	m_fTimerScales[0] = m_fTimerScales[1] = 1.f;
 }
 
 Engine::~Engine()
 {
 }
 
-void Engine::receiveEvent(Object * obj, const int event, void * data)
+void Engine::receiveEvent(const BroadcastSystem::Event &event)
 {
-	if (event == BroadcastSystem::EVENT::KEY_PRESS || event == BroadcastSystem::EVENT::KEY_REPEAT)
+	// Anything but a bare cursor move may change what is on screen
+	if (event.type != BroadcastSystem::EVENT::MOUSE_MOVE || event.move.buttonDown)
+		m_nSceneVersion++;
+
+	if (event.type == BroadcastSystem::EVENT::KEY_PRESS || event.type == BroadcastSystem::EVENT::KEY_REPEAT)
 	{
-		int key;
-		memcpy(&key, data, sizeof(key));
+		int key = event.key;
 
-		if (key == GLFW_KEY_P)
+		// Runs in the background; pressing again restarts it with the box as it is now
+		if (key == GLFW_KEY_P && event.type == BroadcastSystem::EVENT::KEY_PRESS)
 		{
-			float boxSize = 50.f; // cm
-			float totalAreaInside = 0.f;
-			for (auto const &obj : m_vpModels)
+			if (m_pMeasurementJob || m_bMeasurementWaiting)
 			{
-				float modelAreaInside = 0.f;
-				std::vector<unsigned int> inds = obj->getIndices();
-				std::vector<glm::vec3> verts = obj->getVertices();
-				std::vector<unsigned int> indsRet;
-				for (std::vector<unsigned int>::iterator it = inds.begin(); it != inds.end(); it += 3)
+				if (m_pMeasurementJob)
 				{
-					float res = getTriangleSurfaceAreaInAABB(
-						verts[*(it + 0)],
-						verts[*(it + 1)],
-						verts[*(it + 2)],
-						glm::vec3(0.f),
-						glm::vec3(boxSize, boxSize, -boxSize)
-					);
-					
-					if (res > 0.f)
-					{
-						indsRet.push_back(*(it + 0));
-						indsRet.push_back(*(it + 1));
-						indsRet.push_back(*(it + 2));
-					}
+					m_pMeasurementJob->cancel();
+					m_pMeasurementJob->wait();
+					m_pMeasurementJob.reset();
+				}
+				std::cout << "Measurement superseded" << std::endl;
+			}
+
+			// Only the scans overlapping the box are measured, a batch at a time; any not in memory are
+			// loaded for their batch and released again after it
+			releaseMeasurementScans();
+			m_vec3MeasurementMin = m_pMeasurementBox->getMin();
+			m_vec3MeasurementMax = m_pMeasurementBox->getMax();
+			m_pSurvey->query(m_vec3MeasurementMin, m_vec3MeasurementMax, m_vuiMeasurementQueue);
+			std::stable_partition(m_vuiMeasurementQueue.begin(), m_vuiMeasurementQueue.end(), [this](unsigned int scan) { return m_pSurvey->getScan(scan).model == NULL; });
+			m_nMeasurementScanCount = m_vuiMeasurementQueue.size();
+			m_nMeasurementTriangles = 0;
+			m_dMeasurementSeconds = 0.0;
+			startMeasurementBatch();
+		}
+
+		// Esc is taken by the window, which closes on it before listeners hear about it
+		if (key == GLFW_KEY_C && event.type == BroadcastSystem::EVENT::KEY_PRESS && (m_pMeasurementJob || m_bMeasurementWaiting))
+		{
+			if (m_pMeasurementJob)
+			{
+				m_pMeasurementJob->cancel();
+				m_pMeasurementJob->wait();
+				m_pMeasurementJob.reset();
+			}
+			releaseMeasurementScans();
+			updateAreaReadout();
+			std::cout << "Measurement cancelled" << std::endl;
+		}
+
+		if (key == GLFW_KEY_V && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			for (auto const &obj : m_vpModels)
+			{
+				float start = static_cast<float>(glfwGetTime());
+				MeshMetrics metrics(obj, m_pMeasurementBox->getMin(), m_pMeasurementBox->getMax());
+
+				std::cout << "\tModel " << obj->getName() << (metrics.isClosed() ? " (closed)" : " (open)") << std::endl;
+				if (metrics.isClosed())
+					std::cout << "\t\tEnclosed volume inside bounding box = " << metrics.getEnclosedVolume() << " cm^3" << std::endl;
+				std::cout << "\t\tConvex hull volume = " << metrics.getConvexHullVolume() << " cm^3 (" << metrics.getConvexHullVertexCount() << " hull vertices)" << std::endl;
+				std::cout << "\t\tOccupied voxel volume = " << metrics.getVoxelVolume() << " cm^3 at " << MESH_METRICS_DEFAULT_VOXEL_SIZE << " cm" << std::endl;
+				std::cout << "\t\t[" << (static_cast<float>(glfwGetTime()) - start) * 1000.f << " ms]" << std::endl;
+			}
+		}
+
+		// Octree box queries at the standard survey sizes, anchored at the measurement box's top corner
+		if (key == GLFW_KEY_Q && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			glm::vec3 anchor(m_pMeasurementBox->getMin().x, m_pMeasurementBox->getMin().y, m_pMeasurementBox->getMax().z);
+			for (auto const &size : g_fAreaQuerySizes)
+			{
+				glm::vec3 bbMin(anchor - glm::vec3(0.f, 0.f, size)), bbMax(anchor + glm::vec3(size, size, 0.f));
+
+				double exact = 0.0, approx = 0.0, errorBound = 0.0;
+				float start = static_cast<float>(glfwGetTime());
+				for (auto const &obj : m_vpModels)
+					exact += obj->queryArea(bbMin, bbMax).area;
+				float exactMs = (static_cast<float>(glfwGetTime()) - start) * 1000.f;
 
-					modelAreaInside += res;
+				start = static_cast<float>(glfwGetTime());
+				for (auto const &obj : m_vpModels)
+				{
+					AreaOctree::Result r(obj->queryArea(bbMin, bbMax, size * AREA_QUERY_APPROX_FRACTION));
+					approx += r.area;
+					errorBound += r.errorBound;
 				}
+				float approxMs = (static_cast<float>(glfwGetTime()) - start) * 1000.f;
+
+				std::cout << size << "-cm box: " << exact * 2.f << " cm^2 [" << exactMs << " ms], approximately " << approx * 2.f << " +/- " << errorBound * 2.f << " cm^2 [" << approxMs << " ms]" << std::endl;
+			}
+		}
+
+		// The measurement box and its inscribed cylinder lined up with the rotated world instead of the scene axes
+		if (key == GLFW_KEY_R && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			glm::mat4 sceneFromWorld(glm::inverse(m_mat4WorldRotation));
+			MeasurementVolume box(MeasurementVolume::fromBox(MeasurementVolume::BOX, m_pMeasurementBox->getMin(), m_pMeasurementBox->getMax(), sceneFromWorld));
+			MeasurementVolume cylinder(MeasurementVolume::fromBox(MeasurementVolume::CYLINDER, m_pMeasurementBox->getMin(), m_pMeasurementBox->getMax(), sceneFromWorld));
+
+			for (auto const &obj : m_vpModels)
+			{
+				float start = static_cast<float>(glfwGetTime());
+				double boxArea = box.measure(obj);
+				float boxMs = (static_cast<float>(glfwGetTime()) - start) * 1000.f;
+
+				start = static_cast<float>(glfwGetTime());
+				double cylinderArea = cylinder.measure(obj);
+				float cylinderMs = (static_cast<float>(glfwGetTime()) - start) * 1000.f;
+
 				std::cout << "\tModel " << obj->getName() << std::endl;
-				std::cout << "\t\tSurface area inside " << boxSize << "-cm bounding box = " << modelAreaInside * 2.f << " cm^2" << std::endl;
-				totalAreaInside += modelAreaInside;
-				obj->setIndices(indsRet);
+				std::cout << "\t\tSurface area inside world-aligned box = " << boxArea * 2.f << " cm^2 [" << box.getLastCandidateCount() << " candidates, " << boxMs << " ms]" << std::endl;
+				std::cout << "\t\tSurface area inside cylinder (r = " << cylinder.getHalfExtents().x << ") = " << cylinderArea * 2.f << " cm^2 [" << cylinder.getLastCandidateCount() << " candidates, " << cylinderMs << " ms]" << std::endl;
 			}
-			std::cout << "Total area inside " << boxSize << "-cm bounding box = " << totalAreaInside * 2.f << " cm^2" << std::endl;
+		}
+
+		// Save what was measured: the selection, or the box's triangles if nothing is selected. Holding Alt
+		// cuts triangles to the box exactly, holding Ctrl writes OBJ instead of binary PLY.
+		if (key == GLFW_KEY_X && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			bool clip = GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_ALT);
+			bool obj = GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_CONTROL);
+
+			for (auto const &m : m_vpModels)
+			{
+				std::string name(m->getName());
+				name = name.substr(name.find_last_of("/\\") + 1);
+				name = name.substr(0, name.find_last_of('.')) + (clip ? ".clipped" : ".selection") + (obj ? ".obj" : ".ply");
+
+				MeshExporter exporter(name);
+				if (!exporter.write(m, m->hasSelection() ? m->getSelection() : m_pMeasurementBox->getTrianglesInside(m), clip, m_pMeasurementBox->getMin(), m_pMeasurementBox->getMax()))
+					continue;
+
+				std::cout << "Wrote " << exporter.getTriangleCount() << " triangles, " << exporter.getVertexCount() << " vertices to " << name;
+				std::cout << " [" << exporter.getSeconds() * 1000.0 << " ms, " << exporter.getTrianglesPerSecond() / 1e6 << " M triangles/s]" << std::endl;
+			}
+		}
+
+		// Selections only hide triangles, so undoing or clearing them is immediate
+		if (key == GLFW_KEY_BACKSPACE && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			bool undone = false;
+			for (auto const &obj : m_vpModels)
+				undone |= obj->undoSelection();
+			std::cout << (undone ? "Selection undone" : "Nothing to undo") << std::endl;
+		}
+
+		if (key == GLFW_KEY_DELETE && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			for (auto const &obj : m_vpModels)
+				obj->clearSelection();
+			std::cout << "Selection cleared" << std::endl;
+		}
+
+		// Measurement box: I/K, J/L and U/O step it along z, x and y; holding Alt resizes instead
+		bool resizeBox = GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_ALT);
+		if (key == GLFW_KEY_J)
+			moveMeasurementBox(glm::vec3(-MEASUREMENT_BOX_STEP, 0.f, 0.f), resizeBox);
+		if (key == GLFW_KEY_L)
+			moveMeasurementBox(glm::vec3(MEASUREMENT_BOX_STEP, 0.f, 0.f), resizeBox);
+		if (key == GLFW_KEY_U)
+			moveMeasurementBox(glm::vec3(0.f, -MEASUREMENT_BOX_STEP, 0.f), resizeBox);
+		if (key == GLFW_KEY_O)
+			moveMeasurementBox(glm::vec3(0.f, MEASUREMENT_BOX_STEP, 0.f), resizeBox);
+		if (key == GLFW_KEY_I)
+			moveMeasurementBox(glm::vec3(0.f, 0.f, -MEASUREMENT_BOX_STEP), resizeBox);
+		if (key == GLFW_KEY_K)
+			moveMeasurementBox(glm::vec3(0.f, 0.f, MEASUREMENT_BOX_STEP), resizeBox);
+
+		if (key == GLFW_KEY_F1 && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+			printStats();
+
+		// Cycle 0, 2, 4, ... up to what the driver supports
+		if (key == GLFW_KEY_M && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			m_iMSAASamples = m_iMSAASamples == 0 ? 2 : m_iMSAASamples * 2;
+			if (m_iMSAASamples > RenderTarget::getMaxSamples())
+				m_iMSAASamples = 0;
+			std::cout << "MSAA " << (m_iMSAASamples > 0 ? std::to_string(m_iMSAASamples) + "x" : "off") << std::endl;
+		}
+
+		if (key == GLFW_KEY_T && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			m_bDynamicResolution = !m_bDynamicResolution;
+			m_fRenderScale = 1.f;
+			std::cout << "Dynamic resolution " << (m_bDynamicResolution ? "on" : "off") << std::endl;
+		}
+
+		if (key == GLFW_KEY_F2 && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			m_bMultiDraw = !m_bMultiDraw;
+			std::cout << "Multi-draw " << (m_bMultiDraw ? "on" : "off") << std::endl;
+		}
+
+		if (key == GLFW_KEY_N && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			RenderPass *normals = getRenderPass("normals");
+			normals->enabled = !normals->enabled;
+			std::cout << "Normals pass " << (normals->enabled ? "on" : "off") << std::endl;
+		}
+
+		if (key == GLFW_KEY_Z && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			setDepthPrepass(!getDepthPrepass());
+			std::cout << "Depth pre-pass " << (getDepthPrepass() ? "on" : "off") << std::endl;
+		}
+
+		if (key == GLFW_KEY_E && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			m_bIdleMode = !m_bIdleMode;
+			std::cout << "Idle mode " << (m_bIdleMode ? "on (redraw on change)" : "off (continuous redraw)") << std::endl;
+		}
+
+		if (key == GLFW_KEY_B && event.type == BroadcastSystem::EVENT::KEY_PRESS)
+		{
+			m_bBackfaceCulling = !m_bBackfaceCulling;
+			std::cout << "Backface culling " << (m_bBackfaceCulling ? "on" : "off") << std::endl;
 		}
 
 		if (key == GLFW_KEY_RIGHT)
+		{
 			m_mat4WorldRotation = glm::rotate(m_mat4WorldRotation, glm::radians(1.f), glm::vec3(0.f, 1.f, 0.f));
+			m_bWorldRotationDirty = true;
+		}
 		if (key == GLFW_KEY_LEFT)
+		{
 			m_mat4WorldRotation = glm::rotate(m_mat4WorldRotation, glm::radians(-1.f), glm::vec3(0.f, 1.f, 0.f));
+			m_bWorldRotationDirty = true;
+		}
 
 		if (key == GLFW_KEY_KP_7)
 			g_pfCurrentEditValue = &g_vec3Ambient.r;
@@ -112,6 +345,7 @@ void Engine::receiveEvent(Object * obj, const int event, void * data)
 				*g_pfCurrentEditValue += g_fEditValueDelta;
 				if (*g_pfCurrentEditValue > 1.f)
 					*g_pfCurrentEditValue = 1.f;
+				g_uiMaterialVersion++;
 			}
 		}
 		if (key == GLFW_KEY_KP_SUBTRACT)
@@ -121,20 +355,54 @@ void Engine::receiveEvent(Object * obj, const int event, void * data)
 				*g_pfCurrentEditValue -= g_fEditValueDelta;
 				if (*g_pfCurrentEditValue < 0.f)
 					*g_pfCurrentEditValue = 0.f;
+				g_uiMaterialVersion++;
 			}
 		}
 	}
 
-	if (event == BroadcastSystem::EVENT::MOUSE_UNCLICK)
+	if (event.type == BroadcastSystem::EVENT::WINDOW_RESIZE)
+		resize(event.size.width, event.size.height);
+
+	if (event.type == BroadcastSystem::EVENT::MOUSE_CLICK)
+	{
+		m_fClickX = event.click.x;
+		m_fClickY = event.click.y;
+	}
+
+	if (event.type == BroadcastSystem::EVENT::MOUSE_MOVE)
+	{
+		if (event.move.buttonDown && GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_ALT))
+			dragMeasurementBox(event.move.dx, event.move.dy);
+	}
+
+	if (event.type == BroadcastSystem::EVENT::MOUSE_UNCLICK)
 	{
-		int button;
-		memcpy(&button, data, sizeof(button));
+		int button = event.click.button;
 
 		if (button == GLFW_MOUSE_BUTTON_LEFT || button == GLFW_MOUSE_BUTTON_RIGHT)
 		{
-			glm::vec3 rayFrom = m_pCamera->getPosition();
-			glm::vec3 rayTo = rayFrom + m_pCamera->getOrientation()[2] * CAST_RAY_LEN;
-			glm::vec3 payload[2] = { rayFrom, rayTo };
+			float x = event.click.x, y = event.click.y;
+
+			bool dragged = fabs(x - m_fClickX) > PICK_DRAG_THRESHOLD || fabs(y - m_fClickY) > PICK_DRAG_THRESHOLD;
+
+			if (dragged && GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_CONTROL))
+				pickRect(m_fClickX, m_fClickY, x, y);
+			else if (!dragged && !GLFWInputBroadcaster::getInstance().keyPressed(GLFW_KEY_LEFT_ALT))
+			{
+				float start = static_cast<float>(glfwGetTime());
+				PickResult result;
+				bool hit = pick(x, y, result);
+				float ms = (static_cast<float>(glfwGetTime()) - start) * 1000.f;
+
+				if (hit)
+				{
+					std::cout << "Picked " << result.model->getName() << " triangle " << result.triangle;
+					std::cout << " at (" << result.point.x << ", " << result.point.y << ", " << result.point.z << "), distance " << result.distance;
+					std::cout << " [" << ms << " ms]" << std::endl;
+				}
+				else
+					std::cout << "Pick missed [" << ms << " ms]" << std::endl;
+			}
 		}
 	}
 }
@@ -150,7 +418,8 @@ bool Engine::init()
 		return false;
 
 	GLFWInputBroadcaster::getInstance().init(m_pWindow);
-	GLFWInputBroadcaster::getInstance().attach(this);  // Register self with input broadcaster
+	// Register self with input broadcaster
+	GLFWInputBroadcaster::getInstance().attach(this, { BroadcastSystem::KEY_PRESS, BroadcastSystem::KEY_REPEAT, BroadcastSystem::MOUSE_CLICK, BroadcastSystem::MOUSE_MOVE, BroadcastSystem::MOUSE_UNCLICK, BroadcastSystem::WINDOW_REFRESH, BroadcastSystem::WINDOW_RESIZE });
 
 	init_lighting();
 	init_camera();
@@ -158,8 +427,7 @@ bool Engine::init()
 
 	m_pSphere = new Icosphere(4, glm::vec3(0.f, 0.f, 1.f), glm::vec3(1.f));
 
-	for (int i = 1; i < m_vstrArgs.size(); ++i)
-		m_vpModels.push_back(new ObjModel(m_vstrArgs[i]));
+	init_models();
 
 	return true;
 }
@@ -167,25 +435,62 @@ bool Engine::init()
 void Engine::mainLoop()
 {
 	m_fLastTime = static_cast<float>(glfwGetTime());
+	m_dLoopStatsStart = glfwGetTime();
 
 	// Main Rendering Loop
 	while (!glfwWindowShouldClose(m_pWindow)) {
-		// Calculate deltatime of current frame
+		// In idle mode the loop sleeps until input arrives unless something is moving by itself
+		bool animating = !m_bIdleMode || m_pCamera->isMoving() || m_pLightingSystem->getLightCount(LightingSystem::POINT) > 0;
+
+		if (animating)
+			GLFWInputBroadcaster::getInstance().poll();
+		else
+		{
+			double waitStart = glfwGetTime();
+			GLFWInputBroadcaster::getInstance().wait(m_pMeasurementJob || m_bMeasurementWaiting || m_pSurvey->isBusy() ? IDLE_PROGRESS_TIMEOUT : IDLE_WAIT_TIMEOUT);
+			m_dIdleWaitSeconds += glfwGetTime() - waitStart;
+		}
+
+		// Calculate deltatime of current frame; time spent asleep doesn't count
 		float newTime = static_cast<float>(glfwGetTime());
-		m_fDeltaTime = newTime - m_fLastTime;
+		m_fDeltaTime = animating ? newTime - m_fLastTime : 0.f;
 		m_fLastTime = newTime;
 
-		// Poll input events first
-		GLFWInputBroadcaster::getInstance().poll();
+		// GL work handed back by background jobs
+		if (JobSystem::getInstance().runMainThreadJobs() > 0)
+			m_nSceneVersion++;
+		updateMeasurementJob();
 
 		update(m_fDeltaTime);
 
+		// Redraw only when something that shows on screen has changed since the last frame
+		// Once the scene settles, a frame drawn at reduced resolution is redrawn at full resolution
+		unsigned int sceneVersion = getSceneVersion();
+		bool settled = !animating && sceneVersion == m_nDrawnSceneVersion;
+		if (settled && !m_bLastFrameScaled)
+		{
+			m_nIdleWakeups++;
+			continue;
+		}
+
+		m_bFullResolutionFrame = settled;
 		render();
+		m_nDrawnSceneVersion = sceneVersion;
+		m_nFramesDrawn++;
 
 		// Flip buffers and render to screen
 		glfwSwapBuffers(m_pWindow);
 	}
 
+	// The job reads the models, so it has to stop before anything is torn down
+	if (m_pMeasurementJob)
+	{
+		m_pMeasurementJob->cancel();
+		m_pMeasurementJob->wait();
+		m_pMeasurementJob.reset();
+	}
+	releaseMeasurementScans();
+
 	glfwTerminate();
 }
 
@@ -193,68 +498,503 @@ void Engine::update(float dt)
 {
 	m_pCamera->update(dt);
 
-	for (auto &pl : m_pLightingSystem->pLights)
-	{
-		float step = 180.f * dt;
-		pl.position = glm::vec3(glm::rotate(glm::mat4(), glm::radians(step), glm::vec3(0.f, 1.f, 0.f)) * glm::vec4(pl.position, 1.f));
-		pl.diffuse = (glm::normalize(pl.position) + glm::vec3(1.f)) / glm::vec3(2.f);
-		pl.specular = (glm::normalize(pl.position) + glm::vec3(1.f)) / glm::vec3(2.f);
-	}
+	m_pLightingSystem->orbitPointLights(glm::radians(180.f * dt));
+
+	// Bring every world transform up to date in one pass, then refresh the moved models
+	SceneGraph::getInstance().update();
+	updateModelComponents();
 
-	// Create camera transformations
+	// Camera transformations are cached; only rebuild ours and re-upload when the camera or the world moved
 	glm::mat4 view = m_pCamera->getViewMatrix();
-	glm::mat4 projection = glm::perspective(
-		glm::radians(m_pCamera->getZoom()),
-		static_cast<float>(m_iWidth) / static_cast<float>(m_iHeight),
-		0.1f,
-		1000.0f
-		);
-
-	for (auto &shader : m_vpShaders)
+	if (m_pCamera->getVersion() != m_nCameraVersion || m_bWorldRotationDirty)
 	{
-		shader->use();
-
-		glUniformMatrix4fv(glGetUniformLocation(shader->m_nProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-		glUniformMatrix4fv(glGetUniformLocation(shader->m_nProgram, "worldRotation"), 1, GL_FALSE, glm::value_ptr(m_mat4WorldRotation));
-		glUniformMatrix4fv(glGetUniformLocation(shader->m_nProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-		
-		if (shader == m_pShaderLighting)
-			m_pLightingSystem->update(view, shader);
+		glm::mat4 projection = m_pCamera->getProjectionMatrix();
+		m_mat4ViewProjection = m_pCamera->getViewProjectionMatrix() * m_mat4WorldRotation;
+
+		// One upload serves every program bound to the FrameUniforms block
+		glBindBuffer(GL_UNIFORM_BUFFER, m_glFrameUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0 * sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(view));
+		glBufferSubData(GL_UNIFORM_BUFFER, 1 * sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(projection));
+		glBufferSubData(GL_UNIFORM_BUFFER, 2 * sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(m_mat4WorldRotation));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		m_nCameraVersion = m_pCamera->getVersion();
+		m_bWorldRotationDirty = false;
+		m_nViewVersion++;
 	}
 
+	// Load and evict scans for the new view; the camera is taken back to scene space with the frustum
+	glm::vec3 sceneCamera(glm::inverse(m_mat4WorldRotation) * glm::vec4(m_pCamera->getPosition(), 1.f));
+	m_pSurvey->update(Frustum(m_mat4ViewProjection), sceneCamera, m_pArena);
+
+	m_pLightingSystem->update(view, m_pShaderLighting);
+
 	Shader::off();
 }
 
 void Engine::render()
 {
+	// Nothing to draw into while minimised
+	if (m_iFramebufferWidth <= 0 || m_iFramebufferHeight <= 0)
+		return;
+
+	// The scene goes into the offscreen target, at a fraction of the window's resolution if frames run long
+	float scale = m_bFullResolutionFrame ? 1.f : getQuantizedRenderScale();
+	int width = std::max(1, static_cast<int>(m_iFramebufferWidth * scale));
+	int height = std::max(1, static_cast<int>(m_iFramebufferHeight * scale));
+	if (!m_pRenderTarget->resize(width, height, m_iMSAASamples))
+	{
+		// Fall back to no MSAA rather than drawing nothing
+		m_iMSAASamples = 0;
+		m_pRenderTarget->resize(width, height, 0);
+	}
+	m_pRenderTarget->bind();
+	m_fTimerScales[m_nFrameCount % 2] = scale;
+	glBeginQuery(GL_TIME_ELAPSED, m_glTimerQueries[m_nFrameCount % 2]);
+
 	// OpenGL options
-	glEnable(GL_DEPTH_TEST);
 	glEnable(GL_MULTISAMPLE);
+	if (m_bBackfaceCulling)
+		glEnable(GL_CULL_FACE);
+	else
+		glDisable(GL_CULL_FACE);
 
 	// Background Fill Color
 	glClearColor(0.25f, 0.25f, 0.25f, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	for (auto& shader : m_vpShaders)
+	cullModels();
+
+	float submitStart = static_cast<float>(glfwGetTime());
+
+	GLuint currentProgram = 0;
+
+	for (auto const &pass : m_vRenderPasses)
 	{
-		shader->use();
+		if (!pass.enabled)
+			continue;
+
+		pass.apply();
+
+		// Passes are sorted by program, so consecutive passes can skip the switch
+		if (pass.shader->m_nProgram != currentProgram)
+		{
+			pass.shader->use();
+			currentProgram = pass.shader->m_nProgram;
+			m_frameStats.programSwitches++;
+		}
+
+		//m_pLightingSystem->draw(*pass.shader);
 
-		//m_pLightingSystem->draw(*shader);
+		//m_pSphere->draw(*pass.shader);
 
-		//m_pSphere->draw(*shader);
+		if (pass.useMaterial)
+			uploadMaterial(pass.shader);
 
+		if (pass.countFragments)
+			glBeginQuery(m_glFragmentQueryTarget, m_glFragmentQueries[m_nFrameCount % 2]);
 
-		glUniform3fv(glGetUniformLocation(shader->m_nProgram, "material.ambient"), 1, glm::value_ptr(g_vec3Ambient));
-		glUniform3fv(glGetUniformLocation(shader->m_nProgram, "material.diffuse"), 1, glm::value_ptr(g_vec3Diffuse));
-		glUniform3fv(glGetUniformLocation(shader->m_nProgram, "material.specular"), 1, glm::value_ptr(g_vec3Specular));
-		glUniform3fv(glGetUniformLocation(shader->m_nProgram, "material.emissive"), 1, glm::value_ptr(g_vec3Emissive));
-		glUniform1f(glGetUniformLocation(shader->m_nProgram, "material.shininess"), g_fShininess);
+		m_frameStats.drawCalls += m_pArena->draw(*pass.shader, m_bMultiDraw);
 
-		for (auto const &m : m_vpModels)
-			m->draw(*shader);
+		if (pass.countFragments)
+			glEndQuery(m_glFragmentQueryTarget);
 	}
 
+	// Restore default state so the next glClear writes depth and color
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+	m_pShaderBox->use();
+	m_pMeasurementBox->draw();
+
 	Shader::off();
+
+	m_frameStats.submitTimeMs = (static_cast<float>(glfwGetTime()) - submitStart) * 1000.f;
+
+	m_pRenderTarget->blitToScreen(m_iFramebufferWidth, m_iFramebufferHeight);
+	glEndQuery(GL_TIME_ELAPSED);
+	m_bLastFrameScaled = scale < 1.f;
+
+	// Pick up last frame's fragment count and GPU time if the GPU has finished with them
+	GLuint prevQuery = m_glFragmentQueries[(m_nFrameCount + 1) % 2];
+	GLint available = 0;
+	if (m_nFrameCount > 0)
+		glGetQueryObjectiv(prevQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available)
+		glGetQueryObjectui64v(prevQuery, GL_QUERY_RESULT, &m_frameStats.fragmentsShaded);
+
+	GLuint prevTimer = m_glTimerQueries[(m_nFrameCount + 1) % 2];
+	available = 0;
+	if (m_nFrameCount > 0)
+		glGetQueryObjectiv(prevTimer, GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available)
+	{
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(prevTimer, GL_QUERY_RESULT, &ns);
+		m_frameStats.gpuTimeMs = static_cast<float>(ns) / 1e6f;
+		adaptRenderScale(m_frameStats.gpuTimeMs, m_fTimerScales[(m_nFrameCount + 1) % 2]);
+	}
+
+	m_nFrameCount++;
+}
+
+// Ray through a window position; clipToModel is the inverse of the model's full clip transform
+void Engine::getPickRay(float x, float y, glm::mat4 clipToModel, glm::vec3 &origin, glm::vec3 &direction)
+{
+	float ndcX = 2.f * x / static_cast<float>(m_iWidth) - 1.f;
+	float ndcY = 1.f - 2.f * y / static_cast<float>(m_iHeight);
+
+	glm::vec4 nearPt(clipToModel * glm::vec4(ndcX, ndcY, -1.f, 1.f));
+	glm::vec4 farPt(clipToModel * glm::vec4(ndcX, ndcY, 1.f, 1.f));
+
+	origin = glm::vec3(nearPt) / nearPt.w;
+	direction = glm::normalize(glm::vec3(farPt) / farPt.w - origin);
+}
+
+bool Engine::pick(float x, float y, PickResult &result)
+{
+	result.model = NULL;
+	result.distance = FLT_MAX;
+
+	glm::vec3 camPos(m_pCamera->getPosition());
+
+	for (auto const &m : m_vpModels)
+	{
+		// Scans out of the arena aren't on screen
+		if (!m->isResident())
+			continue;
+
+		glm::vec3 origin, direction;
+		getPickRay(x, y, glm::inverse(m_mat4ViewProjection * m->getModelMatrix()), origin, direction);
+
+		BVH::Hit hit;
+		if (!m->intersectRay(origin, direction, hit))
+			continue;
+
+		// Compare hits across models in world space
+		glm::vec3 worldPt(m_mat4WorldRotation * m->getModelMatrix() * glm::vec4(origin + direction * hit.t, 1.f));
+		float dist = glm::length(worldPt - camPos);
+
+		if (dist < result.distance)
+		{
+			result.model = m;
+			result.triangle = hit.triangle;
+			result.point = worldPt;
+			result.distance = dist;
+		}
+	}
+
+	return result.model != NULL;
+}
+
+// Rubber-band selection: a grid of rays over the rectangle, traced four at a time. Each ray keeps its
+// nearest hit over all models, so triangles hidden behind another scan aren't picked, and every model
+// hit gets the triangles as its selection, undoable with Backspace.
+void Engine::pickRect(float x0, float y0, float x1, float y1)
+{
+	float start = static_cast<float>(glfwGetTime());
+
+	int left = static_cast<int>(std::min(x0, x1)), right = static_cast<int>(std::max(x0, x1));
+	int top = static_cast<int>(std::min(y0, y1)), bottom = static_cast<int>(std::max(y0, y1));
+
+	std::vector<ObjModel*> models;
+	std::vector<glm::mat4> clipToModels, modelToWorlds;
+	for (auto const &m : m_vpModels)
+	{
+		if (!m->isResident())
+			continue;
+
+		models.push_back(m);
+		clipToModels.push_back(glm::inverse(m_mat4ViewProjection * m->getModelMatrix()));
+		modelToWorlds.push_back(m_mat4WorldRotation * m->getModelMatrix());
+	}
+
+	glm::vec3 camPos(m_pCamera->getPosition());
+	std::vector<std::vector<bool>> selected(models.size());
+	size_t nRays = 0;
+
+	for (int y = top; y <= bottom; y += RUBBER_BAND_RAY_SPACING)
+	{
+		for (int x = left; x <= right; x += 4 * RUBBER_BAND_RAY_SPACING)
+		{
+			size_t nearestModel[4];
+			unsigned int nearestTriangle[4];
+			float nearestDistance[4] = { FLT_MAX, FLT_MAX, FLT_MAX, FLT_MAX };
+
+			for (size_t i = 0; i < models.size(); ++i)
+			{
+				BVH::Ray rays[4];
+				for (int r = 0; r < 4; ++r)
+					getPickRay(static_cast<float>(std::min(x + r * RUBBER_BAND_RAY_SPACING, right)), static_cast<float>(y), clipToModels[i], rays[r].origin, rays[r].direction);
+
+				BVH::Hit hits[4];
+				models[i]->intersectRays4(rays, hits);
+
+				// Compare hits across models in world space
+				for (int r = 0; r < 4; ++r)
+				{
+					if (!hits[r].valid())
+						continue;
+
+					glm::vec3 worldPt(modelToWorlds[i] * glm::vec4(rays[r].origin + rays[r].direction * hits[r].t, 1.f));
+					float dist = glm::length(worldPt - camPos);
+					if (dist < nearestDistance[r])
+					{
+						nearestModel[r] = i;
+						nearestTriangle[r] = hits[r].triangle;
+						nearestDistance[r] = dist;
+					}
+				}
+
+				nRays += 4;
+			}
+
+			for (int r = 0; r < 4; ++r)
+			{
+				if (nearestDistance[r] == FLT_MAX)
+					continue;
+
+				std::vector<bool> &triangles = selected[nearestModel[r]];
+				if (triangles.empty())
+					triangles.resize(models[nearestModel[r]]->getIndices().size() / 3, false);
+				triangles[nearestTriangle[r]] = true;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < models.size(); ++i)
+	{
+		if (selected[i].empty())
+			continue;
+
+		models[i]->setSelection(selected[i]);
+		std::cout << "\tModel " << models[i]->getName() << ": " << models[i]->getSelectedTriangleCount() << " triangles selected" << std::endl;
+	}
+
+	std::cout << "Rubber-band selection traced " << nRays << " rays in " << (static_cast<float>(glfwGetTime()) - start) * 1000.f << " ms" << std::endl;
+}
+
+// Models get an entity with their mesh, a copy of their world transform and their world bounds
+void Engine::addModelComponents(ObjModel *model)
+{
+	Entity e = m_Entities.create();
+	m_RenderMeshes.add(e, model);
+
+	// World versions start at 1, so this is filled in by the next updateModelComponents
+	ModelTransform transform;
+	transform.version = 0;
+	m_ModelTransforms.add(e, transform);
+
+	m_ModelBounds.add(e, ModelBounds());
+	m_mapModelEntities[model] = e;
+}
+
+void Engine::removeModelComponents(ObjModel *model)
+{
+	auto it = m_mapModelEntities.find(model);
+	if (it == m_mapModelEntities.end())
+		return;
+
+	m_RenderMeshes.remove(it->second);
+	m_ModelTransforms.remove(it->second);
+	m_ModelBounds.remove(it->second);
+	m_Entities.release(it->second);
+	m_mapModelEntities.erase(it);
+}
+
+// Survey callbacks, on the main thread as scans enter and leave memory
+void Engine::onScanLoaded(ObjModel *model)
+{
+	m_vpModels.push_back(model);
+	addModelComponents(model);
+	m_pMeasurementBox->addModel(model);
+
+	m_bCullValid = false;
+	m_nSceneVersion++;
+
+	if (m_bMeasurementWaiting)
+		startMeasurementJob();
+}
+
+void Engine::onScanDropped(ObjModel *model)
+{
+	m_vpModels.erase(std::remove(m_vpModels.begin(), m_vpModels.end(), model), m_vpModels.end());
+	m_vpVisibleModels.erase(std::remove(m_vpVisibleModels.begin(), m_vpVisibleModels.end(), model), m_vpVisibleModels.end());
+	removeModelComponents(model);
+	m_pMeasurementBox->removeModel(model);
+
+	m_bCullValid = false;
+	m_nSceneVersion++;
+}
+
+// Pushes moved models to the arena and refreshes their transform and bounds components
+void Engine::updateModelComponents()
+{
+	for (size_t i = 0; i < m_RenderMeshes.size(); ++i)
+	{
+		ObjModel *m = m_RenderMeshes[i];
+		m->syncTransform();
+
+		unsigned int version = m->getWorldVersion();
+		if (version == m_ModelTransforms[i].version)
+			continue;
+
+		glm::mat4 world(m->getModelMatrix());
+		m_ModelTransforms[i].world = world;
+		m_ModelTransforms[i].version = version;
+		m_nSceneVersion++;
+
+		float scale = std::max(glm::length(glm::vec3(world[0])), std::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+		m_ModelBounds[i].center = glm::vec3(world * glm::vec4(m->getBSCenter(), 1.f));
+		m_ModelBounds[i].radius = m->getBSRadius() * scale;
+	}
+}
+
+// Gather the models whose bounds touch the view frustum. While the view, the selections and the
+// culling options stay the same, last frame's visible set and draw batch are still valid.
+void Engine::cullModels()
+{
+	unsigned int drawVersion = 0;
+	for (auto const &m : m_vpModels)
+		drawVersion += m->getDrawVersion();
+
+	unsigned int nPasses = 0;
+	for (auto const &pass : m_vRenderPasses)
+		if (pass.enabled)
+			nPasses++;
+
+	m_frameStats.drawCalls = 0;
+	m_frameStats.programSwitches = 0;
+	m_frameStats.submitTimeMs = 0.f;
+
+	if (m_bCullValid && m_nCullViewVersion == m_nViewVersion && m_nCullDrawVersion == drawVersion && m_bCullBackface == m_bBackfaceCulling && m_nCullPasses == nPasses)
+	{
+		m_frameStats.cullingReused = true;
+		return;
+	}
+
+	m_bCullValid = true;
+	m_nCullViewVersion = m_nViewVersion;
+	m_nCullDrawVersion = drawVersion;
+	m_bCullBackface = m_bBackfaceCulling;
+	m_nCullPasses = nPasses;
+
+	m_vpVisibleModels.clear();
+	GLuint64 fragmentsShaded = m_frameStats.fragmentsShaded;
+	memset(&m_frameStats, 0, sizeof(m_frameStats));
+	m_frameStats.fragmentsShaded = fragmentsShaded;
+
+	// Bounding spheres first, in one sweep over the dense bounds; only models in view get a job
+	Frustum sceneFrustum(m_mat4ViewProjection);
+	size_t nModels = m_ModelBounds.size();
+	m_vbInFrustum.resize(nModels);
+	for (size_t i = 0; i < nModels; ++i)
+		m_vbInFrustum[i] = m_RenderMeshes[i]->isResident() && sceneFrustum.intersectsSphere(m_ModelBounds[i].center, m_ModelBounds[i].radius);
+
+	// One job per model; each only touches its own meshlet state
+	glm::vec3 eye(m_pCamera->getPosition());
+	JobSystem &jobs = JobSystem::getInstance();
+	std::vector<int> visibleTris(nModels, -1);
+	std::vector<JobSystem::JobHandle> culls;
+	for (size_t i = 0; i < nModels; ++i)
+	{
+		if (!m_vbInFrustum[i])
+			continue;
+
+		ObjModel *m = m_RenderMeshes[i];
+		glm::mat4 world(m_ModelTransforms[i].world);
+		int *result = &visibleTris[i];
+		culls.push_back(jobs.submit([this, m, world, eye, result]() {
+			// Test in model space so the stored bounds can be used as-is
+			Frustum frustum(m_mat4ViewProjection * world);
+
+			if (!frustum.intersectsAABB(m->getBBMin(), m->getBBMax()))
+				return;
+
+			glm::vec3 camPos(glm::inverse(m_mat4WorldRotation * world) * glm::vec4(eye, 1.f));
+			*result = static_cast<int>(m->cullMeshlets(frustum, camPos, m_bBackfaceCulling));
+		}));
+	}
+	jobs.wait(culls);
+
+	// Gather in model order so the draw batch stays stable
+	for (size_t i = 0; i < nModels; ++i)
+	{
+		ObjModel *m = m_RenderMeshes[i];
+
+		if (visibleTris[i] < 0)
+		{
+			m_frameStats.modelsCulled++;
+			m_frameStats.meshletsCulled += m->getMeshletCount();
+			continue;
+		}
+
+		if (visibleTris[i] > 0)
+		{
+			m_vpVisibleModels.push_back(m);
+			m_frameStats.modelsDrawn++;
+		}
+		else
+			m_frameStats.modelsCulled++;
+
+		m_frameStats.meshletsDrawn += m->getVisibleMeshletCount();
+		m_frameStats.meshletsCulled += m->getMeshletCount() - m->getVisibleMeshletCount();
+		m_frameStats.trianglesSubmitted += visibleTris[i];
+	}
+
+	// Geometry is submitted once per enabled pass
+	m_frameStats.trianglesSubmitted *= nPasses;
+
+	// Build the frame's draw batch once; every shader replays it
+	m_pArena->clearDraws();
+	for (auto const &m : m_vpVisibleModels)
+		m->queueDraws();
+	m_pArena->commitDraws();
+}
+
+Engine::FrameStats Engine::getFrameStats()
+{
+	return m_frameStats;
+}
+
+void Engine::printStats()
+{
+	std::cout << "Frame stats:" << std::endl;
+	std::cout << "\tModels drawn: " << m_frameStats.modelsDrawn << std::endl;
+	std::cout << "\tModels culled: " << m_frameStats.modelsCulled << std::endl;
+	std::cout << "\tMeshlets drawn: " << m_frameStats.meshletsDrawn << std::endl;
+	std::cout << "\tMeshlets culled: " << m_frameStats.meshletsCulled << std::endl;
+	std::cout << "\tTriangles submitted: " << m_frameStats.trianglesSubmitted << std::endl;
+	std::cout << "\tDraw calls: " << m_frameStats.drawCalls << (m_bMultiDraw ? (m_pArena->hasIndirect() ? " (indirect multi-draw)" : " (base-vertex multi-draw)") : " (per-range draws)") << std::endl;
+	std::cout << "\tProgram switches: " << m_frameStats.programSwitches << std::endl;
+	std::cout << "\tLit fragments: " << m_frameStats.fragmentsShaded << (m_glFragmentQueryTarget == GL_SAMPLES_PASSED ? " (samples passed)" : " (fragment shader invocations)") << std::endl;
+	std::cout << "\tDepth pre-pass: " << (getDepthPrepass() ? "on" : "off") << std::endl;
+	std::cout << "\tDraw submission: " << m_frameStats.submitTimeMs << " ms" << std::endl;
+	std::cout << "\tGPU frame time: " << m_frameStats.gpuTimeMs << " ms (target " << DYNAMIC_RES_TARGET_MS << " ms)" << std::endl;
+	std::cout << "\tRender target: " << m_pRenderTarget->getWidth() << "x" << m_pRenderTarget->getHeight() << " for a " << m_iFramebufferWidth << "x" << m_iFramebufferHeight << " window";
+	std::cout << ", MSAA " << m_iMSAASamples << "x, dynamic resolution " << (m_bDynamicResolution ? "on" : "off") << std::endl;
+	std::cout << "\tCulling: " << (m_frameStats.cullingReused ? "reused, view unchanged" : "recomputed") << " (camera version " << m_pCamera->getVersion() << ")" << std::endl;
+	std::cout << "\tScene graph: " << SceneGraph::getInstance().getLastUpdateCount() << " of " << SceneGraph::getInstance().getNodeCount() << " world transforms recomputed last update" << std::endl;
+	std::cout << "\tSurvey: " << m_pSurvey->getScanCount() << " scans, " << m_pSurvey->getCount(Survey::RESIDENT) << " resident, " << m_pSurvey->getCount(Survey::LOADED) << " in memory only, " << m_pSurvey->getCount(Survey::LOADING) << " loading" << std::endl;
+	std::cout << "\t\tMemory " << (m_pSurvey->getMemoryUsed() >> 20) << " of " << (m_pSurvey->getMemoryBudget() >> 20) << " MB, arena " << (m_pSurvey->getGPUUsed() >> 20) << " of " << (m_pSurvey->getGPUBudget() >> 20) << " MB";
+	std::cout << " (" << (m_pArena->getLiveBytes() >> 20) << " MB live), " << m_pSurvey->getLoadCount() << " loads (" << m_pSurvey->getPrefetchCount() << " prefetched), " << m_pSurvey->getEvictionCount() << " evictions" << std::endl;
+	std::cout << "\tInput events: " << GLFWInputBroadcaster::getInstance().getDispatchedCount() << " dispatched, ";
+	std::cout << GLFWInputBroadcaster::getInstance().getCoalescedCount() << " mouse moves coalesced, " << GLFWInputBroadcaster::getInstance().getDroppedCount() << " dropped" << std::endl;
+
+	// Main loop activity since the last report
+	double elapsed = glfwGetTime() - m_dLoopStatsStart;
+	std::cout << "\tMain loop: " << m_nFramesDrawn << " frames drawn, " << m_nIdleWakeups << " wakeups without a redraw in " << elapsed << " s (idle mode " << (m_bIdleMode ? "on" : "off") << ")" << std::endl;
+	std::cout << "\tMain thread asleep " << (elapsed > 0.0 ? 100.0 * m_dIdleWaitSeconds / elapsed : 0.0) << "% of the time" << std::endl;
+	m_nFramesDrawn = m_nIdleWakeups = 0;
+	m_dIdleWaitSeconds = 0.0;
+	m_dLoopStatsStart = glfwGetTime();
+
+	// Job counts since the last report
+	JobSystem::Stats jobStats(JobSystem::getInstance().getStats());
+	std::cout << "\tJobs: " << jobStats.jobsRun << " run on " << JobSystem::getInstance().getThreadCount() << " threads, " << jobStats.mainThreadJobsRun << " on the main thread" << std::endl;
+	std::cout << "\tSteals: " << jobStats.steals << " (" << jobStats.failedSteals << " failed rounds), worker idle " << jobStats.idleMs << " ms" << std::endl;
+	JobSystem::getInstance().resetStats();
 }
 
 GLFWwindow* Engine::init_gl_context(std::string winName)
@@ -263,9 +1003,8 @@ GLFWwindow* Engine::init_gl_context(std::string winName)
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
-	glfwWindowHint(GLFW_SAMPLES, 16);
-	//glfwWindowHint(GLFW_SAMPLES, 4);
+	glfwWindowHint(GLFW_RESIZABLE, GL_TRUE);
+	glfwWindowHint(GLFW_SAMPLES, 0);	// multisampling happens in the offscreen render target
 	GLFWwindow* mWindow = glfwCreateWindow(m_iWidth, m_iHeight, winName.c_str(), nullptr, nullptr);
 	// Check for Valid Context
 	if (mWindow == nullptr)
@@ -283,8 +1022,11 @@ GLFWwindow* Engine::init_gl_context(std::string winName)
 	fprintf(stderr, "OpenGL %s\n", glGetString(GL_VERSION));
 	GLenum err = glGetError(); // clear GL_INVALID_ENUM error from glewInit
 
-	// Define the viewport dimensions
-	glViewport(0, 0, m_iWidth, m_iHeight);
+	// Define the viewport dimensions; the framebuffer may be larger than the window on high-DPI screens
+	glfwGetFramebufferSize(mWindow, &m_iFramebufferWidth, &m_iFramebufferHeight);
+	glViewport(0, 0, m_iFramebufferWidth, m_iFramebufferHeight);
+
+	m_pRenderTarget = new RenderTarget();
 
 	return mWindow;
 }
@@ -293,7 +1035,7 @@ GLFWwindow* Engine::init_gl_context(std::string winName)
 void Engine::init_lighting()
 {
 	m_pLightingSystem = new LightingSystem();
-	GLFWInputBroadcaster::getInstance().attach(m_pLightingSystem);
+	GLFWInputBroadcaster::getInstance().attach(m_pLightingSystem, { BroadcastSystem::KEY_PRESS });
 
 	// Directional light
 	m_pLightingSystem->addDirectLight(glm::vec3(1.f)
@@ -315,30 +1057,298 @@ void Engine::init_lighting()
 void Engine::init_camera()
 {
 	m_pCamera = new Camera(glm::vec3(0.f, 0.f, 15.f));
-	GLFWInputBroadcaster::getInstance().attach(m_pCamera);
+	m_pCamera->setAspect(static_cast<float>(m_iFramebufferWidth) / static_cast<float>(m_iFramebufferHeight));
+	m_pLightingSystem->setCameraNode(m_pCamera->getNode());
+	GLFWInputBroadcaster::getInstance().attach(m_pCamera, { BroadcastSystem::KEY_PRESS, BroadcastSystem::KEY_UNPRESS, BroadcastSystem::MOUSE_MOVE, BroadcastSystem::MOUSE_SCROLL });
+}
+
+// Load the OBJ files named on the command line into the shared geometry arena.
+// "--replicate N" lays out N copies of each model in a grid, for draw submission benchmarks.
+void Engine::init_models()
+{
+	m_pArena = new GeometryArena();
+
+	int replicas = 1;
+	size_t memoryMB = SURVEY_DEFAULT_MEMORY_MB, gpuMB = SURVEY_DEFAULT_GPU_MB;
+	std::vector<std::string> inputs;
+
+	for (size_t i = 1; i < m_vstrArgs.size(); ++i)
+	{
+		if (m_vstrArgs[i] == "--replicate" && i + 1 < m_vstrArgs.size())
+			replicas = std::max(1, atoi(m_vstrArgs[++i].c_str()));
+		else if (m_vstrArgs[i] == "--memory-budget" && i + 1 < m_vstrArgs.size())
+			memoryMB = std::max(1, atoi(m_vstrArgs[++i].c_str()));
+		else if (m_vstrArgs[i] == "--gpu-budget" && i + 1 < m_vstrArgs.size())
+			gpuMB = std::max(1, atoi(m_vstrArgs[++i].c_str()));
+		else
+			inputs.push_back(m_vstrArgs[i]);
+	}
+
+	// Starts as the original 50-cm box at the origin; scans join it as they are loaded
+	m_pMeasurementBox = new MeasurementBox(glm::vec3(0.f, 0.f, -50.f), glm::vec3(50.f, 50.f, 0.f));
+
+	// Only the scans' bounds are read here; geometry streams in from update() as scans come into view
+	m_pSurvey = new Survey(memoryMB << 20, gpuMB << 20);
+	m_pSurvey->setCallbacks([this](ObjModel *model) { onScanLoaded(model); }, [this](ObjModel *model) { onScanDropped(model); });
+	m_pSurvey->open(inputs, replicas);
+
+	updateAreaReadout();
+}
+
+// Step the box along a scene axis, or grow/shrink it from its max corner
+void Engine::moveMeasurementBox(glm::vec3 delta, bool resize)
+{
+	float start = static_cast<float>(glfwGetTime());
+
+	if (resize)
+		m_pMeasurementBox->resize(delta);
+	else
+		m_pMeasurementBox->translate(delta);
+
+	float ms = (static_cast<float>(glfwGetTime()) - start) * 1000.f;
+	std::cout << "Measurement box updated: " << m_pMeasurementBox->getLastUpdateCount() << " triangles re-tested in " << ms << " ms" << std::endl;
+
+	updateAreaReadout();
+}
+
+// Alt-drag moves the box in the screen plane, scaled so it tracks the cursor at the box's depth
+void Engine::dragMeasurementBox(float dx, float dy)
+{
+	glm::mat4 cameraToWorld(glm::inverse(m_pCamera->getViewMatrix()));
+	glm::mat4 worldToScene(glm::inverse(m_mat4WorldRotation));
+
+	glm::vec3 center((m_pMeasurementBox->getMin() + m_pMeasurementBox->getMax()) * 0.5f);
+	float depth = glm::length(glm::vec3(m_mat4WorldRotation * glm::vec4(center, 1.f)) - m_pCamera->getPosition());
+	float unitsPerPixel = 2.f * depth * tan(glm::radians(m_pCamera->getZoom()) * 0.5f) / static_cast<float>(m_iHeight);
+
+	glm::vec3 right(worldToScene * cameraToWorld[0]), up(worldToScene * cameraToWorld[1]);
+
+	m_pMeasurementBox->translate((right * dx + up * dy) * unitsPerPixel);
+
+	updateAreaReadout();
+}
+
+// Cursor positions are in window coordinates, which can differ from the framebuffer's on high-DPI screens
+void Engine::resize(int framebufferWidth, int framebufferHeight)
+{
+	m_iFramebufferWidth = framebufferWidth;
+	m_iFramebufferHeight = framebufferHeight;
+	glfwGetWindowSize(m_pWindow, &m_iWidth, &m_iHeight);
+
+	if (framebufferWidth > 0 && framebufferHeight > 0)
+		m_pCamera->setAspect(static_cast<float>(framebufferWidth) / static_cast<float>(framebufferHeight));
+}
+
+// Pixel count, and so fill cost, goes with the square of the scale
+void Engine::adaptRenderScale(float gpuMs, float measuredScale)
+{
+	if (!m_bDynamicResolution || gpuMs <= 0.f)
+		return;
+
+	float estimate = measuredScale * sqrt(DYNAMIC_RES_TARGET_MS / gpuMs);
+	m_fRenderScale += (estimate - m_fRenderScale) * DYNAMIC_RES_SMOOTHING;
+	m_fRenderScale = glm::clamp(m_fRenderScale, DYNAMIC_RES_MIN_SCALE, 1.f);
+}
+
+// Snapped to steps so the target isn't reallocated for every small change
+float Engine::getQuantizedRenderScale()
+{
+	if (!m_bDynamicResolution)
+		return 1.f;
+
+	float steps = floor(m_fRenderScale / DYNAMIC_RES_STEP + 0.5f);
+	return glm::clamp(steps * DYNAMIC_RES_STEP, DYNAMIC_RES_MIN_SCALE, 1.f);
+}
+
+// Sum of everything that changes what is drawn; each part only ever grows. Models coming and going and
+// moving bump m_nSceneVersion, so nothing depends on which models are live.
+unsigned int Engine::getSceneVersion()
+{
+	return m_nSceneVersion + m_nViewVersion + ObjModel::getDrawVersionTotal();
+}
+
+// Next scans off the queue, as many as fit in a share of the memory budget but always at least one.
+// Scans already in memory cost nothing and were queued last, so they are measured first.
+void Engine::startMeasurementBatch()
+{
+	m_pSurvey->unpin(m_vuiMeasurementScans);
+	m_vuiMeasurementScans.clear();
+
+	size_t budget = static_cast<size_t>(m_pSurvey->getMemoryBudget() * MEASUREMENT_BATCH_BUDGET);
+	size_t bytes = 0;
+	while (!m_vuiMeasurementQueue.empty())
+	{
+		unsigned int scan = m_vuiMeasurementQueue.back();
+		size_t cost = m_pSurvey->getScan(scan).model ? 0 : m_pSurvey->getMemoryEstimate(scan);
+		if (!m_vuiMeasurementScans.empty() && bytes + cost > budget)
+			break;
+
+		m_vuiMeasurementScans.push_back(scan);
+		m_vuiMeasurementQueue.pop_back();
+		bytes += cost;
+	}
+
+	m_pSurvey->pin(m_vuiMeasurementScans);
+	m_bMeasurementWaiting = true;
+	m_iMeasurementPercent = -1;
+	startMeasurementJob();
+}
+
+// Once the last scan of the batch has arrived
+void Engine::startMeasurementJob()
+{
+	if (!m_pSurvey->isLoaded(m_vuiMeasurementScans))
+		return;
+
+	std::vector<ObjModel*> models;
+	for (auto const &scan : m_vuiMeasurementScans)
+		models.push_back(m_pSurvey->getScan(scan).model);
+
+	m_bMeasurementWaiting = false;
+	m_pMeasurementJob = std::make_shared<MeasurementJob>(models, m_vec3MeasurementMin, m_vec3MeasurementMax);
+	m_pMeasurementJob->start();
+}
+
+// Show the background measurement's progress, collect each batch's results as it finishes, and
+// report them all once the last batch is done
+void Engine::updateMeasurementJob()
+{
+	if (!m_pMeasurementJob && !m_bMeasurementWaiting)
+		return;
+
+	size_t batch = m_vuiMeasurementScans.size();
+	size_t done = m_nMeasurementScanCount - m_vuiMeasurementQueue.size() - batch;
+
+	if (m_bMeasurementWaiting || !m_pMeasurementJob->isFinished())
+	{
+		float batchProgress = m_bMeasurementWaiting ? 0.f : m_pMeasurementJob->getProgress();
+		int percent = m_nMeasurementScanCount > 0 ? static_cast<int>((done + batchProgress * batch) * 100.f / m_nMeasurementScanCount) : 0;
+		if (percent == m_iMeasurementPercent)
+			return;
+
+		m_iMeasurementPercent = percent;
+
+		std::stringstream ss;
+		ss << "OpenGL Seaweed Viewer - measuring " << percent << "% (" << done << " / " << m_nMeasurementScanCount << " scans, ";
+		if (m_bMeasurementWaiting)
+			ss << "loading the next " << batch;
+		else
+			ss << m_pMeasurementJob->getTrianglesProcessed() << " / " << m_pMeasurementJob->getTriangleCount() << " triangles in the next " << batch;
+		ss << ", C cancels)";
+		glfwSetWindowTitle(m_pWindow, ss.str().c_str());
+		return;
+	}
+
+	// Selections keep a scan in memory, so only the scans on screen get one
+	auto const &results = m_pMeasurementJob->getResults();
+	for (size_t i = 0; i < results.size(); ++i)
+	{
+		MeasurementJob::ModelResult const &r = results[i];
+		if (m_pSurvey->getScan(m_vuiMeasurementScans[i]).state == Survey::RESIDENT)
+			r.model->setSelection(r.inside);
+
+		MeasuredModel measured;
+		measured.name = r.model->getName();
+		measured.area = r.area;
+		measured.stats = r.stats;
+		m_vMeasuredModels.push_back(measured);
+	}
+
+	m_nMeasurementTriangles += m_pMeasurementJob->getTriangleCount();
+	m_dMeasurementSeconds += m_pMeasurementJob->getSeconds();
+	m_pMeasurementJob.reset();
+
+	if (!m_vuiMeasurementQueue.empty())
+	{
+		startMeasurementBatch();
+		return;
+	}
+
+	glm::vec3 bbMin(m_vec3MeasurementMin), bbMax(m_vec3MeasurementMax);
+	std::cout << "Measurement box (" << bbMin.x << ", " << bbMin.y << ", " << bbMin.z << ") to (" << bbMax.x << ", " << bbMax.y << ", " << bbMax.z << ")" << std::endl;
+
+	std::ofstream statsFile(MEASUREMENT_STATS_FILE);
+	SurfaceStats::writeCSVHeader(statsFile);
+
+	double totalArea = 0.0;
+	for (auto const &m : m_vMeasuredModels)
+	{
+		std::cout << "\tModel " << m.name << std::endl;
+		std::cout << "\t\tSurface area inside bounding box = " << m.area * 2.f << " cm^2" << std::endl;
+		if (!m.stats.empty())
+		{
+			std::cout << "\t\tMean leaf inclination = " << m.stats.getMeanInclination() << " deg" << std::endl;
+			std::cout << "\t\tSurface extent (" << m.stats.getMin().x << ", " << m.stats.getMin().y << ", " << m.stats.getMin().z << ") to (" << m.stats.getMax().x << ", " << m.stats.getMax().y << ", " << m.stats.getMax().z << ")" << std::endl;
+		}
+		m.stats.writeCSV(statsFile, m.name);
+		totalArea += m.area;
+	}
+
+	std::cout << "Total area inside bounding box = " << totalArea * 2.f << " cm^2" << std::endl;
+	std::cout << "Wrote histograms to " << MEASUREMENT_STATS_FILE << std::endl;
+	std::cout << "\t[" << m_nMeasurementTriangles << " triangles tested in " << m_dMeasurementSeconds * 1000.0 << " ms]" << std::endl;
+
+	releaseMeasurementScans();
+	updateAreaReadout();
+}
+
+void Engine::releaseMeasurementScans()
+{
+	m_pSurvey->unpin(m_vuiMeasurementScans);
+	m_vuiMeasurementScans.clear();
+	m_vuiMeasurementQueue.clear();
+	m_vMeasuredModels.clear();
+	m_bMeasurementWaiting = false;
+}
+
+// Live readout in the window title; doubled as both sides of the fronds are counted
+void Engine::updateAreaReadout()
+{
+	std::stringstream ss;
+	ss << "OpenGL Seaweed Viewer - area in box: " << m_pMeasurementBox->getTotalArea() * 2.f << " cm^2";
+	glfwSetWindowTitle(m_pWindow, ss.str().c_str());
 }
 
 void Engine::init_shaders()
 {
 	// Build and compile our shader program
 	m_pShaderLighting = m_pLightingSystem->generateLightingShader();
-	m_vpShaders.push_back(m_pShaderLighting);
+
+	glGenBuffers(1, &m_glFrameUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_glFrameUBO);
+	glBufferData(GL_UNIFORM_BUFFER, 3 * sizeof(glm::mat4), NULL, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, m_glFrameUBO);
 
 	std::string vBuffer, fBuffer, gBuffer;
 
 	vBuffer.append("#version 330 core\n");
 	vBuffer.append("layout(location = 0) in vec3 position;\n");
 	vBuffer.append("layout(location = 1) in vec3 normal;\n");
+	vBuffer.append("layout(location = 2) in float transformSlot;\n");
 	vBuffer.append("out VS_OUT{\n");
 	vBuffer.append("	vec3 normal;\n");
 	vBuffer.append("} vs_out;\n");
-	vBuffer.append("uniform mat4 projection;\n");
-	vBuffer.append("uniform mat4 view;\n");
+	vBuffer.append("layout(std140) uniform FrameUniforms {\n");
+	vBuffer.append("	mat4 view;\n");
+	vBuffer.append("	mat4 projection;\n");
+	vBuffer.append("	mat4 worldRotation;\n");
+	vBuffer.append("};\n");
 	vBuffer.append("uniform mat4 model;\n");
+	vBuffer.append("uniform bool useModelTransforms;\n");
+	vBuffer.append("uniform samplerBuffer modelTransforms;\n");
+	vBuffer.append("mat4 getModelMatrix()\n");
+	vBuffer.append("{\n");
+	vBuffer.append("	if (!useModelTransforms)\n");
+	vBuffer.append("		return model;\n");
+	vBuffer.append("	int base = int(transformSlot) * 4;\n");
+	vBuffer.append("	return mat4(texelFetch(modelTransforms, base), texelFetch(modelTransforms, base + 1), texelFetch(modelTransforms, base + 2), texelFetch(modelTransforms, base + 3));\n");
+	vBuffer.append("}\n");
 	vBuffer.append("void main()\n");
 	vBuffer.append("{\n");
-	vBuffer.append("	gl_Position = projection * view * model * vec4(position, 1.0f);\n");
-	vBuffer.append("	mat3 normalMatrix = mat3(transpose(inverse(view * model)));\n");
+	vBuffer.append("	mat4 modelMatrix = getModelMatrix();\n");
+	vBuffer.append("	gl_Position = projection * view * worldRotation * modelMatrix * vec4(position, 1.0f);\n");
+	vBuffer.append("	mat3 normalMatrix = mat3(transpose(inverse(view * worldRotation * modelMatrix)));\n");
 	vBuffer.append("	vs_out.normal = normalize(vec3(projection * vec4(normalMatrix * normal, 1.0)));\n");
 	vBuffer.append("}");
 
@@ -372,23 +1382,140 @@ void Engine::init_shaders()
 	fBuffer.append("}");
 
 	m_pShaderNormals = new Shader(vBuffer.c_str(), fBuffer.c_str(), gBuffer.c_str());
-	//m_vpShaders.push_back(m_pShaderNormals);
+
+	// Depth-only program for the optional pre-pass; transforms must match the lighting shader exactly
+	vBuffer.clear();
+	fBuffer.clear();
+
+	vBuffer.append("#version 330 core\n");
+	vBuffer.append("layout(location = 0) in vec3 position;\n");
+	vBuffer.append("layout(location = 2) in float transformSlot;\n");
+	vBuffer.append("layout(std140) uniform FrameUniforms {\n");
+	vBuffer.append("	mat4 view;\n");
+	vBuffer.append("	mat4 projection;\n");
+	vBuffer.append("	mat4 worldRotation;\n");
+	vBuffer.append("};\n");
+	vBuffer.append("uniform mat4 model;\n");
+	vBuffer.append("uniform bool useModelTransforms;\n");
+	vBuffer.append("uniform samplerBuffer modelTransforms;\n");
+	vBuffer.append("invariant gl_Position;\n");
+	vBuffer.append("mat4 getModelMatrix()\n");
+	vBuffer.append("{\n");
+	vBuffer.append("	if (!useModelTransforms)\n");
+	vBuffer.append("		return model;\n");
+	vBuffer.append("	int base = int(transformSlot) * 4;\n");
+	vBuffer.append("	return mat4(texelFetch(modelTransforms, base), texelFetch(modelTransforms, base + 1), texelFetch(modelTransforms, base + 2), texelFetch(modelTransforms, base + 3));\n");
+	vBuffer.append("}\n");
+	vBuffer.append("void main()\n");
+	vBuffer.append("{\n");
+	vBuffer.append("	mat4 modelMatrix = getModelMatrix();\n");
+	vBuffer.append("	gl_Position = projection * view * worldRotation * modelMatrix * vec4(position, 1.0f);\n");
+	vBuffer.append("}");
+
+	fBuffer.append("#version 330 core\n");
+	fBuffer.append("void main()\n");
+	fBuffer.append("{\n");
+	fBuffer.append("}");
+
+	m_pShaderDepth = new Shader(vBuffer.c_str(), fBuffer.c_str());
+
+	// Flat-colored lines for the measurement box, drawn in scene space
+	vBuffer.clear();
+	fBuffer.clear();
+
+	vBuffer.append("#version 330 core\n");
+	vBuffer.append("layout(location = 0) in vec3 position;\n");
+	vBuffer.append("layout(std140) uniform FrameUniforms {\n");
+	vBuffer.append("	mat4 view;\n");
+	vBuffer.append("	mat4 projection;\n");
+	vBuffer.append("	mat4 worldRotation;\n");
+	vBuffer.append("};\n");
+	vBuffer.append("void main()\n");
+	vBuffer.append("{\n");
+	vBuffer.append("	gl_Position = projection * view * worldRotation * vec4(position, 1.0f);\n");
+	vBuffer.append("}");
+
+	fBuffer.append("#version 330 core\n");
+	fBuffer.append("out vec4 color;\n");
+	fBuffer.append("void main()\n");
+	fBuffer.append("{\n");
+	fBuffer.append("	color = vec4(1.0f, 0.5f, 0.0f, 1.0f);\n");
+	fBuffer.append("}");
+
+	m_pShaderBox = new Shader(vBuffer.c_str(), fBuffer.c_str());
+
+	GLuint boxBlockIndex = glGetUniformBlockIndex(m_pShaderBox->m_nProgram, "FrameUniforms");
+	glUniformBlockBinding(m_pShaderBox->m_nProgram, boxBlockIndex, FRAME_UNIFORMS_BINDING);
+
+	RenderPass depth("depth", m_pShaderDepth, -1);
+	depth.colorWrite = false;
+	depth.useMaterial = false;
+	depth.enabled = false;
+	addRenderPass(depth);
+
+	RenderPass lighting("lighting", m_pShaderLighting, 0);
+	lighting.countFragments = true;
+	addRenderPass(lighting);
+
+	RenderPass normals("normals", m_pShaderNormals, 1);
+	normals.useMaterial = false;
+	normals.enabled = false;
+	addRenderPass(normals);
+
+	// Count fragment shader invocations where supported; otherwise samples passing the depth test
+	if (GLEW_ARB_pipeline_statistics_query)
+		m_glFragmentQueryTarget = GL_FRAGMENT_SHADER_INVOCATIONS_ARB;
+	glGenQueries(2, m_glFragmentQueries);
+	glGenQueries(2, m_glTimerQueries);
+}
+
+// With the pre-pass on, the lit pass only shades the front-most fragment of each pixel
+void Engine::setDepthPrepass(bool enable)
+{
+	getRenderPass("depth")->enabled = enable;
+
+	RenderPass *lighting = getRenderPass("lighting");
+	lighting->depthFunc = enable ? GL_EQUAL : GL_LESS;
+	lighting->depthWrite = !enable;
+}
+
+bool Engine::getDepthPrepass()
+{
+	return getRenderPass("depth")->enabled;
+}
+
+// Insert a pass keeping the list sorted, and bind its program to the shared frame uniforms
+void Engine::addRenderPass(RenderPass pass)
+{
+	GLuint blockIndex = glGetUniformBlockIndex(pass.shader->m_nProgram, "FrameUniforms");
+	if (blockIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(pass.shader->m_nProgram, blockIndex, FRAME_UNIFORMS_BINDING);
+
+	m_vRenderPasses.push_back(pass);
+	std::stable_sort(m_vRenderPasses.begin(), m_vRenderPasses.end());
+}
+
+RenderPass* Engine::getRenderPass(std::string name)
+{
+	for (auto &pass : m_vRenderPasses)
+		if (pass.name == name)
+			return &pass;
+
+	return NULL;
 }
 
-float Engine::getTriangleSurfaceAreaInAABB(glm::vec3 triVert1, glm::vec3 triVert2, glm::vec3 triVert3, glm::vec3 bbMin, glm::vec3 bbMax)
+// Material uniforms are program state, so only re-send them after an edit
+void Engine::uploadMaterial(Shader *s)
 {
-	glm::vec3 boxCenter((bbMax - bbMin) * 0.5f);
-	glm::vec3 boxHalfExtents(abs(boxCenter));
-	float verts[3][3] = { 
-		{ triVert1.x, triVert1.y, triVert1.z },
-		{ triVert2.x, triVert2.y, triVert2.z },
-		{ triVert3.x, triVert3.y, triVert3.z } 
-	};
+	unsigned int &version = m_mapMaterialVersions[s->m_nProgram];
+	if (version == g_uiMaterialVersion)
+		return;
 
-	// No overlap
-	if (triBoxOverlap(glm::value_ptr(boxCenter), glm::value_ptr(boxHalfExtents), verts) == 0)
-		return 0.0f;
+	glUniform3fv(glGetUniformLocation(s->m_nProgram, "material.ambient"), 1, glm::value_ptr(g_vec3Ambient));
+	glUniform3fv(glGetUniformLocation(s->m_nProgram, "material.diffuse"), 1, glm::value_ptr(g_vec3Diffuse));
+	glUniform3fv(glGetUniformLocation(s->m_nProgram, "material.specular"), 1, glm::value_ptr(g_vec3Specular));
+	glUniform3fv(glGetUniformLocation(s->m_nProgram, "material.emissive"), 1, glm::value_ptr(g_vec3Emissive));
+	glUniform1f(glGetUniformLocation(s->m_nProgram, "material.shininess"), g_fShininess);
 
-	// Process overlap
-	return glm::length(glm::cross(triVert2 - triVert1, triVert3 - triVert1)) * 0.5;
+	version = g_uiMaterialVersion;
 }
@@ -10,40 +10,175 @@
 #include "Camera.h"
 #include "LightingSystem.h"
 #include "GLFWInputBroadcaster.h"
+#include "Frustum.h"
+#include "GeometryArena.h"
+#include "RenderPass.h"
+#include "MeasurementBox.h"
+#include "MeasurementVolume.h"
+#include "MeshExporter.h"
+#include "MeshMetrics.h"
+#include "JobSystem.h"
+#include "MeasurementJob.h"
+#include "RenderTarget.h"
+#include "ComponentStore.h"
+#include "Survey.h"
 
 #include "Icosphere.h" // example
 #include "ObjModel.h" // test
 
-#include <tribox3.h>
+#include <map>
 
 #define MS_PER_UPDATE 0.0333333333f
-#define CAST_RAY_LEN 1000.f
+#define FRAME_UNIFORMS_BINDING 0
+#define PICK_DRAG_THRESHOLD 3.f		// pixels the cursor may move before a click becomes a drag
+#define RUBBER_BAND_RAY_SPACING 2	// pixels between rubber-band selection rays
+#define MEASUREMENT_BOX_STEP 1.f	// cm per key press when moving or resizing the measurement box
+#define AREA_QUERY_APPROX_FRACTION 0.05f	// approximate queries stop at octree nodes this fraction of the box size
+#define MEASUREMENT_STATS_FILE "measurement_stats.csv"	// leaf angle and height histograms written by P
+#define MEASUREMENT_BATCH_BUDGET 0.5f	// share of the survey's memory budget the scans P loads at once may take
+#define IDLE_WAIT_TIMEOUT 0.5		// seconds the idle loop sleeps without input before checking again
+#define IDLE_PROGRESS_TIMEOUT 0.1	// shorter while a background measurement reports progress
+#define DEFAULT_MSAA_SAMPLES 4
+#define DYNAMIC_RES_TARGET_MS 16.6f	// GPU time per frame the render scale adapts to
+#define DYNAMIC_RES_MIN_SCALE 0.5f	// of the window's resolution, per axis
+#define DYNAMIC_RES_STEP 0.0625f	// render scale changes in steps of this much
+#define DYNAMIC_RES_SMOOTHING 0.25f	// fraction of the way to the estimated scale moved per frame
 
 class Engine : public BroadcastSystem::Listener
 {
+public:
+	// Per-frame rendering counters
+	struct FrameStats {
+		unsigned int modelsDrawn;
+		unsigned int modelsCulled;
+		unsigned int meshletsDrawn;
+		unsigned int meshletsCulled;
+		unsigned int trianglesSubmitted;
+		unsigned int drawCalls;
+		unsigned int programSwitches;
+		GLuint64 fragmentsShaded;	// lit-pass fragments, read back one frame late
+		float submitTimeMs;	// CPU time spent issuing draws
+		float gpuTimeMs;	// scene and blit, read back one frame late
+		bool cullingReused;	// nothing changed since the last cull, so its results were kept
+	};
+
+	// Per-model components read every frame, copied out of the scene graph when a model moves
+	struct ModelTransform {
+		glm::mat4 world;
+		unsigned int version;	// scene graph world version the copy was taken at
+	};
+
+	struct ModelBounds {
+		glm::vec3 center;	// world bounding sphere
+		float radius;
+	};
+
+	// Closest ray hit over all models
+	struct PickResult {
+		ObjModel *model;
+		unsigned int triangle;
+		glm::vec3 point;	// world space
+		float distance;		// from the camera
+	};
+
+	// One model's part of a P measurement, kept after its scan is released
+	struct MeasuredModel {
+		std::string name;
+		double area;	// one-sided
+		SurfaceStats stats;
+	};
+
 public:
 	std::vector<std::string> m_vstrArgs;
 
 	GLFWwindow* m_pWindow;
 	LightingSystem* m_pLightingSystem;
 
-	// Constants
-	const int m_iWidth = 1920;
-	const int m_iHeight = 1200;
+	// Window size in screen coordinates, as cursor positions are given; starts at this size
+	int m_iWidth = 1920;
+	int m_iHeight = 1200;
 	const float m_fStepSize = 1.f / 120.f;
 
 	float m_fDeltaTime;	// Time between current frame and last frame
 	float m_fLastTime; // Time of last frame
 
 	Camera  *m_pCamera;
-	std::vector<Shader*> m_vpShaders;
-	Shader *m_pShaderLighting, *m_pShaderNormals;
+	std::vector<RenderPass> m_vRenderPasses;
+	Shader *m_pShaderLighting, *m_pShaderNormals, *m_pShaderDepth, *m_pShaderBox;
 
 	Icosphere* m_pSphere;
-	std::vector<ObjModel*> m_vpModels;
+	GeometryArena* m_pArena;
+	std::vector<ObjModel*> m_vpModels;	// the survey's scans in memory
+	MeasurementBox* m_pMeasurementBox;
+	Survey* m_pSurvey;
 
 private:
 	glm::mat4 m_mat4WorldRotation;
+	glm::mat4 m_mat4ViewProjection;	// projection * view * worldRotation, rebuilt in update()
+
+	std::vector<ObjModel*> m_vpVisibleModels;
+
+	// m_vpModels owns the models; these mirror them in dense arrays for the per-frame systems.
+	// Models are added to and removed from all three together, so they share slots.
+	EntityRegistry m_Entities;
+	std::map<ObjModel*, Entity> m_mapModelEntities;
+	ComponentArray<ObjModel*> m_RenderMeshes;
+	ComponentArray<ModelTransform> m_ModelTransforms;
+	ComponentArray<ModelBounds> m_ModelBounds;
+	std::vector<unsigned char> m_vbInFrustum;	// per slot, scratch for cullModels
+	FrameStats m_frameStats;
+
+	bool m_bBackfaceCulling;	// fronds are two-sided, so cone culling is only valid with GL_CULL_FACE on
+	bool m_bMultiDraw;			// one multi-draw per pass instead of one draw per visible range
+
+	GLuint m_glFrameUBO;		// view, projection and worldRotation shared by all programs
+	std::map<GLuint, unsigned int> m_mapMaterialVersions;	// material version last uploaded per program
+
+	// Double-buffered so results are read a frame after they are issued, without stalling
+	GLuint m_glFragmentQueries[2];
+	GLenum m_glFragmentQueryTarget;
+	unsigned int m_nFrameCount;
+
+	std::shared_ptr<MeasurementJob> m_pMeasurementJob;	// P measurement running in the background
+	int m_iMeasurementPercent;	// last progress shown in the title
+	std::vector<unsigned int> m_vuiMeasurementQueue;	// overlapping scans not measured yet, next at the back
+	std::vector<unsigned int> m_vuiMeasurementScans;	// the batch pinned in memory while the job reads it
+	bool m_bMeasurementWaiting;		// the job starts once the batch is all in memory
+	glm::vec3 m_vec3MeasurementMin, m_vec3MeasurementMax;	// the box when P was pressed
+	size_t m_nMeasurementScanCount;	// in all batches
+	std::vector<MeasuredModel> m_vMeasuredModels;	// results of the batches done so far
+	size_t m_nMeasurementTriangles;
+	double m_dMeasurementSeconds;
+
+	// Camera version the frame uniforms were built from; m_nViewVersion counts every rebuild
+	unsigned int m_nCameraVersion, m_nViewVersion;
+	bool m_bWorldRotationDirty;
+
+	// What the current visible set was culled against
+	bool m_bCullValid;
+	unsigned int m_nCullViewVersion, m_nCullDrawVersion;
+	bool m_bCullBackface;
+	unsigned int m_nCullPasses;
+
+	// Idle mode sleeps in the event loop and only redraws when the scene version moves on
+	bool m_bIdleMode;
+	unsigned int m_nSceneVersion;	// bumped by input and main-thread jobs
+	unsigned int m_nDrawnSceneVersion;
+	unsigned int m_nFramesDrawn, m_nIdleWakeups;
+	double m_dIdleWaitSeconds, m_dLoopStatsStart;
+
+	// The scene is drawn offscreen and scaled to the window's framebuffer, which may be larger than
+	// the window on high-DPI screens. The scale follows the GPU time; settled frames use full resolution.
+	RenderTarget *m_pRenderTarget;
+	int m_iFramebufferWidth, m_iFramebufferHeight;
+	int m_iMSAASamples;
+	bool m_bDynamicResolution;
+	float m_fRenderScale;
+	bool m_bFullResolutionFrame, m_bLastFrameScaled;
+	GLuint m_glTimerQueries[2];
+	float m_fTimerScales[2];	// render scale each timer query measured
+
+	float m_fClickX, m_fClickY;	// cursor position when the left button went down
 
 public:
 	Engine(int argc, char* argv[]);
@@ -57,8 +192,10 @@ public:
 
 	void render();
 
+	FrameStats getFrameStats();
+
 	// Inherited from BroadcastSystem
-	void receiveEvent(Object * obj, const int event, void * data);
+	void receiveEvent(const BroadcastSystem::Event &event);
 
 private:
 	GLFWwindow* init_gl_context(std::string winName);
@@ -69,5 +206,38 @@ private:
 
 	void init_shaders();
 
-	float getTriangleSurfaceAreaInAABB(glm::vec3 triVert1, glm::vec3 triVert2, glm::vec3 triVert3, glm::vec3 bbMin, glm::vec3 bbMax);
+	void init_models();
+
+	void addRenderPass(RenderPass pass);
+	RenderPass* getRenderPass(std::string name);
+	void uploadMaterial(Shader *s);
+
+	void getPickRay(float x, float y, glm::mat4 clipToModel, glm::vec3 &origin, glm::vec3 &direction);
+	bool pick(float x, float y, PickResult &result);
+	void pickRect(float x0, float y0, float x1, float y1);
+
+	void setDepthPrepass(bool enable);
+	bool getDepthPrepass();
+
+	void addModelComponents(ObjModel *model);
+	void removeModelComponents(ObjModel *model);
+	void onScanLoaded(ObjModel *model);
+	void onScanDropped(ObjModel *model);
+	void updateModelComponents();
+	void cullModels();
+
+	void printStats();
+
+	void moveMeasurementBox(glm::vec3 delta, bool resize);
+	void dragMeasurementBox(float dx, float dy);
+	void updateAreaReadout();
+	void startMeasurementBatch();
+	void startMeasurementJob();
+	void updateMeasurementJob();
+	void releaseMeasurementScans();
+	unsigned int getSceneVersion();
+
+	void resize(int framebufferWidth, int framebufferHeight);
+	void adaptRenderScale(float gpuMs, float measuredScale);
+	float getQuantizedRenderScale();
 };
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+
+// Bounded lock-free queue of POD records for many producers and a single consumer. Every slot
+// carries a sequence number telling producers whether it is free and the consumer whether it is
+// filled, so pushes from any thread only contend on one atomic counter and never block. A push
+// to a full queue fails and is counted instead of waiting for the consumer.
+template <typename T, unsigned int CAPACITY>
+class EventQueue
+{
+	static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "EventQueue capacity must be a power of two");
+
+public:
+	EventQueue()
+		: m_nEnqueuePos(0)
+		, m_nDequeuePos(0)
+		, m_nDropped(0)
+	{
+		for (unsigned int i = 0; i < CAPACITY; ++i)
+			m_Slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	// Safe from any thread
+	bool push(const T &item)
+	{
+		unsigned int pos = m_nEnqueuePos.load(std::memory_order_relaxed);
+		Slot *slot;
+
+		for (;;)
+		{
+			slot = &m_Slots[pos & (CAPACITY - 1)];
+			int diff = static_cast<int>(slot->sequence.load(std::memory_order_acquire) - pos);
+
+			if (diff == 0)
+			{
+				if (m_nEnqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+			{
+				m_nDropped.fetch_add(1, std::memory_order_relaxed);
+				return false;
+			}
+			else
+				pos = m_nEnqueuePos.load(std::memory_order_relaxed);
+		}
+
+		slot->data = item;
+		slot->sequence.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// Consumer thread only
+	bool pop(T &item)
+	{
+		Slot &slot = m_Slots[m_nDequeuePos & (CAPACITY - 1)];
+		if (static_cast<int>(slot.sequence.load(std::memory_order_acquire) - (m_nDequeuePos + 1)) < 0)
+			return false;
+
+		item = slot.data;
+		slot.sequence.store(m_nDequeuePos + CAPACITY, std::memory_order_release);
+		m_nDequeuePos++;
+
+		return true;
+	}
+
+	unsigned int getDroppedCount() const { return m_nDropped.load(std::memory_order_relaxed); }
+
+private:
+	struct Slot {
+		std::atomic<unsigned int> sequence;
+		T data;
+	};
+
+	Slot m_Slots[CAPACITY];
+	std::atomic<unsigned int> m_nEnqueuePos;
+	unsigned int m_nDequeuePos;
+	std::atomic<unsigned int> m_nDropped;
+
+	EventQueue(EventQueue const&) = delete;
+	void operator=(EventQueue const&) = delete;
+};
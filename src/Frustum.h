@@ -0,0 +1,77 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// View frustum stored as six inward-facing planes (normal.xyz, distance.w) extracted from a clip matrix.
+// Extracting from projection * view * model yields the frustum in that model's local space.
+class Frustum
+{
+public:
+	Frustum() {}
+
+	Frustum(glm::mat4 clip)
+	{
+		extract(clip);
+	}
+
+	// Gribb/Hartmann plane extraction; planes are normalized so plane distances are in object units
+	void extract(glm::mat4 clip)
+	{
+		glm::vec4 row0(clip[0][0], clip[1][0], clip[2][0], clip[3][0]);
+		glm::vec4 row1(clip[0][1], clip[1][1], clip[2][1], clip[3][1]);
+		glm::vec4 row2(clip[0][2], clip[1][2], clip[2][2], clip[3][2]);
+		glm::vec4 row3(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+
+		m_vec4Planes[0] = row3 + row0; // left
+		m_vec4Planes[1] = row3 - row0; // right
+		m_vec4Planes[2] = row3 + row1; // bottom
+		m_vec4Planes[3] = row3 - row1; // top
+		m_vec4Planes[4] = row3 + row2; // near
+		m_vec4Planes[5] = row3 - row2; // far
+
+		for (int i = 0; i < 6; ++i)
+			m_vec4Planes[i] /= glm::length(glm::vec3(m_vec4Planes[i]));
+	}
+
+	bool intersectsSphere(glm::vec3 center, float radius) const
+	{
+		for (int i = 0; i < 6; ++i)
+			if (glm::dot(glm::vec3(m_vec4Planes[i]), center) + m_vec4Planes[i].w < -radius)
+				return false;
+
+		return true;
+	}
+
+	bool containsSphere(glm::vec3 center, float radius) const
+	{
+		for (int i = 0; i < 6; ++i)
+			if (glm::dot(glm::vec3(m_vec4Planes[i]), center) + m_vec4Planes[i].w < radius)
+				return false;
+
+		return true;
+	}
+
+	// Conservative test: only rejects boxes that lie fully behind one plane
+	bool intersectsAABB(glm::vec3 bbMin, glm::vec3 bbMax) const
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			// Test the box corner furthest along the plane normal
+			glm::vec3 p(
+				m_vec4Planes[i].x > 0.f ? bbMax.x : bbMin.x,
+				m_vec4Planes[i].y > 0.f ? bbMax.y : bbMin.y,
+				m_vec4Planes[i].z > 0.f ? bbMax.z : bbMin.z
+			);
+
+			if (glm::dot(glm::vec3(m_vec4Planes[i]), p) + m_vec4Planes[i].w < 0.f)
+				return false;
+		}
+
+		return true;
+	}
+
+	glm::vec4 getPlane(int i) const { return m_vec4Planes[i]; }
+
+private:
+	glm::vec4 m_vec4Planes[6];
+};
@@ -22,6 +22,8 @@ void GLFWInputBroadcaster::init(GLFWwindow * window)
 	glfwSetMouseButtonCallback(window, mouse_button_callback);
 	glfwSetCursorPosCallback(window, mouse_position_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+	glfwSetWindowRefreshCallback(window, refresh_callback);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
 	memset(m_arrbActiveKeys, 0, sizeof m_arrbActiveKeys);
 	m_bFirstMouse = true;
@@ -40,9 +42,24 @@ bool GLFWInputBroadcaster::mousePressed()
 	return m_bMousePressed;
 }
 
+// Last cursor position in window coordinates (origin top-left)
+void GLFWInputBroadcaster::getMousePosition(float &x, float &y)
+{
+	x = m_fLastMouseX;
+	y = m_fLastMouseY;
+}
+
+// Callbacks only record state and queue events; listeners hear about them here, once per frame
 void GLFWInputBroadcaster::poll()
 {
 	glfwPollEvents();
+	dispatch();
+}
+
+void GLFWInputBroadcaster::wait(double timeout)
+{
+	glfwWaitEventsTimeout(timeout);
+	dispatch();
 }
 
 // Is called whenever a key is pressed/released via GLFW
@@ -56,35 +73,49 @@ void GLFWInputBroadcaster::key_callback(GLFWwindow* window, int key, int scancod
 
 	if (key >= 0 && key < 1024)
 	{
+		BroadcastSystem::Event event;
+		event.key = key;
+
 		if (action == GLFW_PRESS)
 		{
 			getInstance().m_arrbActiveKeys[key] = true;
-			getInstance().notify(NULL, BroadcastSystem::EVENT::KEY_PRESS, &key);
+			event.type = BroadcastSystem::EVENT::KEY_PRESS;
 		}
 		else if (action == GLFW_REPEAT)
-		{
-			getInstance().notify(NULL, BroadcastSystem::EVENT::KEY_REPEAT, &key);
-		}
+			event.type = BroadcastSystem::EVENT::KEY_REPEAT;
 		else if (action == GLFW_RELEASE)
 		{
 			getInstance().m_arrbActiveKeys[key] = false;
-			getInstance().notify(NULL, BroadcastSystem::EVENT::KEY_UNPRESS, &key);
+			event.type = BroadcastSystem::EVENT::KEY_UNPRESS;
 		}
+		else
+			return;
+
+		getInstance().post(event);
 	}
 }
 
 void GLFWInputBroadcaster::mouse_button_callback(GLFWwindow * window, int button, int action, int mods)
 {
+	// The position is taken now, as the cursor may have moved on by the time the event is dispatched
+	BroadcastSystem::Event event;
+	event.click.button = button;
+	getInstance().getMousePosition(event.click.x, event.click.y);
+
 	if (action == GLFW_PRESS)
 	{
 		getInstance().m_bMousePressed = true;
-		getInstance().notify(NULL, BroadcastSystem::EVENT::MOUSE_CLICK, &button);
+		event.type = BroadcastSystem::EVENT::MOUSE_CLICK;
 	}
 	else if (action == GLFW_RELEASE)
 	{
 		getInstance().m_bMousePressed = false;
-		getInstance().notify(NULL, BroadcastSystem::EVENT::MOUSE_UNCLICK, &button);
+		event.type = BroadcastSystem::EVENT::MOUSE_UNCLICK;
 	}
+	else
+		return;
+
+	getInstance().post(event);
 }
 
 void GLFWInputBroadcaster::mouse_position_callback(GLFWwindow * window, double xpos, double ypos)
@@ -102,13 +133,39 @@ void GLFWInputBroadcaster::mouse_position_callback(GLFWwindow * window, double x
 	getInstance().m_fLastMouseX = static_cast<GLfloat>(xpos);
 	getInstance().m_fLastMouseY = static_cast<GLfloat>(ypos);
 
-	float offset[2] = { static_cast<float>(xoffset), static_cast<float>(yoffset) };
+	BroadcastSystem::Event event;
+	event.type = BroadcastSystem::EVENT::MOUSE_MOVE;
+	event.move.dx = static_cast<float>(xoffset);
+	event.move.dy = static_cast<float>(yoffset);
+	event.move.buttonDown = getInstance().m_bMousePressed;
 
-	getInstance().notify(NULL, BroadcastSystem::EVENT::MOUSE_MOVE, &offset);
+	getInstance().post(event);
 }
 
 void GLFWInputBroadcaster::scroll_callback(GLFWwindow * window, double xoffset, double yoffset)
 {
-	float offset = static_cast<float>(yoffset);
-	getInstance().notify(NULL, BroadcastSystem::EVENT::MOUSE_SCROLL, &offset);
+	BroadcastSystem::Event event;
+	event.type = BroadcastSystem::EVENT::MOUSE_SCROLL;
+	event.scroll = static_cast<float>(yoffset);
+
+	getInstance().post(event);
+}
+
+// The window was exposed or damaged and its contents need drawing again
+void GLFWInputBroadcaster::refresh_callback(GLFWwindow * window)
+{
+	BroadcastSystem::Event event;
+	event.type = BroadcastSystem::EVENT::WINDOW_REFRESH;
+
+	getInstance().post(event);
+}
+
+void GLFWInputBroadcaster::framebuffer_size_callback(GLFWwindow * window, int width, int height)
+{
+	BroadcastSystem::Event event;
+	event.type = BroadcastSystem::EVENT::WINDOW_RESIZE;
+	event.size.width = width;
+	event.size.height = height;
+
+	getInstance().post(event);
 }
@@ -18,8 +18,13 @@ public:
 
 	bool mousePressed();
 
+	void getMousePosition(float &x, float &y);
+
 	void poll();
 
+	// Like poll, but sleeps until an event arrives or the timeout (seconds) runs out
+	void wait(double timeout);
+
 private:
 	GLFWInputBroadcaster();
 
@@ -27,6 +32,8 @@ private:
 	static void mouse_button_callback(GLFWwindow* window,int x, int y, int z);
 	static void mouse_position_callback(GLFWwindow* window, double xpos, double ypos);
 	static void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+	static void refresh_callback(GLFWwindow* window);
+	static void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
 	bool m_arrbActiveKeys[1024];
 	bool m_bFirstMouse, m_bMousePressed;
@@ -0,0 +1,376 @@
+#include "GeometryArena.h"
+
+#include <algorithm>
+#include <glm/gtc/type_ptr.hpp>
+
+#define TRANSFORM_TEXTURE_UNIT 0
+
+GeometryArena::GeometryArena(GLuint vertexCapacity, GLuint indexCapacity)
+	: m_glVAO(0)
+	, m_glVBO(0)
+	, m_glEBO(0)
+	, m_glIndirectBuffer(0)
+	, m_glTransformBuffer(0)
+	, m_glTransformTexture(0)
+	, m_nVertexCapacity(vertexCapacity)
+	, m_nVertexCount(0)
+	, m_nIndexCapacity(indexCapacity)
+	, m_nIndexCount(0)
+	, m_bTransformsDirty(false)
+	, m_nLiveBytes(0)
+	, m_bIndirect(false)
+{
+	initGL();
+}
+
+GeometryArena::~GeometryArena()
+{
+	glDeleteVertexArrays(1, &m_glVAO);
+	glDeleteBuffers(1, &m_glVBO);
+	glDeleteBuffers(1, &m_glEBO);
+	glDeleteBuffers(1, &m_glTransformBuffer);
+	glDeleteTextures(1, &m_glTransformTexture);
+	if (m_glIndirectBuffer)
+		glDeleteBuffers(1, &m_glIndirectBuffer);
+}
+
+void GeometryArena::initGL()
+{
+	glGenVertexArrays(1, &m_glVAO);
+	glGenBuffers(1, &m_glVBO);
+	glGenBuffers(1, &m_glEBO);
+
+	glBindVertexArray(m_glVAO);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+	glBufferData(GL_ARRAY_BUFFER, m_nVertexCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_glEBO);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_nIndexCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+	setAttribPointers();
+
+	glBindVertexArray(0);
+
+	// Model transforms as a texture buffer of 4 RGBA32F texels per matrix
+	glGenBuffers(1, &m_glTransformBuffer);
+	glGenTextures(1, &m_glTransformTexture);
+
+	// Indirect multi-draw needs GL 4.3; otherwise fall back to base-vertex multi-draw from GL 3.2
+	m_bIndirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+	if (m_bIndirect)
+		glGenBuffers(1, &m_glIndirectBuffer);
+}
+
+void GeometryArena::setAttribPointers()
+{
+	// Vertex Positions
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
+	// Vertex Normals
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, norm));
+	// Transform slot
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, slot));
+}
+
+// Reallocate the VBO at a larger size, keeping the existing contents
+void GeometryArena::growVertices(GLuint minCapacity)
+{
+	GLuint newCapacity = m_nVertexCapacity;
+	while (newCapacity < minCapacity)
+		newCapacity *= 2;
+
+	GLuint newVBO;
+	glGenBuffers(1, &newVBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newVBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * sizeof(Vertex), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_glVBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_nVertexCount * sizeof(Vertex));
+	glDeleteBuffers(1, &m_glVBO);
+
+	m_glVBO = newVBO;
+	m_nVertexCapacity = newCapacity;
+
+	glBindVertexArray(m_glVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+	setAttribPointers();
+	glBindVertexArray(0);
+}
+
+void GeometryArena::growIndices(GLuint minCapacity)
+{
+	GLuint newCapacity = m_nIndexCapacity;
+	while (newCapacity < minCapacity)
+		newCapacity *= 2;
+
+	GLuint newEBO;
+	glGenBuffers(1, &newEBO);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, newEBO);
+	glBufferData(GL_COPY_WRITE_BUFFER, newCapacity * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_READ_BUFFER, m_glEBO);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_nIndexCount * sizeof(GLuint));
+	glDeleteBuffers(1, &m_glEBO);
+
+	m_glEBO = newEBO;
+	m_nIndexCapacity = newCapacity;
+
+	glBindVertexArray(m_glVAO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_glEBO);
+	glBindVertexArray(0);
+}
+
+GeometryArena::Allocation GeometryArena::allocate(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec3> &normals, const std::vector<unsigned int> &indices)
+{
+	Allocation alloc;
+	alloc.vertexCount = static_cast<GLuint>(vertices.size());
+	alloc.indexCount = static_cast<GLuint>(indices.size());
+	alloc.indexCapacity = alloc.indexCount;
+
+	// Reuse released space where it fits, otherwise append
+	GLuint firstVertex;
+	if (!takeRange(m_vFreeVertices, alloc.vertexCount, firstVertex))
+	{
+		firstVertex = m_nVertexCount;
+		if (m_nVertexCount + alloc.vertexCount > m_nVertexCapacity)
+			growVertices(m_nVertexCount + alloc.vertexCount);
+		m_nVertexCount += alloc.vertexCount;
+	}
+	alloc.baseVertex = static_cast<GLint>(firstVertex);
+
+	if (!takeRange(m_vFreeIndices, alloc.indexCount, alloc.firstIndex))
+	{
+		alloc.firstIndex = m_nIndexCount;
+		if (m_nIndexCount + alloc.indexCount > m_nIndexCapacity)
+			growIndices(m_nIndexCount + alloc.indexCount);
+		m_nIndexCount += alloc.indexCount;
+	}
+
+	if (!m_vFreeSlots.empty())
+	{
+		alloc.slot = m_vFreeSlots.back();
+		m_vFreeSlots.pop_back();
+		m_vmat4Transforms[alloc.slot] = glm::mat4();
+	}
+	else
+	{
+		alloc.slot = static_cast<GLuint>(m_vmat4Transforms.size());
+		m_vmat4Transforms.push_back(glm::mat4());
+	}
+
+	std::vector<Vertex> buffer(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i)
+	{
+		buffer[i].pos = vertices[i];
+		buffer[i].norm = i < normals.size() ? normals[i] : glm::vec3(0.f);
+		buffer[i].slot = static_cast<GLfloat>(alloc.slot);
+	}
+
+	if (buffer.size() > 0)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+		glBufferSubData(GL_ARRAY_BUFFER, alloc.baseVertex * sizeof(Vertex), buffer.size() * sizeof(Vertex), &buffer[0]);
+	}
+
+	if (indices.size() > 0)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_glEBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, alloc.firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), &indices[0]);
+	}
+
+	m_bTransformsDirty = true;
+	m_nLiveBytes += getAllocationBytes(alloc);
+
+	return alloc;
+}
+
+// The contents are left in place; the ranges are only handed out again
+void GeometryArena::release(const Allocation &alloc)
+{
+	returnRange(m_vFreeVertices, static_cast<GLuint>(alloc.baseVertex), alloc.vertexCount);
+	returnRange(m_vFreeIndices, alloc.firstIndex, alloc.indexCapacity);
+	m_vFreeSlots.push_back(alloc.slot);
+
+	m_nLiveBytes -= getAllocationBytes(alloc);
+}
+
+size_t GeometryArena::getAllocationBytes(const Allocation &alloc)
+{
+	return alloc.vertexCount * sizeof(Vertex) + alloc.indexCapacity * sizeof(GLuint);
+}
+
+// First fit; the remainder of the range stays free
+bool GeometryArena::takeRange(std::vector<Range> &free, GLuint count, GLuint &first)
+{
+	if (count == 0)
+		return false;
+
+	for (size_t i = 0; i < free.size(); ++i)
+	{
+		if (free[i].count < count)
+			continue;
+
+		first = free[i].first;
+		free[i].first += count;
+		free[i].count -= count;
+		if (free[i].count == 0)
+			free.erase(free.begin() + i);
+
+		return true;
+	}
+
+	return false;
+}
+
+void GeometryArena::returnRange(std::vector<Range> &free, GLuint first, GLuint count)
+{
+	if (count == 0)
+		return;
+
+	Range range;
+	range.first = first;
+	range.count = count;
+
+	auto it = std::lower_bound(free.begin(), free.end(), range, [](const Range &a, const Range &b) { return a.first < b.first; });
+	it = free.insert(it, range);
+
+	// Merge with the following range, then with the preceding one
+	auto next = it + 1;
+	if (next != free.end() && it->first + it->count == next->first)
+	{
+		it->count += next->count;
+		free.erase(next);
+	}
+
+	if (it != free.begin())
+	{
+		auto prev = it - 1;
+		if (prev->first + prev->count == it->first)
+		{
+			prev->count += it->count;
+			free.erase(it);
+		}
+	}
+}
+
+bool GeometryArena::updateIndices(Allocation &alloc, const std::vector<unsigned int> &indices)
+{
+	if (indices.size() > alloc.indexCapacity)
+		return false;
+
+	if (indices.size() > 0)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_glEBO);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, alloc.firstIndex * sizeof(GLuint), indices.size() * sizeof(GLuint), &indices[0]);
+	}
+
+	// Any tail of the original allocation is left unused
+	alloc.indexCount = static_cast<GLuint>(indices.size());
+
+	return true;
+}
+
+void GeometryArena::setTransform(GLuint slot, glm::mat4 model)
+{
+	m_vmat4Transforms[slot] = model;
+	m_bTransformsDirty = true;
+}
+
+void GeometryArena::uploadTransforms()
+{
+	if (!m_bTransformsDirty || m_vmat4Transforms.size() == 0)
+		return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, m_glTransformBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, m_vmat4Transforms.size() * sizeof(glm::mat4), &m_vmat4Transforms[0], GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, m_glTransformTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_glTransformBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	m_bTransformsDirty = false;
+}
+
+void GeometryArena::clearDraws()
+{
+	m_vglDrawCounts.clear();
+	m_vpDrawOffsets.clear();
+	m_vglDrawBaseVertices.clear();
+	m_vDrawCommands.clear();
+}
+
+void GeometryArena::addDraw(GLuint firstIndex, GLsizei count, GLint baseVertex)
+{
+	m_vglDrawCounts.push_back(count);
+	m_vpDrawOffsets.push_back((const GLvoid*)(firstIndex * sizeof(GLuint)));
+	m_vglDrawBaseVertices.push_back(baseVertex);
+
+	DrawElementsIndirectCommand cmd;
+	cmd.count = static_cast<GLuint>(count);
+	cmd.instanceCount = 1;
+	cmd.firstIndex = firstIndex;
+	cmd.baseVertex = baseVertex;
+	cmd.baseInstance = 0;
+	m_vDrawCommands.push_back(cmd);
+}
+
+// Upload the frame's draw batch and transforms once, before the shader passes replay it
+void GeometryArena::commitDraws()
+{
+	uploadTransforms();
+
+	if (m_bIndirect && m_vDrawCommands.size() > 0)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_glIndirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, m_vDrawCommands.size() * sizeof(DrawElementsIndirectCommand), &m_vDrawCommands[0], GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+}
+
+// Returns the number of draw calls issued
+unsigned int GeometryArena::draw(Shader s, bool multiDraw)
+{
+	if (m_vglDrawCounts.size() == 0)
+		return 0;
+
+	glActiveTexture(GL_TEXTURE0 + TRANSFORM_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_BUFFER, m_glTransformTexture);
+	glUniform1i(glGetUniformLocation(s.m_nProgram, "modelTransforms"), TRANSFORM_TEXTURE_UNIT);
+	glUniform1i(glGetUniformLocation(s.m_nProgram, "useModelTransforms"), GL_TRUE);
+
+	unsigned int drawCalls = 0;
+	GLsizei nDraws = static_cast<GLsizei>(m_vglDrawCounts.size());
+
+	glBindVertexArray(m_glVAO);
+	if (!multiDraw)
+	{
+		// One call per range, as each model used to issue its own draws
+		for (GLsizei i = 0; i < nDraws; ++i)
+			glDrawElementsBaseVertex(GL_TRIANGLES, m_vglDrawCounts[i], GL_UNSIGNED_INT, (GLvoid*)m_vpDrawOffsets[i], m_vglDrawBaseVertices[i]);
+		drawCalls = nDraws;
+	}
+	else if (m_bIndirect)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_glIndirectBuffer);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, nDraws, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		drawCalls = 1;
+	}
+	else
+	{
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &m_vglDrawCounts[0], GL_UNSIGNED_INT, &m_vpDrawOffsets[0], nDraws, &m_vglDrawBaseVertices[0]);
+		drawCalls = 1;
+	}
+	glBindVertexArray(0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	return drawCalls;
+}
+
+bool GeometryArena::hasIndirect()
+{
+	return m_bIndirect;
+}
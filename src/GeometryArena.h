@@ -0,0 +1,104 @@
+#pragma once
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif // !GLEW_STATIC
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+// Shared vertex/index storage for all models: one VAO over large sub-allocated VBO/EBO,
+// per-model transforms in a texture buffer, and visible ranges submitted with a single multi-draw.
+// Released ranges go on free lists and are reused first-fit, so streamed models can come and go
+// without the buffers growing each time.
+class GeometryArena
+{
+public:
+	struct Allocation {
+		GLint baseVertex;
+		GLuint firstIndex;
+		GLuint vertexCount;
+		GLuint indexCount;
+		GLuint indexCapacity;
+		GLuint slot;		// index of this allocation's transform in the transform buffer
+	};
+
+public:
+	GeometryArena(GLuint vertexCapacity = 1 << 20, GLuint indexCapacity = 1 << 22);
+	~GeometryArena();
+
+	Allocation allocate(const std::vector<glm::vec3> &vertices, const std::vector<glm::vec3> &normals, const std::vector<unsigned int> &indices);
+	void release(const Allocation &alloc);
+
+	// GPU memory taken by one allocation, and by all live ones
+	static size_t getAllocationBytes(const Allocation &alloc);
+	size_t getLiveBytes() { return m_nLiveBytes; }
+
+	// Overwrite an allocation's indices in place; the new index count must fit the original allocation
+	bool updateIndices(Allocation &alloc, const std::vector<unsigned int> &indices);
+
+	void setTransform(GLuint slot, glm::mat4 model);
+
+	// Draw batch recorded once per frame and replayed for each shader
+	void clearDraws();
+	void addDraw(GLuint firstIndex, GLsizei count, GLint baseVertex);
+	void commitDraws();
+	unsigned int draw(Shader s, bool multiDraw = true);
+
+	bool hasIndirect();
+
+private:
+	void initGL();
+	void growVertices(GLuint minCapacity);
+	void growIndices(GLuint minCapacity);
+	void setAttribPointers();
+	void uploadTransforms();
+
+	struct Range {
+		GLuint first;
+		GLuint count;
+	};
+
+	// Free lists are kept sorted with neighbouring ranges merged
+	static bool takeRange(std::vector<Range> &free, GLuint count, GLuint &first);
+	static void returnRange(std::vector<Range> &free, GLuint first, GLuint count);
+
+	struct Vertex {
+		glm::vec3 pos;
+		glm::vec3 norm;
+		GLfloat slot;
+	};
+
+	// Matches the GL 4.3 indirect command layout
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	GLuint m_glVAO, m_glVBO, m_glEBO, m_glIndirectBuffer;
+	GLuint m_glTransformBuffer, m_glTransformTexture;
+
+	GLuint m_nVertexCapacity, m_nVertexCount;
+	GLuint m_nIndexCapacity, m_nIndexCount;
+
+	std::vector<glm::mat4> m_vmat4Transforms;
+	bool m_bTransformsDirty;
+
+	std::vector<Range> m_vFreeVertices, m_vFreeIndices;
+	std::vector<GLuint> m_vFreeSlots;
+	size_t m_nLiveBytes;
+
+	std::vector<GLsizei> m_vglDrawCounts;
+	std::vector<const GLvoid*> m_vpDrawOffsets;
+	std::vector<GLint> m_vglDrawBaseVertices;
+	std::vector<DrawElementsIndirectCommand> m_vDrawCommands;
+
+	bool m_bIndirect;
+};
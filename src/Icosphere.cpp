@@ -201,9 +201,10 @@ void Icosphere::draw(Shader s)
 	glUniform3f(glGetUniformLocation(s.m_nProgram, "material.emissive"), m_vec3EmisColor.r, m_vec3EmisColor.g, m_vec3EmisColor.b);
 	glUniform1f(glGetUniformLocation(s.m_nProgram, "material.shininess"), 32.0f);
 
-	glm::mat4 model = glm::translate(glm::mat4(), m_vec3Position) * glm::mat4(m_mat3Rotation) * glm::scale(glm::mat4(), m_vec3Scale);
+	glm::mat4 model(getWorldMatrix());
 
 	glUniformMatrix4fv(glGetUniformLocation(s.m_nProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	glUniform1i(glGetUniformLocation(s.m_nProgram, "useModelTransforms"), GL_FALSE);
 	
 	// Draw mesh
 	glBindVertexArray(this->m_glVAO);
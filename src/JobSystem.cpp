@@ -0,0 +1,343 @@
+#include "JobSystem.h"
+
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+
+// Deque owned by the calling thread; -1 for threads the job system didn't start
+static thread_local int t_iQueue = -1;
+
+// Set while a worker runs a background job, so the jobs it submits stay in the background
+static thread_local bool t_bBackground = false;
+
+JobSystem& JobSystem::getInstance()
+{
+	static JobSystem instance;
+	return instance;
+}
+
+// The thread that first asks for the job system is taken as the main thread
+JobSystem::JobSystem()
+	: m_MainThread(std::this_thread::get_id())
+	, m_bQuit(false)
+	, m_nNextExternalQueue(0)
+	, m_nJobsRun(0)
+	, m_nSteals(0)
+	, m_nFailedSteals(0)
+	, m_nMainJobsRun(0)
+	, m_nIdleUs(0)
+{
+	// Always at least one worker, so background jobs progress while the main thread draws
+	unsigned int nThreads = std::max(2u, std::thread::hardware_concurrency());
+
+	for (unsigned int i = 0; i < nThreads; ++i)
+		m_vQueues.push_back(std::unique_ptr<Queue>(new Queue()));
+
+	t_iQueue = 0;
+
+	for (unsigned int i = 1; i < nThreads; ++i)
+		m_vWorkers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+}
+
+JobSystem::~JobSystem()
+{
+	m_bQuit = true;
+	m_SleepCondition.notify_all();
+
+	for (auto &worker : m_vWorkers)
+		worker.join();
+}
+
+unsigned int JobSystem::getQueueIndex()
+{
+	if (t_iQueue >= 0)
+		return static_cast<unsigned int>(t_iQueue);
+
+	// Other threads spread their jobs over all deques
+	return m_nNextExternalQueue++ % m_vQueues.size();
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> task)
+{
+	return submit(task, std::vector<JobHandle>());
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> task, const std::vector<JobHandle> &dependencies)
+{
+	return submit(task, dependencies, t_bBackground);
+}
+
+JobSystem::JobHandle JobSystem::submitBackground(std::function<void()> task)
+{
+	return submit(task, std::vector<JobHandle>(), true);
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> task, const std::vector<JobHandle> &dependencies, bool background)
+{
+	JobHandle job(std::make_shared<Job>());
+	job->task = task;
+	job->done = false;
+	job->background = background;
+
+	// The extra count keeps the job from being scheduled while its dependencies are still being registered
+	job->pendingDependencies = 1;
+
+	for (auto const &dep : dependencies)
+	{
+		std::lock_guard<std::mutex> guard(dep->lock);
+		if (dep->done)
+			continue;
+
+		dep->dependents.push_back(job);
+		job->pendingDependencies++;
+	}
+
+	if (--job->pendingDependencies == 0)
+		schedule(job);
+
+	return job;
+}
+
+void JobSystem::schedule(const JobHandle &job)
+{
+	Queue &queue = job->background ? m_BackgroundQueue : *m_vQueues[getQueueIndex()];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.jobs.push_back(job);
+	}
+
+	m_SleepCondition.notify_one();
+}
+
+// Newest job from our own deque, otherwise the oldest job of another thread, and only then, on a
+// worker, the oldest background job
+JobSystem::JobHandle JobSystem::findJob(unsigned int index)
+{
+	{
+		Queue &own = *m_vQueues[index];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if (!own.jobs.empty())
+		{
+			JobHandle job(own.jobs.back());
+			own.jobs.pop_back();
+			return job;
+		}
+	}
+
+	size_t nQueues = m_vQueues.size();
+	for (size_t i = 1; i < nQueues; ++i)
+	{
+		Queue &victim = *m_vQueues[(index + i) % nQueues];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (!victim.jobs.empty())
+		{
+			JobHandle job(victim.jobs.front());
+			victim.jobs.pop_front();
+			m_nSteals++;
+			return job;
+		}
+	}
+
+	if (index != 0)
+	{
+		std::lock_guard<std::mutex> guard(m_BackgroundQueue.lock);
+		if (!m_BackgroundQueue.jobs.empty())
+		{
+			JobHandle job(m_BackgroundQueue.jobs.front());
+			m_BackgroundQueue.jobs.pop_front();
+			return job;
+		}
+	}
+
+	if (nQueues > 1)
+		m_nFailedSteals++;
+
+	return JobHandle();
+}
+
+void JobSystem::run(const JobHandle &job)
+{
+	bool background = t_bBackground;
+	t_bBackground = job->background;
+	job->task();
+	t_bBackground = background;
+	job->task = nullptr;
+	m_nJobsRun++;
+
+	std::vector<JobHandle> dependents;
+	{
+		std::lock_guard<std::mutex> guard(job->lock);
+		job->done = true;
+		dependents.swap(job->dependents);
+	}
+
+	for (auto const &dependent : dependents)
+		if (--dependent->pendingDependencies == 0)
+			schedule(dependent);
+}
+
+void JobSystem::workerLoop(unsigned int index)
+{
+	t_iQueue = static_cast<int>(index);
+	int idleRounds = 0;
+
+	while (!m_bQuit)
+	{
+		JobHandle job(findJob(index));
+		if (job)
+		{
+			run(job);
+			idleRounds = 0;
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+
+		if (++idleRounds < JOB_SYSTEM_SPIN_TRIES)
+			std::this_thread::yield();
+		else
+		{
+			std::unique_lock<std::mutex> sleep(m_SleepLock);
+			m_SleepCondition.wait_for(sleep, std::chrono::microseconds(JOB_SYSTEM_SLEEP_US));
+		}
+
+		m_nIdleUs += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+bool JobSystem::finished(const JobHandle &job)
+{
+	return !job || job->done;
+}
+
+void JobSystem::wait(const JobHandle &job)
+{
+	unsigned int index = getQueueIndex();
+
+	while (!finished(job))
+	{
+		JobHandle other(findJob(index));
+		if (other)
+			run(other);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::wait(const std::vector<JobHandle> &jobs)
+{
+	for (auto const &job : jobs)
+		wait(job);
+}
+
+void JobSystem::submitMain(std::function<void()> task)
+{
+	std::lock_guard<std::mutex> guard(m_MainLock);
+	m_vMainJobs.push_back(task);
+}
+
+// Jobs submitted while these run wait for the next call
+unsigned int JobSystem::runMainThreadJobs()
+{
+	if (std::this_thread::get_id() != m_MainThread)
+	{
+		std::cerr << "Main-thread jobs run from another thread" << std::endl;
+		return 0;
+	}
+
+	std::vector<std::function<void()>> jobs;
+	{
+		std::lock_guard<std::mutex> guard(m_MainLock);
+		jobs.swap(m_vMainJobs);
+	}
+
+	for (auto const &job : jobs)
+		job();
+
+	m_nMainJobsRun += jobs.size();
+
+	return static_cast<unsigned int>(jobs.size());
+}
+
+JobSystem::Stats JobSystem::getStats()
+{
+	Stats stats;
+	stats.jobsRun = m_nJobsRun;
+	stats.steals = m_nSteals;
+	stats.failedSteals = m_nFailedSteals;
+	stats.mainThreadJobsRun = m_nMainJobsRun;
+	stats.idleMs = m_nIdleUs / 1000.0;
+
+	return stats;
+}
+
+void JobSystem::resetStats()
+{
+	m_nJobsRun = 0;
+	m_nSteals = 0;
+	m_nFailedSteals = 0;
+	m_nMainJobsRun = 0;
+	m_nIdleUs = 0;
+}
+
+void JobSystem::benchmark()
+{
+	const int nTiny = 100000;
+	const int nChain = 1000;
+	const int nParents = 256, nChildren = 16;
+
+	std::cout << "Job system benchmark on " << getThreadCount() << " threads" << std::endl;
+	resetStats();
+
+	// Scheduling overhead: many jobs that do almost nothing
+	std::atomic<int> counter(0);
+	auto start = std::chrono::steady_clock::now();
+	std::vector<JobHandle> jobs;
+	jobs.reserve(nTiny);
+	for (int i = 0; i < nTiny; ++i)
+		jobs.push_back(submit([&counter]() { counter++; }));
+	wait(jobs);
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "\t" << nTiny << " tiny jobs: " << seconds * 1000.0 << " ms (" << nTiny / seconds / 1e6 << " M jobs/s)" << (counter == nTiny ? "" : " [LOST JOBS]") << std::endl;
+
+	// Dependency latency: each job may only start once the one before it has finished
+	int order = 0;
+	bool inOrder = true;
+	start = std::chrono::steady_clock::now();
+	JobHandle previous;
+	for (int i = 0; i < nChain; ++i)
+	{
+		std::vector<JobHandle> deps;
+		if (previous)
+			deps.push_back(previous);
+		previous = submit([&order, &inOrder, i]() { inOrder = inOrder && order == i; order++; }, deps);
+	}
+	wait(previous);
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "\t" << nChain << "-job dependency chain: " << seconds * 1000.0 << " ms (" << seconds * 1e6 / nChain << " us per link)" << (inOrder ? "" : " [OUT OF ORDER]") << std::endl;
+
+	// Nested fork-join: jobs that wait on jobs they submit must not deadlock
+	counter = 0;
+	start = std::chrono::steady_clock::now();
+	jobs.clear();
+	for (int i = 0; i < nParents; ++i)
+	{
+		jobs.push_back(submit([this, &counter]() {
+			std::vector<JobHandle> children;
+			for (int c = 0; c < nChildren; ++c)
+				children.push_back(submit([&counter]() {
+					volatile float x = 0.f;
+					for (int k = 0; k < 10000; ++k)
+						x = x + 1.f;
+					counter++;
+				}));
+			wait(children);
+		}));
+	}
+	wait(jobs);
+	seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "\t" << nParents << " x " << nChildren << " nested jobs: " << seconds * 1000.0 << " ms" << (counter == nParents * nChildren ? "" : " [LOST JOBS]") << std::endl;
+
+	Stats stats(getStats());
+	std::cout << "\t" << stats.jobsRun << " jobs run, " << stats.steals << " steals, " << stats.failedSteals << " failed steal rounds, " << stats.idleMs << " ms worker idle time" << std::endl;
+}
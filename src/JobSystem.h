@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_SYSTEM_SPIN_TRIES 64		// failed steal rounds before a worker sleeps
+#define JOB_SYSTEM_SLEEP_US 500			// longest a sleeping worker waits before looking again
+
+// Work-stealing task scheduler shared by the whole program. Every worker owns a deque: it pushes
+// and pops its own jobs at the back and, when it runs dry, steals from the front of the others.
+// Jobs may depend on other jobs and only start once those have finished. A thread waiting on a
+// job keeps running jobs in the meantime, so jobs can wait on jobs they submit. Long-running work
+// goes to a background queue that only workers take from, together with every job it submits, so
+// a main thread waiting on its own short jobs never ends up running a scan load mid-frame. GL work
+// can only run on the thread that owns the context, so it goes through a separate main-thread
+// queue that the main loop drains once per frame.
+class JobSystem
+{
+public:
+	struct Job;
+	typedef std::shared_ptr<Job> JobHandle;
+
+	struct Stats {
+		uint64_t jobsRun;
+		uint64_t steals;
+		uint64_t failedSteals;
+		uint64_t mainThreadJobsRun;
+		double idleMs;			// summed over workers, sleeping or spinning without work
+	};
+
+public:
+	static JobSystem& getInstance();
+
+	// Workers plus the main thread
+	unsigned int getThreadCount() { return static_cast<unsigned int>(m_vQueues.size()); }
+
+	JobHandle submit(std::function<void()> task);
+	JobHandle submit(std::function<void()> task, const std::vector<JobHandle> &dependencies);
+
+	// Never run by the main thread, not even while it waits on the job
+	JobHandle submitBackground(std::function<void()> task);
+
+	// Runs other jobs until the given ones have finished; the main thread skips background jobs
+	void wait(const JobHandle &job);
+	void wait(const std::vector<JobHandle> &jobs);
+	bool finished(const JobHandle &job);
+
+	// GL and other main-thread-only work, run by runMainThreadJobs in submission order
+	void submitMain(std::function<void()> task);
+	unsigned int runMainThreadJobs();
+
+	Stats getStats();
+	void resetStats();
+
+	// Stress test: many tiny jobs, a dependency chain and nested fork-join, with timings
+	void benchmark();
+
+private:
+	struct Queue {
+		std::mutex lock;
+		std::deque<JobHandle> jobs;
+	};
+
+	JobSystem();
+	~JobSystem();
+
+	void workerLoop(unsigned int index);
+	void schedule(const JobHandle &job);
+	JobHandle submit(std::function<void()> task, const std::vector<JobHandle> &dependencies, bool background);
+	JobHandle findJob(unsigned int index);
+	void run(const JobHandle &job);
+	unsigned int getQueueIndex();
+
+	std::vector<std::unique_ptr<Queue>> m_vQueues;	// 0 belongs to the main thread
+	Queue m_BackgroundQueue;						// shared by the workers, oldest first
+	std::vector<std::thread> m_vWorkers;
+	std::thread::id m_MainThread;
+	std::atomic<bool> m_bQuit;
+	std::atomic<unsigned int> m_nNextExternalQueue;
+
+	std::mutex m_SleepLock;
+	std::condition_variable m_SleepCondition;
+
+	std::mutex m_MainLock;
+	std::vector<std::function<void()>> m_vMainJobs;
+
+	std::atomic<uint64_t> m_nJobsRun, m_nSteals, m_nFailedSteals, m_nMainJobsRun, m_nIdleUs;
+
+	JobSystem(JobSystem const&) = delete;
+	void operator=(JobSystem const&) = delete;
+};
+
+struct JobSystem::Job {
+	std::function<void()> task;
+	std::atomic<int> pendingDependencies;
+	std::atomic<bool> done;
+	bool background;
+	std::mutex lock;
+	std::vector<JobHandle> dependents;	// scheduled when this job finishes
+};
@@ -14,17 +14,21 @@
 #include <glm/gtc/type_ptr.hpp>
 
 LightingSystem::LightingSystem() 
-	: m_bRefreshShader(true)
+	: m_glLightUBO(0)
+	, m_bRefreshShader(true)
 	, m_bDrawLightBulbs(true)
 	, m_pLightBulb(NULL)
+	, m_cameraNode(SCENE_NODE_NONE)
 {
 }
 
 LightingSystem::~LightingSystem()
 {
-	dLights.clear();
-	pLights.clear();
-	sLights.clear();
+	for (auto const &node : m_Nodes)
+		SceneGraph::getInstance().release(node);
+
+	if (m_glLightUBO)
+		glDeleteBuffers(1, &m_glLightUBO);
 }
 
 // Uses the current shader
@@ -39,127 +43,178 @@ void LightingSystem::update(glm::mat4 view, Shader *s)
 	
 	s->use();
 
-	glm::vec3 black(0.f);
-
 	glm::mat4 invView = glm::inverse(view);
 	glm::vec3 camPos(invView[3].x, invView[3].y, invView[3].z);
-	glm::vec3 camFwd(invView[2].x, invView[2].y, invView[2].z);
 
 	glUniform3fv(glGetUniformLocation(s->m_nProgram, "viewPos"), 1, glm::value_ptr(camPos));
 
-	// Directional light
-	for (int i = 0; i < dLights.size(); ++i)
+	// World placement of every point and spot light in one pass over the graph
+	SceneGraph &graph = SceneGraph::getInstance();
+	graph.getWorldPositions(m_Nodes.data(), m_Nodes.size(), m_Positions.data());
+
+	for (size_t i = 0; i < m_Cones.size(); ++i)
 	{
-		std::string name = "dirLights[" + std::to_string(i);
-		name += "]";
+		SceneGraph::Node node = *m_Nodes.get(m_Cones.getEntity(i));
+		m_Cones[i].direction = glm::mat3(graph.getWorldMatrix(node)) * m_Cones[i].localDirection;
+	}
 
-		if (dLights[i].on)
-		{
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".position").c_str()), 1, glm::value_ptr(dLights[i].position));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".ambient").c_str()), 1, glm::value_ptr(dLights[i].ambient));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".diffuse").c_str()), 1, glm::value_ptr(dLights[i].diffuse));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".specular").c_str()), 1, glm::value_ptr(dLights[i].specular));
-		}
-		else
-		{
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".ambient").c_str()), 1, glm::value_ptr(black));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".diffuse").c_str()), 1, glm::value_ptr(black));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".specular").c_str()), 1, glm::value_ptr(black));
-		}
+	if (m_vvec4Uniforms.empty())
+		return;
+
+	packUniforms();
+
+	if (!m_glLightUBO)
+		glGenBuffers(1, &m_glLightUBO);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_glLightUBO);
+	glBufferData(GL_UNIFORM_BUFFER, m_vvec4Uniforms.size() * sizeof(glm::vec4), m_vvec4Uniforms.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_UNIFORMS_BINDING, m_glLightUBO);
+}
+
+// Each component array is copied into its columns of the block; lights off keep their colours
+// and are zeroed in the shader by the ambient w
+void LightingSystem::packUniforms()
+{
+	size_t n = m_vvec4Uniforms.size() / 6;
+	glm::vec4 *position = m_vvec4Uniforms.data();
+	glm::vec4 *direction = position + n;
+	glm::vec4 *attenuation = direction + n;
+	glm::vec4 *ambient = attenuation + n;
+	glm::vec4 *diffuse = ambient + n;
+	glm::vec4 *specular = diffuse + n;
+	const unsigned int *slot = m_vUniformSlot.data();
+
+	for (size_t i = 0; i < m_Directions.size(); ++i)
+		position[slot[m_Directions.getEntity(i)]] = glm::vec4(m_Directions[i], 0.f);
+
+	for (size_t i = 0; i < m_Positions.size(); ++i)
+		position[slot[m_Positions.getEntity(i)]] = glm::vec4(m_Positions[i], 1.f);
+
+	for (size_t i = 0; i < m_Attenuations.size(); ++i)
+	{
+		unsigned int s = slot[m_Attenuations.getEntity(i)];
+		attenuation[s] = glm::vec4(m_Attenuations[i].constant, m_Attenuations[i].linear, m_Attenuations[i].quadratic, 0.f);
 	}
 
-	// Point light
-	for (int i = 0; i < pLights.size(); ++i)
+	for (size_t i = 0; i < m_Cones.size(); ++i)
 	{
-		std::string name = "pointLights[" + std::to_string(i);
-		name += "]";
+		unsigned int s = slot[m_Cones.getEntity(i)];
+		direction[s] = glm::vec4(m_Cones[i].direction, m_Cones[i].cutOff);
+		attenuation[s].w = m_Cones[i].outerCutOff;
+	}
 
-		if (pLights[i].on)
-		{
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".position").c_str()), 1, glm::value_ptr(pLights[i].position));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".ambient").c_str()), 1, glm::value_ptr(pLights[i].ambient));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".diffuse").c_str()), 1, glm::value_ptr(pLights[i].diffuse));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".specular").c_str()), 1, glm::value_ptr(pLights[i].specular));
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".constant").c_str()), pLights[i].constant);
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".linear").c_str()), pLights[i].linear);
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".quadratic").c_str()), pLights[i].quadratic);
-		}
-		else
-		{
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".ambient").c_str()), 1, glm::value_ptr(black));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".diffuse").c_str()), 1, glm::value_ptr(black));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".specular").c_str()), 1, glm::value_ptr(black));
-		}
+	for (size_t i = 0; i < m_Colors.size(); ++i)
+	{
+		unsigned int s = slot[m_Colors.getEntity(i)];
+		ambient[s] = glm::vec4(m_Colors[i].ambient, 0.f);
+		diffuse[s] = glm::vec4(m_Colors[i].diffuse, 0.f);
+		specular[s] = glm::vec4(m_Colors[i].specular, 0.f);
 	}
 
-	// SpotLight
-	for (int i = 0; i < sLights.size(); ++i)
+	for (size_t i = 0; i < m_On.size(); ++i)
+		ambient[slot[m_On.getEntity(i)]].w = m_On[i];
+}
+
+void LightingSystem::setCameraNode(SceneGraph::Node camera)
+{
+	m_cameraNode = camera;
+
+	for (size_t i = 0; i < m_Cones.size(); ++i)
+		if (m_Cones[i].attachedToCamera)
+			SceneGraph::getInstance().setParent(*m_Nodes.get(m_Cones.getEntity(i)), camera);
+}
+
+// Positions are read and written through the graph in one batch each, and turned in a plain loop
+void LightingSystem::orbitPointLights(float radians)
+{
+	std::vector<Entity> const &points = m_vEntities[POINT];
+	size_t n = points.size();
+	if (n == 0)
+		return;
+
+	m_vOrbitNodes.resize(n);
+	m_vvec3OrbitPositions.resize(n);
+	for (size_t i = 0; i < n; ++i)
+		m_vOrbitNodes[i] = *m_Nodes.get(points[i]);
+
+	SceneGraph &graph = SceneGraph::getInstance();
+	graph.getPositions(m_vOrbitNodes.data(), n, m_vvec3OrbitPositions.data());
+
+	float c = cos(radians);
+	float s = sin(radians);
+	glm::vec3 *p = m_vvec3OrbitPositions.data();
+	for (size_t i = 0; i < n; ++i)
 	{
-		std::string name = "spotLights[" + std::to_string(i);
-		name += "]";
+		float x = p[i].x;
+		p[i].x = c * x + s * p[i].z;
+		p[i].z = c * p[i].z - s * x;
+	}
 
-		if (sLights[i].attachedToCamera)
-		{
-			sLights[i].position = camPos;
-			sLights[i].direction = camFwd;
-		}
+	graph.setPositions(m_vOrbitNodes.data(), n, p);
 
-		if (sLights[i].on)
-		{
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".position").c_str()), 1, glm::value_ptr(sLights[i].position));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".direction").c_str()), 1, glm::value_ptr(sLights[i].direction));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".ambient").c_str()), 1, glm::value_ptr(sLights[i].ambient));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".diffuse").c_str()), 1, glm::value_ptr(sLights[i].diffuse));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".specular").c_str()), 1, glm::value_ptr(sLights[i].specular));
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".constant").c_str()), sLights[i].constant);
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".linear").c_str()), sLights[i].linear);
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".quadratic").c_str()), sLights[i].quadratic);
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".cutOff").c_str()), sLights[i].cutOff);
-			glUniform1f(glGetUniformLocation(s->m_nProgram, (name + ".outerCutOff").c_str()), sLights[i].outerCutOff);
-		}
-		else
-		{
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".ambient").c_str()), 1, glm::value_ptr(black));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".diffuse").c_str()), 1, glm::value_ptr(black));
-			glUniform3fv(glGetUniformLocation(s->m_nProgram, (name + ".specular").c_str()), 1, glm::value_ptr(black));
-		}
+	for (size_t i = 0; i < n; ++i)
+	{
+		LightColor *color = m_Colors.get(points[i]);
+		color->diffuse = color->specular = (glm::normalize(p[i]) + glm::vec3(1.f)) / glm::vec3(2.f);
 	}
 }
 
-bool LightingSystem::addDirectLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular)
+// Every light gets a colour and a switch; uniform slots are handed out by type, in the order the
+// shader loops over them
+Entity LightingSystem::addLight(LIGHT_TYPE type, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular)
 {
-	DLight dl;
+	Entity e = m_Entities.create();
+	m_vEntities[type].push_back(e);
+
+	LightColor color;
+	color.ambient = ambient;
+	color.diffuse = diffuse;
+	color.specular = specular;
+	m_Colors.add(e, color);
+	m_On.add(e, 1.f);
 
-	dl.position = position;
-	dl.ambient = ambient;
-	dl.diffuse = diffuse;
-	dl.specular = specular;
+	if (e >= m_vUniformSlot.size())
+		m_vUniformSlot.resize(e + 1, 0);
 
-	dl.on = true;
+	unsigned int slot = 0;
+	for (int t = 0; t < LIGHT_TYPE_COUNT; ++t)
+		for (auto const &l : m_vEntities[t])
+			m_vUniformSlot[l] = slot++;
 
-	dLights.push_back(dl);
+	m_vvec4Uniforms.assign(6 * slot, glm::vec4(0.f));
 
 	m_bRefreshShader = true;
 
-	return true;
+	return e;
 }
 
-bool LightingSystem::addPointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, GLfloat constant, GLfloat linear, GLfloat quadratic)
+void LightingSystem::addPlacement(Entity e, glm::vec3 position, GLfloat constant, GLfloat linear, GLfloat quadratic)
 {
-	PLight pl;
-	pl.position = position;
-	pl.ambient = ambient;
-	pl.diffuse = diffuse;
-	pl.specular = specular;
-	pl.constant = constant;
-	pl.linear = linear;
-	pl.quadratic = quadratic;
+	SceneGraph::Node node = SceneGraph::getInstance().create();
+	SceneGraph::getInstance().setPosition(node, position);
+	m_Nodes.add(e, node);
+	m_Positions.add(e, position);
+
+	Attenuation attenuation;
+	attenuation.constant = constant;
+	attenuation.linear = linear;
+	attenuation.quadratic = quadratic;
+	m_Attenuations.add(e, attenuation);
+}
 
-	pl.on = true;
+bool LightingSystem::addDirectLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular)
+{
+	Entity e = addLight(DIRECTIONAL, ambient, diffuse, specular);
+	m_Directions.add(e, position);
 
-	pLights.push_back(pl);
+	return true;
+}
 
-	m_bRefreshShader = true;
+bool LightingSystem::addPointLight(glm::vec3 position, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, GLfloat constant, GLfloat linear, GLfloat quadratic)
+{
+	Entity e = addLight(POINT, ambient, diffuse, specular);
+	addPlacement(e, position, constant, linear, quadratic);
 
 	if (!m_pLightBulb)
 	{
@@ -172,24 +227,26 @@ bool LightingSystem::addPointLight(glm::vec3 position, glm::vec3 ambient, glm::v
 
 bool LightingSystem::addSpotLight(glm::vec3 position, glm::vec3 direction, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular, GLfloat constant, GLfloat linear, GLfloat quadratic, GLfloat cutOffDeg, GLfloat outerCutOffDeg, bool attachToCamera)
 {
-	SLight sl;
-	sl.position = position;
-	sl.direction = direction;
-	sl.ambient = ambient;
-	sl.diffuse = diffuse;
-	sl.specular = specular;
-	sl.constant = constant;
-	sl.linear = linear;
-	sl.quadratic = quadratic;
-	sl.cutOff = glm::cos(glm::radians(cutOffDeg));
-	sl.outerCutOff = glm::cos(glm::radians(outerCutOffDeg));
-	sl.attachedToCamera = attachToCamera;
-
-	sl.on = true;
-
-	sLights.push_back(sl);
+	Entity e = addLight(SPOT, ambient, diffuse, specular);
+	addPlacement(e, position, constant, linear, quadratic);
+
+	SpotCone cone;
+	cone.localDirection = direction;
+	cone.direction = direction;
+	cone.cutOff = glm::cos(glm::radians(cutOffDeg));
+	cone.outerCutOff = glm::cos(glm::radians(outerCutOffDeg));
+	cone.attachedToCamera = attachToCamera;
+
+	// Camera spot lights sit at the eye and point along the view's +Z axis, the node's -Z
+	if (attachToCamera)
+	{
+		SceneGraph::Node node = *m_Nodes.get(e);
+		cone.localDirection = glm::vec3(0.f, 0.f, -1.f);
+		SceneGraph::getInstance().setPosition(node, glm::vec3(0.f));
+		SceneGraph::getInstance().setParent(node, m_cameraNode);
+	}
 
-	m_bRefreshShader = true;
+	m_Cones.add(e, cone);
 
 	return true;
 }
@@ -199,15 +256,16 @@ void LightingSystem::draw(Shader s)
 	if (!m_bDrawLightBulbs)
 		return;
 
-	for (GLuint i = 0; i < pLights.size(); ++i)
+	for (auto const &e : m_vEntities[POINT])
 	{
-		m_pLightBulb->setPosition(pLights[i].position);
+		m_pLightBulb->setPosition(*m_Positions.get(e));
 
-		if (pLights[i].on)
+		if (*m_On.get(e) > 0.f)
 		{
-			m_pLightBulb->m_vec3DiffColor = pLights[i].diffuse;
-			m_pLightBulb->m_vec3SpecColor = pLights[i].specular;
-			m_pLightBulb->m_vec3EmisColor = pLights[i].diffuse;
+			LightColor *color = m_Colors.get(e);
+			m_pLightBulb->m_vec3DiffColor = color->diffuse;
+			m_pLightBulb->m_vec3SpecColor = color->specular;
+			m_pLightBulb->m_vec3EmisColor = color->diffuse;
 		}
 		else
 		{
@@ -218,21 +276,27 @@ void LightingSystem::draw(Shader s)
 	}
 }
 
-void LightingSystem::receiveEvent(Object * obj, const int event, void * data)
+void LightingSystem::toggle(LIGHT_TYPE type)
 {
-	if (event == BroadcastSystem::EVENT::KEY_PRESS)
+	for (auto const &e : m_vEntities[type])
 	{
-		int key;
-		memcpy(&key, data, sizeof(key));
+		GLfloat *on = m_On.get(e);
+		*on = 1.f - *on;
+	}
+}
+
+void LightingSystem::receiveEvent(const BroadcastSystem::Event &event)
+{
+	if (event.type == BroadcastSystem::EVENT::KEY_PRESS)
+	{
+		int key = event.key;
 
 		if (key == GLFW_KEY_1)
-			for (auto &l : dLights) l.on = !l.on;
+			toggle(DIRECTIONAL);
 		if (key == GLFW_KEY_2)
-			for (auto &l : pLights) l.on = !l.on;
-		if (key == GLFW_KEY_3)
-			for (auto &l : sLights) l.on = !l.on;
+			toggle(POINT);
 		if (key == GLFW_KEY_3)
-			for (auto &l : sLights) l.on = !l.on;
+			toggle(SPOT);
 		if (key == GLFW_KEY_GRAVE_ACCENT)
 			toggleShowPointLights();
 	}
@@ -258,17 +322,31 @@ Shader* LightingSystem::generateLightingShader()
 		vBuffer.append("#version 330 core\n");
 		vBuffer.append("layout(location = 0) in vec3 position;\n");
 		vBuffer.append("layout(location = 1) in vec3 normal;\n");
+		vBuffer.append("layout(location = 2) in float transformSlot;\n");
 		vBuffer.append("out vec3 Normal;\n");
 		vBuffer.append("out vec3 FragPos;\n");
 		vBuffer.append("uniform mat4 model;\n");
-		vBuffer.append("uniform mat4 worldRotation;\n");
-		vBuffer.append("uniform mat4 view;\n");
-		vBuffer.append("uniform mat4 projection;\n");
+		vBuffer.append("uniform bool useModelTransforms;\n");
+		vBuffer.append("uniform samplerBuffer modelTransforms;\n");
+		vBuffer.append("layout(std140) uniform FrameUniforms {\n"); // shared per-frame block, see Engine::update
+		vBuffer.append("	mat4 view;\n");
+		vBuffer.append("	mat4 projection;\n");
+		vBuffer.append("	mat4 worldRotation;\n");
+		vBuffer.append("};\n");
+		vBuffer.append("invariant gl_Position;\n"); // must match the depth pre-pass bit for bit for GL_EQUAL testing
+		vBuffer.append("mat4 getModelMatrix()\n"); // geometry arena draws fetch their transform by slot
+		vBuffer.append("{\n");
+		vBuffer.append("	if (!useModelTransforms)\n");
+		vBuffer.append("		return model;\n");
+		vBuffer.append("	int base = int(transformSlot) * 4;\n");
+		vBuffer.append("	return mat4(texelFetch(modelTransforms, base), texelFetch(modelTransforms, base + 1), texelFetch(modelTransforms, base + 2), texelFetch(modelTransforms, base + 3));\n");
+		vBuffer.append("}\n");
 		vBuffer.append("void main()\n");
 		vBuffer.append("{\n");
-		vBuffer.append("	gl_Position = projection * view * worldRotation * model * vec4(position, 1.0f);\n");
-		vBuffer.append("	FragPos = vec3(worldRotation * model * vec4(position, 1.0f));\n");
-		vBuffer.append("	Normal = normalize(mat3(transpose(inverse(worldRotation * model))) * normal);\n"); // this preserves correct normals under nonuniform scaling by using the normal matrix
+		vBuffer.append("	mat4 modelMatrix = getModelMatrix();\n");
+		vBuffer.append("	gl_Position = projection * view * worldRotation * modelMatrix * vec4(position, 1.0f);\n");
+		vBuffer.append("	FragPos = vec3(worldRotation * modelMatrix * vec4(position, 1.0f));\n");
+		vBuffer.append("	Normal = normalize(mat3(transpose(inverse(worldRotation * modelMatrix))) * normal);\n"); // this preserves correct normals under nonuniform scaling by using the normal matrix
 		vBuffer.append("}\n");
 	} // VERTEX SHADER
 
@@ -285,92 +363,55 @@ Shader* LightingSystem::generateLightingShader()
 		fBuffer.append("};\n");
 		fBuffer.append("uniform Material material;\n");
 
-		if (dLights.size() > 0)
+		size_t nDir = m_vEntities[DIRECTIONAL].size();
+		size_t nPoint = m_vEntities[POINT].size();
+		size_t nSpot = m_vEntities[SPOT].size();
+		size_t nLights = nDir + nPoint + nSpot;
+
+		if (nLights > 0)
 		{
-			fBuffer.append("#define N_DIR_LIGHTS "); fBuffer.append(std::to_string(dLights.size())); fBuffer.append("\n");
-			fBuffer.append("struct DirLight {\n");
-			fBuffer.append("    vec3 position;\n");
-			fBuffer.append("    vec3 ambient;\n");
-			fBuffer.append("    vec3 diffuse;\n");
-			fBuffer.append("    vec3 specular;\n");
+			fBuffer.append("#define N_LIGHTS "); fBuffer.append(std::to_string(nLights)); fBuffer.append("\n");
+			fBuffer.append("#define FIRST_POINT_LIGHT "); fBuffer.append(std::to_string(nDir)); fBuffer.append("\n");
+			fBuffer.append("#define FIRST_SPOT_LIGHT "); fBuffer.append(std::to_string(nDir + nPoint)); fBuffer.append("\n");
+			fBuffer.append("layout(std140) uniform LightUniforms {\n"); // see LightingSystem::packUniforms
+			fBuffer.append("    vec4 lightPosition[N_LIGHTS];\n"); // world position, or direction towards a directional light
+			fBuffer.append("    vec4 lightDirection[N_LIGHTS];\n"); // spot direction, w = cos of the inner cut-off
+			fBuffer.append("    vec4 lightAttenuation[N_LIGHTS];\n"); // constant, linear, quadratic, w = cos of the outer cut-off
+			fBuffer.append("    vec4 lightAmbient[N_LIGHTS];\n"); // w = 1 if on, 0 if off
+			fBuffer.append("    vec4 lightDiffuse[N_LIGHTS];\n");
+			fBuffer.append("    vec4 lightSpecular[N_LIGHTS];\n");
 			fBuffer.append("};\n");
-			fBuffer.append("uniform DirLight dirLights[N_DIR_LIGHTS];\n");
-			fBuffer.append("vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)\n");
+			fBuffer.append("vec3 CalcLight(int i, vec3 lightDir, vec3 normal, vec3 viewDir)\n");
 			fBuffer.append("{\n");
-			fBuffer.append("    vec3 lightDir = normalize(light.position);\n");
 			fBuffer.append("    float diff = max(dot(normal, lightDir), 0.0);\n");
 			fBuffer.append("    vec3 reflectDir = reflect(-lightDir, normal);\n");
 			fBuffer.append("    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);\n");
-			fBuffer.append("    vec3 ambient = light.ambient * material.ambient;\n");
-			fBuffer.append("    vec3 diffuse = light.diffuse * diff * material.diffuse;\n");
-			fBuffer.append("    vec3 specular = light.specular * spec * material.specular;\n");
-			fBuffer.append("    return (ambient + diffuse + specular);\n");
+			fBuffer.append("    vec3 ambient = lightAmbient[i].rgb * material.ambient;\n");
+			fBuffer.append("    vec3 diffuse = lightDiffuse[i].rgb * diff * material.diffuse;\n");
+			fBuffer.append("    vec3 specular = lightSpecular[i].rgb * spec * material.specular;\n");
+			fBuffer.append("    return (ambient + diffuse + specular) * lightAmbient[i].w;\n");
 			fBuffer.append("}\n");
-		}
-		if (pLights.size() > 0)
-		{
-			fBuffer.append("#define N_POINT_LIGHTS "); fBuffer.append(std::to_string(pLights.size())); fBuffer.append("\n");
-			fBuffer.append("struct PointLight {\n");
-			fBuffer.append("    vec3 position;\n");
-			fBuffer.append("    float constant;\n");
-			fBuffer.append("    float linear;\n");
-			fBuffer.append("    float quadratic;\n");
-			fBuffer.append("    vec3 ambient;\n");
-			fBuffer.append("    vec3 diffuse;\n");
-			fBuffer.append("    vec3 specular;\n");
-			fBuffer.append("};\n");
-			fBuffer.append("uniform PointLight pointLights[N_POINT_LIGHTS];\n");
-			fBuffer.append("vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)\n");
+			fBuffer.append("vec3 CalcDirLight(int i, vec3 normal, vec3 viewDir)\n");
 			fBuffer.append("{\n");
-			fBuffer.append("    vec3 lightDir = normalize(light.position - fragPos);\n");
-			fBuffer.append("    float diff = max(dot(normal, lightDir), 0.0);\n");
-			fBuffer.append("    vec3 reflectDir = reflect(-lightDir, normal);\n");
-			fBuffer.append("    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);\n");
-			fBuffer.append("    float distance = length(light.position - fragPos);\n");
-			fBuffer.append("    float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));\n");
-			fBuffer.append("    vec3 ambient = light.ambient * material.ambient;\n");
-			fBuffer.append("    vec3 diffuse = light.diffuse * diff * material.diffuse;\n");
-			fBuffer.append("    vec3 specular = light.specular * spec * material.specular;\n");
-			fBuffer.append("    ambient *= attenuation;\n");
-			fBuffer.append("    diffuse *= attenuation;\n");
-			fBuffer.append("    specular *= attenuation;\n");
-			fBuffer.append("    return (ambient + diffuse + specular);\n");
+			fBuffer.append("    return CalcLight(i, normalize(lightPosition[i].xyz), normal, viewDir);\n");
 			fBuffer.append("}\n");
-		}
-		if (sLights.size() > 0)
-		{
-			fBuffer.append("#define N_SPOT_LIGHTS "); fBuffer.append(std::to_string(sLights.size())); fBuffer.append("\n");
-			fBuffer.append("struct SpotLight {\n");
-			fBuffer.append("    vec3 position;\n");
-			fBuffer.append("    vec3 direction;\n");
-			fBuffer.append("    float cutOff;\n");
-			fBuffer.append("    float outerCutOff;\n");
-			fBuffer.append("    float constant;\n");
-			fBuffer.append("    float linear;\n");
-			fBuffer.append("    float quadratic;\n");
-			fBuffer.append("    vec3 ambient;\n");
-			fBuffer.append("    vec3 diffuse;\n");
-			fBuffer.append("    vec3 specular;\n");
-			fBuffer.append("};\n");
-			fBuffer.append("uniform SpotLight spotLights[N_SPOT_LIGHTS];\n");
-			fBuffer.append("vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir)\n");
+			fBuffer.append("float CalcAttenuation(int i, vec3 fragPos)\n");
 			fBuffer.append("{\n");
-			fBuffer.append("    vec3 lightDir = normalize(light.position - fragPos);\n");
-			fBuffer.append("    float diff = max(dot(normal, lightDir), 0.0);\n");
-			fBuffer.append("    vec3 reflectDir = reflect(-lightDir, normal);\n");
-			fBuffer.append("    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);\n");
-			fBuffer.append("    float distance = length(light.position - fragPos);\n");
-			fBuffer.append("    float attenuation = 1.0f / (light.constant + light.linear * distance + light.quadratic * (distance * distance));\n");
-			fBuffer.append("    float theta = dot(lightDir, normalize(-light.direction));\n");
-			fBuffer.append("    float epsilon = light.cutOff - light.outerCutOff;\n");
-			fBuffer.append("    float intensity = clamp((theta - light.outerCutOff) / epsilon, 0.0, 1.0);\n");
-			fBuffer.append("    vec3 ambient = light.ambient * material.ambient;\n");
-			fBuffer.append("    vec3 diffuse = light.diffuse * diff * material.diffuse;\n");
-			fBuffer.append("    vec3 specular = light.specular * spec * material.specular;\n");
-			fBuffer.append("    ambient *= attenuation * intensity;\n");
-			fBuffer.append("    diffuse *= attenuation * intensity;\n");
-			fBuffer.append("    specular *= attenuation * intensity;\n");
-			fBuffer.append("    return (ambient + diffuse + specular);\n");
+			fBuffer.append("    float distance = length(lightPosition[i].xyz - fragPos);\n");
+			fBuffer.append("    return 1.0f / (lightAttenuation[i].x + lightAttenuation[i].y * distance + lightAttenuation[i].z * (distance * distance));\n");
+			fBuffer.append("}\n");
+			fBuffer.append("vec3 CalcPointLight(int i, vec3 normal, vec3 fragPos, vec3 viewDir)\n");
+			fBuffer.append("{\n");
+			fBuffer.append("    vec3 lightDir = normalize(lightPosition[i].xyz - fragPos);\n");
+			fBuffer.append("    return CalcLight(i, lightDir, normal, viewDir) * CalcAttenuation(i, fragPos);\n");
+			fBuffer.append("}\n");
+			fBuffer.append("vec3 CalcSpotLight(int i, vec3 normal, vec3 fragPos, vec3 viewDir)\n");
+			fBuffer.append("{\n");
+			fBuffer.append("    vec3 lightDir = normalize(lightPosition[i].xyz - fragPos);\n");
+			fBuffer.append("    float theta = dot(lightDir, normalize(-lightDirection[i].xyz));\n");
+			fBuffer.append("    float epsilon = lightDirection[i].w - lightAttenuation[i].w;\n");
+			fBuffer.append("    float intensity = clamp((theta - lightAttenuation[i].w) / epsilon, 0.0, 1.0);\n");
+			fBuffer.append("    return CalcLight(i, lightDir, normal, viewDir) * CalcAttenuation(i, fragPos) * intensity;\n");
 			fBuffer.append("}\n");
 		}
 
@@ -386,20 +427,20 @@ Shader* LightingSystem::generateLightingShader()
 		fBuffer.append("    if(!gl_FrontFacing)\n");
 		fBuffer.append("		norm = -norm;\n");
 		fBuffer.append("    vec3 result = vec3(0.f);\n");
-		if (dLights.size() > 0)
+		if (nDir > 0)
 		{
-			fBuffer.append("    for(int i = 0; i < N_DIR_LIGHTS; i++)\n");
-			fBuffer.append("        result += CalcDirLight(dirLights[i], norm, viewDirection);\n");
+			fBuffer.append("    for(int i = 0; i < FIRST_POINT_LIGHT; i++)\n");
+			fBuffer.append("        result += CalcDirLight(i, norm, viewDirection);\n");
 		}
-		if (pLights.size() > 0)
+		if (nPoint > 0)
 		{
-			fBuffer.append("    for(int i = 0; i < N_POINT_LIGHTS; i++)\n");
-			fBuffer.append("        result += CalcPointLight(pointLights[i], norm, FragPos, viewDirection);\n");
+			fBuffer.append("    for(int i = FIRST_POINT_LIGHT; i < FIRST_SPOT_LIGHT; i++)\n");
+			fBuffer.append("        result += CalcPointLight(i, norm, FragPos, viewDirection);\n");
 		}
-		if (sLights.size() > 0)
+		if (nSpot > 0)
 		{
-			fBuffer.append("    for(int i = 0; i < N_SPOT_LIGHTS; i++)\n");
-			fBuffer.append("        result += CalcSpotLight(spotLights[i], norm, FragPos, viewDirection);\n");
+			fBuffer.append("    for(int i = FIRST_SPOT_LIGHT; i < N_LIGHTS; i++)\n");
+			fBuffer.append("        result += CalcSpotLight(i, norm, FragPos, viewDirection);\n");
 		}
 		fBuffer.append("    result += material.emissive;\n");
 		//fBuffer.append("    vec3 gammaCorrection = vec3(1.f/2.2f);\n");
@@ -413,7 +454,13 @@ Shader* LightingSystem::generateLightingShader()
 
 	m_bRefreshShader = false;
 
-	return new Shader(vBuffer.c_str(), fBuffer.c_str());
+	Shader *shader = new Shader(vBuffer.c_str(), fBuffer.c_str());
+
+	GLuint blockIndex = glGetUniformBlockIndex(shader->m_nProgram, "LightUniforms");
+	if (blockIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(shader->m_nProgram, blockIndex, LIGHT_UNIFORMS_BINDING);
+
+	return shader;
 }
 
 #endif
\ No newline at end of file
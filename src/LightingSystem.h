@@ -6,42 +6,48 @@
 #include "BroadcastSystem.h"
 #include "Shader.h"
 #include "Icosphere.h"
+#include "SceneGraph.h"
+#include "ComponentStore.h"
 
 #include <glm/glm.hpp>
 
+#define LIGHT_UNIFORMS_BINDING 1
+
+// Lights are entities with components in dense arrays; each system below walks only the arrays it
+// needs. Every light has a colour and an on switch, directional lights a direction, point and spot
+// lights a scene graph node, world position and attenuation, and spot lights a cone. The shader
+// reads all lights from one uniform block laid out as one vec4 array per quantity, so packing is a
+// straight copy per component array.
 class LightingSystem : public BroadcastSystem::Listener
 {
 public:
-	struct BasicLight {
-		GLboolean on;
+	enum LIGHT_TYPE {
+		DIRECTIONAL,
+		POINT,
+		SPOT,
+		LIGHT_TYPE_COUNT
+	};
+
+	struct LightColor {
 		glm::vec3 ambient;
 		glm::vec3 diffuse;
 		glm::vec3 specular;
 	};
 
-	struct DLight : BasicLight {
-		glm::vec3 position;
-	};
-
-	struct PLight : BasicLight {
-		glm::vec3 position;
+	struct Attenuation {
 		GLfloat constant;
 		GLfloat linear;
 		GLfloat quadratic;
 	};
 
-	struct SLight : PLight {
-		glm::vec3 direction;
+	struct SpotCone {
+		glm::vec3 localDirection;	// in the node's frame
+		glm::vec3 direction;		// world, refreshed by update()
 		GLfloat cutOff;
 		GLfloat outerCutOff;
 		bool attachedToCamera;
 	};
 
-public:
-	std::vector<DLight> dLights;
-	std::vector<PLight> pLights;
-	std::vector<SLight> sLights;
-
 public:
 	LightingSystem();
 	~LightingSystem();
@@ -49,6 +55,14 @@ public:
     // Uses the current shader
 	void update(glm::mat4 view, Shader *s);
 
+	// Spot lights attached to the camera become children of this node
+	void setCameraNode(SceneGraph::Node camera);
+
+	// Turns every point light about the vertical axis through the origin and tints it by where it is
+	void orbitPointLights(float radians);
+
+	size_t getLightCount(LIGHT_TYPE type) { return m_vEntities[type].size(); }
+
 	bool addDirectLight(glm::vec3 position = glm::vec3(1.0f)
 		, glm::vec3 ambient = glm::vec3(0.2f)
 		, glm::vec3 diffuse = glm::vec3(1.f)
@@ -81,15 +95,40 @@ public:
 
 	void draw(Shader s);
 
-	void receiveEvent(Object * obj, const int event, void * data);
+	void receiveEvent(const BroadcastSystem::Event &event);
 
 	void showPointLights(bool yesno);
 	bool toggleShowPointLights();
 
 private:
+	Entity addLight(LIGHT_TYPE type, glm::vec3 ambient, glm::vec3 diffuse, glm::vec3 specular);
+	void addPlacement(Entity e, glm::vec3 position, GLfloat constant, GLfloat linear, GLfloat quadratic);
+	void toggle(LIGHT_TYPE type);
+	void packUniforms();
+
+	EntityRegistry m_Entities;
+	std::vector<Entity> m_vEntities[LIGHT_TYPE_COUNT];	// in shader order within each type
+
+	ComponentArray<LightColor> m_Colors;
+	ComponentArray<GLfloat> m_On;				// 1 or 0, scales the light's contribution
+	ComponentArray<glm::vec3> m_Directions;		// towards directional lights
+	ComponentArray<SceneGraph::Node> m_Nodes;	// point and spot lights; added with m_Positions and
+	ComponentArray<glm::vec3> m_Positions;		// never removed, so the two share slots
+	ComponentArray<Attenuation> m_Attenuations;
+	ComponentArray<SpotCone> m_Cones;
+
+	// Uniform block: N vec4s each of position, direction, attenuation, ambient, diffuse, specular
+	std::vector<unsigned int> m_vUniformSlot;	// per entity
+	std::vector<glm::vec4> m_vvec4Uniforms;
+	GLuint m_glLightUBO;
+
+	std::vector<SceneGraph::Node> m_vOrbitNodes;
+	std::vector<glm::vec3> m_vvec3OrbitPositions;
+
 	GLboolean m_bRefreshShader, m_bDrawLightBulbs;
 
 	Icosphere *m_pLightBulb;
+	SceneGraph::Node m_cameraNode;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,291 @@
+#include "MeasurementBox.h"
+
+#include <tribox3.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Parallel.h"
+
+MeasurementBox::MeasurementBox(glm::vec3 bbMin, glm::vec3 bbMax)
+	: m_vec3Min(glm::min(bbMin, bbMax))
+	, m_vec3Max(glm::max(bbMin, bbMax))
+	, m_nLastUpdateTris(0)
+	, m_glVAO(0)
+	, m_glVBO(0)
+	, m_bDirtyGL(true)
+{
+}
+
+MeasurementBox::~MeasurementBox()
+{
+	if (m_glVAO)
+		glDeleteVertexArrays(1, &m_glVAO);
+	if (m_glVBO)
+		glDeleteBuffers(1, &m_glVBO);
+}
+
+void MeasurementBox::addModel(ObjModel *model)
+{
+	ModelState state;
+	state.model = model;
+	state.area = 0.0;
+	m_vModelStates.push_back(state);
+
+	resetModel(model);
+}
+
+void MeasurementBox::removeModel(ObjModel *model)
+{
+	for (size_t i = 0; i < m_vModelStates.size(); ++i)
+	{
+		if (m_vModelStates[i].model == model)
+		{
+			m_vModelStates.erase(m_vModelStates.begin() + i);
+			return;
+		}
+	}
+}
+
+void MeasurementBox::resetModel(ObjModel *model)
+{
+	ModelState *state = getState(model);
+	if (!state)
+		return;
+
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+
+	state->inside.assign(inds.size() / 3, 0);
+	state->area = 0.0;
+
+	// The model-space box only finds candidates; triangles are tested and measured in scene space
+	glm::vec3 bbMin, bbMax;
+	model->toModelSpace(m_vec3Min, m_vec3Max, bbMin, bbMax);
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	m_vuiCandidates.clear();
+	model->getBVH().queryAABB(bbMin, bbMax, verts, inds, m_vuiCandidates);
+
+	for (auto const &t : m_vuiCandidates)
+	{
+		glm::vec3 a(modelMatrix * glm::vec4(verts[inds[3 * t + 0]], 1.f));
+		glm::vec3 b(modelMatrix * glm::vec4(verts[inds[3 * t + 1]], 1.f));
+		glm::vec3 c(modelMatrix * glm::vec4(verts[inds[3 * t + 2]], 1.f));
+		float area = getTriangleSurfaceAreaInAABB(a, b, c, m_vec3Min, m_vec3Max);
+		if (area > 0.f)
+		{
+			state->inside[t] = 1;
+			state->area += area;
+		}
+	}
+}
+
+MeasurementBox::ModelState* MeasurementBox::getState(ObjModel *model)
+{
+	for (auto &state : m_vModelStates)
+		if (state.model == model)
+			return &state;
+
+	return NULL;
+}
+
+void MeasurementBox::setBounds(glm::vec3 bbMin, glm::vec3 bbMax)
+{
+	glm::vec3 newMin(glm::min(bbMin, bbMax)), newMax(glm::max(bbMin, bbMax));
+
+	m_nLastUpdateTris = 0;
+
+	// Grow first, then shrink, so every intermediate box is valid
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (newMax[axis] > m_vec3Max[axis])
+			moveFace(axis, true, newMax[axis]);
+		if (newMin[axis] < m_vec3Min[axis])
+			moveFace(axis, false, newMin[axis]);
+	}
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		if (newMax[axis] < m_vec3Max[axis])
+			moveFace(axis, true, newMax[axis]);
+		if (newMin[axis] > m_vec3Min[axis])
+			moveFace(axis, false, newMin[axis]);
+	}
+
+	m_bDirtyGL = true;
+}
+
+void MeasurementBox::translate(glm::vec3 delta)
+{
+	setBounds(m_vec3Min + delta, m_vec3Max + delta);
+}
+
+void MeasurementBox::resize(glm::vec3 delta)
+{
+	setBounds(m_vec3Min, glm::max(m_vec3Max + delta, m_vec3Min));
+}
+
+// Only triangles touching the slab between the old and new face position can change state
+void MeasurementBox::moveFace(int axis, bool maxFace, float value)
+{
+	float oldValue = maxFace ? m_vec3Max[axis] : m_vec3Min[axis];
+
+	glm::vec3 slabMin(m_vec3Min), slabMax(m_vec3Max);
+	slabMin[axis] = std::min(oldValue, value);
+	slabMax[axis] = std::max(oldValue, value);
+
+	if (maxFace)
+		m_vec3Max[axis] = value;
+	else
+		m_vec3Min[axis] = value;
+
+	for (auto &state : m_vModelStates)
+	{
+		const std::vector<glm::vec3> &verts = state.model->getVertices();
+		const std::vector<unsigned int> &inds = state.model->getIndices();
+
+		glm::vec3 queryMin, queryMax;
+		state.model->toModelSpace(slabMin, slabMax, queryMin, queryMax);
+		glm::mat4 modelMatrix(state.model->getModelMatrix());
+
+		m_vuiCandidates.clear();
+		state.model->getBVH().queryAABB(queryMin, queryMax, verts, inds, m_vuiCandidates);
+
+		for (auto const &t : m_vuiCandidates)
+		{
+			glm::vec3 a(modelMatrix * glm::vec4(verts[inds[3 * t + 0]], 1.f));
+			glm::vec3 b(modelMatrix * glm::vec4(verts[inds[3 * t + 1]], 1.f));
+			glm::vec3 c(modelMatrix * glm::vec4(verts[inds[3 * t + 2]], 1.f));
+			float area = getTriangleSurfaceAreaInAABB(a, b, c, m_vec3Min, m_vec3Max);
+			unsigned char inside = area > 0.f ? 1 : 0;
+
+			if (inside == state.inside[t])
+				continue;
+
+			state.inside[t] = inside;
+			state.area += inside ? area : -glm::length(glm::cross(b - a, c - a)) * 0.5;
+		}
+
+		m_nLastUpdateTris += m_vuiCandidates.size();
+	}
+}
+
+double MeasurementBox::getArea(ObjModel *model)
+{
+	ModelState *state = getState(model);
+	return state ? state->area : 0.0;
+}
+
+double MeasurementBox::getTotalArea()
+{
+	double total = 0.0;
+	for (auto const &state : m_vModelStates)
+		total += state.area;
+
+	return total;
+}
+
+std::vector<bool> MeasurementBox::getTrianglesInside(ObjModel *model)
+{
+	ModelState *state = getState(model);
+	if (!state)
+		return std::vector<bool>();
+
+	return std::vector<bool>(state->inside.begin(), state->inside.end());
+}
+
+SurfaceStats MeasurementBox::getSurfaceStats(ObjModel *model)
+{
+	SurfaceStats result(m_vec3Min.y, m_vec3Max.y);
+
+	ModelState *state = getState(model);
+	if (!state)
+		return result;
+
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<SurfaceStats> partial(nThreads, result);
+
+	Parallel::parallelFor(state->inside.size(), [&](size_t begin, size_t end, unsigned int chunk) {
+		for (size_t t = begin; t < end; ++t)
+		{
+			if (!state->inside[t])
+				continue;
+
+			glm::vec3 a(modelMatrix * glm::vec4(verts[inds[3 * t + 0]], 1.f));
+			glm::vec3 b(modelMatrix * glm::vec4(verts[inds[3 * t + 1]], 1.f));
+			glm::vec3 c(modelMatrix * glm::vec4(verts[inds[3 * t + 2]], 1.f));
+			partial[chunk].addTriangle(a, b, c, m_vec3Min, m_vec3Max);
+		}
+	}, nThreads);
+
+	for (auto const &stats : partial)
+		result.merge(stats);
+
+	return result;
+}
+
+void MeasurementBox::initGL()
+{
+	glGenVertexArrays(1, &m_glVAO);
+	glGenBuffers(1, &m_glVBO);
+
+	glBindVertexArray(m_glVAO);
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+	glBufferData(GL_ARRAY_BUFFER, 24 * sizeof(glm::vec3), NULL, GL_DYNAMIC_DRAW);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+	glBindVertexArray(0);
+}
+
+// Rewrite the 12 edges as line segments
+void MeasurementBox::updateGL()
+{
+	glm::vec3 c[8];
+	for (int i = 0; i < 8; ++i)
+		c[i] = glm::vec3(i & 1 ? m_vec3Max.x : m_vec3Min.x, i & 2 ? m_vec3Max.y : m_vec3Min.y, i & 4 ? m_vec3Max.z : m_vec3Min.z);
+
+	glm::vec3 lines[24] = {
+		c[0], c[1], c[2], c[3], c[4], c[5], c[6], c[7],	// x edges
+		c[0], c[2], c[1], c[3], c[4], c[6], c[5], c[7],	// y edges
+		c[0], c[4], c[1], c[5], c[2], c[6], c[3], c[7]	// z edges
+	};
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_glVBO);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(lines), lines);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	m_bDirtyGL = false;
+}
+
+void MeasurementBox::draw()
+{
+	if (!m_glVAO)
+		initGL();
+	if (m_bDirtyGL)
+		updateGL();
+
+	glBindVertexArray(m_glVAO);
+	glDrawArrays(GL_LINES, 0, 24);
+	glBindVertexArray(0);
+}
+
+float MeasurementBox::getTriangleSurfaceAreaInAABB(glm::vec3 triVert1, glm::vec3 triVert2, glm::vec3 triVert3, glm::vec3 bbMin, glm::vec3 bbMax)
+{
+	glm::vec3 boxCenter((bbMax + bbMin) * 0.5f);
+	glm::vec3 boxHalfExtents(abs(bbMax - bbMin) * 0.5f);
+	float verts[3][3] = {
+		{ triVert1.x, triVert1.y, triVert1.z },
+		{ triVert2.x, triVert2.y, triVert2.z },
+		{ triVert3.x, triVert3.y, triVert3.z }
+	};
+
+	// No overlap
+	if (triBoxOverlap(glm::value_ptr(boxCenter), glm::value_ptr(boxHalfExtents), verts) == 0)
+		return 0.0f;
+
+	// Process overlap
+	return glm::length(glm::cross(triVert2 - triVert1, triVert3 - triVert1)) * 0.5;
+}
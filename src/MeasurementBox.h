@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif // !GLEW_STATIC
+#include <GL/glew.h>
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+#include "ObjModel.h"
+#include "SurfaceStats.h"
+
+// Axis-aligned measurement box in scene space (before the world rotation) that tracks the
+// surface area of the triangles it overlaps. Moving a face only re-tests the triangles in the
+// slab the face swept, found through each model's BVH, so dragging costs far less than a full pass.
+class MeasurementBox
+{
+public:
+	MeasurementBox(glm::vec3 bbMin, glm::vec3 bbMax);
+	~MeasurementBox();
+
+	void addModel(ObjModel *model);
+	void removeModel(ObjModel *model);
+
+	// Recompute a model's state from scratch, e.g. after its indices changed
+	void resetModel(ObjModel *model);
+
+	void setBounds(glm::vec3 bbMin, glm::vec3 bbMax);
+	void translate(glm::vec3 delta);
+	void resize(glm::vec3 delta);	// moves the max corner
+
+	glm::vec3 getMin() { return m_vec3Min; }
+	glm::vec3 getMax() { return m_vec3Max; }
+
+	double getArea(ObjModel *model);
+	double getTotalArea();
+
+	// Triangles last tested by incremental updates, for profiling
+	size_t getLastUpdateCount() { return m_nLastUpdateTris; }
+
+	// Per-triangle flags for the triangles currently overlapping the box, usable as a selection
+	std::vector<bool> getTrianglesInside(ObjModel *model);
+
+	// Leaf angle and height distributions of the triangles inside, in scene space, in one parallel pass
+	SurfaceStats getSurfaceStats(ObjModel *model);
+
+	void draw();	// with the current shader
+
+	static float getTriangleSurfaceAreaInAABB(glm::vec3 triVert1, glm::vec3 triVert2, glm::vec3 triVert3, glm::vec3 bbMin, glm::vec3 bbMax);
+
+private:
+	struct ModelState {
+		ObjModel *model;
+		std::vector<unsigned char> inside;	// per triangle
+		double area;
+	};
+
+	ModelState* getState(ObjModel *model);
+	void moveFace(int axis, bool maxFace, float value);
+	void initGL();
+	void updateGL();
+
+	glm::vec3 m_vec3Min, m_vec3Max;
+	std::vector<ModelState> m_vModelStates;
+	std::vector<unsigned int> m_vuiCandidates;
+	size_t m_nLastUpdateTris;
+
+	GLuint m_glVAO, m_glVBO;
+	bool m_bDirtyGL;
+};
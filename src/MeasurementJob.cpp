@@ -0,0 +1,136 @@
+#include "MeasurementJob.h"
+
+#include <chrono>
+#include <algorithm>
+
+#include "MeasurementBox.h"
+#include "Parallel.h"
+
+MeasurementJob::MeasurementJob(const std::vector<ObjModel*> &models, glm::vec3 bbMin, glm::vec3 bbMax)
+	: m_vec3Min(glm::min(bbMin, bbMax))
+	, m_vec3Max(glm::max(bbMin, bbMax))
+	, m_bCancelled(false)
+	, m_bFinished(false)
+	, m_nProcessed(0)
+	, m_nTotal(0)
+	, m_dSeconds(0.0)
+{
+	for (auto const &m : models)
+	{
+		ModelResult result;
+		result.model = m;
+		result.area = 0.0;
+		result.stats = SurfaceStats(m_vec3Min.y, m_vec3Max.y);
+		m_vResults.push_back(result);
+	}
+}
+
+MeasurementJob::~MeasurementJob()
+{
+}
+
+// The job holds a reference, so a superseded job can be dropped by its owner while it winds down
+void MeasurementJob::start()
+{
+	std::shared_ptr<MeasurementJob> self(shared_from_this());
+	m_Job = JobSystem::getInstance().submitBackground([self]() { self->run(); });
+}
+
+void MeasurementJob::cancel()
+{
+	m_bCancelled = true;
+}
+
+void MeasurementJob::wait()
+{
+	JobSystem::getInstance().wait(m_Job);
+}
+
+float MeasurementJob::getProgress()
+{
+	size_t total = m_nTotal;
+	return total > 0 ? static_cast<float>(m_nProcessed) / static_cast<float>(total) : 0.f;
+}
+
+double MeasurementJob::getTotalArea()
+{
+	double area = 0.0;
+	for (auto const &r : m_vResults)
+		area += r.area;
+
+	return area;
+}
+
+void MeasurementJob::run()
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// Candidates first, so progress has a total to count against
+	std::vector<std::vector<unsigned int>> candidates(m_vResults.size());
+	size_t total = 0;
+	for (size_t i = 0; i < m_vResults.size(); ++i)
+	{
+		ObjModel *model = m_vResults[i].model;
+		glm::vec3 bbMin, bbMax;
+		model->toModelSpace(m_vec3Min, m_vec3Max, bbMin, bbMax);
+		model->getBVH().queryAABB(bbMin, bbMax, model->getVertices(), model->getIndices(), candidates[i]);
+		total += candidates[i].size();
+	}
+	m_nTotal = total;
+
+	for (size_t i = 0; i < m_vResults.size() && !m_bCancelled; ++i)
+		measureModel(m_vResults[i], candidates[i]);
+
+	m_dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!m_bCancelled)
+		m_bFinished = true;
+}
+
+// Overlap, area and stats all come from the triangles in scene space, where the box is
+void MeasurementJob::measureModel(ModelResult &result, const std::vector<unsigned int> &candidates)
+{
+	ObjModel *model = result.model;
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	std::vector<unsigned char> inside(inds.size() / 3, 0);
+
+	// One job per batch rather than per thread, so cancelling stops within a batch and progress moves
+	// in steps no larger than one
+	unsigned int nBatches = std::max(1u, static_cast<unsigned int>((candidates.size() + MEASUREMENT_JOB_BATCH - 1) / MEASUREMENT_JOB_BATCH));
+	std::vector<double> areas(nBatches, 0.0);
+	std::vector<SurfaceStats> partial(nBatches, result.stats);
+
+	Parallel::parallelFor(candidates.size(), [&](size_t begin, size_t end, unsigned int batch) {
+		if (m_bCancelled)
+			return;
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			unsigned int t = candidates[i];
+			glm::vec3 a(modelMatrix * glm::vec4(verts[inds[3 * t + 0]], 1.f));
+			glm::vec3 b(modelMatrix * glm::vec4(verts[inds[3 * t + 1]], 1.f));
+			glm::vec3 c(modelMatrix * glm::vec4(verts[inds[3 * t + 2]], 1.f));
+
+			float area = MeasurementBox::getTriangleSurfaceAreaInAABB(a, b, c, m_vec3Min, m_vec3Max);
+			if (area <= 0.f)
+				continue;
+
+			inside[t] = 1;
+			areas[batch] += area;
+			partial[batch].addTriangle(a, b, c, m_vec3Min, m_vec3Max);
+		}
+
+		m_nProcessed += end - begin;
+	}, nBatches);
+
+	for (unsigned int i = 0; i < nBatches; ++i)
+	{
+		result.area += areas[i];
+		result.stats.merge(partial[i]);
+	}
+
+	result.inside.assign(inside.begin(), inside.end());
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+#include "SurfaceStats.h"
+#include "JobSystem.h"
+
+#define MEASUREMENT_JOB_BATCH 4096	// triangles per job, between progress updates and cancellation checks
+
+// Full surface measurement of a scene-space box over a set of models, run on the job system so the
+// window keeps drawing. The box is copied when the job is made and the pass only reads the models'
+// geometry, so the live measurement box can keep moving. Progress counts candidate triangles from
+// the models' BVHs. Results are only read back once finished and applied by the owner on the GL thread.
+class MeasurementJob : public std::enable_shared_from_this<MeasurementJob>
+{
+public:
+	struct ModelResult {
+		ObjModel *model;
+		double area;				// one-sided
+		SurfaceStats stats;
+		std::vector<bool> inside;	// per triangle, ready for ObjModel::setSelection
+	};
+
+public:
+	MeasurementJob(const std::vector<ObjModel*> &models, glm::vec3 bbMin, glm::vec3 bbMax);
+	~MeasurementJob();
+
+	void start();
+
+	// Batches not yet started are skipped; a cancelled job never finishes
+	void cancel();
+	void wait();
+
+	bool isCancelled() { return m_bCancelled; }
+	bool isFinished() { return m_bFinished; }
+
+	size_t getTrianglesProcessed() { return m_nProcessed; }
+	size_t getTriangleCount() { return m_nTotal; }	// 0 until the BVH queries are done
+	float getProgress();	// 0 to 1
+
+	glm::vec3 getMin() { return m_vec3Min; }
+	glm::vec3 getMax() { return m_vec3Max; }
+
+	// Only valid once finished
+	const std::vector<ModelResult>& getResults() { return m_vResults; }
+	double getTotalArea();
+	double getSeconds() { return m_dSeconds; }
+
+private:
+	void run();
+	void measureModel(ModelResult &result, const std::vector<unsigned int> &candidates);
+
+	glm::vec3 m_vec3Min, m_vec3Max;
+	std::vector<ModelResult> m_vResults;
+
+	JobSystem::JobHandle m_Job;
+	std::atomic<bool> m_bCancelled, m_bFinished;
+	std::atomic<size_t> m_nProcessed, m_nTotal;
+	double m_dSeconds;
+};
@@ -0,0 +1,189 @@
+#include "MeasurementVolume.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <emmintrin.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "PolygonClip.h"
+
+MeasurementVolume::MeasurementVolume(SHAPE shape, glm::mat4 volumeToScene, glm::vec3 halfExtents)
+	: m_eShape(shape)
+	, m_mat4VolumeToScene(volumeToScene)
+	, m_vec3HalfExtents(glm::abs(halfExtents))
+	, m_nLastCandidates(0)
+{
+	if (m_eShape == CYLINDER)
+		m_vec3BoundsHalfExtents = glm::vec3(m_vec3HalfExtents.x, m_vec3HalfExtents.y, m_vec3HalfExtents.x);
+	else
+		m_vec3BoundsHalfExtents = m_vec3HalfExtents;
+}
+
+MeasurementVolume::~MeasurementVolume()
+{
+}
+
+MeasurementVolume MeasurementVolume::fromBox(SHAPE shape, glm::vec3 bbMin, glm::vec3 bbMax, glm::mat4 rotation)
+{
+	glm::vec3 halfExtents(glm::abs(bbMax - bbMin) * 0.5f);
+	glm::mat4 volumeToScene(glm::translate(glm::mat4(), (bbMin + bbMax) * 0.5f) * glm::mat4(glm::mat3(rotation)));
+
+	if (shape == CYLINDER)
+		halfExtents = glm::vec3(std::min(halfExtents.x, halfExtents.z), halfExtents.y, std::min(halfExtents.x, halfExtents.z));
+
+	return MeasurementVolume(shape, volumeToScene, halfExtents);
+}
+
+double MeasurementVolume::measure(ObjModel *model, std::vector<bool> *inside)
+{
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+
+	glm::mat4 modelToVolume(glm::inverse(m_mat4VolumeToScene) * model->getModelMatrix());
+	glm::mat4 volumeToModel(glm::inverse(modelToVolume));
+
+	if (inside)
+		inside->assign(inds.size() / 3, false);
+
+	// The volume's bounds in model space pick the candidates, exactly as for the axis-aligned box
+	glm::vec3 bbMin(FLT_MAX), bbMax(-FLT_MAX);
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec3 corner(i & 1 ? 1.f : -1.f, i & 2 ? 1.f : -1.f, i & 4 ? 1.f : -1.f);
+		glm::vec3 p(volumeToModel * glm::vec4(corner * m_vec3BoundsHalfExtents, 1.f));
+		bbMin = glm::min(bbMin, p);
+		bbMax = glm::max(bbMax, p);
+	}
+
+	m_vuiCandidates.clear();
+	model->getBVH().queryAABB(bbMin, bbMax, verts, inds, m_vuiCandidates);
+	m_nLastCandidates = m_vuiCandidates.size();
+
+	double area = 0.0;
+	glm::vec3 tris[4][3];
+
+	for (size_t i = 0; i < m_vuiCandidates.size(); i += 4)
+	{
+		int count = static_cast<int>(std::min<size_t>(4, m_vuiCandidates.size() - i));
+
+		// Short batches repeat their last triangle; the extra lanes are masked off below
+		for (int k = 0; k < 4; ++k)
+		{
+			unsigned int t = m_vuiCandidates[i + std::min(k, count - 1)];
+			for (int v = 0; v < 3; ++v)
+				tris[k][v] = glm::vec3(modelToVolume * glm::vec4(verts[inds[3 * t + v]], 1.f));
+		}
+
+		int mask = overlapBox4(tris, m_vec3BoundsHalfExtents) & ((1 << count) - 1);
+
+		for (int k = 0; k < count; ++k)
+		{
+			if (!(mask & (1 << k)))
+				continue;
+
+			if (m_eShape == CYLINDER && !overlapCylinder(tris[k][0], tris[k][1], tris[k][2], m_vec3HalfExtents.x, m_vec3HalfExtents.y))
+				continue;
+
+			// The volume frame is rigid, so this is the scene-space area
+			area += glm::length(glm::cross(tris[k][1] - tris[k][0], tris[k][2] - tris[k][0])) * 0.5;
+			if (inside)
+				(*inside)[m_vuiCandidates[i + k]] = true;
+		}
+	}
+
+	return area;
+}
+
+// Lanes whose triangle lies wholly on one side of the origin-centred box along the given axis
+static inline __m128 separatedOnAxis(__m128 ax, __m128 ay, __m128 az, const __m128 v[3][3], const __m128 h[3])
+{
+	__m128 absMask = _mm_set1_ps(-0.f);
+
+	__m128 p[3];
+	for (int i = 0; i < 3; ++i)
+		p[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, v[i][0]), _mm_mul_ps(ay, v[i][1])), _mm_mul_ps(az, v[i][2]));
+
+	__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(h[0], _mm_andnot_ps(absMask, ax)), _mm_mul_ps(h[1], _mm_andnot_ps(absMask, ay))), _mm_mul_ps(h[2], _mm_andnot_ps(absMask, az)));
+	__m128 pMin = _mm_min_ps(p[0], _mm_min_ps(p[1], p[2]));
+	__m128 pMax = _mm_max_ps(p[0], _mm_max_ps(p[1], p[2]));
+
+	return _mm_or_ps(_mm_cmpgt_ps(pMin, r), _mm_cmplt_ps(pMax, _mm_xor_ps(r, absMask)));
+}
+
+// Separating-axis test of four triangles against the box [-h, h]: the three box axes, the triangle
+// normal and the nine edge-axis cross products. Returns a bit per overlapping triangle.
+int MeasurementVolume::overlapBox4(const glm::vec3 tris[4][3], glm::vec3 halfExtents)
+{
+	__m128 v[3][3];
+	for (int i = 0; i < 3; ++i)
+		for (int axis = 0; axis < 3; ++axis)
+			v[i][axis] = _mm_setr_ps(tris[0][i][axis], tris[1][i][axis], tris[2][i][axis], tris[3][i][axis]);
+
+	__m128 h[3] = { _mm_set1_ps(halfExtents.x), _mm_set1_ps(halfExtents.y), _mm_set1_ps(halfExtents.z) };
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.f);
+
+	// Box faces
+	__m128 sep = separatedOnAxis(one, zero, zero, v, h);
+	sep = _mm_or_ps(sep, separatedOnAxis(zero, one, zero, v, h));
+	sep = _mm_or_ps(sep, separatedOnAxis(zero, zero, one, v, h));
+
+	// Triangle edges
+	__m128 f[3][3];
+	for (int i = 0; i < 3; ++i)
+		for (int axis = 0; axis < 3; ++axis)
+			f[i][axis] = _mm_sub_ps(v[(i + 1) % 3][axis], v[i][axis]);
+
+	// Triangle plane
+	__m128 nx = _mm_sub_ps(_mm_mul_ps(f[0][1], f[1][2]), _mm_mul_ps(f[0][2], f[1][1]));
+	__m128 ny = _mm_sub_ps(_mm_mul_ps(f[0][2], f[1][0]), _mm_mul_ps(f[0][0], f[1][2]));
+	__m128 nz = _mm_sub_ps(_mm_mul_ps(f[0][0], f[1][1]), _mm_mul_ps(f[0][1], f[1][0]));
+	sep = _mm_or_ps(sep, separatedOnAxis(nx, ny, nz, v, h));
+
+	// Box axis x edge
+	for (int i = 0; i < 3; ++i)
+	{
+		__m128 negX = _mm_sub_ps(zero, f[i][0]), negY = _mm_sub_ps(zero, f[i][1]), negZ = _mm_sub_ps(zero, f[i][2]);
+		sep = _mm_or_ps(sep, separatedOnAxis(zero, negZ, f[i][1], v, h));
+		sep = _mm_or_ps(sep, separatedOnAxis(f[i][2], zero, negX, v, h));
+		sep = _mm_or_ps(sep, separatedOnAxis(negY, f[i][0], zero, v, h));
+	}
+
+	return ~_mm_movemask_ps(sep) & 0xf;
+}
+
+// The triangle is clipped to the cylinder's height; what is left meets the cylinder exactly when its
+// shadow on the XZ plane reaches the disc of the cylinder's radius
+bool MeasurementVolume::overlapCylinder(glm::vec3 a, glm::vec3 b, glm::vec3 c, float radius, float halfHeight)
+{
+	glm::vec3 tri[3] = { a, b, c };
+	glm::vec3 poly[5], tmp[5];
+
+	int n = PolygonClip::clipSlab(tri, 3, poly, tmp, 1, -halfHeight, halfHeight);
+	if (n == 0)
+		return false;
+
+	float radius2 = radius * radius;
+	bool positive = false, negative = false;
+
+	for (int i = 0; i < n; ++i)
+	{
+		glm::vec2 p(poly[i].x, poly[i].z), q(poly[(i + 1) % n].x, poly[(i + 1) % n].z);
+		glm::vec2 e(q - p);
+
+		// Closest point of the edge to the axis
+		float len2 = glm::dot(e, e);
+		float s = len2 > 0.f ? glm::clamp(-glm::dot(p, e) / len2, 0.f, 1.f) : 0.f;
+		glm::vec2 closest(p + e * s);
+		if (glm::dot(closest, closest) <= radius2)
+			return true;
+
+		float side = e.x * -p.y - e.y * -p.x;
+		positive = positive || side > 0.f;
+		negative = negative || side < 0.f;
+	}
+
+	// The axis passes through the polygon's interior
+	return !(positive && negative);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+
+// Oriented measurement volume: a box or a capped cylinder with its own rigid frame in scene space.
+// Triangles are found through the model's BVH with the volume's bounds, moved into the volume frame
+// one candidate at a time and tested there, so no copy of the mesh is ever transformed. Boxes use a
+// separating-axis test on four triangles at once with SSE; cylinders use it as a prefilter on their
+// bounding box before an exact test.
+class MeasurementVolume
+{
+public:
+	enum SHAPE {
+		BOX,
+		CYLINDER	// axis along the frame's Y
+	};
+
+public:
+	// For a cylinder, halfExtents.x is the radius and halfExtents.y half the height
+	MeasurementVolume(SHAPE shape, glm::mat4 volumeToScene, glm::vec3 halfExtents);
+	~MeasurementVolume();
+
+	// A scene-space box turned about its centre by the rotation part of a matrix, e.g. to line it up
+	// with the world rotation; cylinders get the largest radius that fits in the box
+	static MeasurementVolume fromBox(SHAPE shape, glm::vec3 bbMin, glm::vec3 bbMax, glm::mat4 rotation);
+
+	// One-sided area of the model's triangles that overlap the volume; optionally flags them
+	double measure(ObjModel *model, std::vector<bool> *inside = NULL);
+
+	SHAPE getShape() { return m_eShape; }
+	glm::vec3 getHalfExtents() { return m_vec3HalfExtents; }
+	glm::mat4 getVolumeToScene() { return m_mat4VolumeToScene; }
+
+	// Triangles tested by the last measure call, for profiling
+	size_t getLastCandidateCount() { return m_nLastCandidates; }
+
+private:
+	static int overlapBox4(const glm::vec3 tris[4][3], glm::vec3 halfExtents);
+	static bool overlapCylinder(glm::vec3 a, glm::vec3 b, glm::vec3 c, float radius, float halfHeight);
+
+	SHAPE m_eShape;
+	glm::mat4 m_mat4VolumeToScene;
+	glm::vec3 m_vec3HalfExtents;
+	glm::vec3 m_vec3BoundsHalfExtents;	// box the shape fits in, in its own frame
+
+	std::vector<unsigned int> m_vuiCandidates;
+	size_t m_nLastCandidates;
+};
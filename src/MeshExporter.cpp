@@ -0,0 +1,242 @@
+#include "MeshExporter.h"
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include "PolygonClip.h"
+
+MeshExporter::MeshExporter(std::string path)
+	: m_strPath(path)
+	, m_eFormat(PLY)
+	, m_nBuffered(0)
+	, m_nVertexCountOffset(0)
+	, m_nFaceCountOffset(0)
+	, m_nVertices(0)
+	, m_nTriangles(0)
+	, m_nBytes(0)
+	, m_dSeconds(0.0)
+{
+	std::string ext(path.size() >= 4 ? path.substr(path.size() - 4) : "");
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == ".obj")
+		m_eFormat = OBJ;
+}
+
+MeshExporter::~MeshExporter()
+{
+}
+
+// Two passes over the flagged triangles: the first writes each used vertex once and numbers it,
+// the second writes the faces, so the remap table is the only per-vertex state kept
+bool MeshExporter::write(ObjModel *model, const std::vector<bool> &triangles, bool clip, glm::vec3 bbMin, glm::vec3 bbMax)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	m_Out.open(m_strPath, std::ios::binary);
+	if (!m_Out)
+	{
+		std::cerr << "Could not open " << m_strPath << " for writing" << std::endl;
+		return false;
+	}
+
+	m_vcBuffer.resize(MESH_EXPORTER_BUFFER_SIZE);
+	m_nBuffered = 0;
+	m_nVertices = 0;
+	m_nTriangles = 0;
+	m_nBytes = 0;
+
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+	size_t nTris = std::min(triangles.size(), inds.size() / 3);
+
+	writeHeader("seaweedViewer export of " + model->getName());
+
+	std::vector<unsigned int> remap(verts.size(), ~0u);
+	std::vector<unsigned int> clippedFirst;		// first vertex of each clipped polygon, in triangle order
+	glm::vec3 tri[3], poly[9], tmp[9];
+
+	// Scene-space corners of triangle t; true when it is written unclipped
+	auto loadTriangle = [&](size_t t) {
+		bool whole = true;
+		for (int v = 0; v < 3; ++v)
+		{
+			tri[v] = glm::vec3(modelMatrix * glm::vec4(verts[inds[3 * t + v]], 1.f));
+			whole = whole && (!clip || (glm::all(glm::greaterThanEqual(tri[v], bbMin)) && glm::all(glm::lessThanEqual(tri[v], bbMax))));
+		}
+		return whole;
+	};
+
+	// Polygon left after cutting the loaded triangle to the box; 0 when nothing is left
+	auto clipTriangle = [&]() {
+		if (glm::any(glm::lessThan(glm::max(tri[0], glm::max(tri[1], tri[2])), bbMin)) || glm::any(glm::greaterThan(glm::min(tri[0], glm::min(tri[1], tri[2])), bbMax)))
+			return 0;
+
+		int n = 3;
+		std::copy(tri, tri + 3, poly);
+		for (int axis = 0; axis < 3 && n > 0; ++axis)
+			n = PolygonClip::clipSlab(poly, n, poly, tmp, axis, bbMin[axis], bbMax[axis]);
+		return n >= 3 ? n : 0;
+	};
+
+	for (size_t t = 0; t < nTris; ++t)
+	{
+		if (!triangles[t])
+			continue;
+
+		if (loadTriangle(t))
+		{
+			for (int v = 0; v < 3; ++v)
+			{
+				unsigned int &id = remap[inds[3 * t + v]];
+				if (id != ~0u)
+					continue;
+
+				id = static_cast<unsigned int>(m_nVertices);
+				writeVertex(tri[v]);
+			}
+			m_nTriangles++;
+			continue;
+		}
+
+		// Cut vertices belong to one polygon only and are written with it
+		int n = clipTriangle();
+		if (n == 0)
+			continue;
+
+		clippedFirst.push_back(static_cast<unsigned int>(m_nVertices));
+		for (int i = 0; i < n; ++i)
+			writeVertex(poly[i]);
+		m_nTriangles += n - 2;
+	}
+
+	size_t nextClipped = 0;
+	for (size_t t = 0; t < nTris; ++t)
+	{
+		if (!triangles[t])
+			continue;
+
+		if (loadTriangle(t))
+		{
+			writeTriangle(remap[inds[3 * t + 0]], remap[inds[3 * t + 1]], remap[inds[3 * t + 2]]);
+			continue;
+		}
+
+		// Clipping is repeated only to learn the polygon's size
+		int n = clipTriangle();
+		if (n == 0)
+			continue;
+
+		unsigned int first = clippedFirst[nextClipped++];
+		for (int i = 1; i + 1 < n; ++i)
+			writeTriangle(first, first + i, first + i + 1);
+	}
+
+	flush();
+	patchHeader();
+
+	bool ok = m_Out.good();
+	m_Out.close();
+	m_vcBuffer.clear();
+	m_vcBuffer.shrink_to_fit();
+
+	m_dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	if (!ok)
+		std::cerr << "Error writing " << m_strPath << std::endl;
+
+	return ok;
+}
+
+// PLY element counts are written as zero-padded placeholders and filled in at the end
+void MeshExporter::writeHeader(std::string comment)
+{
+	std::string placeholder(MESH_EXPORTER_COUNT_DIGITS, '0');
+	std::string header;
+
+	if (m_eFormat == OBJ)
+	{
+		header = "# " + comment + "\n";
+		put(header.data(), header.size());
+		return;
+	}
+
+	header = "ply\nformat binary_little_endian 1.0\ncomment " + comment + "\nelement vertex ";
+	m_nVertexCountOffset = static_cast<std::streamoff>(header.size());
+	header += placeholder + "\nproperty float x\nproperty float y\nproperty float z\nelement face ";
+	m_nFaceCountOffset = static_cast<std::streamoff>(header.size());
+	header += placeholder + "\nproperty list uchar uint vertex_indices\nend_header\n";
+
+	put(header.data(), header.size());
+}
+
+void MeshExporter::patchHeader()
+{
+	if (m_eFormat != PLY)
+		return;
+
+	char count[MESH_EXPORTER_COUNT_DIGITS + 1];
+
+	snprintf(count, sizeof(count), "%0*zu", MESH_EXPORTER_COUNT_DIGITS, m_nVertices);
+	m_Out.seekp(m_nVertexCountOffset);
+	m_Out.write(count, MESH_EXPORTER_COUNT_DIGITS);
+
+	snprintf(count, sizeof(count), "%0*zu", MESH_EXPORTER_COUNT_DIGITS, m_nTriangles);
+	m_Out.seekp(m_nFaceCountOffset);
+	m_Out.write(count, MESH_EXPORTER_COUNT_DIGITS);
+
+	m_Out.seekp(0, std::ios::end);
+}
+
+void MeshExporter::writeVertex(glm::vec3 p)
+{
+	m_nVertices++;
+
+	if (m_eFormat == PLY)
+	{
+		put(&p[0], 3 * sizeof(float));
+		return;
+	}
+
+	char line[64];
+	int len = snprintf(line, sizeof(line), "v %.7g %.7g %.7g\n", p.x, p.y, p.z);
+	put(line, len);
+}
+
+void MeshExporter::writeTriangle(unsigned int a, unsigned int b, unsigned int c)
+{
+	if (m_eFormat == PLY)
+	{
+		char face[1 + 3 * sizeof(unsigned int)];
+		unsigned int ids[3] = { a, b, c };
+
+		face[0] = 3;
+		memcpy(face + 1, ids, sizeof(ids));
+		put(face, sizeof(face));
+		return;
+	}
+
+	char line[48];
+	int len = snprintf(line, sizeof(line), "f %u %u %u\n", a + 1, b + 1, c + 1);
+	put(line, len);
+}
+
+void MeshExporter::put(const void *data, size_t size)
+{
+	if (m_nBuffered + size > m_vcBuffer.size())
+		flush();
+
+	memcpy(m_vcBuffer.data() + m_nBuffered, data, size);
+	m_nBuffered += size;
+	m_nBytes += size;
+}
+
+void MeshExporter::flush()
+{
+	if (m_nBuffered > 0)
+		m_Out.write(m_vcBuffer.data(), m_nBuffered);
+	m_nBuffered = 0;
+}
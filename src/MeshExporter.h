@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+
+#define MESH_EXPORTER_BUFFER_SIZE (4 << 20)	// bytes collected before each write to disk
+#define MESH_EXPORTER_COUNT_DIGITS 10		// fixed width of the PLY element counts, patched once known
+
+// Writes part of a model to a binary little-endian PLY or an OBJ file, in scene space. Output goes
+// through a fixed buffer straight to disk, so nothing the size of the output is ever held in memory.
+// Only vertices used by the written triangles are kept, renumbered through a remap table.
+class MeshExporter
+{
+public:
+	enum FORMAT {
+		PLY,
+		OBJ
+	};
+
+public:
+	// The format follows the extension: .obj for OBJ, anything else for PLY
+	MeshExporter(std::string path);
+	~MeshExporter();
+
+	// Writes the flagged triangles. With clipping, triangles crossing the box are cut to it and
+	// triangulated; otherwise every flagged triangle is written whole.
+	bool write(ObjModel *model, const std::vector<bool> &triangles, bool clip = false, glm::vec3 bbMin = glm::vec3(0.f), glm::vec3 bbMax = glm::vec3(0.f));
+
+	size_t getVertexCount() { return m_nVertices; }
+	size_t getTriangleCount() { return m_nTriangles; }
+	size_t getBytesWritten() { return m_nBytes; }
+	double getSeconds() { return m_dSeconds; }
+	double getTrianglesPerSecond() { return m_dSeconds > 0.0 ? m_nTriangles / m_dSeconds : 0.0; }
+
+private:
+	void writeHeader(std::string comment);
+	void patchHeader();
+	void writeVertex(glm::vec3 p);
+	void writeTriangle(unsigned int a, unsigned int b, unsigned int c);
+	void put(const void *data, size_t size);
+	void flush();
+
+	std::string m_strPath;
+	FORMAT m_eFormat;
+	std::ofstream m_Out;
+
+	std::vector<char> m_vcBuffer;
+	size_t m_nBuffered;
+
+	std::streamoff m_nVertexCountOffset, m_nFaceCountOffset;
+	size_t m_nVertices;
+	size_t m_nTriangles;
+	size_t m_nBytes;
+	double m_dSeconds;
+};
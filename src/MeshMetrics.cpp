@@ -0,0 +1,439 @@
+#include "MeshMetrics.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <tribox3.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "ConvexHull.h"
+#include "Parallel.h"
+#include "PolygonClip.h"
+
+#define MESH_METRICS_MAX_VOXELS_PER_AXIS 4096
+
+MeshMetrics::MeshMetrics(ObjModel *model, glm::vec3 bbMin, glm::vec3 bbMax)
+	: m_vec3Min(glm::min(bbMin, bbMax))
+	, m_vec3Max(glm::max(bbMin, bbMax))
+	, m_pModel(model)
+	, m_bClosed(false)
+	, m_bContained(false)
+	, m_nHullVertices(0)
+	, m_bHullBuilt(false)
+	, m_dHullVolume(0.0)
+	, m_SurfaceStats(m_vec3Min.y, m_vec3Max.y)
+	, m_bSurfaceStatsBuilt(false)
+	, m_nTrianglesInBox(0)
+{
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	// Scene-space bounds of the model decide whether the box clips it at all
+	glm::vec3 sceneMin(FLT_MAX), sceneMax(-FLT_MAX);
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec3 corner(i & 1 ? model->getBBMax().x : model->getBBMin().x, i & 2 ? model->getBBMax().y : model->getBBMin().y, i & 4 ? model->getBBMax().z : model->getBBMin().z);
+		glm::vec3 p(modelMatrix * glm::vec4(corner, 1.f));
+		sceneMin = glm::min(sceneMin, p);
+		sceneMax = glm::max(sceneMax, p);
+	}
+	m_bContained = glm::all(glm::greaterThanEqual(sceneMin, m_vec3Min)) && glm::all(glm::lessThanEqual(sceneMax, m_vec3Max));
+
+	// Keep every triangle over the box's footprint that isn't wholly below it; those above
+	// still bound the enclosed volume from the top
+	size_t nTris = inds.size() / 3;
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<std::vector<glm::vec3>> chunkTris(nThreads);
+
+	Parallel::parallelFor(nTris, [&](size_t begin, size_t end, unsigned int chunk) {
+		for (size_t t = begin; t < end; ++t)
+		{
+			glm::vec3 a(modelMatrix * glm::vec4(verts[inds[3 * t + 0]], 1.f));
+			glm::vec3 b(modelMatrix * glm::vec4(verts[inds[3 * t + 1]], 1.f));
+			glm::vec3 c(modelMatrix * glm::vec4(verts[inds[3 * t + 2]], 1.f));
+
+			glm::vec3 triMin(glm::min(a, glm::min(b, c))), triMax(glm::max(a, glm::max(b, c)));
+			if (triMax.x < m_vec3Min.x || triMin.x > m_vec3Max.x || triMax.y < m_vec3Min.y || triMin.y > m_vec3Max.y || triMax.z < m_vec3Min.z)
+				continue;
+
+			chunkTris[chunk].push_back(a);
+			chunkTris[chunk].push_back(b);
+			chunkTris[chunk].push_back(c);
+		}
+	}, nThreads);
+
+	for (auto &tris : chunkTris)
+		m_vvec3Triangles.insert(m_vvec3Triangles.end(), tris.begin(), tris.end());
+
+	// Closed and consistently wound: every directed edge has exactly one reverse twin
+	std::vector<uint64_t> edges;
+	edges.reserve(inds.size());
+	for (size_t t = 0; t < nTris; ++t)
+		for (int e = 0; e < 3; ++e)
+			edges.push_back(static_cast<uint64_t>(inds[3 * t + e]) << 32 | inds[3 * t + (e + 1) % 3]);
+
+	std::sort(edges.begin(), edges.end());
+
+	m_bClosed = nTris > 0 && std::adjacent_find(edges.begin(), edges.end()) == edges.end();
+	for (size_t i = 0; m_bClosed && i < edges.size(); ++i)
+	{
+		uint64_t twin = (edges[i] << 32) | (edges[i] >> 32);
+		m_bClosed = std::binary_search(edges.begin(), edges.end(), twin);
+	}
+}
+
+MeshMetrics::~MeshMetrics()
+{
+}
+
+bool MeshMetrics::isClosed()
+{
+	return m_bClosed;
+}
+
+// Clip to the box's x/y footprint, leaving z unbounded
+int MeshMetrics::clipToColumn(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 *poly)
+{
+	glm::vec3 tmp[12];
+	poly[0] = a;
+	poly[1] = b;
+	poly[2] = c;
+
+	int n = 3;
+	n = PolygonClip::clip(poly, n, tmp, 0, m_vec3Min.x, true);
+	n = PolygonClip::clip(tmp, n, poly, 0, m_vec3Max.x, false);
+	n = PolygonClip::clip(poly, n, tmp, 1, m_vec3Min.y, true);
+	n = PolygonClip::clip(tmp, n, poly, 1, m_vec3Max.y, false);
+
+	return n;
+}
+
+int MeshMetrics::clipToBox(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 *poly)
+{
+	glm::vec3 tmp[12];
+
+	int n = clipToColumn(a, b, c, poly);
+	n = PolygonClip::clip(poly, n, tmp, 2, m_vec3Min.z, true);
+	n = PolygonClip::clip(tmp, n, poly, 2, m_vec3Max.z, false);
+
+	return n;
+}
+
+static double signedAreaXY(glm::vec3 a, glm::vec3 b, glm::vec3 c)
+{
+	return 0.5 * (static_cast<double>(b.x - a.x) * (c.y - a.y) - static_cast<double>(c.x - a.x) * (b.y - a.y));
+}
+
+// Point-in-triangle edge test with a top-left rule for points exactly on the edge
+static bool edgeCovers(double w, double dx, double dy)
+{
+	if (w != 0.0)
+		return w > 0.0;
+
+	return dy > 0.0 || (dy == 0.0 && dx < 0.0);
+}
+
+// Divergence theorem with the field (0, 0, clamp(z) - zmin): each triangle adds its signed xy-projected
+// area times the clamped height, so the walls of the box never need to be closed explicitly
+double MeshMetrics::getEnclosedVolume()
+{
+	if (!m_bClosed)
+		return 0.0;
+
+	size_t nTris = m_vvec3Triangles.size() / 3;
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<double> partial(nThreads, 0.0);
+
+	Parallel::parallelFor(nTris, [&](size_t begin, size_t end, unsigned int chunk) {
+		double volume = 0.0;
+		glm::vec3 poly[12], slab[12], tmp[12];
+
+		for (size_t t = begin; t < end; ++t)
+		{
+			glm::vec3 a(m_vvec3Triangles[3 * t + 0]), b(m_vvec3Triangles[3 * t + 1]), c(m_vvec3Triangles[3 * t + 2]);
+
+			if (m_bContained)
+			{
+				volume += glm::dot(glm::dvec3(a), glm::cross(glm::dvec3(b), glm::dvec3(c))) / 6.0;
+				continue;
+			}
+
+			int n = clipToColumn(a, b, c, poly);
+			if (n < 3)
+				continue;
+
+			// Part inside the box's z range: height varies linearly, so the centroid height is exact
+			int m = PolygonClip::clip(poly, n, tmp, 2, m_vec3Min.z, true);
+			m = PolygonClip::clip(tmp, m, slab, 2, m_vec3Max.z, false);
+			for (int k = 1; k + 1 < m; ++k)
+				volume += signedAreaXY(slab[0], slab[k], slab[k + 1]) * ((slab[0].z + slab[k].z + slab[k + 1].z) / 3.0 - m_vec3Min.z);
+
+			// Part above the box contributes the full box height
+			m = PolygonClip::clip(poly, n, slab, 2, m_vec3Max.z, true);
+			for (int k = 1; k + 1 < m; ++k)
+				volume += signedAreaXY(slab[0], slab[k], slab[k + 1]) * (m_vec3Max.z - m_vec3Min.z);
+		}
+
+		partial[chunk] = volume;
+	}, nThreads);
+
+	double volume = 0.0;
+	for (auto const &v : partial)
+		volume += v;
+
+	return volume;
+}
+
+// Hull of the surface inside the box: model vertices inside it, plus the corners where triangles cross its faces
+double MeshMetrics::getConvexHullVolume()
+{
+	if (m_bHullBuilt)
+		return m_dHullVolume;
+
+	const std::vector<glm::vec3> &verts = m_pModel->getVertices();
+	glm::mat4 modelMatrix(m_pModel->getModelMatrix());
+
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<std::vector<glm::dvec3>> chunkPoints(nThreads);
+
+	Parallel::parallelFor(verts.size(), [&](size_t begin, size_t end, unsigned int chunk) {
+		for (size_t i = begin; i < end; ++i)
+		{
+			glm::vec3 p(modelMatrix * glm::vec4(verts[i], 1.f));
+			if (glm::all(glm::greaterThan(p, m_vec3Min)) && glm::all(glm::lessThan(p, m_vec3Max)))
+				chunkPoints[chunk].push_back(glm::dvec3(p));
+		}
+	}, nThreads);
+
+	std::vector<glm::dvec3> points;
+	for (auto &chunk : chunkPoints)
+	{
+		points.insert(points.end(), chunk.begin(), chunk.end());
+		chunk.clear();
+	}
+
+	Parallel::parallelFor(m_vvec3Triangles.size() / 3, [&](size_t begin, size_t end, unsigned int chunk) {
+		glm::vec3 poly[12];
+		for (size_t t = begin; t < end; ++t)
+		{
+			glm::vec3 a(m_vvec3Triangles[3 * t + 0]), b(m_vvec3Triangles[3 * t + 1]), c(m_vvec3Triangles[3 * t + 2]);
+			glm::vec3 triMin(glm::min(a, glm::min(b, c))), triMax(glm::max(a, glm::max(b, c)));
+
+			// Triangles strictly inside already contributed their vertices
+			if (glm::all(glm::greaterThan(triMin, m_vec3Min)) && glm::all(glm::lessThan(triMax, m_vec3Max)))
+				continue;
+
+			int n = clipToBox(a, b, c, poly);
+			for (int k = 0; k < n; ++k)
+				chunkPoints[chunk].push_back(glm::dvec3(poly[k]));
+		}
+	}, nThreads);
+
+	for (auto const &chunk : chunkPoints)
+		points.insert(points.end(), chunk.begin(), chunk.end());
+
+	ConvexHull hull;
+	if (hull.build(points))
+	{
+		m_dHullVolume = hull.getVolume();
+		m_nHullVertices = hull.getVertices().size();
+	}
+
+	m_bHullBuilt = true;
+
+	return m_dHullVolume;
+}
+
+size_t MeshMetrics::getTriangleCount()
+{
+	getSurfaceStats();
+	return m_nTrianglesInBox;
+}
+
+size_t MeshMetrics::getConvexHullVertexCount()
+{
+	getConvexHullVolume();
+	return m_nHullVertices;
+}
+
+// Voxel rows along y run in parallel. The shell is every voxel a triangle overlaps; closed meshes
+// also fill the voxels between crossing pairs of a vertical ray through each column's center.
+double MeshMetrics::getVoxelVolume(float voxelSize)
+{
+	if (voxelSize <= 0.f)
+		return 0.0;
+
+	glm::vec3 extent(m_vec3Max - m_vec3Min);
+	glm::ivec3 dims(glm::clamp(glm::ivec3(glm::ceil(extent / voxelSize)), glm::ivec3(1), glm::ivec3(MESH_METRICS_MAX_VOXELS_PER_AXIS)));
+	glm::vec3 cell(extent / glm::vec3(dims));
+
+	if (cell.x <= 0.f || cell.y <= 0.f || cell.z <= 0.f)
+		return 0.0;
+
+	// Bin triangles by the voxel rows their y range covers
+	std::vector<std::vector<unsigned int>> rows(dims.y);
+	size_t nTris = m_vvec3Triangles.size() / 3;
+	for (size_t t = 0; t < nTris; ++t)
+	{
+		glm::vec3 a(m_vvec3Triangles[3 * t + 0]), b(m_vvec3Triangles[3 * t + 1]), c(m_vvec3Triangles[3 * t + 2]);
+		int y0 = std::max(0, static_cast<int>(floor((std::min(a.y, std::min(b.y, c.y)) - m_vec3Min.y) / cell.y)));
+		int y1 = std::min(dims.y - 1, static_cast<int>(floor((std::max(a.y, std::max(b.y, c.y)) - m_vec3Min.y) / cell.y)));
+
+		for (int iy = y0; iy <= y1; ++iy)
+			rows[iy].push_back(static_cast<unsigned int>(t));
+	}
+
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<size_t> partial(nThreads, 0);
+
+	Parallel::parallelFor(dims.y, [&](size_t begin, size_t end, unsigned int chunk) {
+		std::vector<bool> occupied;
+		std::vector<std::pair<int, float>> crossings;
+		glm::vec3 halfCell(cell * 0.5f);
+
+		for (size_t iy = begin; iy < end; ++iy)
+		{
+			occupied.assign(static_cast<size_t>(dims.x) * dims.z, false);
+			crossings.clear();
+
+			float rowY = m_vec3Min.y + (iy + 0.5f) * cell.y;
+
+			for (auto const &t : rows[iy])
+			{
+				glm::vec3 a(m_vvec3Triangles[3 * t + 0]), b(m_vvec3Triangles[3 * t + 1]), c(m_vvec3Triangles[3 * t + 2]);
+				glm::vec3 triMin(glm::min(a, glm::min(b, c))), triMax(glm::max(a, glm::max(b, c)));
+
+				int x0 = std::max(0, static_cast<int>(floor((triMin.x - m_vec3Min.x) / cell.x)));
+				int x1 = std::min(dims.x - 1, static_cast<int>(floor((triMax.x - m_vec3Min.x) / cell.x)));
+				int z0 = std::max(0, static_cast<int>(floor((triMin.z - m_vec3Min.z) / cell.z)));
+				int z1 = std::min(dims.z - 1, static_cast<int>(floor((triMax.z - m_vec3Min.z) / cell.z)));
+
+				float triVerts[3][3] = {
+					{ a.x, a.y, a.z },
+					{ b.x, b.y, b.z },
+					{ c.x, c.y, c.z }
+				};
+
+				for (int ix = x0; ix <= x1; ++ix)
+				{
+					for (int iz = z0; iz <= z1; ++iz)
+					{
+						size_t v = static_cast<size_t>(ix) * dims.z + iz;
+						if (occupied[v])
+							continue;
+
+						glm::vec3 center(m_vec3Min + (glm::vec3(ix, iy, iz) + 0.5f) * cell);
+						if (triBoxOverlap(glm::value_ptr(center), glm::value_ptr(halfCell), triVerts))
+							occupied[v] = true;
+					}
+
+					if (!m_bClosed)
+						continue;
+
+					// Where the column's vertical ray crosses the triangle, if it does
+					double px = m_vec3Min.x + (ix + 0.5) * cell.x, py = rowY;
+					double w0 = (static_cast<double>(b.x) - px) * (c.y - py) - (static_cast<double>(c.x) - px) * (b.y - py);
+					double w1 = (static_cast<double>(c.x) - px) * (a.y - py) - (static_cast<double>(a.x) - px) * (c.y - py);
+					double w2 = (static_cast<double>(a.x) - px) * (b.y - py) - (static_cast<double>(b.x) - px) * (a.y - py);
+					double sum = w0 + w1 + w2;
+					if (sum == 0.0)
+						continue;
+
+					// Wind counter-clockwise so a ray through a shared edge is counted by exactly one triangle
+					double flip = sum > 0.0 ? 1.0 : -1.0;
+					if (!edgeCovers(w0 * flip, (c.x - b.x) * flip, (c.y - b.y) * flip) ||
+						!edgeCovers(w1 * flip, (a.x - c.x) * flip, (a.y - c.y) * flip) ||
+						!edgeCovers(w2 * flip, (b.x - a.x) * flip, (b.y - a.y) * flip))
+						continue;
+
+					float z = static_cast<float>((w0 * a.z + w1 * b.z + w2 * c.z) / sum);
+					if (z >= m_vec3Min.z)
+						crossings.push_back(std::make_pair(ix, z));
+				}
+			}
+
+			// Walk each column's crossings from the top; an unpaired last crossing runs out the bottom of the box
+			std::sort(crossings.begin(), crossings.end(), [](const std::pair<int, float> &l, const std::pair<int, float> &r) {
+				return l.first != r.first ? l.first < r.first : l.second > r.second;
+			});
+
+			for (size_t i = 0; i < crossings.size();)
+			{
+				int ix = crossings[i].first;
+				size_t j = i;
+				while (j < crossings.size() && crossings[j].first == ix)
+					++j;
+
+				for (size_t k = i; k < j; k += 2)
+				{
+					float top = crossings[k].second;
+					float bottom = k + 1 < j ? crossings[k + 1].second : m_vec3Min.z;
+
+					int zTop = std::min(dims.z - 1, static_cast<int>(floor((top - m_vec3Min.z) / cell.z - 0.5f)));
+					int zBottom = std::max(0, static_cast<int>(ceil((bottom - m_vec3Min.z) / cell.z - 0.5f)));
+
+					for (int iz = zBottom; iz <= zTop; ++iz)
+						occupied[static_cast<size_t>(ix) * dims.z + iz] = true;
+				}
+
+				i = j;
+			}
+
+			partial[chunk] += std::count(occupied.begin(), occupied.end(), true);
+		}
+	}, nThreads);
+
+	size_t nVoxels = 0;
+	for (auto const &n : partial)
+		nVoxels += n;
+
+	return static_cast<double>(nVoxels) * cell.x * cell.y * cell.z;
+}
+
+double MeshMetrics::getSurfaceArea()
+{
+	return getSurfaceStats().getArea();
+}
+
+const SurfaceStats& MeshMetrics::getSurfaceStats()
+{
+	if (m_bSurfaceStatsBuilt)
+		return m_SurfaceStats;
+
+	size_t nTris = m_vvec3Triangles.size() / 3;
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<SurfaceStats> partial(nThreads, SurfaceStats(m_vec3Min.y, m_vec3Max.y));
+	std::vector<size_t> inBox(nThreads, 0);
+
+	glm::vec3 boxCenter((m_vec3Min + m_vec3Max) * 0.5f);
+	glm::vec3 boxHalfExtents((m_vec3Max - m_vec3Min) * 0.5f);
+
+	// Same overlap rule as the measurement box: a triangle touching the box counts in full
+	Parallel::parallelFor(nTris, [&](size_t begin, size_t end, unsigned int chunk) {
+		SurfaceStats &stats = partial[chunk];
+		for (size_t t = begin; t < end; ++t)
+		{
+			const glm::vec3 *tri = &m_vvec3Triangles[3 * t];
+			float triVerts[3][3] = {
+				{ tri[0].x, tri[0].y, tri[0].z },
+				{ tri[1].x, tri[1].y, tri[1].z },
+				{ tri[2].x, tri[2].y, tri[2].z }
+			};
+
+			if (triBoxOverlap(glm::value_ptr(boxCenter), glm::value_ptr(boxHalfExtents), triVerts))
+			{
+				stats.addTriangle(tri[0], tri[1], tri[2], m_vec3Min, m_vec3Max);
+				inBox[chunk]++;
+			}
+		}
+	}, nThreads);
+
+	for (auto const &stats : partial)
+		m_SurfaceStats.merge(stats);
+	for (auto const &n : inBox)
+		m_nTrianglesInBox += n;
+	m_bSurfaceStatsBuilt = true;
+
+	return m_SurfaceStats;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+#include "SurfaceStats.h"
+
+#define MESH_METRICS_DEFAULT_VOXEL_SIZE 0.5f	// cm
+
+// Volume measurements of one model clipped to a scene-space measurement box, for biomass estimates.
+// Triangles are gathered into scene space once; each metric then runs across all cores.
+class MeshMetrics
+{
+public:
+	MeshMetrics(ObjModel *model, glm::vec3 bbMin, glm::vec3 bbMax);
+	~MeshMetrics();
+
+	// True when every edge is shared by exactly two triangles, so enclosed volumes are meaningful
+	bool isClosed();
+
+	// Volume of the closed mesh inside the box. Signed tetrahedra when the box holds the whole
+	// mesh, otherwise the same divergence-theorem sum over triangles clipped to the box.
+	double getEnclosedVolume();
+
+	// Volume of the convex hull of the surface inside the box
+	double getConvexHullVolume();
+	size_t getConvexHullVertexCount();
+
+	// Volume of the voxels the surface passes through, plus the interior of closed meshes
+	double getVoxelVolume(float voxelSize = MESH_METRICS_DEFAULT_VOXEL_SIZE);
+
+	// One-sided surface area inside the box
+	double getSurfaceArea();
+
+	// Area with its leaf angle, azimuth and height distributions, gathered in the same pass
+	const SurfaceStats& getSurfaceStats();
+
+	// Triangles overlapping the box, counted by the surface stats pass
+	size_t getTriangleCount();
+
+private:
+	int clipToColumn(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 *poly);
+	int clipToBox(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 *poly);
+
+	glm::vec3 m_vec3Min, m_vec3Max;
+	ObjModel *m_pModel;
+	std::vector<glm::vec3> m_vvec3Triangles;	// scene space, 3 per triangle, everything that can reach the box
+	bool m_bClosed;
+	bool m_bContained;	// the whole mesh lies inside the box
+
+	size_t m_nHullVertices;
+	bool m_bHullBuilt;
+	double m_dHullVolume;
+
+	SurfaceStats m_SurfaceStats;
+	bool m_bSurfaceStatsBuilt;
+	size_t m_nTrianglesInBox;
+};
@@ -0,0 +1,349 @@
+#include "MeshPartitioner.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <cstdlib>
+#include <cstring>
+#include <experimental/filesystem>
+
+#include "Survey.h"
+
+namespace fs = std::experimental::filesystem;
+
+MeshPartitioner::MeshPartitioner(const std::vector<std::string> &args)
+	: m_fChunkSize(0.f)
+	, m_bValid(false)
+	, m_vec3Min(0.f)
+	, m_vec3Max(0.f)
+	, m_iChunksX(1)
+	, m_iChunksZ(1)
+	, m_nSkippedFaces(0)
+{
+	m_bValid = parseArgs(args);
+}
+
+MeshPartitioner::~MeshPartitioner()
+{
+}
+
+bool MeshPartitioner::requested(const std::vector<std::string> &args)
+{
+	return std::find(args.begin(), args.end(), "--partition") != args.end();
+}
+
+bool MeshPartitioner::parseArgs(const std::vector<std::string> &args)
+{
+	for (size_t i = 1; i < args.size(); ++i)
+	{
+		if (args[i] == "--partition" && i + 1 < args.size())
+			m_strInput = args[++i];
+		else if (args[i] == "--chunk" && i + 1 < args.size())
+			m_fChunkSize = static_cast<float>(atof(args[++i].c_str()));
+		else if (args[i] == "--out" && i + 1 < args.size())
+			m_strOutDir = args[++i];
+		else
+		{
+			std::cerr << "Unrecognized partition argument " << args[i] << std::endl;
+			return false;
+		}
+	}
+
+	if (m_strInput.empty())
+	{
+		std::cerr << "Usage: --partition <mesh.obj> [--chunk cm] [--out dir]" << std::endl;
+		return false;
+	}
+
+	if (m_fChunkSize < 0.f)
+	{
+		std::cerr << "Chunk size must be positive" << std::endl;
+		return false;
+	}
+
+	// Chunks go in a directory beside the mesh unless told otherwise
+	m_strName = fs::path(m_strInput).stem().string();
+	if (m_strOutDir.empty())
+		m_strOutDir = (fs::path(m_strInput).parent_path() / (m_strName + "_chunks")).string();
+
+	return true;
+}
+
+std::string MeshPartitioner::getChunkPath(unsigned int chunk, std::string ext)
+{
+	std::stringstream name;
+	name << m_strName << "_" << chunk % m_iChunksX << "_" << chunk / m_iChunksX << ext;
+
+	return (fs::path(m_strOutDir) / name.str()).string();
+}
+
+int MeshPartitioner::run()
+{
+	if (!m_bValid)
+		return EXIT_FAILURE;
+
+	auto start = std::chrono::steady_clock::now();
+
+	// First pass, or the cached result of an earlier one
+	size_t vertices, triangles;
+	if (!Survey::readBounds(m_strInput, m_vec3Min, m_vec3Max, vertices, triangles) || vertices == 0)
+	{
+		std::cerr << "Could not read " << m_strInput << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Square chunks, either as given or sized so the average chunk holds the target triangle count
+	glm::vec3 extent(m_vec3Max - m_vec3Min);
+	float side = m_fChunkSize;
+	if (side <= 0.f)
+	{
+		float chunks = std::max(1.f, static_cast<float>(ceil(static_cast<double>(triangles) / MESH_PARTITION_CHUNK_TRIANGLES)));
+		side = extent.x > 0.f && extent.z > 0.f ? sqrtf(extent.x * extent.z / chunks) : std::max(extent.x, extent.z) / chunks;
+	}
+	side = std::max(side, 1e-3f);
+
+	m_iChunksX = std::max(1, static_cast<int>(ceil(extent.x / side)));
+	m_iChunksZ = std::max(1, static_cast<int>(ceil(extent.z / side)));
+	m_fChunkSize = side;
+	m_vChunks.assign(m_iChunksX * m_iChunksZ, Chunk());
+	for (auto &c : m_vChunks)
+		c.triangles = 0;
+
+	std::error_code ec;
+	fs::create_directories(m_strOutDir, ec);
+	if (!fs::is_directory(m_strOutDir, ec))
+	{
+		std::cerr << "Could not create " << m_strOutDir << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Spill files left by an interrupted run would be appended to
+	for (unsigned int c = 0; c < m_vChunks.size(); ++c)
+		fs::remove(getChunkPath(c, ".tris"), ec);
+
+	std::cout << "Partitioning " << m_strInput << " (" << vertices << " vertices, " << triangles << " triangles) into a " << m_iChunksX << "x" << m_iChunksZ << " grid of " << side << " cm chunks" << std::endl;
+
+	m_vvec3Positions.reserve(vertices);
+	if (!readGeometry())
+		return EXIT_FAILURE;
+
+	double readSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "\tRead in " << readSeconds << " s";
+	if (m_nSkippedFaces > 0)
+		std::cout << ", skipped " << m_nSkippedFaces << " faces with missing vertices";
+	std::cout << std::endl;
+
+	// Chunks are assembled one at a time, so only one is ever held whole
+	fs::path manifestPath(fs::path(m_strOutDir) / (m_strName + ".survey"));
+	std::ofstream manifest(manifestPath.string());
+	if (!manifest)
+	{
+		std::cerr << "Could not open " << manifestPath.string() << " for writing" << std::endl;
+		return EXIT_FAILURE;
+	}
+	manifest << "# " << m_strInput << " in " << side << " cm chunks, written by seaweedViewer --partition" << std::endl;
+
+	unsigned int written = 0;
+	bool ok = true;
+	for (unsigned int c = 0; c < m_vChunks.size(); ++c)
+	{
+		if (m_vChunks[c].triangles == 0)
+			continue;
+
+		if (!writeChunk(c))
+		{
+			ok = false;
+			continue;
+		}
+
+		manifest << fs::path(getChunkPath(c, ".ply")).filename().string() << std::endl;
+		written++;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Wrote " << written << " chunks and " << manifestPath.string() << " in " << seconds << " s" << std::endl;
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Second pass: positions are kept, faces are fanned into triangles and handed to their chunks
+bool MeshPartitioner::readGeometry()
+{
+	std::ifstream in(m_strInput);
+	if (!in)
+	{
+		std::cerr << "Could not open " << m_strInput << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		if (line.size() < 2 || (line[1] != ' ' && line[1] != '\t'))
+			continue;
+
+		if (line[0] == 'v')
+		{
+			char *end;
+			glm::vec3 v;
+			v.x = strtof(line.c_str() + 2, &end);
+			v.y = strtof(end, &end);
+			v.z = strtof(end, &end);
+			m_vvec3Positions.push_back(v);
+		}
+		else if (line[0] == 'f')
+		{
+			// Corners are v, v/vt, v//vn or v/vt/vn; negative indices count back from the last vertex
+			const char *p = line.c_str() + 2;
+			uint32_t ids[3];
+			int corners = 0;
+			bool valid = true;
+
+			while (valid)
+			{
+				while (*p == ' ' || *p == '\t')
+					++p;
+				if (*p == '\0' || *p == '\r' || *p == '#')
+					break;
+
+				char *end;
+				long i = strtol(p, &end, 10);
+				long index = i < 0 ? static_cast<long>(m_vvec3Positions.size()) + i : i - 1;
+				valid = end != p && index >= 0 && index < static_cast<long>(m_vvec3Positions.size());
+
+				for (p = end; *p != '\0' && *p != ' ' && *p != '\t'; ++p)
+					;
+
+				ids[std::min(corners, 2)] = static_cast<uint32_t>(index);
+				if (valid && corners >= 2)
+				{
+					addTriangle(ids[0], ids[1], ids[2]);
+					ids[1] = ids[2];
+				}
+				corners++;
+			}
+
+			if (!valid)
+				m_nSkippedFaces++;
+		}
+	}
+
+	return true;
+}
+
+void MeshPartitioner::addTriangle(uint32_t a, uint32_t b, uint32_t c)
+{
+	glm::vec3 centroid((m_vvec3Positions[a] + m_vvec3Positions[b] + m_vvec3Positions[c]) / 3.f);
+	int x = glm::clamp(static_cast<int>(floor((centroid.x - m_vec3Min.x) / m_fChunkSize)), 0, m_iChunksX - 1);
+	int z = glm::clamp(static_cast<int>(floor((centroid.z - m_vec3Min.z) / m_fChunkSize)), 0, m_iChunksZ - 1);
+	unsigned int chunk = z * m_iChunksX + x;
+
+	Chunk &ch = m_vChunks[chunk];
+	ch.pending.push_back(a);
+	ch.pending.push_back(b);
+	ch.pending.push_back(c);
+	ch.triangles++;
+
+	if (ch.pending.size() >= 3 * MESH_PARTITION_SPILL_TRIANGLES)
+		spill(chunk);
+}
+
+// Appends the chunk's buffered triangles to its spill file; files are opened per spill, as there may
+// be more chunks than the process can keep open at once
+void MeshPartitioner::spill(unsigned int chunk)
+{
+	Chunk &ch = m_vChunks[chunk];
+	if (ch.pending.empty())
+		return;
+
+	std::ofstream out(getChunkPath(chunk, ".tris"), std::ios::binary | std::ios::app);
+	out.write(reinterpret_cast<const char*>(ch.pending.data()), ch.pending.size() * sizeof(uint32_t));
+	if (!out)
+		std::cerr << "Could not write to " << getChunkPath(chunk, ".tris") << std::endl;
+
+	ch.pending.clear();
+	ch.pending.shrink_to_fit();
+}
+
+// The spill file and what is still buffered, renumbered to the vertices the chunk uses
+bool MeshPartitioner::writeChunk(unsigned int chunk)
+{
+	Chunk &ch = m_vChunks[chunk];
+	std::string spillPath(getChunkPath(chunk, ".tris"));
+	std::string plyPath(getChunkPath(chunk, ".ply"));
+
+	std::vector<uint32_t> indices(ch.triangles * 3);
+	size_t spilled = indices.size() - ch.pending.size();
+
+	if (spilled > 0)
+	{
+		std::ifstream in(spillPath, std::ios::binary);
+		in.read(reinterpret_cast<char*>(indices.data()), spilled * sizeof(uint32_t));
+		if (!in)
+		{
+			std::cerr << "Could not read back " << spillPath << std::endl;
+			return false;
+		}
+		in.close();
+
+		std::error_code ec;
+		fs::remove(spillPath, ec);
+	}
+	std::copy(ch.pending.begin(), ch.pending.end(), indices.begin() + spilled);
+	ch.pending.clear();
+	ch.pending.shrink_to_fit();
+
+	std::vector<uint32_t> used(indices);
+	std::sort(used.begin(), used.end());
+	used.erase(std::unique(used.begin(), used.end()), used.end());
+
+	for (auto &i : indices)
+		i = static_cast<uint32_t>(std::lower_bound(used.begin(), used.end(), i) - used.begin());
+
+	std::ofstream out(plyPath, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "Could not open " << plyPath << " for writing" << std::endl;
+		return false;
+	}
+
+	out << "ply\nformat binary_little_endian 1.0\ncomment chunk of " << fs::path(m_strInput).filename().string() << "\n";
+	out << "element vertex " << used.size() << "\nproperty float x\nproperty float y\nproperty float z\n";
+	out << "element face " << ch.triangles << "\nproperty list uchar uint vertex_indices\nend_header\n";
+
+	glm::vec3 bbMin(FLT_MAX), bbMax(-FLT_MAX);
+	std::vector<glm::vec3> positions(used.size());
+	for (size_t v = 0; v < used.size(); ++v)
+	{
+		positions[v] = m_vvec3Positions[used[v]];
+		bbMin = glm::min(bbMin, positions[v]);
+		bbMax = glm::max(bbMax, positions[v]);
+	}
+	out.write(reinterpret_cast<const char*>(positions.data()), positions.size() * sizeof(glm::vec3));
+
+	std::vector<char> faces(ch.triangles * (1 + 3 * sizeof(uint32_t)));
+	for (size_t t = 0; t < ch.triangles; ++t)
+	{
+		char *face = faces.data() + t * (1 + 3 * sizeof(uint32_t));
+		face[0] = 3;
+		memcpy(face + 1, &indices[3 * t], 3 * sizeof(uint32_t));
+	}
+	out.write(faces.data(), faces.size());
+	out.close();
+
+	if (!out)
+	{
+		std::cerr << "Could not write " << plyPath << std::endl;
+		return false;
+	}
+
+	// The viewer finds the chunk's bounds without opening it
+	Survey::writeBounds(plyPath, bbMin, bbMax, used.size(), ch.triangles);
+
+	std::cout << "\t" << fs::path(plyPath).filename().string() << ": " << ch.triangles << " triangles, " << used.size() << " vertices" << std::endl;
+
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#define MESH_PARTITION_CHUNK_TRIANGLES 1000000	// triangles per chunk the grid is sized for without --chunk
+#define MESH_PARTITION_SPILL_TRIANGLES 4096		// buffered per chunk before they are appended to its spill file
+
+// One-time preprocessing for meshes too large to load whole. The OBJ is cut into chunks on a grid over
+// the horizontal plane, each triangle going to the chunk its centroid is in, and every chunk is written
+// as a binary PLY with its .bounds sidecar and listed in a survey manifest, <name>.survey, which the
+// viewer streams from and --batch measures chunk by chunk.
+//
+//   seaweedViewer --partition <mesh.obj> [--chunk cm] [--out dir]
+//
+// The OBJ is read twice, for its bounds and then for its geometry. Only the vertex positions are held
+// throughout, 12 bytes per vertex; triangles pass through small per-chunk buffers into spill files, and
+// each chunk is assembled from its spill file on its own.
+class MeshPartitioner
+{
+public:
+	MeshPartitioner(const std::vector<std::string> &args);
+	~MeshPartitioner();
+
+	static bool requested(const std::vector<std::string> &args);
+
+	// Returns the process exit code
+	int run();
+
+private:
+	struct Chunk {
+		std::vector<uint32_t> pending;	// global vertex indices, three per triangle, not spilled yet
+		size_t triangles;
+	};
+
+	bool parseArgs(const std::vector<std::string> &args);
+	bool readGeometry();
+	void addTriangle(uint32_t a, uint32_t b, uint32_t c);
+	std::string getChunkPath(unsigned int chunk, std::string ext);
+	void spill(unsigned int chunk);
+	bool writeChunk(unsigned int chunk);
+
+	std::string m_strInput;
+	std::string m_strOutDir;
+	std::string m_strName;	// the input's file name without extension
+	float m_fChunkSize;		// cm on a side; 0 sizes chunks for MESH_PARTITION_CHUNK_TRIANGLES
+	bool m_bValid;
+
+	glm::vec3 m_vec3Min, m_vec3Max;
+	int m_iChunksX, m_iChunksZ;
+	std::vector<glm::vec3> m_vvec3Positions;
+	std::vector<Chunk> m_vChunks;
+	size_t m_nSkippedFaces;
+};
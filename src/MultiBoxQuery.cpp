@@ -0,0 +1,212 @@
+#include "MultiBoxQuery.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <emmintrin.h>
+
+#include <tribox3.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Parallel.h"
+
+MultiBoxQuery::MultiBoxQuery(const std::vector<glm::vec3> &bbMins, const std::vector<glm::vec3> &bbMaxs)
+	: m_nLastExactTests(0)
+{
+	size_t nBoxes = std::min(bbMins.size(), bbMaxs.size());
+	for (size_t i = 0; i < nBoxes; ++i)
+	{
+		m_vvec3Min.push_back(glm::min(bbMins[i], bbMaxs[i]));
+		m_vvec3Max.push_back(glm::max(bbMins[i], bbMaxs[i]));
+	}
+
+	std::vector<unsigned int> boxes(nBoxes);
+	for (size_t i = 0; i < nBoxes; ++i)
+		boxes[i] = static_cast<unsigned int>(i);
+
+	// Few boxes are cheaper to scan than to traverse
+	if (nBoxes <= MULTI_BOX_PACKET * MULTI_BOX_BVH_THRESHOLD)
+	{
+		for (size_t i = 0; i < nBoxes; i += MULTI_BOX_PACKET)
+			addPacket(boxes, i, std::min(nBoxes, i + MULTI_BOX_PACKET));
+		return;
+	}
+
+	m_vNodes.push_back(Node());
+	buildNode(0, boxes, 0, nBoxes);
+}
+
+MultiBoxQuery::~MultiBoxQuery()
+{
+}
+
+// Median split on the longest axis of the box centres, sized so leaves come out as full packets
+void MultiBoxQuery::buildNode(unsigned int nodeIndex, std::vector<unsigned int> &boxes, size_t begin, size_t end)
+{
+	glm::vec3 bbMin(FLT_MAX), bbMax(-FLT_MAX), centerMin(FLT_MAX), centerMax(-FLT_MAX);
+	for (size_t i = begin; i < end; ++i)
+	{
+		bbMin = glm::min(bbMin, m_vvec3Min[boxes[i]]);
+		bbMax = glm::max(bbMax, m_vvec3Max[boxes[i]]);
+		centerMin = glm::min(centerMin, m_vvec3Min[boxes[i]] + m_vvec3Max[boxes[i]]);
+		centerMax = glm::max(centerMax, m_vvec3Min[boxes[i]] + m_vvec3Max[boxes[i]]);
+	}
+
+	m_vNodes[nodeIndex].bbMin = bbMin;
+	m_vNodes[nodeIndex].bbMax = bbMax;
+
+	if (end - begin <= MULTI_BOX_PACKET)
+	{
+		m_vNodes[nodeIndex].leftOrPacket = static_cast<unsigned int>(m_vPackets.size());
+		m_vNodes[nodeIndex].leaf = 1;
+		addPacket(boxes, begin, end);
+		return;
+	}
+
+	glm::vec3 extent(centerMax - centerMin);
+	int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+	size_t half = ((end - begin) / 2 + MULTI_BOX_PACKET - 1) / MULTI_BOX_PACKET * MULTI_BOX_PACKET;
+	size_t mid = begin + std::min(half, end - begin - 1);
+
+	std::nth_element(boxes.begin() + begin, boxes.begin() + mid, boxes.begin() + end, [&](unsigned int a, unsigned int b) {
+		return m_vvec3Min[a][axis] + m_vvec3Max[a][axis] < m_vvec3Min[b][axis] + m_vvec3Max[b][axis];
+	});
+
+	unsigned int left = static_cast<unsigned int>(m_vNodes.size());
+	m_vNodes.push_back(Node());
+	m_vNodes.push_back(Node());
+	m_vNodes[nodeIndex].leftOrPacket = left;
+	m_vNodes[nodeIndex].leaf = 0;
+
+	buildNode(left, boxes, begin, mid);
+	buildNode(left + 1, boxes, mid, end);
+}
+
+// Unused lanes get inverted bounds so they never pass the bounds test
+void MultiBoxQuery::addPacket(const std::vector<unsigned int> &boxes, size_t begin, size_t end)
+{
+	Packet packet;
+	packet.count = static_cast<unsigned int>(end - begin);
+
+	for (unsigned int lane = 0; lane < MULTI_BOX_PACKET; ++lane)
+	{
+		bool used = lane < packet.count;
+		unsigned int box = used ? boxes[begin + lane] : 0;
+		glm::vec3 bbMin(used ? m_vvec3Min[box] : glm::vec3(FLT_MAX)), bbMax(used ? m_vvec3Max[box] : glm::vec3(-FLT_MAX));
+
+		packet.minX[lane] = bbMin.x;
+		packet.minY[lane] = bbMin.y;
+		packet.minZ[lane] = bbMin.z;
+		packet.maxX[lane] = bbMax.x;
+		packet.maxY[lane] = bbMax.y;
+		packet.maxZ[lane] = bbMax.z;
+		packet.boxes[lane] = box;
+	}
+
+	m_vPackets.push_back(packet);
+}
+
+// Bounds test against the four boxes at once, then the exact test for the lanes that pass
+size_t MultiBoxQuery::testPacket(const Packet &packet, glm::vec3 triMin, glm::vec3 triMax, const glm::vec3 tri[3], double area, double *areas)
+{
+	__m128 overlap = _mm_and_ps(_mm_cmple_ps(_mm_set1_ps(triMin.x), _mm_loadu_ps(packet.maxX)), _mm_cmpge_ps(_mm_set1_ps(triMax.x), _mm_loadu_ps(packet.minX)));
+	overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_set1_ps(triMin.y), _mm_loadu_ps(packet.maxY)), _mm_cmpge_ps(_mm_set1_ps(triMax.y), _mm_loadu_ps(packet.minY))));
+	overlap = _mm_and_ps(overlap, _mm_and_ps(_mm_cmple_ps(_mm_set1_ps(triMin.z), _mm_loadu_ps(packet.maxZ)), _mm_cmpge_ps(_mm_set1_ps(triMax.z), _mm_loadu_ps(packet.minZ))));
+
+	int mask = _mm_movemask_ps(overlap);
+	if (mask == 0)
+		return 0;
+
+	float triVerts[3][3] = {
+		{ tri[0].x, tri[0].y, tri[0].z },
+		{ tri[1].x, tri[1].y, tri[1].z },
+		{ tri[2].x, tri[2].y, tri[2].z }
+	};
+
+	size_t tests = 0;
+	for (unsigned int lane = 0; lane < MULTI_BOX_PACKET; ++lane)
+	{
+		if (!(mask & (1 << lane)))
+			continue;
+
+		unsigned int box = packet.boxes[lane];
+		glm::vec3 boxCenter((m_vvec3Min[box] + m_vvec3Max[box]) * 0.5f);
+		glm::vec3 boxHalfExtents((m_vvec3Max[box] - m_vvec3Min[box]) * 0.5f);
+
+		if (triBoxOverlap(glm::value_ptr(boxCenter), glm::value_ptr(boxHalfExtents), triVerts))
+			areas[box] += area;
+		tests++;
+	}
+
+	return tests;
+}
+
+std::vector<double> MultiBoxQuery::measure(ObjModel *model)
+{
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	size_t nBoxes = m_vvec3Min.size();
+	if (nBoxes == 0)
+		return std::vector<double>();
+
+	unsigned int nThreads = Parallel::getThreadCount();
+	std::vector<std::vector<double>> partial(nThreads, std::vector<double>(nBoxes, 0.0));
+	std::vector<size_t> partialTests(nThreads, 0);
+
+	Parallel::parallelFor(inds.size() / 3, [&](size_t begin, size_t end, unsigned int chunk) {
+		double *areas = partial[chunk].data();
+		size_t tests = 0;
+		unsigned int stack[64];
+
+		for (size_t t = begin; t < end; ++t)
+		{
+			glm::vec3 tri[3];
+			for (int v = 0; v < 3; ++v)
+				tri[v] = glm::vec3(modelMatrix * glm::vec4(verts[inds[3 * t + v]], 1.f));
+
+			glm::vec3 triMin(glm::min(tri[0], glm::min(tri[1], tri[2]))), triMax(glm::max(tri[0], glm::max(tri[1], tri[2])));
+			double area = glm::length(glm::cross(tri[1] - tri[0], tri[2] - tri[0])) * 0.5;
+
+			if (m_vNodes.empty())
+			{
+				for (auto const &packet : m_vPackets)
+					tests += testPacket(packet, triMin, triMax, tri, area, areas);
+				continue;
+			}
+
+			int sp = 0;
+			stack[sp++] = 0;
+			while (sp > 0)
+			{
+				const Node &node = m_vNodes[stack[--sp]];
+
+				if (glm::any(glm::lessThan(triMax, node.bbMin)) || glm::any(glm::greaterThan(triMin, node.bbMax)))
+					continue;
+
+				if (node.leaf)
+				{
+					tests += testPacket(m_vPackets[node.leftOrPacket], triMin, triMax, tri, area, areas);
+					continue;
+				}
+
+				stack[sp++] = node.leftOrPacket + 1;
+				stack[sp++] = node.leftOrPacket;
+			}
+		}
+
+		partialTests[chunk] = tests;
+	}, nThreads);
+
+	std::vector<double> areas(nBoxes, 0.0);
+	for (auto const &p : partial)
+		for (size_t i = 0; i < nBoxes; ++i)
+			areas[i] += p[i];
+
+	m_nLastExactTests = 0;
+	for (auto const &n : partialTests)
+		m_nLastExactTests += n;
+
+	return areas;
+}
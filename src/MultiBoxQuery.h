@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+
+#define MULTI_BOX_PACKET 4				// boxes tested together with SSE
+#define MULTI_BOX_BVH_THRESHOLD 16		// packets scanned linearly up to this many, through a BVH beyond
+
+// Surface area inside many scene-space boxes at once, e.g. random quadrat placements for bootstrap
+// statistics. Each triangle is read once and tested against every box it could touch: boxes are kept
+// in packets of four in SoA form for an SSE bounds test, and with many boxes the packets sit in a BVH
+// of their own so a triangle only visits packets near it. Bounds hits are confirmed with the same
+// exact overlap test as the measurement box, and a triangle counts in full for every box it touches.
+class MultiBoxQuery
+{
+public:
+	MultiBoxQuery(const std::vector<glm::vec3> &bbMins, const std::vector<glm::vec3> &bbMaxs);
+	~MultiBoxQuery();
+
+	// One-sided area per box, in box order, across all cores
+	std::vector<double> measure(ObjModel *model);
+
+	size_t getBoxCount() { return m_vvec3Min.size(); }
+	size_t getPacketCount() { return m_vPackets.size(); }
+	bool usesBVH() { return !m_vNodes.empty(); }
+
+	// Box-vs-triangle tests that reached the exact overlap test in the last measure call
+	size_t getLastExactTestCount() { return m_nLastExactTests; }
+
+private:
+	struct Packet {
+		float minX[MULTI_BOX_PACKET], minY[MULTI_BOX_PACKET], minZ[MULTI_BOX_PACKET];
+		float maxX[MULTI_BOX_PACKET], maxY[MULTI_BOX_PACKET], maxZ[MULTI_BOX_PACKET];
+		unsigned int boxes[MULTI_BOX_PACKET];
+		unsigned int count;
+	};
+
+	struct Node {
+		glm::vec3 bbMin;
+		unsigned int leftOrPacket;	// first child for interior nodes (second child follows), packet for leaves
+		glm::vec3 bbMax;
+		unsigned int leaf;
+	};
+
+	void buildNode(unsigned int nodeIndex, std::vector<unsigned int> &boxes, size_t begin, size_t end);
+	void addPacket(const std::vector<unsigned int> &boxes, size_t begin, size_t end);
+	size_t testPacket(const Packet &packet, glm::vec3 triMin, glm::vec3 triMax, const glm::vec3 tri[3], double area, double *areas);
+
+	std::vector<glm::vec3> m_vvec3Min, m_vvec3Max;
+	std::vector<Packet> m_vPackets;
+	std::vector<Node> m_vNodes;
+	size_t m_nLastExactTests;
+};
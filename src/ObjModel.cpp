@@ -3,28 +3,56 @@
 #endif
 
 #include "ObjModel.h"
+#include "MeasurementBox.h"
 #include <list>
 #include <map>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstring>
 #include <glm/gtc/type_ptr.hpp>
 
-ObjModel::ObjModel(std::string objFile)
+std::atomic<unsigned int> ObjModel::s_nDrawVersionTotal(0);
+
+ObjModel::ObjModel(std::string objFile, GeometryArena *arena)
 	: m_strModelName(objFile)
+	, m_pArena(NULL)
+	, m_nTransformVersion(0)
+	, m_vec3BBMin(glm::vec3(0.f))
+	, m_vec3BBMax(glm::vec3(0.f))
+	, m_vec3BSCenter(glm::vec3(0.f))
+	, m_fBSRadius(0.f)
+	, m_nVisibleMeshlets(0)
+	, m_nSelectedTriangles(0)
+	, m_nDrawVersion(0)
 	, m_vec3DiffColor(glm::vec3(0.f, 0.8f, 0.f))
 	, m_vec3SpecColor(glm::vec3(0.f))
 	, m_vec3EmisColor(glm::vec3(0.f))
 {
 	load(objFile);
-	initGL();
+	computeBounds();
+	buildMeshlets();
+	m_bvh.build(m_vvec3Vertices, m_vuiIndices);
+
+	// Headless tools load models without a GL context
+	if (arena)
+		initGL(arena);
 }
 
 ObjModel::~ObjModel(void)
 {
+	releaseGL();
 	m_vvec3Vertices.clear();
 	m_vuiIndices.clear();
 }
 
 bool ObjModel::load(std::string objName)
 {	
+	std::string ext(objName.substr(std::min(objName.size(), objName.find_last_of('.'))));
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	if (ext == ".ply")
+		return loadPLY(objName);
+
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
 	std::vector<tinyobj::material_t> materials;
@@ -106,61 +134,449 @@ bool ObjModel::load(std::string objName)
 	}
 }
 
-void ObjModel::initGL()
+// Read straight into our arrays, without the parser's copies; normals are area-weighted face normals
+bool ObjModel::loadPLY(std::string plyName)
+{
+	size_t faceCount;
+	if (!readPLY(plyName, m_vvec3Vertices, &m_vuiIndices, faceCount))
+		return false;
+
+	m_vvec3Normals.assign(m_vvec3Vertices.size(), glm::vec3(0.f));
+	for (size_t i = 0; i < m_vuiIndices.size(); i += 3)
+	{
+		glm::vec3 const &a = m_vvec3Vertices[m_vuiIndices[i + 0]];
+		glm::vec3 const &b = m_vvec3Vertices[m_vuiIndices[i + 1]];
+		glm::vec3 const &c = m_vvec3Vertices[m_vuiIndices[i + 2]];
+		glm::vec3 norm(glm::cross(b - a, c - a));
+
+		for (int v = 0; v < 3; ++v)
+			m_vvec3Normals[m_vuiIndices[i + v]] += norm;
+	}
+
+	for (auto &n : m_vvec3Normals)
+		n = glm::length(n) > 0.f ? glm::normalize(n) : glm::vec3(0.f, 1.f, 0.f);
+
+	return true;
+}
+
+static int plyTypeSize(const std::string &type)
+{
+	if (type == "char" || type == "uchar" || type == "int8" || type == "uint8")
+		return 1;
+	if (type == "short" || type == "ushort" || type == "int16" || type == "uint16")
+		return 2;
+	if (type == "int" || type == "uint" || type == "float" || type == "int32" || type == "uint32" || type == "float32")
+		return 4;
+	if (type == "double" || type == "float64")
+		return 8;
+
+	return 0;
+}
+
+bool ObjModel::readPLY(std::string file, std::vector<glm::vec3> &vertices, std::vector<unsigned int> *indices, size_t &faceCount)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+	{
+		std::cerr << "Could not open " << file << std::endl;
+		return false;
+	}
+
+	// Vertex properties other than x, y and z are skipped over; the face element may only hold the index list
+	size_t vertexCount = 0;
+	faceCount = 0;
+	int stride = 0, countSize = 0, indexSize = 0;
+	int offsets[3] = { -1, -1, -1 };
+	std::string line, element, format;
+
+	std::getline(in, line);
+	if (line.compare(0, 3, "ply") != 0)
+	{
+		std::cerr << file << " is not a PLY file" << std::endl;
+		return false;
+	}
+
+	while (std::getline(in, line) && line.compare(0, 10, "end_header") != 0)
+	{
+		std::istringstream ss(line);
+		std::string keyword;
+		ss >> keyword;
+
+		if (keyword == "format")
+			ss >> format;
+		else if (keyword == "element")
+		{
+			size_t count = 0;
+			ss >> element >> count;
+			if (element == "vertex")
+				vertexCount = count;
+			else if (element == "face")
+				faceCount = count;
+			else
+			{
+				std::cerr << file << ": unsupported PLY element " << element << std::endl;
+				return false;
+			}
+		}
+		else if (keyword == "property" && element == "vertex")
+		{
+			std::string type, name;
+			ss >> type >> name;
+
+			int axis = name == "x" ? 0 : name == "y" ? 1 : name == "z" ? 2 : -1;
+			if (axis >= 0 && type != "float" && type != "float32")
+			{
+				std::cerr << file << ": PLY vertex positions must be float" << std::endl;
+				return false;
+			}
+			if (axis >= 0)
+				offsets[axis] = stride;
+
+			stride += plyTypeSize(type);
+		}
+		else if (keyword == "property" && element == "face")
+		{
+			std::string list, countType, indexType;
+			ss >> list >> countType >> indexType;
+			countSize = plyTypeSize(countType);
+			indexSize = plyTypeSize(indexType);
+		}
+	}
+
+	if (format != "binary_little_endian" || offsets[0] < 0 || offsets[1] < 0 || offsets[2] < 0 || (faceCount > 0 && indexSize != 4))
+	{
+		std::cerr << file << ": only binary little-endian PLY with float positions and 32-bit indices is read" << std::endl;
+		return false;
+	}
+
+	std::vector<char> data(vertexCount * stride);
+	in.read(data.data(), data.size());
+	if (!in)
+	{
+		std::cerr << file << ": PLY vertex data is truncated" << std::endl;
+		return false;
+	}
+
+	vertices.resize(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		for (int axis = 0; axis < 3; ++axis)
+			memcpy(&vertices[v][axis], data.data() + v * stride + offsets[axis], sizeof(float));
+
+	if (!indices)
+		return true;
+
+	// Faces are variable-length, so the rest of the file is read in one go
+	std::streampos start(in.tellg());
+	in.seekg(0, std::ios::end);
+	data.resize(static_cast<size_t>(in.tellg() - start));
+	in.seekg(start);
+	in.read(data.data(), data.size());
+
+	indices->clear();
+	indices->reserve(faceCount * 3);
+	const char *p = data.data(), *end = data.data() + data.size();
+	for (size_t f = 0; f < faceCount; ++f)
+	{
+		if (p + countSize > end)
+		{
+			std::cerr << file << ": PLY face data is truncated" << std::endl;
+			return false;
+		}
+
+		unsigned int corners = 0;
+		memcpy(&corners, p, countSize);
+		p += countSize;
+
+		if (p + corners * indexSize > end)
+		{
+			std::cerr << file << ": PLY face data is truncated" << std::endl;
+			return false;
+		}
+
+		unsigned int ids[3];
+		for (unsigned int c = 0; c < corners; ++c, p += indexSize)
+		{
+			memcpy(&ids[std::min(c, 2u)], p, indexSize);
+			if (ids[std::min(c, 2u)] >= vertexCount)
+			{
+				std::cerr << file << ": PLY face " << f << " uses a vertex out of range" << std::endl;
+				return false;
+			}
+
+			if (c >= 2)
+			{
+				indices->push_back(ids[0]);
+				indices->push_back(ids[1]);
+				indices->push_back(ids[2]);
+				ids[1] = ids[2];
+			}
+		}
+	}
+
+	faceCount = indices->size() / 3;
+
+	return true;
+}
+
+// Axis-aligned box and bounding sphere in model space, used for culling
+void ObjModel::computeBounds()
+{
+	if (m_vvec3Vertices.size() == 0)
+		return;
+
+	m_vec3BBMin = m_vec3BBMax = m_vvec3Vertices[0];
+
+	for (auto const &v : m_vvec3Vertices)
+	{
+		m_vec3BBMin = glm::min(m_vec3BBMin, v);
+		m_vec3BBMax = glm::max(m_vec3BBMax, v);
+	}
+
+	// Sphere centered on the box, radius tightened to the furthest vertex
+	m_vec3BSCenter = (m_vec3BBMin + m_vec3BBMax) * 0.5f;
+
+	float maxDist2 = 0.f;
+	for (auto const &v : m_vvec3Vertices)
+	{
+		glm::vec3 d(v - m_vec3BSCenter);
+		maxDist2 = glm::max(maxDist2, glm::dot(d, d));
+	}
+
+	m_fBSRadius = sqrt(maxDist2);
+}
+
+// Spread the low 10 bits of v so there are two zero bits between each
+static unsigned int expandBits(unsigned int v)
+{
+	v = (v * 0x00010001u) & 0xFF0000FFu;
+	v = (v * 0x00000101u) & 0x0F00F00Fu;
+	v = (v * 0x00000011u) & 0xC30C30C3u;
+	v = (v * 0x00000005u) & 0x49249249u;
+	return v;
+}
+
+// Sorts triangles along a Morton curve and cuts them into MESHLET_TRIANGLES-sized clusters
+void ObjModel::buildMeshlets()
+{
+	m_vMeshlets.clear();
+	m_vglDrawCounts.clear();
+	m_vglDrawFirstIndices.clear();
+	m_nVisibleMeshlets = 0;
+	m_nDrawVersion++;
+	s_nDrawVersionTotal++;
+
+	size_t nTris = m_vuiIndices.size() / 3;
+
+	if (nTris == 0)
+		return;
+
+	glm::vec3 extent(glm::max(m_vec3BBMax - m_vec3BBMin, glm::vec3(1e-6f)));
+
+	std::vector<std::pair<unsigned int, unsigned int>> keys(nTris);
+	for (size_t t = 0; t < nTris; ++t)
+	{
+		glm::vec3 centroid((m_vvec3Vertices[m_vuiIndices[3 * t + 0]] + m_vvec3Vertices[m_vuiIndices[3 * t + 1]] + m_vvec3Vertices[m_vuiIndices[3 * t + 2]]) / 3.f);
+		glm::vec3 q(glm::clamp((centroid - m_vec3BBMin) / extent, 0.f, 1.f) * 1023.f);
+		unsigned int code = (expandBits(static_cast<unsigned int>(q.x)) << 2) | (expandBits(static_cast<unsigned int>(q.y)) << 1) | expandBits(static_cast<unsigned int>(q.z));
+		keys[t] = std::make_pair(code, static_cast<unsigned int>(t));
+	}
+
+	std::sort(keys.begin(), keys.end());
+
+	std::vector<unsigned int> sorted(nTris * 3);
+	for (size_t t = 0; t < nTris; ++t)
+	{
+		sorted[3 * t + 0] = m_vuiIndices[3 * keys[t].second + 0];
+		sorted[3 * t + 1] = m_vuiIndices[3 * keys[t].second + 1];
+		sorted[3 * t + 2] = m_vuiIndices[3 * keys[t].second + 2];
+	}
+	m_vuiIndices.swap(sorted);
+
+	for (size_t first = 0; first < nTris; first += MESHLET_TRIANGLES)
+	{
+		size_t last = std::min(first + MESHLET_TRIANGLES, nTris);
+
+		Meshlet m;
+		m.firstIndex = static_cast<GLuint>(first * 3);
+		m.indexCount = static_cast<GLuint>((last - first) * 3);
+		m.bbMin = m.bbMax = m_vvec3Vertices[m_vuiIndices[m.firstIndex]];
+
+		glm::vec3 normalSum(0.f);
+		for (size_t t = first; t < last; ++t)
+		{
+			glm::vec3 a(m_vvec3Vertices[m_vuiIndices[3 * t + 0]]);
+			glm::vec3 b(m_vvec3Vertices[m_vuiIndices[3 * t + 1]]);
+			glm::vec3 c(m_vvec3Vertices[m_vuiIndices[3 * t + 2]]);
+
+			m.bbMin = glm::min(m.bbMin, glm::min(a, glm::min(b, c)));
+			m.bbMax = glm::max(m.bbMax, glm::max(a, glm::max(b, c)));
+
+			glm::vec3 n(glm::cross(b - a, c - a));
+			float len = glm::length(n);
+			if (len > 0.f)
+				normalSum += n / len;
+		}
+
+		m.center = (m.bbMin + m.bbMax) * 0.5f;
+		m.radius = glm::length(m.bbMax - m.center);
+
+		// Normal cone: widest angle between the mean normal and any face normal
+		float lenSum = glm::length(normalSum);
+		float minDot = lenSum > 0.f ? 1.f : -1.f;
+		m.coneAxis = lenSum > 0.f ? normalSum / lenSum : glm::vec3(0.f, 0.f, 1.f);
+		for (size_t t = first; t < last && minDot > 0.f; ++t)
+		{
+			glm::vec3 a(m_vvec3Vertices[m_vuiIndices[3 * t + 0]]);
+			glm::vec3 n(glm::cross(m_vvec3Vertices[m_vuiIndices[3 * t + 1]] - a, m_vvec3Vertices[m_vuiIndices[3 * t + 2]] - a));
+			float len = glm::length(n);
+			if (len > 0.f)
+				minDot = glm::min(minDot, glm::dot(m.coneAxis, n / len));
+		}
+
+		m.coneCutoff = minDot > 0.f ? sqrt(1.f - minDot * minDot) : 1.f;
+
+		m_vMeshlets.push_back(m);
+	}
+}
+
+unsigned int ObjModel::cullMeshlets(const Frustum &frustum, glm::vec3 cameraPos, bool backfaceCull)
+{
+	m_vglDrawCounts.clear();
+	m_vglDrawFirstIndices.clear();
+	m_nVisibleMeshlets = 0;
+
+	unsigned int nTris = 0;
+	bool fullyInside = frustum.containsSphere(m_vec3BSCenter, m_fBSRadius);
+	GLuint rangeEnd = 0;
+
+	for (auto const &m : m_vMeshlets)
+	{
+		if (!fullyInside && (!frustum.intersectsSphere(m.center, m.radius) || !frustum.intersectsAABB(m.bbMin, m.bbMax)))
+			continue;
+
+		// Whole cluster faces away if the view direction stays inside the back of the normal cone
+		if (backfaceCull && m.coneCutoff < 1.f)
+		{
+			glm::vec3 toCenter(m.center - cameraPos);
+			if (glm::dot(toCenter, m.coneAxis) >= m.coneCutoff * glm::length(toCenter) + m.radius)
+				continue;
+		}
+
+		GLuint drawn = m.indexCount;
+		if (m_vbSelection.empty())
+			addDrawRange(m.firstIndex, m.indexCount, rangeEnd);
+		else
+			drawn = addSelectedRanges(m.firstIndex, m.indexCount, rangeEnd);
+
+		if (drawn == 0)
+			continue;
+
+		nTris += drawn / 3;
+		m_nVisibleMeshlets++;
+	}
+
+	return nTris;
+}
+
+// Extend the previous range when the new one is adjacent in the index buffer
+void ObjModel::addDrawRange(GLuint first, GLuint count, GLuint &rangeEnd)
+{
+	if (m_vglDrawCounts.size() > 0 && rangeEnd == first)
+		m_vglDrawCounts.back() += count;
+	else
+	{
+		m_vglDrawCounts.push_back(count);
+		m_vglDrawFirstIndices.push_back(first);
+	}
+
+	rangeEnd = first + count;
+}
+
+// Clip a meshlet's index range against the selection ranges; returns the indices drawn
+GLuint ObjModel::addSelectedRanges(GLuint first, GLuint count, GLuint &rangeEnd)
 {
-	// Create buffers/arrays
-	if (!this->m_glVAO) glGenVertexArrays(1, &this->m_glVAO);
-	if (!this->m_glVBO) glGenBuffers(1, &this->m_glVBO);
-	if (!this->m_glEBO) glGenBuffers(1, &this->m_glEBO);
+	GLuint end = first + count;
+	GLuint drawn = 0;
 
-	std::vector<Vertex> buffer;
+	// First selection range ending after the meshlet starts
+	size_t i = std::upper_bound(m_vglSelectionEnds.begin(), m_vglSelectionEnds.end(), first) - m_vglSelectionEnds.begin();
 
-	for (int i = 0; i < m_vvec3Vertices.size(); ++i)
+	for (; i < m_vglSelectionFirsts.size() && m_vglSelectionFirsts[i] < end; ++i)
 	{
-		Vertex temp;
-		temp.pos = m_vvec3Vertices[i];
-		temp.norm = m_vvec3Normals[i];
-		buffer.push_back(temp);
+		GLuint a = std::max(first, m_vglSelectionFirsts[i]);
+		GLuint b = std::min(end, m_vglSelectionEnds[i]);
+		addDrawRange(a, b - a, rangeEnd);
+		drawn += b - a;
 	}
 
-	glBindVertexArray(this->m_glVAO);
-	// Load data into vertex buffers
-	glBindBuffer(GL_ARRAY_BUFFER, this->m_glVBO);
-	// A great thing about structs is that their memory layout is sequential for all its items.
-	// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-	// again translates to 3/2 floats which translates to a byte array.
-	glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(Vertex), &buffer[0], GL_STATIC_DRAW);
+	return drawn;
+}
+
+unsigned int ObjModel::getVisibleMeshletCount()
+{
+	return m_nVisibleMeshlets;
+}
+
+unsigned int ObjModel::getMeshletCount()
+{
+	return static_cast<unsigned int>(m_vMeshlets.size());
+}
+
+bool ObjModel::intersectRay(glm::vec3 origin, glm::vec3 direction, BVH::Hit &hit)
+{
+	return m_bvh.intersect(BVH::Ray(origin, direction), m_vvec3Vertices, m_vuiIndices, hit);
+}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->m_glEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_vuiIndices.size() * sizeof(GLuint), &m_vuiIndices[0], GL_STATIC_DRAW);
+void ObjModel::intersectRays4(const BVH::Ray rays[4], BVH::Hit hits[4])
+{
+	m_bvh.intersect4(rays, m_vvec3Vertices, m_vuiIndices, hits);
+}
 
-	// Set the vertex attribute pointers
-	// Vertex Positions
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-	// Vertex Normals
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, norm));
+void ObjModel::initGL(GeometryArena *arena)
+{
+	m_pArena = arena;
+	m_allocation = m_pArena->allocate(m_vvec3Vertices, m_vvec3Normals, m_vuiIndices);
+	m_pArena->setTransform(m_allocation.slot, getWorldMatrix());
+	m_nTransformVersion = getWorldVersion();
+	m_nDrawVersion++;
+	s_nDrawVersionTotal++;
+}
 
-	glBindVertexArray(0);
+void ObjModel::releaseGL()
+{
+	if (!m_pArena)
+		return;
+
+	m_pArena->release(m_allocation);
+	m_pArena = NULL;
+	m_vglDrawCounts.clear();
+	m_vglDrawFirstIndices.clear();
+	m_nDrawVersion++;
+	s_nDrawVersionTotal++;
 }
 
-void ObjModel::draw(Shader s)
+size_t ObjModel::getMemoryBytes()
 {
-	//glUniform3f(glGetUniformLocation(s.m_nProgram, "material.diffuse"), m_vec3DiffColor.r, m_vec3DiffColor.g, m_vec3DiffColor.b);
-	//glUniform3f(glGetUniformLocation(s.m_nProgram, "material.specular"), m_vec3SpecColor.r, m_vec3SpecColor.g, m_vec3SpecColor.b);
-	//glUniform3f(glGetUniformLocation(s.m_nProgram, "material.emissive"), m_vec3EmisColor.r, m_vec3EmisColor.g, m_vec3EmisColor.b);
-	//glUniform1f(glGetUniformLocation(s.m_nProgram, "material.shininess"), 32.f);
+	size_t nTris = m_vuiIndices.size() / 3;
 
-	glUniformMatrix4fv(glGetUniformLocation(s.m_nProgram, "model"), 1, GL_FALSE, glm::value_ptr(m_mat4Model));
-	
-	// Draw mesh
-	glBindVertexArray(this->m_glVAO);
-	glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(m_vuiIndices.size()), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
+	return m_vvec3Vertices.size() * sizeof(glm::vec3) + m_vvec3Normals.size() * sizeof(glm::vec3)
+		+ m_vuiIndices.size() * sizeof(unsigned int) + m_vMeshlets.size() * sizeof(Meshlet)
+		+ m_bvh.getNodeCount() * sizeof(BVH::Node) + nTris * sizeof(unsigned int)
+		+ m_vbSelection.size() / 8;
 }
 
-std::vector<unsigned int> ObjModel::getIndices()
+size_t ObjModel::getGPUBytes()
+{
+	return m_pArena ? GeometryArena::getAllocationBytes(m_allocation) : 0;
+}
+
+void ObjModel::queueDraws()
+{
+	for (size_t i = 0; i < m_vglDrawCounts.size(); ++i)
+		m_pArena->addDraw(m_allocation.firstIndex + m_vglDrawFirstIndices[i], m_vglDrawCounts[i], m_allocation.baseVertex);
+}
+
+const std::vector<unsigned int>& ObjModel::getIndices()
 {
 	return m_vuiIndices;
 }
@@ -168,16 +584,238 @@ std::vector<unsigned int> ObjModel::getIndices()
 void ObjModel::setIndices(std::vector<unsigned int> inds)
 {
 	m_vuiIndices = inds;
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->m_glEBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_vuiIndices.size() * sizeof(GLuint), &m_vuiIndices[0], GL_STATIC_DRAW);
+
+	// Triangle order changes, so old selections no longer apply
+	m_vbSelection.clear();
+	m_vvbSelectionUndo.clear();
+	buildSelectionRanges();
+
+	buildMeshlets();
+	m_bvh.build(m_vvec3Vertices, m_vuiIndices);
+	m_pAreaOctree.reset();
+	if (m_pArena)
+		m_pArena->updateIndices(m_allocation, m_vuiIndices);
+}
+
+void ObjModel::setSelection(const std::vector<bool> &selected)
+{
+	if (selected.size() != m_vuiIndices.size() / 3)
+	{
+		std::cerr << "ObjModel::setSelection: expected " << m_vuiIndices.size() / 3 << " triangles, got " << selected.size() << std::endl;
+		return;
+	}
+
+	m_vvbSelectionUndo.push_back(m_vbSelection);
+	m_vbSelection = selected;
+	buildSelectionRanges();
+}
+
+void ObjModel::clearSelection()
+{
+	if (m_vbSelection.empty())
+		return;
+
+	m_vvbSelectionUndo.push_back(m_vbSelection);
+	m_vbSelection.clear();
+	buildSelectionRanges();
+}
+
+bool ObjModel::undoSelection()
+{
+	if (m_vvbSelectionUndo.empty())
+		return false;
+
+	m_vbSelection.swap(m_vvbSelectionUndo.back());
+	m_vvbSelectionUndo.pop_back();
+	buildSelectionRanges();
+
+	return true;
+}
+
+bool ObjModel::hasSelection()
+{
+	return !m_vbSelection.empty();
+}
+
+const std::vector<bool>& ObjModel::getSelection()
+{
+	return m_vbSelection;
 }
 
-std::vector<glm::vec3> ObjModel::getVertices()
+unsigned int ObjModel::getSelectedTriangleCount()
+{
+	return m_vbSelection.empty() ? static_cast<unsigned int>(m_vuiIndices.size() / 3) : m_nSelectedTriangles;
+}
+
+// Collapse the bitset into runs of selected triangles, as index ranges for drawing
+void ObjModel::buildSelectionRanges()
+{
+	m_vglSelectionFirsts.clear();
+	m_vglSelectionEnds.clear();
+	m_nSelectedTriangles = 0;
+	m_nDrawVersion++;
+	s_nDrawVersionTotal++;
+
+	for (size_t t = 0; t < m_vbSelection.size(); ++t)
+	{
+		if (!m_vbSelection[t])
+			continue;
+
+		GLuint first = static_cast<GLuint>(3 * t);
+		if (m_vglSelectionEnds.size() > 0 && m_vglSelectionEnds.back() == first)
+			m_vglSelectionEnds.back() += 3;
+		else
+		{
+			m_vglSelectionFirsts.push_back(first);
+			m_vglSelectionEnds.push_back(first + 3);
+		}
+
+		m_nSelectedTriangles++;
+	}
+}
+
+const std::vector<glm::vec3>& ObjModel::getVertices()
 {
 	return m_vvec3Vertices;
 }
 
+const BVH& ObjModel::getBVH()
+{
+	return m_bvh;
+}
+
+const AreaOctree& ObjModel::getAreaOctree()
+{
+	if (!m_pAreaOctree)
+	{
+		m_pAreaOctree = std::make_shared<AreaOctree>();
+
+		std::string cachePath(AreaOctree::getCachePath(m_strModelName));
+		if (!m_pAreaOctree->load(cachePath, m_vvec3Vertices, m_vuiIndices))
+		{
+			m_pAreaOctree->build(m_vvec3Vertices, m_vuiIndices);
+			if (m_pAreaOctree->save(cachePath, m_vvec3Vertices, m_vuiIndices))
+				std::cout << "Saved area octree for " << m_strModelName << " (" << m_pAreaOctree->getNodeCount() << " nodes)" << std::endl;
+		}
+	}
+
+	return *m_pAreaOctree;
+}
+
+// The octree answers for translated and uniformly scaled models, whose scene-space boxes map exactly onto
+// model-space boxes. Under a rotation the triangles are clipped one by one in scene space instead.
+AreaOctree::Result ObjModel::queryArea(glm::vec3 bbMin, glm::vec3 bbMax, float minNodeSize)
+{
+	glm::vec3 modelMin, modelMax;
+	toModelSpace(bbMin, bbMax, modelMin, modelMax);
+
+	float scale = getUniformScale();
+	if (scale > 0.f)
+	{
+		AreaOctree::Result result(getAreaOctree().query(modelMin, modelMax, m_vvec3Vertices, m_vuiIndices, minNodeSize));
+		result.area *= scale * scale;
+		result.errorBound *= scale * scale;
+		return result;
+	}
+
+	std::vector<unsigned int> candidates;
+	m_bvh.queryAABB(modelMin, modelMax, m_vvec3Vertices, m_vuiIndices, candidates);
+
+	AreaOctree::Result result;
+	result.area = 0.0;
+	result.errorBound = 0.0;
+	result.nodesVisited = 0;
+	result.trianglesTested = candidates.size();
+
+	glm::mat4 modelMatrix(getModelMatrix());
+	for (auto const &t : candidates)
+	{
+		glm::vec3 a(modelMatrix * glm::vec4(m_vvec3Vertices[m_vuiIndices[3 * t + 0]], 1.f));
+		glm::vec3 b(modelMatrix * glm::vec4(m_vvec3Vertices[m_vuiIndices[3 * t + 1]], 1.f));
+		glm::vec3 c(modelMatrix * glm::vec4(m_vvec3Vertices[m_vuiIndices[3 * t + 2]], 1.f));
+		result.area += MeasurementBox::getTriangleSurfaceAreaInAABB(a, b, c, bbMin, bbMax);
+	}
+
+	return result;
+}
+
+void ObjModel::toModelSpace(glm::vec3 bbMin, glm::vec3 bbMax, glm::vec3 &outMin, glm::vec3 &outMax)
+{
+	glm::mat4 toModel(glm::inverse(getModelMatrix()));
+
+	outMin = glm::vec3(FLT_MAX);
+	outMax = glm::vec3(-FLT_MAX);
+
+	for (int i = 0; i < 8; ++i)
+	{
+		glm::vec3 corner(i & 1 ? bbMax.x : bbMin.x, i & 2 ? bbMax.y : bbMin.y, i & 4 ? bbMax.z : bbMin.z);
+		glm::vec3 p(toModel * glm::vec4(corner, 1.f));
+		outMin = glm::min(outMin, p);
+		outMax = glm::max(outMax, p);
+	}
+}
+
+float ObjModel::getUniformScale()
+{
+	glm::mat4 m(getModelMatrix());
+	float scale = m[0][0];
+	float tolerance = 1e-6f * fabs(scale);
+
+	for (int c = 0; c < 3; ++c)
+		for (int r = 0; r < 3; ++r)
+			if (fabs(m[c][r] - (c == r ? scale : 0.f)) > tolerance)
+				return 0.f;
+
+	return scale > 0.f ? scale : 0.f;
+}
+
 std::string ObjModel::getName()
 {
 	return m_strModelName;
 }
+
+glm::mat4 ObjModel::getModelMatrix()
+{
+	return getWorldMatrix();
+}
+
+void ObjModel::setModelMatrix(glm::mat4 model)
+{
+	SceneGraph::getInstance().setLocalMatrix(m_node, model);
+	syncTransform();
+}
+
+bool ObjModel::syncTransform()
+{
+	if (!m_pArena)
+		return false;
+
+	unsigned int version = getWorldVersion();
+	if (version == m_nTransformVersion)
+		return false;
+
+	m_pArena->setTransform(m_allocation.slot, getWorldMatrix());
+	m_nTransformVersion = version;
+
+	return true;
+}
+
+glm::vec3 ObjModel::getBBMin()
+{
+	return m_vec3BBMin;
+}
+
+glm::vec3 ObjModel::getBBMax()
+{
+	return m_vec3BBMax;
+}
+
+glm::vec3 ObjModel::getBSCenter()
+{
+	return m_vec3BSCenter;
+}
+
+float ObjModel::getBSRadius()
+{
+	return m_fBSRadius;
+}
@@ -5,40 +5,148 @@
 #include <tinyobjloader/tiny_obj_loader.h>
 
 #include "Shader.h"
+#include "Frustum.h"
+#include "GeometryArena.h"
+#include "BVH.h"
+#include "AreaOctree.h"
+#include "Object.h"
 
-class ObjModel
+#include <memory>
+#include <atomic>
+
+#define MESHLET_TRIANGLES 256
+
+// The model matrix is the world matrix of the model's scene graph node
+class ObjModel : public Object
 {
+public:
+	// Fixed-size cluster of spatially coherent triangles with its culling bounds
+	struct Meshlet {
+		GLuint firstIndex;
+		GLuint indexCount;
+		glm::vec3 bbMin, bbMax;
+		glm::vec3 center;
+		float radius;
+		glm::vec3 coneAxis;
+		float coneCutoff; // sine of the normal cone half-angle; >= 1 disables backface rejection
+	};
+
 public:	
-	ObjModel(std::string objFile);
+	ObjModel(std::string objFile, GeometryArena *arena);	// arena may be NULL for headless use; .ply files are read as PLY
 	~ObjModel();
+
+	// Binary little-endian PLY with float x, y, z vertex properties and polygon faces, as MeshExporter and
+	// MeshPartitioner write it; polygons are fanned into triangles. Without indices only the vertices are
+	// read, and the face count is the header's.
+	static bool readPLY(std::string file, std::vector<glm::vec3> &vertices, std::vector<unsigned int> *indices, size_t &faceCount);
 	
 private:		
 	bool load(std::string objName);
+	bool loadPLY(std::string plyName);
+	void computeBounds();
+	void buildMeshlets();
+	void buildSelectionRanges();
+	void addDrawRange(GLuint first, GLuint count, GLuint &rangeEnd);
+	GLuint addSelectedRanges(GLuint first, GLuint count, GLuint &rangeEnd);
 	
 	std::vector<glm::vec3> m_vvec3Vertices;
 	std::vector<glm::vec3> m_vvec3Normals;
 	std::vector<unsigned int> m_vuiIndices;
 	
 public:
-	void initGL();
-	void draw(Shader s);
+	void initGL(GeometryArena *arena);
+
+	// Gives the geometry's arena space back; the CPU copy stays, and initGL uploads it again
+	void releaseGL();
+	bool isResident() { return m_pArena != NULL; }
 
-	std::vector<unsigned int> getIndices();
+	// Approximate bytes held by the geometry and its acceleration structures, and in the arena
+	size_t getMemoryBytes();
+	size_t getGPUBytes();
+
+	// Adds the visible ranges from the last cullMeshlets() call to the arena's draw batch
+	void queueDraws();
+
+	// Frustum and camera position are in model space
+	unsigned int cullMeshlets(const Frustum &frustum, glm::vec3 cameraPos, bool backfaceCull);
+	unsigned int getVisibleMeshletCount();
+	unsigned int getMeshletCount();
+
+	// Ray queries in model space against the model's BVH
+	bool intersectRay(glm::vec3 origin, glm::vec3 direction, BVH::Hit &hit);
+	void intersectRays4(const BVH::Ray rays[4], BVH::Hit hits[4]);
+
+	const std::vector<unsigned int>& getIndices();
 	void setIndices(std::vector<unsigned int> inds);
-	std::vector<glm::vec3> getVertices();
+
+	// Non-destructive triangle selection over the current index order; only selected
+	// triangles are drawn. Each change can be undone, and none touches the index buffer.
+	void setSelection(const std::vector<bool> &selected);
+	void clearSelection();
+	bool undoSelection();
+	bool hasSelection();
+	const std::vector<bool>& getSelection();
+	unsigned int getSelectedTriangleCount();
+
+	// Bumped when the meshlets, the selection or the transform change, so cached culling results go stale
+	unsigned int getDrawVersion() { return m_nDrawVersion + getWorldVersion(); }
+
+	// Bumped with every model's own draw version, without the transform; it never goes back as models are deleted
+	static unsigned int getDrawVersionTotal() { return s_nDrawVersionTotal; }
+	const std::vector<glm::vec3>& getVertices();
+	const BVH& getBVH();
+
+	// Summed-area octree, loaded from the sidecar cache beside the OBJ or built and saved on first use
+	const AreaOctree& getAreaOctree();
+
+	// Area of the triangles overlapping a scene-space box, through the octree
+	AreaOctree::Result queryArea(glm::vec3 bbMin, glm::vec3 bbMax, float minNodeSize = 0.f);
+
+	// Model-space box around a scene-space one. A rotation makes it larger than the box, so it only finds
+	// candidate triangles; overlap and area are measured on the triangles moved into scene space.
+	void toModelSpace(glm::vec3 bbMin, glm::vec3 bbMax, glm::vec3 &outMin, glm::vec3 &outMax);
+
+	// The scale of a model matrix made of a translation and a uniform scale only, otherwise 0
+	float getUniformScale();
 
 	std::string getName();
 
-private:
-	struct Vertex {
-		glm::vec3 pos;
-		glm::vec3 norm;
-	};
+	glm::mat4 getModelMatrix();
+	void setModelMatrix(glm::mat4 model);	// local to the node's parent
 
+	// Re-uploads the arena transform if the world matrix changed since; true if it did
+	bool syncTransform();
+
+	glm::vec3 getBBMin();
+	glm::vec3 getBBMax();
+	glm::vec3 getBSCenter();
+	float getBSRadius();
+
+private:
 	std::string m_strModelName;
 
-	GLuint m_glVAO, m_glVBO, m_glEBO;
-	glm::mat4 m_mat4Model;
+	GeometryArena *m_pArena;
+	GeometryArena::Allocation m_allocation;
+	unsigned int m_nTransformVersion;	// world version last written to the arena
+	glm::vec3 m_vec3BBMin, m_vec3BBMax;
+	glm::vec3 m_vec3BSCenter;
+	float m_fBSRadius;
+
+	std::vector<Meshlet> m_vMeshlets;
+	BVH m_bvh;
+	std::shared_ptr<AreaOctree> m_pAreaOctree;	// shared by replicas of the same mesh
+
+	// Visible index ranges from the last cullMeshlets() call, merged where contiguous
+	std::vector<GLsizei> m_vglDrawCounts;
+	std::vector<GLuint> m_vglDrawFirstIndices;
+	unsigned int m_nVisibleMeshlets;
+
+	std::vector<bool> m_vbSelection;	// one bit per triangle; empty when nothing is selected
+	std::vector<std::vector<bool>> m_vvbSelectionUndo;
+	std::vector<GLuint> m_vglSelectionFirsts, m_vglSelectionEnds;	// selected index ranges, sorted
+	unsigned int m_nSelectedTriangles;
+	unsigned int m_nDrawVersion;
+	static std::atomic<unsigned int> s_nDrawVersionTotal;
 	glm::vec3 m_vec3DiffColor, m_vec3SpecColor, m_vec3EmisColor;
 };
 
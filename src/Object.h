@@ -2,36 +2,64 @@
 
 #include <glm/glm.hpp>
 
+#include "SceneGraph.h"
+
+// Something placed in the scene. The transform itself is a node in the shared SceneGraph, so objects
+// can hang off each other, e.g. scans positioned relative to a transect anchor, and world matrices are
+// only recomputed when something above them moved.
 class Object
 {
 public:
 	Object()
-		: m_vec3Position(glm::vec3())
-		, m_mat3Rotation(glm::mat3())
-		, m_vec3Scale(glm::vec3(1.f))
+		: m_node(SceneGraph::getInstance().create())
 	{}
 
 	Object(glm::vec3 position, glm::mat3 rotation, glm::vec3 scale = glm::vec3(1.f))
-		: m_vec3Position(position)
-		, m_mat3Rotation(rotation)
-		, m_vec3Scale(scale)
+		: m_node(SceneGraph::getInstance().create())
+	{
+		setPosition(position);
+		setOrientation(rotation);
+		setScale(scale);
+	}
+
+	// Copies get a node of their own with the same local transform and parent
+	Object(const Object &other)
+		: m_node(SceneGraph::getInstance().clone(other.m_node))
 	{}
 
-	~Object() {}
+	Object& operator=(const Object &other)
+	{
+		if (this != &other)
+		{
+			SceneGraph &graph = SceneGraph::getInstance();
+			graph.setPosition(m_node, graph.getPosition(other.m_node));
+			graph.setRotation(m_node, graph.getRotation(other.m_node));
+			graph.setScale(m_node, graph.getScale(other.m_node));
+			graph.setParent(m_node, graph.getParent(other.m_node));
+		}
+
+		return *this;
+	}
+
+	~Object() { SceneGraph::getInstance().release(m_node); }
 
-	void setPosition(glm::vec3 pos) { m_vec3Position = pos; }
-	glm::vec3 getPosition() { return m_vec3Position; }
+	void setPosition(glm::vec3 pos) { SceneGraph::getInstance().setPosition(m_node, pos); }
+	glm::vec3 getPosition() { return SceneGraph::getInstance().getPosition(m_node); }
 
-	void setOrientation(glm::mat3 rot) { m_mat3Rotation = rot; }
-	glm::mat3 getOrientation() { return m_mat3Rotation; }
+	void setOrientation(glm::mat3 rot) { SceneGraph::getInstance().setRotation(m_node, rot); }
+	glm::mat3 getOrientation() { return SceneGraph::getInstance().getRotation(m_node); }
 
-	void setScale(glm::vec3 s) { m_vec3Scale = s; }
-	void setScale(float s) { m_vec3Scale = glm::vec3(s); }
-	glm::vec3 getScale() { return m_vec3Scale; }
+	void setScale(glm::vec3 s) { SceneGraph::getInstance().setScale(m_node, s); }
+	void setScale(float s) { SceneGraph::getInstance().setScale(m_node, glm::vec3(s)); }
+	glm::vec3 getScale() { return SceneGraph::getInstance().getScale(m_node); }
+
+	// NULL makes this a root again
+	bool setParent(Object *parent) { return SceneGraph::getInstance().setParent(m_node, parent ? parent->m_node : SCENE_NODE_NONE); }
+
+	glm::mat4 getWorldMatrix() { return SceneGraph::getInstance().getWorldMatrix(m_node); }
+	unsigned int getWorldVersion() { return SceneGraph::getInstance().getWorldVersion(m_node); }
+	SceneGraph::Node getNode() { return m_node; }
 
 protected:
-	glm::vec3 m_vec3Position;
-	glm::mat3 m_mat3Rotation;
-	glm::vec3 m_vec3Scale;
+	SceneGraph::Node m_node;
 };
-
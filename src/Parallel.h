@@ -0,0 +1,45 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+
+#include "JobSystem.h"
+
+namespace Parallel
+{
+	inline unsigned int getThreadCount()
+	{
+		return JobSystem::getInstance().getThreadCount();
+	}
+
+	// Split [0, count) into one contiguous chunk per thread and run func(begin, end, chunk) on each.
+	// Chunks are numbered so callers can keep per-thread results without locking. The chunks run as
+	// jobs, so a parallelFor inside another job shares the workers instead of starting threads.
+	inline void parallelFor(size_t count, const std::function<void(size_t, size_t, unsigned int)> &func, unsigned int nThreads = getThreadCount())
+	{
+		nThreads = static_cast<unsigned int>(std::max<size_t>(1, std::min<size_t>(nThreads, count)));
+
+		if (nThreads == 1)
+		{
+			func(0, count, 0);
+			return;
+		}
+
+		size_t chunk = (count + nThreads - 1) / nThreads;
+
+		JobSystem &jobs = JobSystem::getInstance();
+		std::vector<JobSystem::JobHandle> chunks;
+		for (unsigned int t = 1; t < nThreads; ++t)
+		{
+			size_t begin = std::min(count, t * chunk);
+			size_t end = std::min(count, begin + chunk);
+			chunks.push_back(jobs.submit([&func, begin, end, t]() { func(begin, end, t); }));
+		}
+
+		// The calling thread takes the first chunk, then helps with the rest
+		func(0, std::min(count, chunk), 0);
+
+		jobs.wait(chunks);
+	}
+}
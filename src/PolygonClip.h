@@ -0,0 +1,50 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+// Convex polygon clipping against axis-aligned planes, shared by the volume and voxel measurements.
+// A triangle clipped by k planes has at most 3 + k vertices; callers size their buffers for that.
+namespace PolygonClip
+{
+	// One Sutherland-Hodgman step: keeps the part with p[axis] >= value (keepAbove) or <= value;
+	// strict drops the plane itself, so a polygon lying in it is removed
+	inline int clip(const glm::vec3 *in, int n, glm::vec3 *out, int axis, float value, bool keepAbove, bool strict = false)
+	{
+		int m = 0;
+		for (int i = 0; i < n; ++i)
+		{
+			const glm::vec3 &cur = in[i];
+			const glm::vec3 &next = in[(i + 1) % n];
+
+			float dCur = keepAbove ? cur[axis] - value : value - cur[axis];
+			float dNext = keepAbove ? next[axis] - value : value - next[axis];
+
+			bool inCur = strict ? dCur > 0.f : dCur >= 0.f;
+			bool inNext = strict ? dNext > 0.f : dNext >= 0.f;
+
+			if (inCur)
+				out[m++] = cur;
+			if (inCur != inNext)
+				out[m++] = cur + (next - cur) * (dCur / (dCur - dNext));
+		}
+
+		return m;
+	}
+
+	// Keeps the part with lo <= p[axis] <= hi, or lo <= p[axis] < hi when tiling space into slabs so
+	// that a polygon lying on a shared face is counted once; tmp must hold as many vertices as out
+	inline int clipSlab(const glm::vec3 *in, int n, glm::vec3 *out, glm::vec3 *tmp, int axis, float lo, float hi, bool hiExclusive = false)
+	{
+		n = clip(in, n, tmp, axis, lo, true);
+		return clip(tmp, n, out, axis, hi, false, hiExclusive);
+	}
+
+	inline double area(const glm::vec3 *poly, int n)
+	{
+		glm::dvec3 sum(0.0);
+		for (int k = 1; k + 1 < n; ++k)
+			sum += glm::cross(glm::dvec3(poly[k] - poly[0]), glm::dvec3(poly[k + 1] - poly[0]));
+
+		return glm::length(sum) * 0.5;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif // !GLEW_STATIC
+#include <GL/glew.h>
+
+#include <string>
+
+#include "Shader.h"
+
+// One entry in the engine's ordered pass list: a program plus the fixed-function state it draws with
+struct RenderPass
+{
+	std::string name;
+	Shader *shader;
+	bool enabled;
+	int order;			// passes run in ascending order; equal orders are grouped by program
+
+	bool depthTest;
+	GLenum depthFunc;
+	bool depthWrite;
+	bool colorWrite;
+	bool useMaterial;	// pass reads the material.* uniforms
+	bool countFragments;	// wrap the pass in the engine's fragment statistics query
+
+	RenderPass(std::string passName, Shader *passShader, int passOrder)
+		: name(passName)
+		, shader(passShader)
+		, enabled(true)
+		, order(passOrder)
+		, depthTest(true)
+		, depthFunc(GL_LESS)
+		, depthWrite(true)
+		, colorWrite(true)
+		, useMaterial(true)
+		, countFragments(false)
+	{}
+
+	void apply() const
+	{
+		if (depthTest)
+			glEnable(GL_DEPTH_TEST);
+		else
+			glDisable(GL_DEPTH_TEST);
+
+		glDepthFunc(depthFunc);
+		glDepthMask(depthWrite ? GL_TRUE : GL_FALSE);
+		glColorMask(colorWrite, colorWrite, colorWrite, colorWrite);
+	}
+
+	// Sort key: pass order first, then program so passes sharing a program run back to back
+	bool operator<(const RenderPass &other) const
+	{
+		if (order != other.order)
+			return order < other.order;
+
+		return shader->m_nProgram < other.shader->m_nProgram;
+	}
+};
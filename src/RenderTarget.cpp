@@ -0,0 +1,122 @@
+#include "RenderTarget.h"
+
+#include <iostream>
+
+RenderTarget::RenderTarget()
+	: m_glFBO(0)
+	, m_glColorRB(0)
+	, m_glDepthRB(0)
+	, m_glResolveFBO(0)
+	, m_glResolveRB(0)
+	, m_iWidth(0)
+	, m_iHeight(0)
+	, m_iSamples(0)
+{
+}
+
+RenderTarget::~RenderTarget()
+{
+	release();
+}
+
+void RenderTarget::release()
+{
+	if (m_glFBO)
+		glDeleteFramebuffers(1, &m_glFBO);
+	if (m_glResolveFBO)
+		glDeleteFramebuffers(1, &m_glResolveFBO);
+	if (m_glColorRB)
+		glDeleteRenderbuffers(1, &m_glColorRB);
+	if (m_glDepthRB)
+		glDeleteRenderbuffers(1, &m_glDepthRB);
+	if (m_glResolveRB)
+		glDeleteRenderbuffers(1, &m_glResolveRB);
+
+	m_glFBO = m_glColorRB = m_glDepthRB = m_glResolveFBO = m_glResolveRB = 0;
+	m_iWidth = m_iHeight = m_iSamples = 0;
+}
+
+int RenderTarget::getMaxSamples()
+{
+	GLint maxSamples = 0;
+	glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+	return maxSamples;
+}
+
+bool RenderTarget::resize(int width, int height, int samples)
+{
+	if (m_glFBO && width == m_iWidth && height == m_iHeight && samples == m_iSamples)
+		return true;
+
+	release();
+
+	m_iWidth = width;
+	m_iHeight = height;
+	m_iSamples = samples;
+
+	glGenRenderbuffers(1, &m_glColorRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_glColorRB);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+
+	glGenRenderbuffers(1, &m_glDepthRB);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_glDepthRB);
+	glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+
+	glGenFramebuffers(1, &m_glFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_glFBO);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_glColorRB);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_glDepthRB);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	// Multisampled buffers can only be blitted at their own size, so scaling goes through a resolved copy
+	if (complete && samples > 0)
+	{
+		glGenRenderbuffers(1, &m_glResolveRB);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_glResolveRB);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+		glGenFramebuffers(1, &m_glResolveFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_glResolveFBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_glResolveRB);
+		complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	}
+
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (!complete)
+	{
+		std::cerr << "Render target " << width << "x" << height << " with " << samples << " samples is incomplete" << std::endl;
+		release();
+	}
+
+	return complete;
+}
+
+void RenderTarget::bind()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_glFBO);
+	glViewport(0, 0, m_iWidth, m_iHeight);
+}
+
+void RenderTarget::blitToScreen(int screenWidth, int screenHeight)
+{
+	bool scaled = screenWidth != m_iWidth || screenHeight != m_iHeight;
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_glFBO);
+
+	// Samples are always resolved into our own RGBA8 copy: resolving straight into the window is an
+	// error whenever the window's format differs, e.g. RGB8 or sRGB
+	if (m_iSamples > 0)
+	{
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_glResolveFBO);
+		glBlitFramebuffer(0, 0, m_iWidth, m_iHeight, 0, 0, m_iWidth, m_iHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_glResolveFBO);
+	}
+
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, m_iWidth, m_iHeight, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT, scaled ? GL_LINEAR : GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, screenWidth, screenHeight);
+}
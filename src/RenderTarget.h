@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef GLEW_STATIC
+#define GLEW_STATIC
+#endif // !GLEW_STATIC
+#include <GL/glew.h>
+
+// Offscreen colour and depth buffers the scene is drawn into, at any resolution and sample count,
+// so neither is tied to the window. Presenting resolves the samples and scales the image to the
+// window with framebuffer blits.
+class RenderTarget
+{
+public:
+	RenderTarget();
+	~RenderTarget();
+
+	// Reallocates only when the size or sample count changed; false if the framebuffer is incomplete
+	bool resize(int width, int height, int samples);
+
+	// Binds for drawing and sets the viewport to the whole target
+	void bind();
+
+	// Onto the default framebuffer, stretched to the given size; leaves the default framebuffer bound
+	void blitToScreen(int screenWidth, int screenHeight);
+
+	int getWidth() { return m_iWidth; }
+	int getHeight() { return m_iHeight; }
+	int getSamples() { return m_iSamples; }
+
+	static int getMaxSamples();
+
+private:
+	void release();
+
+	GLuint m_glFBO, m_glColorRB, m_glDepthRB;	// multisampled when m_iSamples > 0
+	GLuint m_glResolveFBO, m_glResolveRB;		// single-sampled copy a multisampled target is resolved into
+	int m_iWidth, m_iHeight, m_iSamples;
+
+	RenderTarget(RenderTarget const&) = delete;
+	void operator=(RenderTarget const&) = delete;
+};
@@ -0,0 +1,286 @@
+#include "SceneGraph.h"
+
+#include <iostream>
+#include <algorithm>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+SceneGraph& SceneGraph::getInstance()
+{
+	static SceneGraph instance;
+	return instance;
+}
+
+SceneGraph::SceneGraph()
+	: m_bDirty(false)
+	, m_bOrderDirty(false)
+	, m_nPass(0)
+	, m_nLastUpdated(0)
+{
+}
+
+SceneGraph::Node SceneGraph::create(Node parent)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+
+	Node node;
+	if (!m_vFree.empty())
+	{
+		node = m_vFree.back();
+		m_vFree.pop_back();
+	}
+	else
+	{
+		node = static_cast<Node>(m_vParent.size());
+		m_vvec3Position.push_back(glm::vec3(0.f));
+		m_vmat3Rotation.push_back(glm::mat3());
+		m_vvec3Scale.push_back(glm::vec3(1.f));
+		m_vParent.push_back(SCENE_NODE_NONE);
+		m_vmat4World.push_back(glm::mat4());
+		m_vuiWorldVersion.push_back(0);
+		m_vuiUpdatedPass.push_back(0);
+		m_vbDirty.push_back(0);
+	}
+
+	m_vvec3Position[node] = glm::vec3(0.f);
+	m_vmat3Rotation[node] = glm::mat3();
+	m_vvec3Scale[node] = glm::vec3(1.f);
+	m_vParent[node] = parent;
+	m_vuiWorldVersion[node]++;
+	markDirty(node);
+
+	// While the order is valid the parent is already in it, so the new node can go last
+	if (!m_bOrderDirty)
+		m_vOrder.push_back(node);
+
+	return node;
+}
+
+SceneGraph::Node SceneGraph::clone(Node node)
+{
+	Node copy = create(getParent(node));
+
+	std::lock_guard<std::mutex> guard(m_Lock);
+	m_vvec3Position[copy] = m_vvec3Position[node];
+	m_vmat3Rotation[copy] = m_vmat3Rotation[node];
+	m_vvec3Scale[copy] = m_vvec3Scale[node];
+
+	return copy;
+}
+
+void SceneGraph::release(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+
+	for (size_t i = 0; i < m_vParent.size(); ++i)
+	{
+		if (m_vParent[i] == node)
+		{
+			m_vParent[i] = SCENE_NODE_NONE;
+			markDirty(static_cast<Node>(i));
+		}
+	}
+
+	m_vParent[node] = SCENE_NODE_NONE;
+	m_vbDirty[node] = 0;
+	m_vFree.push_back(node);
+	m_bOrderDirty = true;
+}
+
+bool SceneGraph::setParent(Node node, Node parent)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+
+	for (Node p = parent; p != SCENE_NODE_NONE; p = m_vParent[p])
+	{
+		if (p == node)
+		{
+			std::cerr << "SceneGraph::setParent: node " << parent << " is below node " << node << std::endl;
+			return false;
+		}
+	}
+
+	m_vParent[node] = parent;
+	markDirty(node);
+	m_bOrderDirty = true;
+
+	return true;
+}
+
+SceneGraph::Node SceneGraph::getParent(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	return m_vParent[node];
+}
+
+void SceneGraph::markDirty(Node node)
+{
+	m_vbDirty[node] = 1;
+	m_bDirty = true;
+}
+
+void SceneGraph::setPosition(Node node, glm::vec3 position)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	m_vvec3Position[node] = position;
+	markDirty(node);
+}
+
+void SceneGraph::setRotation(Node node, glm::mat3 rotation)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	m_vmat3Rotation[node] = rotation;
+	markDirty(node);
+}
+
+void SceneGraph::setScale(Node node, glm::vec3 scale)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	m_vvec3Scale[node] = scale;
+	markDirty(node);
+}
+
+void SceneGraph::setLocalMatrix(Node node, glm::mat4 local)
+{
+	glm::vec3 scale(glm::length(glm::vec3(local[0])), glm::length(glm::vec3(local[1])), glm::length(glm::vec3(local[2])));
+	glm::mat3 rotation(glm::vec3(local[0]) / scale.x, glm::vec3(local[1]) / scale.y, glm::vec3(local[2]) / scale.z);
+
+	std::lock_guard<std::mutex> guard(m_Lock);
+	m_vvec3Position[node] = glm::vec3(local[3]);
+	m_vmat3Rotation[node] = rotation;
+	m_vvec3Scale[node] = scale;
+	markDirty(node);
+}
+
+glm::vec3 SceneGraph::getPosition(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	return m_vvec3Position[node];
+}
+
+glm::mat3 SceneGraph::getRotation(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	return m_vmat3Rotation[node];
+}
+
+glm::vec3 SceneGraph::getScale(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	return m_vvec3Scale[node];
+}
+
+glm::mat4 SceneGraph::getWorldMatrix(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	if (m_bDirty)
+		updateLocked();
+
+	return m_vmat4World[node];
+}
+
+unsigned int SceneGraph::getWorldVersion(Node node)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	if (m_bDirty)
+		updateLocked();
+
+	return m_vuiWorldVersion[node];
+}
+
+void SceneGraph::getPositions(const Node *nodes, size_t count, glm::vec3 *positions)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	for (size_t i = 0; i < count; ++i)
+		positions[i] = m_vvec3Position[nodes[i]];
+}
+
+void SceneGraph::setPositions(const Node *nodes, size_t count, const glm::vec3 *positions)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	for (size_t i = 0; i < count; ++i)
+	{
+		m_vvec3Position[nodes[i]] = positions[i];
+		markDirty(nodes[i]);
+	}
+}
+
+void SceneGraph::getWorldPositions(const Node *nodes, size_t count, glm::vec3 *positions)
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	if (m_bDirty)
+		updateLocked();
+
+	for (size_t i = 0; i < count; ++i)
+		positions[i] = glm::vec3(m_vmat4World[nodes[i]][3]);
+}
+
+size_t SceneGraph::update()
+{
+	std::lock_guard<std::mutex> guard(m_Lock);
+	if (!m_bDirty)
+		m_nLastUpdated = 0;
+
+	return m_bDirty ? updateLocked() : 0;
+}
+
+// Order live nodes by depth, which puts every parent ahead of its children
+void SceneGraph::sortLocked()
+{
+	std::vector<unsigned int> depth(m_vParent.size(), 0);
+	std::vector<unsigned char> alive(m_vParent.size(), 1);
+	for (auto const &n : m_vFree)
+		alive[n] = 0;
+
+	m_vOrder.clear();
+	for (Node n = 0; n < m_vParent.size(); ++n)
+	{
+		if (!alive[n])
+			continue;
+
+		for (Node p = m_vParent[n]; p != SCENE_NODE_NONE; p = m_vParent[p])
+			depth[n]++;
+
+		m_vOrder.push_back(n);
+	}
+
+	std::stable_sort(m_vOrder.begin(), m_vOrder.end(), [&depth](Node a, Node b) { return depth[a] < depth[b]; });
+
+	m_bOrderDirty = false;
+}
+
+size_t SceneGraph::updateLocked()
+{
+	if (m_bOrderDirty)
+		sortLocked();
+
+	// A node is recomputed if it changed itself or its parent was recomputed earlier in this pass
+	m_nPass++;
+	size_t updated = 0;
+
+	for (auto const &n : m_vOrder)
+	{
+		Node parent = m_vParent[n];
+		bool parentUpdated = parent != SCENE_NODE_NONE && m_vuiUpdatedPass[parent] == m_nPass;
+
+		if (!m_vbDirty[n] && !parentUpdated)
+			continue;
+
+		glm::mat4 local(m_vmat3Rotation[n]);
+		local[0] *= m_vvec3Scale[n].x;
+		local[1] *= m_vvec3Scale[n].y;
+		local[2] *= m_vvec3Scale[n].z;
+		local[3] = glm::vec4(m_vvec3Position[n], 1.f);
+
+		m_vmat4World[n] = parent != SCENE_NODE_NONE ? m_vmat4World[parent] * local : local;
+		m_vuiWorldVersion[n]++;
+		m_vuiUpdatedPass[n] = m_nPass;
+		m_vbDirty[n] = 0;
+		updated++;
+	}
+
+	m_bDirty = false;
+	m_nLastUpdated = updated;
+
+	return updated;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <mutex>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#define SCENE_NODE_NONE 0xFFFFFFFFu		// parent of root nodes
+
+// Flat transform hierarchy shared by everything placed in the scene. Local transforms, parents and
+// world matrices live in parallel arrays, and the nodes are kept in an order where parents come before
+// their children, so one linear pass recomputes the world matrix of every node whose own transform or
+// ancestor changed and leaves the rest alone. Each recomputed node gets a new world version that
+// consumers compare against to skip unchanged objects. The pass runs lazily on the first world matrix
+// read after a change; calls are serialised so jobs can read transforms while the main thread sets them.
+class SceneGraph
+{
+public:
+	typedef unsigned int Node;
+
+public:
+	static SceneGraph& getInstance();
+
+	Node create(Node parent = SCENE_NODE_NONE);
+	Node clone(Node node);	// same local transform and parent
+	void release(Node node);	// children become roots with their local transforms as-is
+
+	// False if the new parent is the node or one of its descendants
+	bool setParent(Node node, Node parent);
+	Node getParent(Node node);
+
+	void setPosition(Node node, glm::vec3 position);
+	void setRotation(Node node, glm::mat3 rotation);
+	void setScale(Node node, glm::vec3 scale);
+	void setLocalMatrix(Node node, glm::mat4 local);	// split into translation, rotation and scale; no shear
+
+	glm::vec3 getPosition(Node node);
+	glm::mat3 getRotation(Node node);
+	glm::vec3 getScale(Node node);
+
+	glm::mat4 getWorldMatrix(Node node);
+	unsigned int getWorldVersion(Node node);
+
+	// Batched forms for systems moving many nodes at once, taking the lock once
+	void getPositions(const Node *nodes, size_t count, glm::vec3 *positions);
+	void setPositions(const Node *nodes, size_t count, const glm::vec3 *positions);
+	void getWorldPositions(const Node *nodes, size_t count, glm::vec3 *positions);
+
+	// World matrices recomputed by the last pass, for profiling
+	size_t update();
+	size_t getLastUpdateCount() { return m_nLastUpdated; }
+	size_t getNodeCount() { return m_vParent.size() - m_vFree.size(); }
+
+private:
+	SceneGraph();
+
+	size_t updateLocked();
+	void sortLocked();
+	void markDirty(Node node);
+
+	// Local transform
+	std::vector<glm::vec3> m_vvec3Position;
+	std::vector<glm::mat3> m_vmat3Rotation;
+	std::vector<glm::vec3> m_vvec3Scale;
+	std::vector<Node> m_vParent;
+
+	// Derived
+	std::vector<glm::mat4> m_vmat4World;
+	std::vector<unsigned int> m_vuiWorldVersion;
+	std::vector<unsigned int> m_vuiUpdatedPass;	// pass that last recomputed the node
+	std::vector<unsigned char> m_vbDirty;		// local transform or parent changed
+
+	std::vector<Node> m_vOrder;	// live nodes, parents first
+	std::vector<Node> m_vFree;
+	bool m_bDirty, m_bOrderDirty;
+	unsigned int m_nPass;
+	size_t m_nLastUpdated;
+
+	std::mutex m_Lock;
+
+	SceneGraph(SceneGraph const&) = delete;
+	void operator=(SceneGraph const&) = delete;
+};
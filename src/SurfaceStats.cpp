@@ -0,0 +1,97 @@
+#include "SurfaceStats.h"
+
+#include <cfloat>
+#include <cmath>
+#include <algorithm>
+
+#include <glm/gtc/constants.hpp>
+
+SurfaceStats::SurfaceStats(float heightMin, float heightMax)
+	: m_dArea(0.0)
+	, m_dInclinationSum(0.0)
+	, m_nTriangles(0)
+	, m_vec3Min(FLT_MAX)
+	, m_vec3Max(-FLT_MAX)
+	, m_fHeightMin(heightMin)
+	, m_vdInclination(SURFACE_STATS_INCLINATION_BINS, 0.0)
+	, m_vdAzimuth(SURFACE_STATS_AZIMUTH_BINS, 0.0)
+	, m_vdHeight(static_cast<size_t>(std::max(1.f, std::ceil((heightMax - heightMin) / SURFACE_STATS_HEIGHT_BIN))), 0.0)
+{
+}
+
+SurfaceStats::~SurfaceStats()
+{
+}
+
+void SurfaceStats::addTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 clampMin, glm::vec3 clampMax)
+{
+	glm::vec3 n(glm::cross(b - a, c - a));
+	float len = glm::length(n);
+	if (len <= 0.f)
+		return;
+
+	double area = len * 0.5;
+	n /= len;
+	if (n.y < 0.f)
+		n = -n;
+
+	float inclination = glm::degrees(std::acos(glm::clamp(n.y, 0.f, 1.f)));
+	float azimuth = glm::degrees(std::atan2(n.z, n.x));
+	if (azimuth < 0.f)
+		azimuth += 360.f;
+
+	int iInc = glm::clamp(static_cast<int>(inclination / 90.f * SURFACE_STATS_INCLINATION_BINS), 0, SURFACE_STATS_INCLINATION_BINS - 1);
+	int iAz = glm::clamp(static_cast<int>(azimuth / 360.f * SURFACE_STATS_AZIMUTH_BINS), 0, SURFACE_STATS_AZIMUTH_BINS - 1);
+	int iHeight = glm::clamp(static_cast<int>(((a.y + b.y + c.y) / 3.f - m_fHeightMin) / SURFACE_STATS_HEIGHT_BIN), 0, static_cast<int>(m_vdHeight.size()) - 1);
+
+	m_vdInclination[iInc] += area;
+	m_vdAzimuth[iAz] += area;
+	m_vdHeight[iHeight] += area;
+
+	m_dArea += area;
+	m_dInclinationSum += area * inclination;
+	m_nTriangles++;
+
+	m_vec3Min = glm::min(m_vec3Min, glm::clamp(glm::min(a, glm::min(b, c)), clampMin, clampMax));
+	m_vec3Max = glm::max(m_vec3Max, glm::clamp(glm::max(a, glm::max(b, c)), clampMin, clampMax));
+}
+
+void SurfaceStats::merge(const SurfaceStats &other)
+{
+	m_dArea += other.m_dArea;
+	m_dInclinationSum += other.m_dInclinationSum;
+	m_nTriangles += other.m_nTriangles;
+	m_vec3Min = glm::min(m_vec3Min, other.m_vec3Min);
+	m_vec3Max = glm::max(m_vec3Max, other.m_vec3Max);
+
+	for (size_t i = 0; i < m_vdInclination.size(); ++i)
+		m_vdInclination[i] += other.m_vdInclination[i];
+	for (size_t i = 0; i < m_vdAzimuth.size(); ++i)
+		m_vdAzimuth[i] += other.m_vdAzimuth[i];
+	for (size_t i = 0; i < m_vdHeight.size() && i < other.m_vdHeight.size(); ++i)
+		m_vdHeight[i] += other.m_vdHeight[i];
+}
+
+double SurfaceStats::getMeanInclination() const
+{
+	return m_dArea > 0.0 ? m_dInclinationSum / m_dArea : 0.0;
+}
+
+void SurfaceStats::writeCSVHeader(std::ostream &out)
+{
+	out << "model,histogram,bin_start,bin_end,area_cm2" << std::endl;
+}
+
+void SurfaceStats::writeCSV(std::ostream &out, std::string label) const
+{
+	float incStep = 90.f / SURFACE_STATS_INCLINATION_BINS;
+	for (size_t i = 0; i < m_vdInclination.size(); ++i)
+		out << label << ",inclination_deg," << i * incStep << "," << (i + 1) * incStep << "," << m_vdInclination[i] * 2.0 << std::endl;
+
+	float azStep = 360.f / SURFACE_STATS_AZIMUTH_BINS;
+	for (size_t i = 0; i < m_vdAzimuth.size(); ++i)
+		out << label << ",azimuth_deg," << i * azStep << "," << (i + 1) * azStep << "," << m_vdAzimuth[i] * 2.0 << std::endl;
+
+	for (size_t i = 0; i < m_vdHeight.size(); ++i)
+		out << label << ",height_cm," << m_fHeightMin + i * SURFACE_STATS_HEIGHT_BIN << "," << m_fHeightMin + (i + 1) * SURFACE_STATS_HEIGHT_BIN << "," << m_vdHeight[i] * 2.0 << std::endl;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <ostream>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#define SURFACE_STATS_INCLINATION_BINS 18	// 5 degree bins over 0-90
+#define SURFACE_STATS_AZIMUTH_BINS 36		// 10 degree bins over 0-360
+#define SURFACE_STATS_HEIGHT_BIN 1.f		// cm
+
+// Area-weighted leaf angle and height distributions of the surface inside a measurement box, with Y up.
+// Fronds are two-sided, so normals are flipped into the upper hemisphere: inclination is the angle of the
+// normal from vertical (0 = flat blade, 90 = upright) and azimuth the compass direction it leans towards,
+// measured from +X towards +Z. Heights are binned by triangle centroid from the bottom of the box.
+// Built per thread and merged, so it is filled in the same pass that sums the area.
+class SurfaceStats
+{
+public:
+	SurfaceStats(float heightMin = 0.f, float heightMax = 0.f);
+	~SurfaceStats();
+
+	// One-sided area of a triangle that counts towards the box
+	void addTriangle(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 clampMin, glm::vec3 clampMax);
+	void merge(const SurfaceStats &other);
+
+	double getArea() const { return m_dArea; }
+	size_t getTriangleCount() const { return m_nTriangles; }
+	bool empty() const { return m_nTriangles == 0; }
+
+	// Extent of the counted triangles, clamped to the box
+	glm::vec3 getMin() const { return m_vec3Min; }
+	glm::vec3 getMax() const { return m_vec3Max; }
+
+	double getMeanInclination() const;	// degrees
+
+	const std::vector<double>& getInclinationHistogram() const { return m_vdInclination; }
+	const std::vector<double>& getAzimuthHistogram() const { return m_vdAzimuth; }
+	const std::vector<double>& getHeightProfile() const { return m_vdHeight; }
+
+	// Long-format CSV rows under writeCSVHeader, with areas doubled like the other readouts
+	static void writeCSVHeader(std::ostream &out);
+	void writeCSV(std::ostream &out, std::string label) const;
+
+private:
+	double m_dArea;
+	double m_dInclinationSum;	// area-weighted, degrees
+	size_t m_nTriangles;
+	glm::vec3 m_vec3Min, m_vec3Max;
+
+	float m_fHeightMin;
+	std::vector<double> m_vdInclination;
+	std::vector<double> m_vdAzimuth;
+	std::vector<double> m_vdHeight;
+};
@@ -0,0 +1,680 @@
+#include "Survey.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cfloat>
+#include <cstdlib>
+#include <chrono>
+#include <experimental/filesystem>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Parallel.h"
+
+namespace fs = std::experimental::filesystem;
+
+Survey::Survey(size_t memoryBudget, size_t gpuBudget)
+	: m_nMemoryBudget(memoryBudget)
+	, m_nGPUBudget(gpuBudget)
+	, m_nMemoryUsed(0)
+	, m_nGPUUsed(0)
+	, m_nFrame(0)
+	, m_vec3GridMin(0.f)
+	, m_fCellSize(1.f)
+	, m_iCellsX(0)
+	, m_iCellsZ(0)
+	, m_nQuery(0)
+	, m_nLoadsInFlight(0)
+	, m_bWantsLoads(false)
+	, m_nLoads(0)
+	, m_nEvictions(0)
+	, m_nPrefetches(0)
+	, m_vec3LastCamera(0.f)
+	, m_bHasCamera(false)
+{
+}
+
+Survey::~Survey()
+{
+	// Loads still running finish into the survey, without telling anyone
+	m_fnLoaded = nullptr;
+	m_fnDropped = nullptr;
+	JobSystem::getInstance().wait(m_vLoads);
+	JobSystem::getInstance().runMainThreadJobs();
+
+	for (auto const &s : m_vScans)
+		delete s.model;
+}
+
+bool Survey::open(const std::vector<std::string> &inputs, int replicas)
+{
+	std::vector<std::string> paths;
+	std::vector<glm::mat4> transforms;
+	for (auto const &input : inputs)
+		addInput(input, paths, transforms);
+
+	// Bounds passes over files not seen before read every vertex, so spread them over the workers
+	auto start = std::chrono::steady_clock::now();
+	std::vector<Scan> scans(paths.size());
+	std::vector<unsigned char> valid(paths.size(), 0);
+	Parallel::parallelFor(paths.size(), [&](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; ++i)
+			valid[i] = readBounds(paths[i], scans[i].bbMin, scans[i].bbMax, scans[i].vertexCount, scans[i].triangleCount);
+	});
+
+	int gridSize = static_cast<int>(ceil(sqrt(static_cast<float>(std::max(1, replicas)))));
+
+	for (size_t i = 0; i < scans.size(); ++i)
+	{
+		if (!valid[i])
+		{
+			std::cerr << "Could not read scan " << paths[i] << std::endl;
+			continue;
+		}
+
+		glm::vec3 spacing((scans[i].bbMax - scans[i].bbMin) * 1.1f);
+
+		for (int r = 0; r < std::max(1, replicas); ++r)
+		{
+			Scan s(scans[i]);
+			s.path = paths[i];
+			s.transform = glm::translate(glm::mat4(), glm::vec3(spacing.x * (r % gridSize), 0.f, -spacing.z * (r / gridSize))) * transforms[i];
+			s.state = UNLOADED;
+			s.model = NULL;
+			s.lastVisibleFrame = 0;
+			s.distance = FLT_MAX;
+			s.pins = 0;
+			s.memoryBytes = s.gpuBytes = 0;
+
+			s.sceneMin = glm::vec3(FLT_MAX);
+			s.sceneMax = glm::vec3(-FLT_MAX);
+			for (int c = 0; c < 8; ++c)
+			{
+				glm::vec3 corner(c & 1 ? s.bbMax.x : s.bbMin.x, c & 2 ? s.bbMax.y : s.bbMin.y, c & 4 ? s.bbMax.z : s.bbMin.z);
+				glm::vec3 p(s.transform * glm::vec4(corner, 1.f));
+				s.sceneMin = glm::min(s.sceneMin, p);
+				s.sceneMax = glm::max(s.sceneMax, p);
+			}
+
+			m_vScans.push_back(s);
+		}
+	}
+
+	buildGrid();
+
+	if (!m_vScans.empty())
+	{
+		std::cout << "Survey of " << m_vScans.size() << " scans, bounds read in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() * 1000.0 << " ms";
+		std::cout << " (budgets " << (m_nMemoryBudget >> 20) << " MB in memory, " << (m_nGPUBudget >> 20) << " MB on the GPU)" << std::endl;
+	}
+
+	return !m_vScans.empty();
+}
+
+static bool isMeshFile(const fs::path &path)
+{
+	std::string ext = path.extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+	return ext == ".obj" || ext == ".ply";
+}
+
+// A directory gives all its OBJs and PLYs in name order; any other file is read as a manifest
+bool Survey::addInput(const std::string &input, std::vector<std::string> &paths, std::vector<glm::mat4> &transforms)
+{
+	std::error_code ec;
+	if (fs::is_directory(input, ec))
+	{
+		std::vector<std::string> files;
+		for (auto const &entry : fs::directory_iterator(input, ec))
+			if (fs::is_regular_file(entry.path(), ec) && isMeshFile(entry.path()))
+				files.push_back(entry.path().string());
+
+		std::sort(files.begin(), files.end());
+		paths.insert(paths.end(), files.begin(), files.end());
+		transforms.resize(paths.size(), glm::mat4());
+
+		return true;
+	}
+
+	if (!fs::exists(input, ec))
+	{
+		std::cerr << "No such scan, directory or manifest: " << input << std::endl;
+		return false;
+	}
+
+	if (!isMeshFile(input))
+		return readManifest(input, paths, transforms);
+
+	paths.push_back(input);
+	transforms.push_back(glm::mat4());
+
+	return true;
+}
+
+bool Survey::readManifest(const std::string &file, std::vector<std::string> &paths, std::vector<glm::mat4> &transforms)
+{
+	std::ifstream in(file);
+	if (!in)
+	{
+		std::cerr << "Could not open survey manifest " << file << std::endl;
+		return false;
+	}
+
+	fs::path base(fs::path(file).parent_path());
+	std::string line;
+	while (std::getline(in, line))
+	{
+		line = line.substr(0, line.find('#'));
+
+		std::istringstream ss(line);
+		std::string path;
+		if (!(ss >> path))
+			continue;
+
+		// Missing fields keep their defaults
+		float x = 0.f, y = 0.f, z = 0.f, heading = 0.f, scale = 1.f;
+		ss >> x >> y >> z >> heading >> scale;
+
+		fs::path p(path);
+		if (p.is_relative())
+			p = base / p;
+
+		paths.push_back(p.string());
+		transforms.push_back(glm::translate(glm::mat4(), glm::vec3(x, y, z)) * glm::rotate(glm::mat4(), glm::radians(heading), glm::vec3(0.f, 1.f, 0.f)) * glm::scale(glm::mat4(), glm::vec3(scale)));
+	}
+
+	return true;
+}
+
+bool Survey::getFileStamp(const std::string &path, uint64_t stamp[2])
+{
+	std::error_code ec;
+	stamp[0] = fs::file_size(path, ec);
+	if (ec)
+		return false;
+	stamp[1] = static_cast<uint64_t>(fs::last_write_time(path, ec).time_since_epoch().count());
+
+	return !ec;
+}
+
+// The cache holds the mesh file's size and modification time, and is ignored once either changes. Failing
+// to write it is not an error, so read-only surveys just pay for the pass every time.
+bool Survey::readBounds(const std::string &path, glm::vec3 &bbMin, glm::vec3 &bbMax, size_t &vertices, size_t &triangles)
+{
+	uint64_t stamp[2];
+	if (!getFileStamp(path, stamp))
+		return false;
+
+	uint32_t header[2];
+	uint64_t cachedStamp[2], counts[2];
+	float bounds[6];
+
+	std::ifstream cache(path + ".bounds", std::ios::binary);
+	if (cache)
+	{
+		cache.read(reinterpret_cast<char*>(header), sizeof(header));
+		cache.read(reinterpret_cast<char*>(cachedStamp), sizeof(cachedStamp));
+		cache.read(reinterpret_cast<char*>(bounds), sizeof(bounds));
+		cache.read(reinterpret_cast<char*>(counts), sizeof(counts));
+
+		if (cache && header[0] == SURVEY_BOUNDS_MAGIC && header[1] == SURVEY_BOUNDS_VERSION && cachedStamp[0] == stamp[0] && cachedStamp[1] == stamp[1])
+		{
+			bbMin = glm::vec3(bounds[0], bounds[1], bounds[2]);
+			bbMax = glm::vec3(bounds[3], bounds[4], bounds[5]);
+			vertices = static_cast<size_t>(counts[0]);
+			triangles = static_cast<size_t>(counts[1]);
+			return true;
+		}
+	}
+	cache.close();
+
+	bbMin = glm::vec3(FLT_MAX);
+	bbMax = glm::vec3(-FLT_MAX);
+	vertices = triangles = 0;
+
+	std::string ext = fs::path(path).extension().string();
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+	if (ext == ".ply")
+	{
+		// Binary vertices are cheap to read whole; the faces are only counted from the header
+		std::vector<glm::vec3> verts;
+		if (!ObjModel::readPLY(path, verts, NULL, triangles))
+			return false;
+
+		for (auto const &v : verts)
+		{
+			bbMin = glm::min(bbMin, v);
+			bbMax = glm::max(bbMax, v);
+		}
+		vertices = verts.size();
+	}
+	else
+	{
+		std::ifstream in(path);
+		if (!in)
+			return false;
+
+		std::string line;
+		while (std::getline(in, line))
+		{
+			if (line.size() < 2 || (line[1] != ' ' && line[1] != '\t'))
+				continue;
+
+			if (line[0] == 'v')
+			{
+				char *end;
+				glm::vec3 v;
+				v.x = strtof(line.c_str() + 2, &end);
+				v.y = strtof(end, &end);
+				v.z = strtof(end, &end);
+
+				bbMin = glm::min(bbMin, v);
+				bbMax = glm::max(bbMax, v);
+				vertices++;
+			}
+			else if (line[0] == 'f')
+			{
+				// A polygon of n corners is split into n - 2 triangles
+				std::istringstream ss(line.substr(2));
+				std::string corner;
+				size_t corners = 0;
+				while (ss >> corner)
+					corners++;
+
+				if (corners > 2)
+					triangles += corners - 2;
+			}
+		}
+	}
+
+	if (vertices == 0)
+		bbMin = bbMax = glm::vec3(0.f);
+
+	writeBounds(path, bbMin, bbMax, vertices, triangles);
+
+	return true;
+}
+
+// Stamped with the mesh file as it is now, so call it once the file is complete
+bool Survey::writeBounds(const std::string &path, glm::vec3 bbMin, glm::vec3 bbMax, size_t vertices, size_t triangles)
+{
+	uint64_t stamp[2];
+	if (!getFileStamp(path, stamp))
+		return false;
+
+	std::ofstream out(path + ".bounds", std::ios::binary);
+	if (!out)
+		return false;
+
+	uint32_t header[2] = { SURVEY_BOUNDS_MAGIC, SURVEY_BOUNDS_VERSION };
+	float bounds[6] = { bbMin.x, bbMin.y, bbMin.z, bbMax.x, bbMax.y, bbMax.z };
+	uint64_t counts[2] = { vertices, triangles };
+
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(stamp), sizeof(stamp));
+	out.write(reinterpret_cast<const char*>(bounds), sizeof(bounds));
+	out.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+
+	return static_cast<bool>(out);
+}
+
+// Positions, normals, indices, BVH and meshlets as ObjModel builds them, before the file is read
+size_t Survey::estimateMemoryBytes(const Scan &scan)
+{
+	size_t nodes = 2 * scan.triangleCount / BVH_LEAF_SIZE + 1;
+	size_t meshlets = scan.triangleCount / MESHLET_TRIANGLES + 1;
+
+	return scan.vertexCount * 2 * sizeof(glm::vec3) + scan.triangleCount * 4 * sizeof(unsigned int)
+		+ nodes * sizeof(BVH::Node) + meshlets * sizeof(ObjModel::Meshlet);
+}
+
+// Cells are square and sized so that each holds a few scans on average; a scan goes in every cell it overlaps
+void Survey::buildGrid()
+{
+	m_vvuiCells.clear();
+	m_vuiQueryStamp.assign(m_vScans.size(), 0);
+	if (m_vScans.empty())
+		return;
+
+	glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+	for (auto const &s : m_vScans)
+	{
+		lo = glm::min(lo, s.sceneMin);
+		hi = glm::max(hi, s.sceneMax);
+	}
+
+	int cells = std::max(1, static_cast<int>(ceil(sqrt(static_cast<float>(m_vScans.size()) / SURVEY_SCANS_PER_CELL))));
+	m_fCellSize = std::max(std::max(hi.x - lo.x, hi.z - lo.z) / cells, 1e-3f);
+	m_vec3GridMin = lo;
+	m_iCellsX = std::max(1, static_cast<int>(ceil((hi.x - lo.x) / m_fCellSize)));
+	m_iCellsZ = std::max(1, static_cast<int>(ceil((hi.z - lo.z) / m_fCellSize)));
+	m_vvuiCells.resize(m_iCellsX * m_iCellsZ);
+
+	for (unsigned int i = 0; i < m_vScans.size(); ++i)
+	{
+		int x0 = glm::clamp(static_cast<int>(floor((m_vScans[i].sceneMin.x - lo.x) / m_fCellSize)), 0, m_iCellsX - 1);
+		int x1 = glm::clamp(static_cast<int>(floor((m_vScans[i].sceneMax.x - lo.x) / m_fCellSize)), 0, m_iCellsX - 1);
+		int z0 = glm::clamp(static_cast<int>(floor((m_vScans[i].sceneMin.z - lo.z) / m_fCellSize)), 0, m_iCellsZ - 1);
+		int z1 = glm::clamp(static_cast<int>(floor((m_vScans[i].sceneMax.z - lo.z) / m_fCellSize)), 0, m_iCellsZ - 1);
+
+		for (int z = z0; z <= z1; ++z)
+			for (int x = x0; x <= x1; ++x)
+				m_vvuiCells[z * m_iCellsX + x].push_back(i);
+	}
+}
+
+void Survey::setCallbacks(std::function<void(ObjModel*)> loaded, std::function<void(ObjModel*)> dropped)
+{
+	m_fnLoaded = loaded;
+	m_fnDropped = dropped;
+}
+
+void Survey::query(glm::vec3 bbMin, glm::vec3 bbMax, std::vector<unsigned int> &scans)
+{
+	scans.clear();
+	if (m_vvuiCells.empty())
+		return;
+
+	int x0 = static_cast<int>(floor((bbMin.x - m_vec3GridMin.x) / m_fCellSize));
+	int x1 = static_cast<int>(floor((bbMax.x - m_vec3GridMin.x) / m_fCellSize));
+	int z0 = static_cast<int>(floor((bbMin.z - m_vec3GridMin.z) / m_fCellSize));
+	int z1 = static_cast<int>(floor((bbMax.z - m_vec3GridMin.z) / m_fCellSize));
+	if (x1 < 0 || z1 < 0 || x0 >= m_iCellsX || z0 >= m_iCellsZ)
+		return;
+
+	x0 = std::max(x0, 0);
+	z0 = std::max(z0, 0);
+	x1 = std::min(x1, m_iCellsX - 1);
+	z1 = std::min(z1, m_iCellsZ - 1);
+
+	// Scans spanning several cells are only tested once per query
+	m_nQuery++;
+	for (int z = z0; z <= z1; ++z)
+	{
+		for (int x = x0; x <= x1; ++x)
+		{
+			for (auto const &i : m_vvuiCells[z * m_iCellsX + x])
+			{
+				if (m_vuiQueryStamp[i] == m_nQuery)
+					continue;
+				m_vuiQueryStamp[i] = m_nQuery;
+
+				Scan const &s = m_vScans[i];
+				if (glm::all(glm::lessThanEqual(s.sceneMin, bbMax)) && glm::all(glm::greaterThanEqual(s.sceneMax, bbMin)))
+					scans.push_back(i);
+			}
+		}
+	}
+
+	std::sort(scans.begin(), scans.end());
+}
+
+void Survey::pin(const std::vector<unsigned int> &scans)
+{
+	for (auto const &i : scans)
+	{
+		if (m_vScans[i].pins++ == 0 && m_vScans[i].state == UNLOADED)
+			m_vuiPinnedLoads.push_back(i);
+	}
+
+	startPinnedLoads();
+}
+
+// Queued loads of scans no longer pinned are forgotten; ones already running finish as usual
+void Survey::unpin(const std::vector<unsigned int> &scans)
+{
+	for (auto const &i : scans)
+		m_vScans[i].pins = std::max(0, m_vScans[i].pins - 1);
+
+	m_vuiPinnedLoads.erase(std::remove_if(m_vuiPinnedLoads.begin(), m_vuiPinnedLoads.end(), [this](unsigned int i) { return m_vScans[i].pins == 0; }), m_vuiPinnedLoads.end());
+}
+
+bool Survey::isLoaded(const std::vector<unsigned int> &scans)
+{
+	for (auto const &i : scans)
+		if (m_vScans[i].state != LOADED && m_vScans[i].state != RESIDENT)
+			return false;
+
+	return true;
+}
+
+// Scans out of view are evicted first, then ones in view. A scan that still doesn't fit is loaded over
+// budget once nothing else is loading, as whatever pinned it would otherwise wait forever.
+void Survey::startPinnedLoads()
+{
+	size_t started = 0;
+	for (; started < m_vuiPinnedLoads.size() && m_nLoadsInFlight < SURVEY_MAX_LOADS_IN_FLIGHT; ++started)
+	{
+		unsigned int i = m_vuiPinnedLoads[started];
+		if (m_vScans[i].state != UNLOADED)
+			continue;
+
+		if (!makeRoom(estimateMemoryBytes(m_vScans[i]), 0, true) && m_nLoadsInFlight > 0)
+			break;
+
+		startLoad(i);
+	}
+
+	m_vuiPinnedLoads.erase(m_vuiPinnedLoads.begin(), m_vuiPinnedLoads.begin() + started);
+}
+
+unsigned int Survey::getCount(STATE state)
+{
+	unsigned int n = 0;
+	for (auto const &s : m_vScans)
+		if (s.state == state)
+			n++;
+
+	return n;
+}
+
+void Survey::update(const Frustum &frustum, glm::vec3 camera, GeometryArena *arena)
+{
+	m_nFrame++;
+
+	JobSystem &jobs = JobSystem::getInstance();
+	m_vLoads.erase(std::remove_if(m_vLoads.begin(), m_vLoads.end(), [&jobs](const JobSystem::JobHandle &j) { return jobs.finished(j); }), m_vLoads.end());
+
+	// Scans in view, nearest first by distance to their box
+	m_vuiRanked.clear();
+	for (unsigned int i = 0; i < m_vScans.size(); ++i)
+	{
+		Scan &s = m_vScans[i];
+		if (!frustum.intersectsAABB(s.sceneMin, s.sceneMax))
+			continue;
+
+		s.lastVisibleFrame = m_nFrame;
+		s.distance = glm::length(glm::clamp(camera, s.sceneMin, s.sceneMax) - camera);
+		m_vuiRanked.push_back(i);
+	}
+
+	std::sort(m_vuiRanked.begin(), m_vuiRanked.end(), [this](unsigned int a, unsigned int b) { return m_vScans[a].distance < m_vScans[b].distance; });
+
+	startPinnedLoads();
+
+	// Once a scan doesn't fit, the ones further away don't get to push nearer ones out
+	bool memoryFull = false, gpuFull = false;
+	m_bWantsLoads = false;
+	for (auto const &i : m_vuiRanked)
+	{
+		Scan &s = m_vScans[i];
+
+		if (s.state == UNLOADED && !memoryFull)
+		{
+			if (m_nLoadsInFlight >= SURVEY_MAX_LOADS_IN_FLIGHT)
+				m_bWantsLoads = true;
+			else if (makeRoom(estimateMemoryBytes(s), 0))
+				startLoad(i);
+			else
+				memoryFull = true;
+		}
+		else if (s.state == LOADED && !gpuFull)
+		{
+			GeometryArena::Allocation alloc;
+			alloc.vertexCount = static_cast<GLuint>(s.model->getVertices().size());
+			alloc.indexCapacity = static_cast<GLuint>(s.model->getIndices().size());
+
+			if (makeRoom(0, GeometryArena::getAllocationBytes(alloc)))
+				makeResident(i, arena);
+			else
+				gpuFull = true;
+		}
+	}
+
+	prefetch(camera);
+
+	// A pinned scan loaded over budget may have pushed the totals over
+	makeRoom(0, 0);
+}
+
+// Scans near the stretch of path the camera covers in the next SURVEY_PREFETCH_FRAMES frames if it keeps
+// its current motion, nearest to the end of it first. They load into spare memory only, so they never
+// push out scans that were seen more recently.
+void Survey::prefetch(glm::vec3 camera)
+{
+	glm::vec3 motion(m_bHasCamera ? camera - m_vec3LastCamera : glm::vec3(0.f));
+	m_vec3LastCamera = camera;
+	m_bHasCamera = true;
+
+	if (motion == glm::vec3(0.f) || m_vvuiCells.empty())
+		return;
+
+	// Half a cell either side of the path, over the survey's full height
+	glm::vec3 ahead(camera + motion * static_cast<float>(SURVEY_PREFETCH_FRAMES));
+	glm::vec3 margin(m_fCellSize * 0.5f, 0.f, m_fCellSize * 0.5f);
+	glm::vec3 lo(glm::min(camera, ahead) - margin), hi(glm::max(camera, ahead) + margin);
+	lo.y = -FLT_MAX;
+	hi.y = FLT_MAX;
+
+	query(lo, hi, m_vuiAhead);
+
+	auto distanceAhead = [this, ahead](unsigned int i) { return glm::length(glm::clamp(ahead, m_vScans[i].sceneMin, m_vScans[i].sceneMax) - ahead); };
+	std::sort(m_vuiAhead.begin(), m_vuiAhead.end(), [&distanceAhead](unsigned int a, unsigned int b) { return distanceAhead(a) < distanceAhead(b); });
+
+	for (auto const &i : m_vuiAhead)
+	{
+		if (m_nLoadsInFlight >= SURVEY_MAX_LOADS_IN_FLIGHT)
+			break;
+
+		if (m_vScans[i].state != UNLOADED || m_nMemoryUsed + estimateMemoryBytes(m_vScans[i]) > m_nMemoryBudget)
+			continue;
+
+		startLoad(i);
+		m_nPrefetches++;
+	}
+}
+
+void Survey::startLoad(unsigned int scan)
+{
+	Scan &s = m_vScans[scan];
+	s.state = LOADING;
+	s.memoryBytes = estimateMemoryBytes(s);
+	m_nMemoryUsed += s.memoryBytes;
+	m_nLoadsInFlight++;
+
+	std::string path(s.path);
+	glm::mat4 transform(s.transform);
+	JobSystem &jobs = JobSystem::getInstance();
+	m_vLoads.push_back(jobs.submitBackground([this, scan, path, transform, &jobs]() {
+		ObjModel *model = new ObjModel(path, NULL);
+		model->setModelMatrix(transform);
+		jobs.submitMain([this, scan, model]() { finishLoad(scan, model); });
+	}));
+}
+
+// On the main thread; the estimate made when the load started is replaced by the real size
+void Survey::finishLoad(unsigned int scan, ObjModel *model)
+{
+	Scan &s = m_vScans[scan];
+	m_nMemoryUsed -= s.memoryBytes;
+	s.memoryBytes = model->getMemoryBytes();
+	m_nMemoryUsed += s.memoryBytes;
+
+	s.model = model;
+	s.state = LOADED;
+	m_nLoadsInFlight--;
+	m_nLoads++;
+
+	if (m_fnLoaded)
+		m_fnLoaded(model);
+}
+
+void Survey::makeResident(unsigned int scan, GeometryArena *arena)
+{
+	Scan &s = m_vScans[scan];
+	s.model->initGL(arena);
+	s.gpuBytes = s.model->getGPUBytes();
+	m_nGPUUsed += s.gpuBytes;
+	s.state = RESIDENT;
+}
+
+void Survey::evictFromArena(unsigned int scan)
+{
+	Scan &s = m_vScans[scan];
+	s.model->releaseGL();
+	m_nGPUUsed -= s.gpuBytes;
+	s.gpuBytes = 0;
+	s.state = LOADED;
+	m_nEvictions++;
+}
+
+void Survey::drop(unsigned int scan)
+{
+	Scan &s = m_vScans[scan];
+	if (s.state == RESIDENT)
+		evictFromArena(scan);
+
+	if (m_fnDropped)
+		m_fnDropped(s.model);
+
+	delete s.model;
+	s.model = NULL;
+	m_nMemoryUsed -= s.memoryBytes;
+	s.memoryBytes = 0;
+	s.state = UNLOADED;
+	m_nEvictions++;
+}
+
+// Evicts scans out of view this frame, least recently seen first and the furthest of those first,
+// until the given amounts fit; false if they can't be made to. evictVisible also lets scans in view go.
+bool Survey::makeRoom(size_t memoryBytes, size_t gpuBytes, bool evictVisible)
+{
+	auto pick = [this, evictVisible](bool forMemory) {
+		unsigned int best = static_cast<unsigned int>(m_vScans.size());
+		for (unsigned int i = 0; i < m_vScans.size(); ++i)
+		{
+			Scan const &s = m_vScans[i];
+			if (s.lastVisibleFrame == m_nFrame && !evictVisible)
+				continue;
+			if (forMemory ? (s.state != LOADED && s.state != RESIDENT) || s.pins > 0 || s.model->hasSelection() : s.state != RESIDENT)
+				continue;
+
+			if (best == m_vScans.size() || s.lastVisibleFrame < m_vScans[best].lastVisibleFrame
+				|| (s.lastVisibleFrame == m_vScans[best].lastVisibleFrame && s.distance > m_vScans[best].distance))
+				best = i;
+		}
+		return best;
+	};
+
+	while (m_nGPUUsed + gpuBytes > m_nGPUBudget)
+	{
+		unsigned int victim = pick(false);
+		if (victim == m_vScans.size())
+			return false;
+		evictFromArena(victim);
+	}
+
+	while (m_nMemoryUsed + memoryBytes > m_nMemoryBudget)
+	{
+		unsigned int victim = pick(true);
+		if (victim == m_vScans.size())
+			return false;
+		drop(victim);
+	}
+
+	return true;
+}
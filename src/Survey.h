@@ -0,0 +1,144 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+#include "GeometryArena.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+
+#define SURVEY_BOUNDS_MAGIC 0x44425653	// "SVBD"
+#define SURVEY_BOUNDS_VERSION 1
+#define SURVEY_DEFAULT_MEMORY_MB 4096	// scans loaded in memory
+#define SURVEY_DEFAULT_GPU_MB 1024		// scans resident in the geometry arena
+#define SURVEY_MAX_LOADS_IN_FLIGHT 2
+#define SURVEY_SCANS_PER_CELL 4			// average occupancy the lookup grid is sized for
+#define SURVEY_PREFETCH_FRAMES 30		// frames of the camera's current motion that prefetching looks ahead
+
+// The scans of a survey placed in one scene. Inputs are OBJ or PLY files, directories of them, and manifests
+// listing one scan per line as
+//
+//   <obj path> [x y z [heading [scale]]]
+//
+// with the offset in cm, a rotation in degrees about the vertical axis, and a uniform scale. Paths are
+// relative to the manifest; '#' starts a comment. Each scan's bounds come from one pass over the
+// file's vertex lines, cached beside it as <obj>.bounds, and a grid over the horizontal plane finds the
+// scans overlapping a box without loading any geometry.
+//
+// Geometry is loaded on the job system and dropped again under two budgets, one for scans in memory
+// and one for scans resident in the arena. Each frame the scans in view are loaded nearest first while
+// they fit; to make room, the scans out of view longest are evicted, from the arena before memory.
+// Pinned scans and scans with a selection stay in memory, and pinned scans waiting to be loaded go ahead
+// of the ones in view, evicting those if they have to. While the camera moves, scans around where it
+// is heading are read into memory ahead of time if they fit without evicting anything.
+class Survey
+{
+public:
+	enum STATE {
+		UNLOADED,
+		LOADING,
+		LOADED,		// in memory only
+		RESIDENT	// in memory and in the arena
+	};
+
+	struct Scan {
+		std::string path;
+		glm::mat4 transform;
+		glm::vec3 bbMin, bbMax;			// model space
+		glm::vec3 sceneMin, sceneMax;	// box around the transformed bounds
+		size_t vertexCount, triangleCount;
+		STATE state;
+		ObjModel *model;
+		unsigned int lastVisibleFrame;
+		float distance;					// from the camera at the last update
+		int pins;
+		size_t memoryBytes, gpuBytes;	// counted against the budgets
+	};
+
+public:
+	Survey(size_t memoryBudget = static_cast<size_t>(SURVEY_DEFAULT_MEMORY_MB) << 20, size_t gpuBudget = static_cast<size_t>(SURVEY_DEFAULT_GPU_MB) << 20);
+	~Survey();
+
+	// Replicas > 1 lays out that many copies of every scan in a grid, for draw submission benchmarks
+	bool open(const std::vector<std::string> &inputs, int replicas = 1);
+
+	// Called on the main thread as models enter and leave memory; a dropped model is deleted right after
+	void setCallbacks(std::function<void(ObjModel*)> loaded, std::function<void(ObjModel*)> dropped);
+
+	// Scans whose scene-space bounds overlap the box
+	void query(glm::vec3 bbMin, glm::vec3 bbMax, std::vector<unsigned int> &scans);
+
+	// Pinning queues loads for the scans that aren't in memory yet, without waiting for them, and keeps
+	// them in memory until unpinned; the loaded callback reports each one as it arrives
+	void pin(const std::vector<unsigned int> &scans);
+	void unpin(const std::vector<unsigned int> &scans);
+	bool isLoaded(const std::vector<unsigned int> &scans);
+	size_t getMemoryEstimate(unsigned int scan) { return estimateMemoryBytes(m_vScans[scan]); }
+
+	// Once per frame on the main thread, with the frustum and camera in scene space
+	void update(const Frustum &frustum, glm::vec3 camera, GeometryArena *arena);
+
+	size_t getScanCount() { return m_vScans.size(); }
+	Scan& getScan(unsigned int scan) { return m_vScans[scan]; }
+	unsigned int getCount(STATE state);
+	bool isBusy() { return m_nLoadsInFlight > 0 || m_bWantsLoads || !m_vuiPinnedLoads.empty(); }
+
+	size_t getMemoryBudget() { return m_nMemoryBudget; }
+	size_t getGPUBudget() { return m_nGPUBudget; }
+	size_t getMemoryUsed() { return m_nMemoryUsed; }
+	size_t getGPUUsed() { return m_nGPUUsed; }
+
+	unsigned int getLoadCount() { return m_nLoads; }
+	unsigned int getEvictionCount() { return m_nEvictions; }
+	unsigned int getPrefetchCount() { return m_nPrefetches; }
+
+	// Model-space bounds and counts through the <path>.bounds cache, which is written on a miss
+	static bool readBounds(const std::string &path, glm::vec3 &bbMin, glm::vec3 &bbMax, size_t &vertices, size_t &triangles);
+	static bool writeBounds(const std::string &path, glm::vec3 bbMin, glm::vec3 bbMax, size_t vertices, size_t triangles);
+
+private:
+	bool addInput(const std::string &input, std::vector<std::string> &paths, std::vector<glm::mat4> &transforms);
+	bool readManifest(const std::string &file, std::vector<std::string> &paths, std::vector<glm::mat4> &transforms);
+	static bool getFileStamp(const std::string &path, uint64_t stamp[2]);
+	static size_t estimateMemoryBytes(const Scan &scan);
+	void buildGrid();
+
+	void prefetch(glm::vec3 camera);
+	void startPinnedLoads();
+	void startLoad(unsigned int scan);
+	void finishLoad(unsigned int scan, ObjModel *model);
+	void makeResident(unsigned int scan, GeometryArena *arena);
+	void evictFromArena(unsigned int scan);
+	bool makeRoom(size_t memoryBytes, size_t gpuBytes, bool evictVisible = false);
+	void drop(unsigned int scan);
+
+	std::vector<Scan> m_vScans;
+	size_t m_nMemoryBudget, m_nGPUBudget;
+	size_t m_nMemoryUsed, m_nGPUUsed;	// loads in flight count with their estimate
+	unsigned int m_nFrame;
+
+	// Lookup grid over x and z
+	glm::vec3 m_vec3GridMin;
+	float m_fCellSize;
+	int m_iCellsX, m_iCellsZ;
+	std::vector<std::vector<unsigned int>> m_vvuiCells;
+	std::vector<unsigned int> m_vuiQueryStamp;
+	unsigned int m_nQuery;
+
+	std::vector<JobSystem::JobHandle> m_vLoads;
+	unsigned int m_nLoadsInFlight;
+	bool m_bWantsLoads;		// scans in view are still waiting to be loaded
+	std::vector<unsigned int> m_vuiPinnedLoads;	// pinned scans not loading yet, in the order they were pinned
+	std::vector<unsigned int> m_vuiRanked;
+	unsigned int m_nLoads, m_nEvictions, m_nPrefetches;
+
+	glm::vec3 m_vec3LastCamera;
+	bool m_bHasCamera;
+	std::vector<unsigned int> m_vuiAhead;
+
+	std::function<void(ObjModel*)> m_fnLoaded, m_fnDropped;
+};
@@ -0,0 +1,432 @@
+#include "SurveyBatch.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <experimental/filesystem>
+
+#include "ObjModel.h"
+#include "Voxelizer.h"
+#include "MeshExporter.h"
+#include "MultiBoxQuery.h"
+#include "MeasurementBox.h"
+#include "Survey.h"
+
+namespace fs = std::experimental::filesystem;
+
+SurveyBatch::SurveyBatch(const std::vector<std::string> &args)
+	: m_strOutput("survey_metrics.csv")
+	, m_vec3BoxMin(0.f, 0.f, -50.f)
+	, m_vec3BoxMax(50.f, 50.f, 0.f)
+	, m_fVoxelSize(MESH_METRICS_DEFAULT_VOXEL_SIZE)
+	, m_fDensityVoxelSize(0.f)
+	, m_bBenchmarkBoxes(false)
+	, m_bValid(false)
+{
+	m_bValid = parseArgs(args);
+}
+
+SurveyBatch::~SurveyBatch()
+{
+}
+
+bool SurveyBatch::requested(const std::vector<std::string> &args)
+{
+	return std::find(args.begin(), args.end(), "--batch") != args.end();
+}
+
+bool SurveyBatch::parseArgs(const std::vector<std::string> &args)
+{
+	for (size_t i = 1; i < args.size(); ++i)
+	{
+		if (args[i] == "--batch" && i + 1 < args.size())
+			m_strInput = args[++i];
+		else if (args[i] == "--out" && i + 1 < args.size())
+			m_strOutput = args[++i];
+		else if (args[i] == "--voxel" && i + 1 < args.size())
+			m_fVoxelSize = static_cast<float>(atof(args[++i].c_str()));
+		else if (args[i] == "--sizes" && i + 1 < args.size())
+		{
+			std::stringstream ss(args[++i]);
+			std::string size;
+			while (std::getline(ss, size, ','))
+				if (atof(size.c_str()) > 0.0)
+					m_vfQuerySizes.push_back(static_cast<float>(atof(size.c_str())));
+		}
+		else if (args[i] == "--export" && i + 1 < args.size())
+		{
+			m_strExportFormat = args[++i];
+			std::transform(m_strExportFormat.begin(), m_strExportFormat.end(), m_strExportFormat.begin(), ::tolower);
+			if (m_strExportFormat != "ply" && m_strExportFormat != "obj")
+			{
+				std::cerr << "Export format must be ply or obj" << std::endl;
+				return false;
+			}
+		}
+		else if (args[i] == "--boxes" && i + 1 < args.size())
+			m_strBoxFile = args[++i];
+		else if (args[i] == "--bench-boxes")
+			m_bBenchmarkBoxes = true;
+		else if (args[i] == "--density" && i + 1 < args.size())
+			m_fDensityVoxelSize = static_cast<float>(atof(args[++i].c_str()));
+		else if (args[i] == "--box" && i + 6 < args.size())
+		{
+			glm::vec3 a, b;
+			for (int j = 0; j < 3; ++j)
+				a[j] = static_cast<float>(atof(args[++i].c_str()));
+			for (int j = 0; j < 3; ++j)
+				b[j] = static_cast<float>(atof(args[++i].c_str()));
+
+			m_vec3BoxMin = glm::min(a, b);
+			m_vec3BoxMax = glm::max(a, b);
+		}
+		else
+		{
+			std::cerr << "Unrecognized batch argument " << args[i] << std::endl;
+			return false;
+		}
+	}
+
+	if (m_strInput.empty())
+	{
+		std::cerr << "Usage: --batch <dir> [--box x0 y0 z0 x1 y1 z1] [--voxel cm] [--out results.csv] [--density cm] [--sizes 10,25,50,100] [--export ply|obj] [--boxes boxes.csv] [--bench-boxes]" << std::endl;
+		return false;
+	}
+
+	if (m_fVoxelSize <= 0.f || m_fDensityVoxelSize < 0.f)
+	{
+		std::cerr << "Voxel size must be positive" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+// A single OBJ or PLY file, every one in a directory in name order, or the scans of a manifest
+// that the measurements reach
+std::vector<std::string> SurveyBatch::findModels(const std::vector<glm::vec3> &boxMins, const std::vector<glm::vec3> &boxMaxs, std::vector<glm::mat4> &transforms)
+{
+	std::vector<std::string> files;
+
+	std::error_code ec;
+	if (!fs::is_directory(m_strInput, ec))
+	{
+		if (!fs::exists(m_strInput, ec))
+			return files;
+
+		std::string ext = fs::path(m_strInput).extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+		if (ext == ".obj" || ext == ".ply")
+		{
+			files.push_back(m_strInput);
+			transforms.push_back(glm::mat4());
+			return files;
+		}
+
+		// Scans are found from their cached bounds without reading any geometry
+		Survey survey;
+		if (!survey.open(std::vector<std::string>(1, m_strInput)))
+			return files;
+
+		std::vector<unsigned int> scans, hits;
+		if (m_fDensityVoxelSize > 0.f)
+		{
+			for (unsigned int i = 0; i < survey.getScanCount(); ++i)
+				scans.push_back(i);
+		}
+		else
+		{
+			std::vector<glm::vec3> mins(boxMins), maxs(boxMaxs);
+			mins.push_back(m_vec3BoxMin);
+			maxs.push_back(m_vec3BoxMax);
+
+			glm::vec3 anchor(m_vec3BoxMin.x, m_vec3BoxMin.y, m_vec3BoxMax.z);
+			for (auto const &size : m_vfQuerySizes)
+			{
+				mins.push_back(anchor - glm::vec3(0.f, 0.f, size));
+				maxs.push_back(anchor + glm::vec3(size, size, 0.f));
+			}
+
+			for (size_t b = 0; b < mins.size(); ++b)
+			{
+				survey.query(glm::min(mins[b], maxs[b]), glm::max(mins[b], maxs[b]), hits);
+				scans.insert(scans.end(), hits.begin(), hits.end());
+			}
+
+			std::sort(scans.begin(), scans.end());
+			scans.erase(std::unique(scans.begin(), scans.end()), scans.end());
+		}
+
+		std::cout << "Survey manifest " << m_strInput << ": " << scans.size() << " of " << survey.getScanCount() << " scans to measure" << std::endl;
+
+		for (auto const &i : scans)
+		{
+			files.push_back(survey.getScan(i).path);
+			transforms.push_back(survey.getScan(i).transform);
+		}
+
+		return files;
+	}
+
+	for (auto const &entry : fs::directory_iterator(m_strInput, ec))
+	{
+		std::string ext = entry.path().extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+		if (fs::is_regular_file(entry.path(), ec) && (ext == ".obj" || ext == ".ply"))
+			files.push_back(entry.path().string());
+	}
+
+	std::sort(files.begin(), files.end());
+	transforms.assign(files.size(), glm::mat4());
+
+	return files;
+}
+
+// One box per line as x0,y0,z0,x1,y1,z1; lines that don't parse, such as a header, are skipped
+bool SurveyBatch::loadBoxes(std::vector<glm::vec3> &bbMins, std::vector<glm::vec3> &bbMaxs)
+{
+	std::ifstream in(m_strBoxFile);
+	if (!in)
+	{
+		std::cerr << "Could not open " << m_strBoxFile << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while (std::getline(in, line))
+	{
+		std::replace(line.begin(), line.end(), ',', ' ');
+		std::stringstream ss(line);
+
+		glm::vec3 a, b;
+		if (ss >> a.x >> a.y >> a.z >> b.x >> b.y >> b.z)
+		{
+			bbMins.push_back(a);
+			bbMaxs.push_back(b);
+		}
+	}
+
+	std::cout << "Loaded " << bbMins.size() << " boxes from " << m_strBoxFile << std::endl;
+
+	return !bbMins.empty();
+}
+
+// Random cubes over the model's bounds, measured in one shared pass against one full pass per box;
+// the per-box time is taken from the first few boxes and scaled up
+void SurveyBatch::benchmarkBoxes(ObjModel *model)
+{
+	glm::vec3 sceneMin(model->getModelMatrix() * glm::vec4(model->getBBMin(), 1.f)), sceneMax(model->getModelMatrix() * glm::vec4(model->getBBMax(), 1.f));
+	glm::vec3 lo(glm::min(sceneMin, sceneMax)), hi(glm::max(sceneMin, sceneMax));
+
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	std::mt19937 rng(1);
+	for (auto const &nBoxes : { 1, 16, 256, 4096 })
+	{
+		std::vector<glm::vec3> bbMins, bbMaxs;
+		for (int i = 0; i < nBoxes; ++i)
+		{
+			glm::vec3 corner;
+			for (int axis = 0; axis < 3; ++axis)
+				corner[axis] = std::uniform_real_distribution<float>(lo[axis] - BENCHMARK_BOX_SIZE, hi[axis])(rng);
+			bbMins.push_back(corner);
+			bbMaxs.push_back(corner + glm::vec3(BENCHMARK_BOX_SIZE));
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		MultiBoxQuery query(bbMins, bbMaxs);
+		std::vector<double> areas(query.measure(model));
+		double shared = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		int nSampled = std::min(nBoxes, 4);
+		bool match = true;
+		start = std::chrono::steady_clock::now();
+		for (int b = 0; b < nSampled; ++b)
+		{
+			double area = 0.0;
+			for (size_t t = 0; t < inds.size() / 3; ++t)
+			{
+				glm::vec3 a(modelMatrix * glm::vec4(verts[inds[3 * t + 0]], 1.f));
+				glm::vec3 c1(modelMatrix * glm::vec4(verts[inds[3 * t + 1]], 1.f));
+				glm::vec3 c2(modelMatrix * glm::vec4(verts[inds[3 * t + 2]], 1.f));
+				area += MeasurementBox::getTriangleSurfaceAreaInAABB(a, c1, c2, bbMins[b], bbMaxs[b]);
+			}
+			match = match && std::abs(area - areas[b]) <= 1e-3 * std::max(1.0, area);
+		}
+		double perBox = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / nSampled * nBoxes;
+
+		std::cout << "\t\t" << nBoxes << " boxes: " << shared * 1000.0 << " ms shared (" << (query.usesBVH() ? "box BVH" : "linear") << "), ";
+		std::cout << perBox * 1000.0 << " ms one pass per box" << (match ? "" : " [MISMATCH]") << std::endl;
+	}
+}
+
+// The surface cut exactly to the box
+void SurveyBatch::writeExport(ObjModel *model, std::string file)
+{
+	fs::path out(fs::path(m_strOutput).parent_path() / fs::path(file).stem());
+	out += ".box." + m_strExportFormat;
+
+	MeshExporter exporter(out.string());
+	if (!exporter.write(model, std::vector<bool>(model->getIndices().size() / 3, true), true, m_vec3BoxMin, m_vec3BoxMax))
+		return;
+
+	std::cout << "\t\tExported " << exporter.getTriangleCount() << " triangles to " << out.string() << " [" << exporter.getTrianglesPerSecond() / 1e6 << " M triangles/s]" << std::endl;
+}
+
+// Whole-model density map, independent of the measurement box
+void SurveyBatch::writeDensity(ObjModel *model, std::string file)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	Voxelizer voxelizer(m_fDensityVoxelSize);
+	voxelizer.addModel(model);
+	voxelizer.voxelize();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "\t\tVoxelized " << voxelizer.getVoxelCount() << " voxels in " << voxelizer.getBrickCount() << " bricks [" << seconds << " s]" << std::endl;
+
+	fs::path out(fs::path(m_strOutput).parent_path() / fs::path(file).stem());
+	out += ".density.nrrd";
+
+	voxelizer.writeNRRD(out.string());
+}
+
+int SurveyBatch::run()
+{
+	if (!m_bValid)
+		return EXIT_FAILURE;
+
+	// The box list comes first, as a manifest only gives the scans the boxes reach
+	std::vector<glm::vec3> boxMins, boxMaxs;
+	if (!m_strBoxFile.empty() && !loadBoxes(boxMins, boxMaxs))
+		return EXIT_FAILURE;
+
+	std::vector<glm::mat4> transforms;
+	std::vector<std::string> files = findModels(boxMins, boxMaxs, transforms);
+	if (files.empty())
+	{
+		std::cerr << "No models to measure at " << m_strInput << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	std::ofstream out(m_strOutput);
+	if (!out)
+	{
+		std::cerr << "Could not open " << m_strOutput << " for writing" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Leaf angle and height histograms of every model go beside the metrics as <out>.histograms.csv
+	fs::path histogramPath(m_strOutput);
+	histogramPath.replace_extension(".histograms.csv");
+	std::ofstream histograms(histogramPath.string());
+	if (!histograms)
+	{
+		std::cerr << "Could not open " << histogramPath.string() << " for writing" << std::endl;
+		return EXIT_FAILURE;
+	}
+	SurfaceStats::writeCSVHeader(histograms);
+
+	// Areas in every box of the box list go to <out>.boxes.csv, one row per model and box
+	std::ofstream boxAreas;
+	fs::path boxAreasPath(m_strOutput);
+	boxAreasPath.replace_extension(".boxes.csv");
+	if (!m_strBoxFile.empty())
+	{
+		boxAreas.open(boxAreasPath.string());
+		if (!boxAreas)
+		{
+			std::cerr << "Could not open " << boxAreasPath.string() << " for writing" << std::endl;
+			return EXIT_FAILURE;
+		}
+		boxAreas << "file,box,area_cm2" << std::endl;
+	}
+	MultiBoxQuery boxQuery(boxMins, boxMaxs);
+
+	// Areas are doubled like the viewer's readout, counting both sides of the fronds
+	out << "file,triangles_in_box,closed,area_cm2,mean_inclination_deg,surface_height_cm,enclosed_volume_cm3,hull_volume_cm3,hull_vertices,voxel_volume_cm3,voxel_size_cm,seconds";
+	for (auto const &size : m_vfQuerySizes)
+		out << ",area_" << size << "cm_cm2";
+	out << std::endl;
+
+	std::cout << "Measuring " << files.size() << " models in box (" << m_vec3BoxMin.x << ", " << m_vec3BoxMin.y << ", " << m_vec3BoxMin.z << ") to (";
+	std::cout << m_vec3BoxMax.x << ", " << m_vec3BoxMax.y << ", " << m_vec3BoxMax.z << ")" << std::endl;
+
+	int failures = 0;
+	double totalArea = 0.0;	// the whole mesh's, when the models are chunks of one
+
+	for (size_t i = 0; i < files.size(); ++i)
+	{
+		std::string const &f = files[i];
+		auto start = std::chrono::steady_clock::now();
+
+		ObjModel model(f, NULL);
+		if (model.getIndices().empty())
+		{
+			std::cerr << "\tFailed to load " << f << std::endl;
+			failures++;
+			continue;
+		}
+		model.setModelMatrix(transforms[i]);
+
+		MeshMetrics metrics(&model, m_vec3BoxMin, m_vec3BoxMax);
+
+		const SurfaceStats &stats = metrics.getSurfaceStats();
+		double area = stats.getArea() * 2.0;
+		totalArea += area;
+		double enclosed = metrics.getEnclosedVolume();
+		double hull = metrics.getConvexHullVolume();
+		double voxel = metrics.getVoxelVolume(m_fVoxelSize);
+
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		out << f << "," << metrics.getTriangleCount() << "," << (metrics.isClosed() ? 1 : 0) << "," << area << ",";
+		out << stats.getMeanInclination() << "," << (stats.empty() ? 0.f : stats.getMax().y - stats.getMin().y) << ",";
+		out << enclosed << "," << hull << "," << metrics.getConvexHullVertexCount() << "," << voxel << "," << m_fVoxelSize << "," << seconds;
+
+		glm::vec3 anchor(m_vec3BoxMin.x, m_vec3BoxMin.y, m_vec3BoxMax.z);
+		for (auto const &size : m_vfQuerySizes)
+			out << "," << model.queryArea(anchor - glm::vec3(0.f, 0.f, size), anchor + glm::vec3(size, size, 0.f)).area * 2.0;
+		out << std::endl;
+
+		stats.writeCSV(histograms, f);
+
+		std::cout << "\t" << f << ": area " << area << " cm^2, hull " << hull << " cm^3, voxels " << voxel << " cm^3";
+		if (metrics.isClosed())
+			std::cout << ", enclosed " << enclosed << " cm^3";
+		std::cout << " [" << seconds << " s]" << std::endl;
+
+		if (boxQuery.getBoxCount() > 0)
+		{
+			auto boxStart = std::chrono::steady_clock::now();
+			std::vector<double> areas(boxQuery.measure(&model));
+			for (size_t b = 0; b < areas.size(); ++b)
+				boxAreas << f << "," << b << "," << areas[b] * 2.0 << std::endl;
+
+			double boxSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - boxStart).count();
+			std::cout << "\t\tMeasured " << areas.size() << " boxes [" << boxSeconds << " s]" << std::endl;
+		}
+
+		if (m_bBenchmarkBoxes)
+			benchmarkBoxes(&model);
+
+		if (!m_strExportFormat.empty())
+			writeExport(&model, f);
+
+		if (m_fDensityVoxelSize > 0.f)
+			writeDensity(&model, f);
+	}
+
+	std::cout << "Total area in box " << totalArea << " cm^2 over " << files.size() - failures << " models" << std::endl;
+	std::cout << "Wrote " << m_strOutput << " and " << histogramPath.string() << std::endl;
+	if (boxQuery.getBoxCount() > 0)
+		std::cout << "Wrote " << boxAreasPath.string() << std::endl;
+
+	return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
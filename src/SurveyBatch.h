@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "MeshMetrics.h"
+
+#define BENCHMARK_BOX_SIZE 25.f	// cm, edge of the random cubes timed by --bench-boxes
+
+// Headless batch run over a survey directory: every OBJ or PLY is loaded without a GL context, measured
+// against one scene-space box, and written as a row of a CSV file.
+//
+//   seaweedViewer --batch <dir|manifest> [--box x0 y0 z0 x1 y1 z1] [--voxel cm] [--out results.csv] [--density cm]
+//                 [--sizes 10,25,50,100] [--export ply|obj] [--boxes boxes.csv] [--bench-boxes]
+//
+// Leaf inclination, azimuth and height histograms of the surface in the box go to <out>.histograms.csv.
+// --sizes adds the area of cubes of each size hanging below the box's top corner, answered from each
+// model's cached area octree. --export writes the surface cut to the box as <model>.box.ply or .obj, and
+// --density each model's surface-area density map as <model>.density.nrrd, both beside the CSV.
+// --boxes measures every box listed in a CSV in a single pass per model, into <out>.boxes.csv, and
+// --bench-boxes times that shared pass against one pass per box for 1 to 4096 random boxes.
+//
+// Given a survey manifest, such as the one --partition writes, scans are placed by their manifest
+// transforms and only those whose bounds reach the box, the --sizes cubes or the --boxes list are
+// loaded, one at a time, so memory is bounded by the largest scan. --density needs every scan.
+class SurveyBatch
+{
+public:
+	SurveyBatch(const std::vector<std::string> &args);
+	~SurveyBatch();
+
+	static bool requested(const std::vector<std::string> &args);
+
+	// Returns the process exit code
+	int run();
+
+private:
+	bool parseArgs(const std::vector<std::string> &args);
+	std::vector<std::string> findModels(const std::vector<glm::vec3> &boxMins, const std::vector<glm::vec3> &boxMaxs, std::vector<glm::mat4> &transforms);
+	void writeDensity(ObjModel *model, std::string file);
+	void writeExport(ObjModel *model, std::string file);
+	bool loadBoxes(std::vector<glm::vec3> &bbMins, std::vector<glm::vec3> &bbMaxs);
+	void benchmarkBoxes(ObjModel *model);
+
+	std::string m_strInput;
+	std::string m_strOutput;
+	glm::vec3 m_vec3BoxMin, m_vec3BoxMax;
+	float m_fVoxelSize;
+	float m_fDensityVoxelSize;	// 0 disables density maps
+	std::vector<float> m_vfQuerySizes;
+	std::string m_strExportFormat;	// empty disables export
+	std::string m_strBoxFile;
+	bool m_bBenchmarkBoxes;
+	bool m_bValid;
+};
@@ -0,0 +1,420 @@
+#include "Voxelizer.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cfloat>
+#include <climits>
+
+#include "Parallel.h"
+#include "PolygonClip.h"
+
+#define VOXELIZER_KEY_BITS 21
+#define VOXELIZER_KEY_MASK ((1ull << VOXELIZER_KEY_BITS) - 1)
+#define VOXELIZER_KEY_OFFSET (1 << (VOXELIZER_KEY_BITS - 1))
+
+Voxelizer::Voxelizer(float voxelSize)
+	: m_fVoxelSize(voxelSize)
+{
+}
+
+Voxelizer::~Voxelizer()
+{
+}
+
+void Voxelizer::addModel(ObjModel *model)
+{
+	const std::vector<glm::vec3> &verts = model->getVertices();
+	const std::vector<unsigned int> &inds = model->getIndices();
+	glm::mat4 modelMatrix(model->getModelMatrix());
+
+	size_t first = m_vvec3Triangles.size();
+	m_vvec3Triangles.resize(first + inds.size());
+
+	Parallel::parallelFor(inds.size(), [&](size_t begin, size_t end, unsigned int) {
+		for (size_t i = begin; i < end; ++i)
+			m_vvec3Triangles[first + i] = glm::vec3(modelMatrix * glm::vec4(verts[inds[i]], 1.f));
+	});
+}
+
+uint64_t Voxelizer::packKey(glm::ivec3 c)
+{
+	return (static_cast<uint64_t>(c.x + VOXELIZER_KEY_OFFSET) & VOXELIZER_KEY_MASK) |
+		((static_cast<uint64_t>(c.y + VOXELIZER_KEY_OFFSET) & VOXELIZER_KEY_MASK) << VOXELIZER_KEY_BITS) |
+		((static_cast<uint64_t>(c.z + VOXELIZER_KEY_OFFSET) & VOXELIZER_KEY_MASK) << (2 * VOXELIZER_KEY_BITS));
+}
+
+glm::ivec3 Voxelizer::unpackKey(uint64_t key)
+{
+	return glm::ivec3(
+		static_cast<int>(key & VOXELIZER_KEY_MASK) - VOXELIZER_KEY_OFFSET,
+		static_cast<int>((key >> VOXELIZER_KEY_BITS) & VOXELIZER_KEY_MASK) - VOXELIZER_KEY_OFFSET,
+		static_cast<int>((key >> (2 * VOXELIZER_KEY_BITS)) & VOXELIZER_KEY_MASK) - VOXELIZER_KEY_OFFSET
+	);
+}
+
+int Voxelizer::floorDiv(int a, int b)
+{
+	return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+void Voxelizer::voxelize()
+{
+	m_vTiles.clear();
+	m_mapBricks.clear();
+
+	size_t nTris = m_vvec3Triangles.size() / 3;
+	unsigned int nThreads = Parallel::getThreadCount();
+	float tileSize = m_fVoxelSize * VOXELIZER_BRICK_SIZE * VOXELIZER_TILE_BRICKS;
+
+	// Each thread bins its share of triangles by the xy tiles they touch; tiles read every thread's bins
+	std::vector<std::unordered_map<uint64_t, std::vector<unsigned int>>> bins(nThreads);
+
+	Parallel::parallelFor(nTris, [&](size_t begin, size_t end, unsigned int chunk) {
+		for (size_t t = begin; t < end; ++t)
+		{
+			glm::vec3 a(m_vvec3Triangles[3 * t + 0]), b(m_vvec3Triangles[3 * t + 1]), c(m_vvec3Triangles[3 * t + 2]);
+			glm::ivec3 tileMin(glm::floor(glm::min(a, glm::min(b, c)) / tileSize));
+			glm::ivec3 tileMax(glm::floor(glm::max(a, glm::max(b, c)) / tileSize));
+
+			for (int ty = tileMin.y; ty <= tileMax.y; ++ty)
+				for (int tx = tileMin.x; tx <= tileMax.x; ++tx)
+					bins[chunk][packKey(glm::ivec3(tx, ty, 0))].push_back(static_cast<unsigned int>(t));
+		}
+	}, nThreads);
+
+	std::vector<uint64_t> tileKeys;
+	for (auto const &bin : bins)
+		for (auto const &entry : bin)
+			tileKeys.push_back(entry.first);
+
+	std::sort(tileKeys.begin(), tileKeys.end());
+	tileKeys.erase(std::unique(tileKeys.begin(), tileKeys.end()), tileKeys.end());
+
+	// Tiles are handed out one at a time so uneven canopy density still balances across cores
+	std::vector<Tile> tiles(tileKeys.size());
+	std::atomic<size_t> nextTile(0);
+
+	Parallel::parallelFor(nThreads, [&](size_t, size_t, unsigned int) {
+		size_t k;
+		while ((k = nextTile++) < tileKeys.size())
+			voxelizeTile(tileKeys[k], bins, tiles[k]);
+	}, nThreads);
+
+	m_vTiles.swap(tiles);
+
+	for (unsigned int t = 0; t < m_vTiles.size(); ++t)
+		for (unsigned int b = 0; b < m_vTiles[t].keys.size(); ++b)
+			m_mapBricks[m_vTiles[t].keys[b]] = std::make_pair(t, b);
+}
+
+// Clip each triangle to the tile's columns, then slab by slab down to single voxels
+void Voxelizer::voxelizeTile(uint64_t tileKey, const std::vector<std::unordered_map<uint64_t, std::vector<unsigned int>>> &bins, Tile &tile)
+{
+	const int tileVoxels = VOXELIZER_BRICK_SIZE * VOXELIZER_TILE_BRICKS;
+
+	glm::ivec3 tileCoord(unpackKey(tileKey));
+	glm::ivec2 voxelMin(tileCoord.x * tileVoxels, tileCoord.y * tileVoxels);
+	glm::ivec2 voxelMax(voxelMin + glm::ivec2(tileVoxels - 1));
+
+	std::unordered_map<uint64_t, unsigned int> brickIndex;
+
+	glm::vec3 poly[16], slabX[16], slabY[16], voxel[16], tmp[16];
+
+	for (auto const &bin : bins)
+	{
+		auto it = bin.find(tileKey);
+		if (it == bin.end())
+			continue;
+
+		for (auto const &t : it->second)
+		{
+			glm::vec3 a(m_vvec3Triangles[3 * t + 0]), b(m_vvec3Triangles[3 * t + 1]), c(m_vvec3Triangles[3 * t + 2]);
+
+			glm::vec3 normal(glm::cross(b - a, c - a));
+			float len = glm::length(normal);
+			if (len <= 0.f)
+				continue;
+
+			// Fronds are two-sided, so only the normal's orientation is meaningful
+			normal /= len;
+			if (normal.y < 0.f)
+				normal = -normal;
+
+			poly[0] = a;
+			poly[1] = b;
+			poly[2] = c;
+
+			int n = PolygonClip::clipSlab(poly, 3, slabX, tmp, 0, voxelMin.x * m_fVoxelSize, (voxelMax.x + 1) * m_fVoxelSize, true);
+			n = PolygonClip::clipSlab(slabX, n, poly, tmp, 1, voxelMin.y * m_fVoxelSize, (voxelMax.y + 1) * m_fVoxelSize, true);
+			if (n < 3)
+				continue;
+
+			glm::vec3 polyMin(poly[0]), polyMax(poly[0]);
+			for (int k = 1; k < n; ++k)
+			{
+				polyMin = glm::min(polyMin, poly[k]);
+				polyMax = glm::max(polyMax, poly[k]);
+			}
+
+			int x0 = std::max(voxelMin.x, static_cast<int>(floor(polyMin.x / m_fVoxelSize)));
+			int x1 = std::min(voxelMax.x, static_cast<int>(floor(polyMax.x / m_fVoxelSize)));
+
+			for (int ix = x0; ix <= x1; ++ix)
+			{
+				int nx = PolygonClip::clipSlab(poly, n, slabX, tmp, 0, ix * m_fVoxelSize, (ix + 1) * m_fVoxelSize, true);
+				if (nx < 3)
+					continue;
+
+				float yLo = FLT_MAX, yHi = -FLT_MAX;
+				for (int k = 0; k < nx; ++k)
+				{
+					yLo = std::min(yLo, slabX[k].y);
+					yHi = std::max(yHi, slabX[k].y);
+				}
+
+				int y0 = std::max(voxelMin.y, static_cast<int>(floor(yLo / m_fVoxelSize)));
+				int y1 = std::min(voxelMax.y, static_cast<int>(floor(yHi / m_fVoxelSize)));
+
+				for (int iy = y0; iy <= y1; ++iy)
+				{
+					int ny = PolygonClip::clipSlab(slabX, nx, slabY, tmp, 1, iy * m_fVoxelSize, (iy + 1) * m_fVoxelSize, true);
+					if (ny < 3)
+						continue;
+
+					float zLo = FLT_MAX, zHi = -FLT_MAX;
+					for (int k = 0; k < ny; ++k)
+					{
+						zLo = std::min(zLo, slabY[k].z);
+						zHi = std::max(zHi, slabY[k].z);
+					}
+
+					int z0 = static_cast<int>(floor(zLo / m_fVoxelSize));
+					int z1 = static_cast<int>(floor(zHi / m_fVoxelSize));
+
+					for (int iz = z0; iz <= z1; ++iz)
+					{
+						int nz = PolygonClip::clipSlab(slabY, ny, voxel, tmp, 2, iz * m_fVoxelSize, (iz + 1) * m_fVoxelSize, true);
+						float area = static_cast<float>(PolygonClip::area(voxel, nz));
+						if (area <= 0.f)
+							continue;
+
+						glm::ivec3 v(ix, iy, iz);
+						glm::ivec3 brickCoord(floorDiv(ix, VOXELIZER_BRICK_SIZE), floorDiv(iy, VOXELIZER_BRICK_SIZE), floorDiv(iz, VOXELIZER_BRICK_SIZE));
+						uint64_t key = packKey(brickCoord);
+
+						auto found = brickIndex.find(key);
+						unsigned int bi;
+						if (found == brickIndex.end())
+						{
+							bi = static_cast<unsigned int>(tile.bricks.size());
+							tile.bricks.resize(tile.bricks.size() + 1);
+							memset(&tile.bricks.back(), 0, sizeof(Brick));
+							tile.keys.push_back(key);
+							brickIndex[key] = bi;
+						}
+						else
+							bi = found->second;
+
+						glm::ivec3 local(v - brickCoord * VOXELIZER_BRICK_SIZE);
+						int li = local.x + VOXELIZER_BRICK_SIZE * (local.y + VOXELIZER_BRICK_SIZE * local.z);
+
+						Brick &brick = tile.bricks[bi];
+						brick.area[li] += area;
+						brick.normal[0][li] += normal.x * area;
+						brick.normal[1][li] += normal.y * area;
+						brick.normal[2][li] += normal.z * area;
+						brick.triangles[li]++;
+					}
+				}
+			}
+		}
+	}
+}
+
+size_t Voxelizer::getBrickCount()
+{
+	return m_mapBricks.size();
+}
+
+size_t Voxelizer::getVoxelCount()
+{
+	size_t count = 0;
+	for (auto const &tile : m_vTiles)
+		for (auto const &brick : tile.bricks)
+			for (int i = 0; i < VOXELIZER_BRICK_VOXELS; ++i)
+				if (brick.area[i] > 0.f)
+					count++;
+
+	return count;
+}
+
+double Voxelizer::getTotalArea()
+{
+	double area = 0.0;
+	for (auto const &tile : m_vTiles)
+		for (auto const &brick : tile.bricks)
+			for (int i = 0; i < VOXELIZER_BRICK_VOXELS; ++i)
+				area += brick.area[i];
+
+	return area;
+}
+
+bool Voxelizer::getVoxel(glm::vec3 p, Voxel &voxel)
+{
+	glm::ivec3 v(glm::floor(p / m_fVoxelSize));
+	glm::ivec3 brickCoord(floorDiv(v.x, VOXELIZER_BRICK_SIZE), floorDiv(v.y, VOXELIZER_BRICK_SIZE), floorDiv(v.z, VOXELIZER_BRICK_SIZE));
+
+	auto found = m_mapBricks.find(packKey(brickCoord));
+	if (found == m_mapBricks.end())
+		return false;
+
+	const Brick &brick = m_vTiles[found->second.first].bricks[found->second.second];
+	glm::ivec3 local(v - brickCoord * VOXELIZER_BRICK_SIZE);
+	int li = local.x + VOXELIZER_BRICK_SIZE * (local.y + VOXELIZER_BRICK_SIZE * local.z);
+
+	voxel.area = brick.area[li];
+	voxel.normalSum = glm::vec3(brick.normal[0][li], brick.normal[1][li], brick.normal[2][li]);
+	voxel.triangles = brick.triangles[li];
+
+	return voxel.area > 0.f;
+}
+
+bool Voxelizer::getDenseBounds(glm::ivec3 &minVoxel, glm::ivec3 &dims)
+{
+	if (m_mapBricks.empty())
+		return false;
+
+	glm::ivec3 minBrick(INT_MAX), maxBrick(INT_MIN);
+	for (auto const &entry : m_mapBricks)
+	{
+		glm::ivec3 c(unpackKey(entry.first));
+		minBrick = glm::min(minBrick, c);
+		maxBrick = glm::max(maxBrick, c);
+	}
+
+	minVoxel = minBrick * VOXELIZER_BRICK_SIZE;
+	dims = (maxBrick - minBrick + 1) * VOXELIZER_BRICK_SIZE;
+
+	return true;
+}
+
+// Mean normals are left unnormalized: their length is the orientation coherence of the voxel
+bool Voxelizer::buildDense(std::vector<float> &data, glm::ivec3 &minVoxel, glm::ivec3 &dims, bool normals)
+{
+	if (!getDenseBounds(minVoxel, dims))
+	{
+		std::cerr << "Voxelizer: nothing to write" << std::endl;
+		return false;
+	}
+
+	uint64_t nVoxels = static_cast<uint64_t>(dims.x) * dims.y * dims.z;
+	if (nVoxels > VOXELIZER_MAX_DENSE_VOXELS)
+	{
+		std::cerr << "Voxelizer: dense volume of " << dims.x << "x" << dims.y << "x" << dims.z << " is too large; use a coarser voxel size" << std::endl;
+		return false;
+	}
+
+	int components = normals ? 3 : 1;
+	data.assign(static_cast<size_t>(nVoxels) * components, 0.f);
+
+	for (auto const &entry : m_mapBricks)
+	{
+		glm::ivec3 origin(unpackKey(entry.first) * VOXELIZER_BRICK_SIZE - minVoxel);
+		const Brick &brick = m_vTiles[entry.second.first].bricks[entry.second.second];
+
+		for (int li = 0; li < VOXELIZER_BRICK_VOXELS; ++li)
+		{
+			if (brick.area[li] <= 0.f)
+				continue;
+
+			glm::ivec3 v(origin + glm::ivec3(li % VOXELIZER_BRICK_SIZE, (li / VOXELIZER_BRICK_SIZE) % VOXELIZER_BRICK_SIZE, li / (VOXELIZER_BRICK_SIZE * VOXELIZER_BRICK_SIZE)));
+			size_t index = static_cast<size_t>(v.x) + static_cast<size_t>(dims.x) * (v.y + static_cast<size_t>(dims.y) * v.z);
+
+			if (normals)
+			{
+				for (int c = 0; c < 3; ++c)
+					data[3 * index + c] = brick.normal[c][li] / brick.area[li];
+			}
+			else
+				data[index] = brick.area[li];
+		}
+	}
+
+	return true;
+}
+
+bool Voxelizer::writeRaw(std::string path, bool normals)
+{
+	std::vector<float> data;
+	glm::ivec3 minVoxel, dims;
+	if (!buildDense(data, minVoxel, dims, normals))
+		return false;
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "Could not open " << path << " for writing" << std::endl;
+		return false;
+	}
+
+	out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+
+	glm::vec3 origin(glm::vec3(minVoxel) * m_fVoxelSize);
+	std::cout << "Wrote " << path << ": " << (normals ? "3 x " : "") << dims.x << " x " << dims.y << " x " << dims.z << " float32, ";
+	std::cout << m_fVoxelSize << " cm voxels from (" << origin.x << ", " << origin.y << ", " << origin.z << ")" << std::endl;
+
+	return true;
+}
+
+bool Voxelizer::writeNRRD(std::string path, bool normals)
+{
+	std::vector<float> data;
+	glm::ivec3 minVoxel, dims;
+	if (!buildDense(data, minVoxel, dims, normals))
+		return false;
+
+	std::ofstream out(path, std::ios::binary);
+	if (!out)
+	{
+		std::cerr << "Could not open " << path << " for writing" << std::endl;
+		return false;
+	}
+
+	// NRRD places samples at voxel centers
+	glm::vec3 origin((glm::vec3(minVoxel) + 0.5f) * m_fVoxelSize);
+	std::stringstream spacing;
+	spacing << "(" << m_fVoxelSize << ",0,0) (0," << m_fVoxelSize << ",0) (0,0," << m_fVoxelSize << ")";
+
+	out << "NRRD0004\n";
+	out << "# surface area " << (normals ? "mean normal" : "in cm^2") << " per voxel\n";
+	out << "type: float\n";
+	out << "dimension: " << (normals ? 4 : 3) << "\n";
+	out << "space dimension: 3\n";
+	if (normals)
+	{
+		out << "sizes: 3 " << dims.x << " " << dims.y << " " << dims.z << "\n";
+		out << "kinds: 3-vector domain domain domain\n";
+		out << "space directions: none " << spacing.str() << "\n";
+	}
+	else
+	{
+		out << "sizes: " << dims.x << " " << dims.y << " " << dims.z << "\n";
+		out << "kinds: domain domain domain\n";
+		out << "space directions: " << spacing.str() << "\n";
+	}
+	out << "space origin: (" << origin.x << "," << origin.y << "," << origin.z << ")\n";
+	out << "space units: \"cm\" \"cm\" \"cm\"\n";
+	out << "endian: little\n";
+	out << "encoding: raw\n";
+	out << "\n";
+
+	out.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+
+	std::cout << "Wrote " << path << ": " << dims.x << " x " << dims.y << " x " << dims.z << " voxels of " << m_fVoxelSize << " cm" << std::endl;
+
+	return true;
+}
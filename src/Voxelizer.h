@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+
+#include "ObjModel.h"
+
+#define VOXELIZER_BRICK_BITS 3
+#define VOXELIZER_BRICK_SIZE (1 << VOXELIZER_BRICK_BITS)	// voxels per brick edge
+#define VOXELIZER_BRICK_VOXELS (VOXELIZER_BRICK_SIZE * VOXELIZER_BRICK_SIZE * VOXELIZER_BRICK_SIZE)
+#define VOXELIZER_TILE_BRICKS 4		// bricks per tile edge in x and y; one thread owns a tile at a time
+#define VOXELIZER_MAX_DENSE_VOXELS (1u << 28)	// largest volume written out densely
+
+// Surface-area density of the loaded models on a sparse voxel grid. Voxels live in bricks keyed by
+// brick coordinate, so empty water costs nothing. Triangles are clipped into each voxel they cross,
+// giving the exact area per voxel along with area-weighted normal statistics.
+class Voxelizer
+{
+public:
+	struct Voxel {
+		float area;
+		glm::vec3 normalSum;	// area-weighted unit normals, flipped into the +Y hemisphere
+		unsigned int triangles;
+	};
+
+public:
+	Voxelizer(float voxelSize);
+	~Voxelizer();
+
+	// Appends the model's triangles in scene space
+	void addModel(ObjModel *model);
+
+	// Rasterizes everything added so far, one xy tile per job across all cores
+	void voxelize();
+
+	size_t getBrickCount();
+	size_t getVoxelCount();		// voxels with any area
+	double getTotalArea();
+	float getVoxelSize() { return m_fVoxelSize; }
+
+	// Voxel containing a scene-space point; false if it is empty
+	bool getVoxel(glm::vec3 p, Voxel &voxel);
+
+	// Dense area volume over the occupied bounds, as float32. With normals, the mean normal
+	// of each voxel is written as a 3-vector instead.
+	bool writeNRRD(std::string path, bool normals = false);
+	bool writeRaw(std::string path, bool normals = false);
+
+private:
+	struct Brick {
+		float area[VOXELIZER_BRICK_VOXELS];
+		float normal[3][VOXELIZER_BRICK_VOXELS];
+		unsigned int triangles[VOXELIZER_BRICK_VOXELS];
+	};
+
+	// Bricks produced by one tile; tiles never share bricks
+	struct Tile {
+		std::vector<uint64_t> keys;
+		std::vector<Brick> bricks;
+	};
+
+	static uint64_t packKey(glm::ivec3 c);
+	static glm::ivec3 unpackKey(uint64_t key);
+	static int floorDiv(int a, int b);
+
+	void voxelizeTile(uint64_t tileKey, const std::vector<std::unordered_map<uint64_t, std::vector<unsigned int>>> &bins, Tile &tile);
+	bool getDenseBounds(glm::ivec3 &minVoxel, glm::ivec3 &dims);
+	bool buildDense(std::vector<float> &data, glm::ivec3 &minVoxel, glm::ivec3 &dims, bool normals);
+
+	float m_fVoxelSize;
+	std::vector<glm::vec3> m_vvec3Triangles;	// scene space, 3 per triangle
+
+	std::vector<Tile> m_vTiles;
+	std::unordered_map<uint64_t, std::pair<unsigned int, unsigned int>> m_mapBricks;	// brick key -> (tile, brick)
+};
@@ -1,8 +1,29 @@
 // Our classes
 #include "Engine.h"
+#include "SurveyBatch.h"
+#include "MeshPartitioner.h"
+#include "JobSystem.h"
+
+#include <algorithm>
 
 int main(int argc, char * argv[]) 
 {
+	// Batch measurements run headless, without creating a window
+	std::vector<std::string> args(argv, argv + argc);
+	if (SurveyBatch::requested(args))
+		return SurveyBatch(args).run();
+
+	// Cutting a large mesh into streamable chunks, also headless
+	if (MeshPartitioner::requested(args))
+		return MeshPartitioner(args).run();
+
+	// Scheduler stress test, also headless
+	if (std::find(args.begin(), args.end(), "--bench-jobs") != args.end())
+	{
+		JobSystem::getInstance().benchmark();
+		return EXIT_SUCCESS;
+	}
+
 	// Instantiate an engine to drive the application
 	Engine *engine = new Engine(argc, argv);
 